@@ -29,13 +29,10 @@ SEXP RMorphy(SEXP r_n_char, SEXP r_n_taxa, SEXP r_descendants, SEXP r_ancestors,
   int *descendants=INTEGER(r_descendants), *ancestors=INTEGER(r_ancestors);  // INTEGER gives pointer to first element of length n R vector
   const char *rawmatrix=CHAR(asChar(r_rawmatrix));
  
-  Rprintf(" - character string = %s\n", rawmatrix);
-  
   // Calculate relevant properties of the tree and dataset
   int n_internal = n_taxa; // One more than you might expect because there's a dummy root node
   int root_node = n_taxa;
   int max_node = n_taxa + n_internal - 1L;
-  Rprintf(" - %i nodes + dummy root, of which %i are internal (plus dummy root), %i are tips\n", max_node, n_internal - 1L, n_taxa);
   
   // Declare and protect result, to return to R
   SEXP RESULT, pscore, node_children;
@@ -58,10 +55,6 @@ SEXP RMorphy(SEXP r_n_char, SEXP r_n_taxa, SEXP r_descendants, SEXP r_ancestors,
   children_temp[0] = descendants[(root_node_left_child - n_taxa) * 2];
   children_temp[1] = descendants[((root_node_left_child - n_taxa) * 2)+ 1];
   
-  Rprintf(" - Root node's left child has nodes %i and %i as its left and right children\n",
-    children_temp[0], children_temp[1]
-  );
-  
   Morphy handl = mpl_new_Morphy();
   mpl_init_Morphy(n_taxa, n_char, handl);
  
@@ -71,7 +64,6 @@ SEXP RMorphy(SEXP r_n_char, SEXP r_n_taxa, SEXP r_descendants, SEXP r_ancestors,
   mpl_set_num_internal_nodes(n_internal, handl);
   mpl_attach_rawdata(rawmatrix, handl);
   mpl_apply_tipdata(handl);
-  Rprintf(" - Initialized morphy object with %i characters and %i taxa.\n - Begin traversal:\n", mpl_get_num_charac(handl), mpl_get_numtaxa(handl));
   
  
   for (i = max_node - 1L; i > n_taxa; i--) { // First Downpass 
@@ -83,7 +75,6 @@ SEXP RMorphy(SEXP r_n_char, SEXP r_n_taxa, SEXP r_descendants, SEXP r_ancestors,
   // If i == 6 (root node), descendants will be in positions [0, 1].  i - n_taxa = 0
   // If i == 11, descendants will be in positions [8, 9]. i - n_taxa = 4
   
-    Rprintf("   - Reconstructing  node %i < %i,%i.\n", i, descendants[(i - n_taxa) * 2], descendants[((i - n_taxa) * 2) + 1]);
     *pscore_temp += mpl_first_down_recon(i,  descendants[(i - n_taxa) * 2], descendants[((i - n_taxa) * 2) + 1], handl);
   }
   mpl_update_lower_root(max_node, root_node, handl);
@@ -106,7 +97,6 @@ SEXP RMorphy(SEXP r_n_char, SEXP r_n_taxa, SEXP r_descendants, SEXP r_ancestors,
     mpl_finalize_tip(i, ancestors[i], handl);
   }
   
-  Rprintf("\n Traversal complete.\n - Deleting Morphy handle\n");
   mpl_delete_Morphy(handl);
   SET_VECTOR_ELT(RESULT, 0, pscore);
   SET_VECTOR_ELT(RESULT, 1, node_children);
@@ -0,0 +1,187 @@
+// Reconstructions are returned to R as a matrix of nodes by characters. The
+// packed state sets are copied out of the handle when the matrix is made, as
+// one integer for each cell, so that later passes don't change it. Where R
+// supports ALTREP, the character matrix is a view of these integers, and a
+// cell is only decoded into a string of symbols when R asks for it. The
+// whole matrix is decoded only if R needs a pointer to its data, as for
+// modifying it in place.
+
+#include <R.h>
+#include <Rinternals.h>
+#include <Rversion.h>
+#include "mpl.h"
+
+#if R_VERSION >= R_Version(3, 6, 0)
+#define MPL_ALTREP
+#include <R_ext/Altrep.h>
+#include <R_ext/Rdynload.h>
+#endif
+
+/* Packed sets are at most 32 states, plus the terminating null */
+#define MPL_STATES_BUFSIZE 40
+
+static SEXP _R_mpl_decode_states(const int states, Morphy handl)
+{
+    char buf[MPL_STATES_BUFSIZE];
+
+    if (!handl) {
+        error("the Morphy object has been deleted");
+    }
+
+    if (mpl_translate_packed_states((unsigned int)states, buf,
+                                    MPL_STATES_BUFSIZE, handl) < 0) {
+        return NA_STRING;
+    }
+
+    return mkChar(buf);
+}
+
+#ifdef MPL_ALTREP
+
+static R_altrep_class_t _R_mpl_states_class;
+
+/* data1 holds the packed sets, and data2 a list of the handle and the
+ * decoded strings, which are NULL until the whole matrix is needed. */
+static R_xlen_t _R_mpl_states_length(SEXP x)
+{
+    return XLENGTH(R_altrep_data1(x));
+}
+
+static SEXP _R_mpl_states_decoded(SEXP x)
+{
+    return VECTOR_ELT(R_altrep_data2(x), 1);
+}
+
+static SEXP _R_mpl_states_elt(SEXP x, R_xlen_t i)
+{
+    SEXP decoded = _R_mpl_states_decoded(x);
+
+    if (decoded != R_NilValue) {
+        return STRING_ELT(decoded, i);
+    }
+
+    return _R_mpl_decode_states(INTEGER(R_altrep_data1(x))[i],
+                                R_ExternalPtrAddr(VECTOR_ELT(R_altrep_data2(x), 0)));
+}
+
+static SEXP _R_mpl_states_materialize(SEXP x)
+{
+    R_xlen_t i = 0;
+    R_xlen_t n = _R_mpl_states_length(x);
+    SEXP decoded = _R_mpl_states_decoded(x);
+
+    if (decoded != R_NilValue) {
+        return decoded;
+    }
+
+    decoded = PROTECT(allocVector(STRSXP, n));
+    for (i = 0; i < n; ++i) {
+        SET_STRING_ELT(decoded, i, _R_mpl_states_elt(x, i));
+    }
+    SET_VECTOR_ELT(R_altrep_data2(x), 1, decoded);
+    UNPROTECT(1);
+
+    return decoded;
+}
+
+static void* _R_mpl_states_dataptr(SEXP x, Rboolean writeable)
+{
+    return DATAPTR(_R_mpl_states_materialize(x));
+}
+
+static const void* _R_mpl_states_dataptr_or_null(SEXP x)
+{
+    SEXP decoded = _R_mpl_states_decoded(x);
+
+    return decoded == R_NilValue ? NULL : DATAPTR(decoded);
+}
+
+static void _R_mpl_states_set_elt(SEXP x, R_xlen_t i, SEXP v)
+{
+    SET_STRING_ELT(_R_mpl_states_materialize(x), i, v);
+}
+
+static Rboolean _R_mpl_states_inspect
+(SEXP x, int pre, int deep, int pvec,
+ void (*inspect_subtree)(SEXP, int, int, int))
+{
+    Rprintf(" Morphy state sets (%s)\n",
+            _R_mpl_states_decoded(x) == R_NilValue ? "packed" : "decoded");
+    return TRUE;
+}
+
+/* Registers the ALTREP class when the library is loaded. */
+void R_init_RMorphyex(DllInfo* dll)
+{
+    R_altrep_class_t c = R_make_altstring_class("mpl_states", "RMorphyex", dll);
+
+    R_set_altrep_Length_method(c, _R_mpl_states_length);
+    R_set_altrep_Inspect_method(c, _R_mpl_states_inspect);
+    R_set_altvec_Dataptr_method(c, _R_mpl_states_dataptr);
+    R_set_altvec_Dataptr_or_null_method(c, _R_mpl_states_dataptr_or_null);
+    R_set_altstring_Elt_method(c, _R_mpl_states_elt);
+    R_set_altstring_Set_elt_method(c, _R_mpl_states_set_elt);
+
+    _R_mpl_states_class = c;
+}
+
+#endif /* MPL_ALTREP */
+
+SEXP _R_wrap_mpl_get_reconstruction(SEXP Rpassnum, SEXP Rpacked, SEXP MorphyHandl)
+{
+    int i = 0;
+    int j = 0;
+    Morphy handl = R_ExternalPtrAddr(MorphyHandl);
+    int passnum = asInteger(Rpassnum);
+    int ntax = 0;
+    int nchar = 0;
+    int nnodes = 0;
+    int* states = NULL;
+    SEXP Rstates = R_NilValue;
+    SEXP Rret = R_NilValue;
+
+    if (!handl) {
+        error("the Morphy object has been deleted");
+    }
+    if (passnum < 1 || passnum > 4) {
+        error("pass must be from 1 to 4");
+    }
+    if (mpl_get_num_partitions(handl) < 1) {
+        error("tip data have not been applied to the Morphy object");
+    }
+
+    ntax    = mpl_get_numtaxa(handl);
+    nchar   = mpl_get_num_charac(handl);
+    nnodes  = ntax + mpl_get_num_internal_nodes(handl);
+
+    Rstates = PROTECT(allocMatrix(INTSXP, nnodes, nchar));
+    states  = INTEGER(Rstates);
+
+    for (j = 0; j < nchar; ++j) {
+        for (i = 0; i < nnodes; ++i) {
+            states[(size_t)j * nnodes + i] =
+            (int)mpl_get_packed_states(i, j, passnum, handl);
+        }
+    }
+
+    if (asLogical(Rpacked) == TRUE) {
+        UNPROTECT(1);
+        return Rstates;
+    }
+
+#ifdef MPL_ALTREP
+    Rret = PROTECT(allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(Rret, 0, MorphyHandl);
+    Rret = PROTECT(R_new_altrep(_R_mpl_states_class, Rstates, Rret));
+    setAttrib(Rret, R_DimSymbol, getAttrib(Rstates, R_DimSymbol));
+    UNPROTECT(3);
+#else
+    Rret = PROTECT(allocMatrix(STRSXP, nnodes, nchar));
+    for (i = 0; i < nnodes * nchar; ++i) {
+        SET_STRING_ELT(Rret, i, _R_mpl_decode_states(states[i], handl));
+    }
+    UNPROTECT(2);
+#endif
+
+    return Rret;
+}
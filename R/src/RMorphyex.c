@@ -17,6 +17,9 @@ SEXP _R_wrap_mpl_delete_Morphy(SEXP MorphyHandl)
     SEXP Rret = PROTECT(allocVector(INTSXP, 1));
     Morphy handl = R_ExternalPtrAddr(MorphyHandl);
     ret = mpl_delete_Morphy(handl);
+    // Anything still holding the handle, such as a reconstruction, can
+    // then tell that it has gone
+    R_ClearExternalPtr(MorphyHandl);
     INTEGER(Rret)[0] = ret;
     UNPROTECT(1);
     return Rret;
@@ -250,3 +253,120 @@ SEXP _R_wrap_mpl_update_lower_root(SEXP lower_id, SEXP upper_id, SEXP MorphyHand
     UNPROTECT(1);
     return Rret;
 }
+
+/* Converts an edge matrix of an ape phylo object, in which nodes are numbered
+ * from 1 with the tips first and the root at ntax + 1, to a parent vector. A
+ * basal trichotomy, as in trees read unrooted, is resolved with the one node
+ * number such a tree doesn't use. Anything that can't be converted is left
+ * with no parents at all, so that mpl_score_trees rejects it. */
+static void _R_mpl_edges2parents(SEXP Redge, const int ntax, int* parents)
+{
+    int i = 0;
+    int anc = 0;
+    int desc = 0;
+    int nedge = 0;
+    int nroot = 0;
+    int rootkids[3];
+    int nnodes = 2 * ntax - 1;
+    int* edge = NULL;
+
+    for (i = 0; i < nnodes; ++i) {
+        parents[i] = -1;
+    }
+
+    if (!isMatrix(Redge) || TYPEOF(Redge) != INTSXP || ncols(Redge) != 2) {
+        return;
+    }
+
+    nedge = nrows(Redge);
+    edge = INTEGER(Redge);
+
+    for (i = 0; i < nedge; ++i) {
+
+        anc  = edge[i] - 1;
+        desc = edge[i + nedge] - 1;
+
+        if (anc < ntax || anc >= nnodes || desc < 0 || desc >= nnodes) {
+            break;
+        }
+
+        if (anc == ntax) {
+            if (nroot == 3) {
+                break;
+            }
+            rootkids[nroot++] = desc;
+        }
+
+        parents[desc] = anc;
+    }
+
+    if (i < nedge || (nroot == 3 && nedge != nnodes - 2)) {
+        for (i = 0; i < nnodes; ++i) {
+            parents[i] = -1;
+        }
+        return;
+    }
+
+    if (nroot == 3) {
+        parents[rootkids[1]] = nnodes - 1;
+        parents[rootkids[2]] = nnodes - 1;
+        parents[nnodes - 1]  = ntax;
+    }
+}
+
+SEXP _R_wrap_mpl_score_trees(SEXP Redges, SEXP Rnthreads, SEXP Rcharsteps, SEXP MorphyHandl)
+{
+    int i = 0;
+    int ret = 0;
+    Morphy handl = R_ExternalPtrAddr(MorphyHandl);
+    int ntax = mpl_get_numtaxa(handl);
+    int nchar = mpl_get_num_charac(handl);
+    int ntrees = length(Redges);
+    int size = 2 * ntax - 1;
+    int* parents = NULL;
+    int* steps = NULL;
+    SEXP Rlengths = R_NilValue;
+    SEXP Rsteps = R_NilValue;
+    SEXP Rret = R_NilValue;
+
+    if (TYPEOF(Redges) != VECSXP) {
+        error("trees must be a list of edge matrices");
+    }
+    if (ntax < 2) {
+        error("the Morphy object has no taxa");
+    }
+
+    // Converted up front, as R can't be called from the scoring threads
+    parents = (int*)R_alloc((size_t)ntrees * size, sizeof(int));
+    for (i = 0; i < ntrees; ++i) {
+        _R_mpl_edges2parents(VECTOR_ELT(Redges, i), ntax,
+                             &parents[(size_t)i * size]);
+    }
+
+    Rlengths = PROTECT(allocVector(INTSXP, ntrees));
+    if (asLogical(Rcharsteps) == TRUE) {
+        Rsteps = allocMatrix(INTSXP, nchar, ntrees);
+        steps = INTEGER(Rsteps);
+    }
+    PROTECT(Rsteps);
+
+    ret = mpl_score_trees(ntrees, parents, asInteger(Rnthreads),
+                          INTEGER(Rlengths), steps, handl);
+
+    if (ret < 0) {
+        UNPROTECT(2);
+        error("mpl_score_trees failed with Morphy error %i", ret);
+    }
+
+    if (!steps) {
+        UNPROTECT(2);
+        return Rlengths;
+    }
+
+    Rret = PROTECT(allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(Rret, 0, Rlengths);
+    SET_VECTOR_ELT(Rret, 1, Rsteps);
+
+    UNPROTECT(3);
+    return Rret;
+}
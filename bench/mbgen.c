@@ -0,0 +1,326 @@
+//
+//  mbgen.c
+//  morphylib
+//
+//  Characters are either drawn independently for each taxon or evolved down a
+//  tree, changing to a different state on a branch with a fixed probability.
+//  Inapplicable data arise from dependencies between characters: a dependent
+//  character codes a feature of a structure whose presence is coded by an
+//  earlier binary character (state 0 for absence). It is inapplicable in any
+//  taxon in which the structure is absent, or itself inapplicable, so that
+//  chains of dependencies produce nested regions of inapplicability.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mbgen.h"
+
+#define MB_GEN_NA       0xFF
+#define MB_GEN_MISSING  0xFE
+
+static const char mb_gen_symbols[] = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
+
+void mb_rng_seed(mbrng* rng, unsigned long long seed)
+{
+    // One round of splitmix64 so that nearby seeds give unrelated streams
+    seed += 0x9E3779B97F4A7C15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+    seed ^= seed >> 31;
+    rng->s = seed ? seed : 0x2545F4914F6CDD1DULL;
+}
+
+unsigned long long mb_rng_next(mbrng* rng)
+{
+    rng->s ^= rng->s >> 12;
+    rng->s ^= rng->s << 25;
+    rng->s ^= rng->s >> 27;
+    return rng->s * 0x2545F4914F6CDD1DULL;
+}
+
+double mb_rng_uniform(mbrng* rng)
+{
+    return (mb_rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int mb_rng_below(mbrng* rng, const int n)
+{
+    return (int)(mb_rng_next(rng) % (unsigned long long)n);
+}
+
+void mb_gen_defaults(mbgenparams* p)
+{
+    p->seed         = 1;
+    p->ntax         = 32;
+    p->nchar        = 100;
+    p->maxstates    = 4;
+    p->missing      = 0.0;
+    p->inapplicable = 0.0;
+    p->polymorphism = 0.0;
+    p->simulate     = true;
+    p->rate         = 0.1;
+}
+
+/* Joins randomly chosen pairs of subtrees until one is left. Internal nodes
+ * are numbered in the order they are made, which is a postorder. */
+void mb_gen_tree(mbtree* t, const int* tips, const int ntips, const int ntax,
+                 mbrng* rng)
+{
+    int i = 0;
+    int a = 0;
+    int b = 0;
+    int s = 0;
+    int nactive = ntips;
+    int next = ntax;
+    int* active = (int*)malloc(ntips * sizeof(int));
+
+    t->ntax         = ntax;
+    t->ntips        = ntips;
+    t->tips         = (int*)malloc(ntips * sizeof(int));
+    t->ninternal    = ntips - 1;
+    t->postorder    = (int*)malloc(ntips * sizeof(int));
+    t->left         = (int*)malloc(2 * ntax * sizeof(int));
+    t->right        = (int*)malloc(2 * ntax * sizeof(int));
+    t->anc          = (int*)malloc(2 * ntax * sizeof(int));
+
+    memcpy(t->tips, tips, ntips * sizeof(int));
+    memcpy(active, tips, ntips * sizeof(int));
+
+    for (i = 0; i < t->ninternal; ++i) {
+
+        a = mb_rng_below(rng, nactive);
+        b = mb_rng_below(rng, nactive - 1);
+        if (b >= a) {
+            ++b;
+        }
+
+        t->left[next]       = active[a];
+        t->right[next]      = active[b];
+        t->anc[active[a]]   = next;
+        t->anc[active[b]]   = next;
+        t->postorder[i]     = next;
+
+        // Replace the pair with their new ancestor
+        if (a > b) {
+            s = a; a = b; b = s;
+        }
+        active[a] = next;
+        active[b] = active[nactive - 1];
+        --nactive;
+        ++next;
+    }
+
+    t->root     = next - 1;
+    t->lroot    = 2 * ntax - 1;
+    t->anc[t->root] = t->lroot;
+
+    free(active);
+}
+
+void mb_delete_tree(mbtree* t)
+{
+    free(t->tips);
+    free(t->postorder);
+    free(t->left);
+    free(t->right);
+    free(t->anc);
+    memset(t, 0, sizeof(mbtree));
+}
+
+static char* mb_write_newick(const mbtree* t, const int node, char* c)
+{
+    if (node < t->ntax) {
+        return c + sprintf(c, "%i", node + 1);
+    }
+
+    *c++ = '(';
+    c = mb_write_newick(t, t->left[node], c);
+    *c++ = ',';
+    c = mb_write_newick(t, t->right[node], c);
+    *c++ = ')';
+
+    return c;
+}
+
+/* Writes the tree with the taxa labelled by their row in the matrix, counting
+ * from 1. */
+char* mb_gen_newick(const mbtree* t)
+{
+    char* newick = (char*)malloc(t->ntips * 16 + 4);
+    char* end = NULL;
+
+    end = mb_write_newick(t, t->root, newick);
+    *end++ = ';';
+    *end = '\0';
+
+    return newick;
+}
+
+static unsigned char mb_gen_change
+(const unsigned char s, const int nstates, const double rate, mbrng* rng)
+{
+    if (mb_rng_uniform(rng) < rate) {
+        return (unsigned char)((s + 1 + mb_rng_below(rng, nstates - 1)) % nstates);
+    }
+    return s;
+}
+
+/* Fills column j of cells with the states of a character at the tips. */
+static void mb_gen_states
+(unsigned char* cells, const int j, const int nstates, const mbgenparams* p,
+ const mbtree* t, unsigned char* nodestates, mbrng* rng)
+{
+    int i = 0;
+    int n = 0;
+
+    if (!t) {
+        for (i = 0; i < p->ntax; ++i) {
+            cells[(size_t)i * p->nchar + j] = (unsigned char)mb_rng_below(rng, nstates);
+        }
+        return;
+    }
+
+    // The internal nodes in reverse postorder visit every ancestor first
+    nodestates[t->lroot] = (unsigned char)mb_rng_below(rng, nstates);
+    for (i = t->ninternal; i--;) {
+        n = t->postorder[i];
+        nodestates[n] = mb_gen_change(nodestates[t->anc[n]], nstates, p->rate, rng);
+    }
+
+    for (i = 0; i < t->ntips; ++i) {
+        n = t->tips[i];
+        cells[(size_t)n * p->nchar + j]
+            = mb_gen_change(nodestates[t->anc[n]], nstates, p->rate, rng);
+    }
+}
+
+/*!
+ @brief Generates a matrix string that can be passed to mpl_attach_rawdata.
+ @discussion If p->simulate is set, t must be a tree on all p->ntax taxa.
+ Otherwise, t is not used and may be NULL. Rows are separated by newlines.
+ The caller is responsible for freeing the string.
+ */
+char* mb_gen_matrix(const mbgenparams* p, const mbtree* t)
+{
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    int nstates = 0;
+    int ncontrollers = 0;
+    unsigned char s = 0;
+    unsigned char other = 0;
+    size_t cell = 0;
+    size_t size = 0;
+    mbrng rng;
+    int maxstates = p->maxstates;
+    int* stcounts = (int*)malloc(p->nchar * sizeof(int));
+    int* controlledby = (int*)malloc(p->nchar * sizeof(int));
+    int* controllers = (int*)malloc(p->nchar * sizeof(int));
+    unsigned char* cells = (unsigned char*)malloc((size_t)p->ntax * p->nchar);
+    unsigned char* nodestates = NULL;
+    char* matrix = NULL;
+    char* c = NULL;
+
+    if (maxstates < 2) {
+        maxstates = 2;
+    }
+    else if (maxstates > MB_GEN_MAXSTATES) {
+        maxstates = MB_GEN_MAXSTATES;
+    }
+
+    if (p->simulate && t) {
+        nodestates = (unsigned char*)malloc(2 * t->ntax);
+    }
+    else {
+        t = NULL;
+    }
+
+    mb_rng_seed(&rng, p->seed);
+
+    for (j = 0; j < p->nchar; ++j) {
+
+        controlledby[j] = -1;
+        if (ncontrollers && mb_rng_uniform(&rng) < p->inapplicable) {
+            controlledby[j] = controllers[mb_rng_below(&rng, ncontrollers)];
+        }
+
+        nstates = 2 + mb_rng_below(&rng, maxstates - 1);
+        stcounts[j] = nstates;
+
+        // Any binary character can code the presence of a structure,
+        // including one that is itself dependent.
+        if (nstates == 2) {
+            controllers[ncontrollers] = j;
+            ++ncontrollers;
+        }
+
+        mb_gen_states(cells, j, nstates, p, t, nodestates, &rng);
+    }
+
+    // Controllers always come before the characters that depend on them, so
+    // nested dependencies are resolved in a single pass.
+    for (i = 0; i < p->ntax; ++i) {
+        for (j = 0; j < p->nchar; ++j) {
+            k = controlledby[j];
+            if (k < 0) {
+                continue;
+            }
+            s = cells[(size_t)i * p->nchar + k];
+            if (s == 0 || s == MB_GEN_NA) {
+                cells[(size_t)i * p->nchar + j] = MB_GEN_NA;
+            }
+        }
+    }
+
+    for (cell = 0; cell < (size_t)p->ntax * p->nchar; ++cell) {
+        if (mb_rng_uniform(&rng) < p->missing) {
+            cells[cell] = MB_GEN_MISSING;
+        }
+    }
+
+    size = (size_t)p->ntax * (p->nchar + 1) + 2;
+    if (p->polymorphism > 0.0) {
+        size = (size_t)p->ntax * (4 * p->nchar + 1) + 2;
+    }
+
+    matrix = (char*)malloc(size);
+    c = matrix;
+
+    for (i = 0; i < p->ntax; ++i) {
+        for (j = 0; j < p->nchar; ++j) {
+
+            s = cells[(size_t)i * p->nchar + j];
+
+            if (s == MB_GEN_NA) {
+                *c++ = '-';
+            }
+            else if (s == MB_GEN_MISSING) {
+                *c++ = '?';
+            }
+            else if (p->polymorphism > 0.0 &&
+                     mb_rng_uniform(&rng) < p->polymorphism) {
+                other = (unsigned char)((s + 1 + mb_rng_below(&rng, stcounts[j] - 1))
+                                        % stcounts[j]);
+                *c++ = '(';
+                *c++ = mb_gen_symbols[s < other ? s : other];
+                *c++ = mb_gen_symbols[s < other ? other : s];
+                *c++ = ')';
+            }
+            else {
+                *c++ = mb_gen_symbols[s];
+            }
+        }
+        *c++ = '\n';
+    }
+
+    c[-1] = ';';
+    *c = '\0';
+
+    free(stcounts);
+    free(controlledby);
+    free(controllers);
+    free(cells);
+    free(nodestates);
+
+    return matrix;
+}
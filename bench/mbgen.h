@@ -0,0 +1,64 @@
+//
+//  mbgen.h
+//  morphylib
+//
+//  Seeded generation of trees and matrices for benchmarking. Everything
+//  produced here is determined entirely by the seed and parameters, so that a
+//  workload can be reproduced from its description alone.
+//
+
+#ifndef mbgen_h
+#define mbgen_h
+
+#include <stdbool.h>
+
+#define MB_GEN_MAXSTATES 32
+
+typedef struct {
+    unsigned long long s;
+} mbrng;
+
+/* A rooted binary tree as index arrays, in the form expected by the Morphy
+ * nodal functions. Tips keep the indices they are given, and internal nodes
+ * are numbered from ntax. The internal nodes are listed in postorder, and the
+ * root's ancestor is the lower ('dummy') root. */
+typedef struct {
+    int     ntax;
+    int     ntips;
+    int*    tips;
+    int     ninternal;
+    int*    postorder;
+    int*    left;
+    int*    right;
+    int*    anc;
+    int     root;
+    int     lroot;
+} mbtree;
+
+typedef struct {
+    unsigned long long seed;
+    int     ntax;
+    int     nchar;
+    int     maxstates;      /*!< Characters have from 2 to this many states */
+    double  missing;        /*!< Probability that a cell is scored as missing */
+    double  inapplicable;   /*!< Probability that a character depends on the
+                                 presence of a structure coded by another */
+    double  polymorphism;   /*!< Probability that an applicable cell is
+                                 polymorphic */
+    bool    simulate;       /*!< Evolve characters on the tree rather than
+                                 drawing each cell independently */
+    double  rate;           /*!< Probability of change on each branch */
+} mbgenparams;
+
+void    mb_rng_seed(mbrng* rng, unsigned long long seed);
+unsigned long long mb_rng_next(mbrng* rng);
+double  mb_rng_uniform(mbrng* rng);
+
+void    mb_gen_defaults(mbgenparams* p);
+void    mb_gen_tree(mbtree* t, const int* tips, const int ntips, const int ntax,
+                    mbrng* rng);
+void    mb_delete_tree(mbtree* t);
+char*   mb_gen_newick(const mbtree* t);
+char*   mb_gen_matrix(const mbgenparams* p, const mbtree* t);
+
+#endif /* mbgen_h */
@@ -0,0 +1,713 @@
+//
+//  morphybench.c
+//  morphylib
+//
+//  Times the evaluation functions over a grid of workload sizes and writes the
+//  results as JSON. Each pass over a tree is timed separately and reported in
+//  nanoseconds per node-character, so that results can be compared across
+//  tree and matrix sizes. Insertion costs are timed as a sweep of a single
+//  pruned taxon over every branch of the remaining tree. Workloads are made by
+//  the generator in mbgen.c, with characters evolved on the tree being scored.
+//
+//  With --gate, a fixed subset of the workload is run several times and its
+//  throughput is compared to a baseline file. Each sample is divided by the
+//  throughput of a reference kernel timed immediately before and after it in
+//  the same run: a plain Fitch downpass that belongs to the benchmark rather
+//  than the library. The baseline holds these ratios rather than absolute
+//  rates, so that it carries over between machines and is not upset by a
+//  machine that is busy with other work. The exit status is 0 if nothing is
+//  slower than the baseline by more than the threshold, allowing for the
+//  variation between samples, and 1 if something is or if the benchmark was
+//  built without optimisation. --update writes a new baseline instead.
+//
+//  Usage: morphybench [--quick] [--seed n] [--output file] [--trace file]
+//         morphybench --gate baseline [--threshold fraction] [--update]
+//
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "mpl.h"
+#include "mbgen.h"
+
+#ifndef MPL_BENCH_BUILD_TYPE
+#define MPL_BENCH_BUILD_TYPE ""
+#endif
+
+#ifdef __OPTIMIZE__
+#define MB_OPTIMISED true
+#else
+#define MB_OPTIMISED false
+#endif
+
+#define MB_MIN_TIME_NS  20000000.0  // Minimum time spent on each measurement
+#define MB_MIN_REPS     3
+#define MB_GATE_SAMPLES 5
+
+typedef struct {
+    mbgenparams gen;
+    MPLchtype   chtype;
+} mbconfig;
+
+typedef struct {
+    double  apply_tipdata;
+    double  first_down;
+    double  first_up;
+    double  tip_update;
+    double  second_down;
+    double  second_up;
+    double  tip_finalize;
+    double  full_pass;
+    double  insertcost;
+    int     length;
+} mbresult;
+
+static double mb_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static const char* mb_chtype_name(MPLchtype chtype)
+{
+    switch (chtype) {
+        case FITCH_T:           return "fitch";
+        case WAGNER_T:          return "wagner";
+        case DOLLO_T:           return "dollo";
+        case IRREVERSIBLE_T:    return "irreversible";
+        case USERTYPE_T:        return "usertype";
+        default:                return "none";
+    }
+}
+
+static Morphy mb_new_Morphy(const mbconfig* cfg, const char* matrix)
+{
+    int i = 0;
+    Morphy m = mpl_new_Morphy();
+
+    mpl_init_Morphy(cfg->gen.ntax, cfg->gen.nchar, m);
+    if (mpl_attach_rawdata(matrix, m)) {
+        fprintf(stderr, "Generated matrix was rejected (seed %llu)\n",
+                cfg->gen.seed);
+        exit(1);
+    }
+    for (i = 0; i < cfg->gen.nchar; ++i) {
+        mpl_set_parsim_t(i, cfg->chtype, m);
+    }
+    mpl_set_num_internal_nodes(cfg->gen.ntax, m);
+
+    return m;
+}
+
+/* A full pass over the tree, with the time for each pass added to res. */
+static int mb_full_pass(const mbtree* t, Morphy m, mbresult* res)
+{
+    int i = 0;
+    int n = 0;
+    int length = 0;
+    double t0 = 0.0;
+    double t1 = 0.0;
+
+    t0 = mb_now();
+    for (i = 0; i < t->ninternal; ++i) {
+        n = t->postorder[i];
+        length += mpl_first_down_recon(n, t->left[n], t->right[n], m);
+    }
+    t1 = mb_now();
+    res->first_down += t1 - t0;
+
+    mpl_update_lower_root(t->lroot, t->root, m);
+
+    t0 = mb_now();
+    for (i = t->ninternal; i--;) {
+        n = t->postorder[i];
+        mpl_first_up_recon(n, t->left[n], t->right[n], t->anc[n], m);
+    }
+    t1 = mb_now();
+    res->first_up += t1 - t0;
+
+    t0 = mb_now();
+    for (i = 0; i < t->ntips; ++i) {
+        length += mpl_update_tip(t->tips[i], t->anc[t->tips[i]], m);
+    }
+    t1 = mb_now();
+    res->tip_update += t1 - t0;
+
+    t0 = mb_now();
+    for (i = 0; i < t->ninternal; ++i) {
+        n = t->postorder[i];
+        length += mpl_second_down_recon(n, t->left[n], t->right[n], m);
+    }
+    t1 = mb_now();
+    res->second_down += t1 - t0;
+
+    t0 = mb_now();
+    for (i = t->ninternal; i--;) {
+        n = t->postorder[i];
+        mpl_second_up_recon(n, t->left[n], t->right[n], t->anc[n], m);
+    }
+    t1 = mb_now();
+    res->second_up += t1 - t0;
+
+    t0 = mb_now();
+    for (i = 0; i < t->ntips; ++i) {
+        mpl_finalize_tip(t->tips[i], t->anc[t->tips[i]], m);
+    }
+    t1 = mb_now();
+    res->tip_finalize += t1 - t0;
+
+    return length;
+}
+
+static void mb_run_config(const mbconfig* cfg, mbresult* res)
+{
+    int i       = 0;
+    int reps    = 0;
+    int ncalls  = 0;
+    int ntax    = cfg->gen.ntax;
+    int nchar   = cfg->gen.nchar;
+    double t0   = 0.0;
+    double elapsed = 0.0;
+    double nodechars = 0.0;
+    int* tips   = (int*)malloc(ntax * sizeof(int));
+    char* matrix = NULL;
+    Morphy m    = NULL;
+    mbrng rng;
+    mbtree t;
+
+    memset(res, 0, sizeof(mbresult));
+
+    for (i = 0; i < ntax; ++i) {
+        tips[i] = i;
+    }
+
+    // The characters are evolved on the same tree that is scored
+    mb_rng_seed(&rng, cfg->gen.seed);
+    mb_gen_tree(&t, tips, ntax, ntax, &rng);
+    matrix = mb_gen_matrix(&cfg->gen, &t);
+
+    // Setup of the tip data on a fresh handle each time
+    for (reps = 0; reps < MB_MIN_REPS || elapsed < MB_MIN_TIME_NS; ++reps) {
+        m = mb_new_Morphy(cfg, matrix);
+        t0 = mb_now();
+        mpl_apply_tipdata(m);
+        elapsed += mb_now() - t0;
+        mpl_delete_Morphy(m);
+    }
+    res->apply_tipdata = elapsed / reps;
+
+    m = mb_new_Morphy(cfg, matrix);
+    mpl_apply_tipdata(m);
+
+    // Full passes over the whole tree
+    elapsed = 0.0;
+    for (reps = 0; reps < MB_MIN_REPS || elapsed < MB_MIN_TIME_NS; ++reps) {
+        t0 = mb_now();
+        res->length = mb_full_pass(&t, m, res);
+        elapsed += mb_now() - t0;
+    }
+
+    nodechars = (double)t.ninternal * nchar;
+    res->first_down     /= reps * nodechars;
+    res->first_up       /= reps * nodechars;
+    res->second_down    /= reps * nodechars;
+    res->second_up      /= reps * nodechars;
+    res->tip_update     /= reps * (double)t.ntips * nchar;
+    res->tip_finalize   /= reps * (double)t.ntips * nchar;
+    res->full_pass      = elapsed / reps;
+    mb_delete_tree(&t);
+
+    // Insertion of the first taxon on every branch of a tree of the others.
+    // The taxon keeps the sets it was given in the full tree.
+    mbresult unused;
+    memset(&unused, 0, sizeof(mbresult));
+    mb_gen_tree(&t, tips + 1, ntax - 1, ntax, &rng);
+    mb_full_pass(&t, m, &unused);
+
+    elapsed = 0.0;
+    for (reps = 0; reps < MB_MIN_REPS || elapsed < MB_MIN_TIME_NS; ++reps) {
+        t0 = mb_now();
+        for (i = 0; i < t.ninternal; ++i) {
+            mpl_get_insertcost(0, t.postorder[i], t.anc[t.postorder[i]],
+                               false, 0, m);
+        }
+        for (i = 0; i < t.ntips; ++i) {
+            mpl_get_insertcost(0, t.tips[i], t.anc[t.tips[i]], false, 0, m);
+        }
+        elapsed += mb_now() - t0;
+        ncalls += t.ninternal + t.ntips;
+    }
+    res->insertcost = elapsed / ((double)ncalls * nchar);
+    mb_delete_tree(&t);
+
+    mpl_delete_Morphy(m);
+    free(matrix);
+    free(tips);
+}
+
+static void mb_print_result
+(FILE* out, const mbconfig* cfg, const mbresult* res, const bool last)
+{
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"ntax\": %i,\n", cfg->gen.ntax);
+    fprintf(out, "      \"nchar\": %i,\n", cfg->gen.nchar);
+    fprintf(out, "      \"maxstates\": %i,\n", cfg->gen.maxstates);
+    fprintf(out, "      \"inapplicable\": %.3f,\n", cfg->gen.inapplicable);
+    fprintf(out, "      \"seed\": %llu,\n", cfg->gen.seed);
+    fprintf(out, "      \"chtype\": \"%s\",\n", mb_chtype_name(cfg->chtype));
+    fprintf(out, "      \"length\": %i,\n", res->length);
+    fprintf(out, "      \"apply_tipdata_ns\": %.1f,\n", res->apply_tipdata);
+    fprintf(out, "      \"full_pass_ns\": %.1f,\n", res->full_pass);
+    fprintf(out, "      \"ns_per_node_char\": {\n");
+    fprintf(out, "        \"first_down\": %.4f,\n", res->first_down);
+    fprintf(out, "        \"first_up\": %.4f,\n", res->first_up);
+    fprintf(out, "        \"tip_update\": %.4f,\n", res->tip_update);
+    fprintf(out, "        \"second_down\": %.4f,\n", res->second_down);
+    fprintf(out, "        \"second_up\": %.4f,\n", res->second_up);
+    fprintf(out, "        \"tip_finalize\": %.4f,\n", res->tip_finalize);
+    fprintf(out, "        \"insertcost\": %.4f\n", res->insertcost);
+    fprintf(out, "      }\n");
+    fprintf(out, "    }%s\n", last ? "" : ",");
+}
+
+typedef struct {
+    const char* name;
+    MPLchtype   chtype;
+    int         ntax;
+    int         nchar;
+    int         maxstates;
+    double      inapplicable;
+} mbgatecase;
+
+static const mbgatecase mb_gate_cases[] = {
+    {"fitch",       FITCH_T,    128, 1000, 4, 0.0},
+    {"fitch_na",    FITCH_T,    128, 1000, 4, 0.5},
+    {"wagner",      WAGNER_T,   128, 1000, 4, 0.0},
+};
+
+#define MB_GATE_NCASES ((int)(sizeof(mb_gate_cases) / sizeof(mbgatecase)))
+
+/* The reference kernel for the gate. It is a Fitch downpass over sets held by
+ * the benchmark itself, on a tree and matrix the size of the case being
+ * timed, so that it competes for the same caches and cores as the library but
+ * does not change when the library does. Returns node-characters per second. */
+static double mb_reference_rate(const mbgatecase* gc)
+{
+    int i       = 0;
+    int j       = 0;
+    int n       = 0;
+    int reps    = 0;
+    int steps   = 0;
+    int nchar   = gc->nchar;
+    double t0   = 0.0;
+    double elapsed = 0.0;
+    int* tips   = (int*)malloc(gc->ntax * sizeof(int));
+    unsigned long* sets = NULL;
+    static volatile int sink = 0;
+    mbrng rng;
+    mbtree t;
+
+    for (i = 0; i < gc->ntax; ++i) {
+        tips[i] = i;
+    }
+
+    mb_rng_seed(&rng, 1);
+    mb_gen_tree(&t, tips, gc->ntax, gc->ntax, &rng);
+
+    sets = (unsigned long*)calloc((size_t)2 * gc->ntax * nchar,
+                                  sizeof(unsigned long));
+    for (i = 0; i < gc->ntax * nchar; ++i) {
+        sets[i] = 1UL << (mb_rng_next(&rng) % gc->maxstates);
+    }
+
+    for (reps = 0; reps < MB_MIN_REPS || elapsed < MB_MIN_TIME_NS; ++reps) {
+        t0 = mb_now();
+        for (i = 0; i < t.ninternal; ++i) {
+            const unsigned long* l = NULL;
+            const unsigned long* r = NULL;
+            unsigned long* s = NULL;
+
+            n = t.postorder[i];
+            l = &sets[t.left[n] * nchar];
+            r = &sets[t.right[n] * nchar];
+            s = &sets[n * nchar];
+            for (j = 0; j < nchar; ++j) {
+                s[j] = l[j] & r[j];
+                if (!s[j]) {
+                    s[j] = l[j] | r[j];
+                    ++steps;
+                }
+            }
+        }
+        elapsed += mb_now() - t0;
+    }
+    sink += steps;
+
+    elapsed /= reps * (double)t.ninternal * nchar;
+
+    mb_delete_tree(&t);
+    free(sets);
+    free(tips);
+
+    return 1e9 / elapsed;
+}
+
+typedef struct {
+    double  mean;
+    double  cv;     // Coefficient of variation between samples
+} mbsummary;
+
+static void mb_summarise(const double* x, const int n, mbsummary* s)
+{
+    int i = 0;
+    double sum = 0.0;
+    double ss = 0.0;
+
+    for (i = 0; i < n; ++i) {
+        sum += x[i];
+    }
+    s->mean = sum / n;
+
+    for (i = 0; i < n; ++i) {
+        ss += (x[i] - s->mean) * (x[i] - s->mean);
+    }
+    s->cv = n > 1 && s->mean > 0.0 ? sqrt(ss / (n - 1)) / s->mean : 0.0;
+}
+
+static char* mb_read_file(const char* filename)
+{
+    long size = 0;
+    char* text = NULL;
+    FILE* f = fopen(filename, "r");
+
+    if (!f) {
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+
+    text = (char*)calloc(size + 1, sizeof(char));
+    if (text) {
+        size = (long)fread(text, 1, size, f);
+        text[size] = '\0';
+    }
+    fclose(f);
+
+    return text;
+}
+
+/* Finds the number stored under key in the baseline entry for a case. The
+ * baseline is only ever written by mb_write_baseline, so a flat search is
+ * enough. */
+static int mb_baseline_value
+(const char* json, const char* name, const char* key, double* v)
+{
+    char pattern[64];
+    const char* entry = NULL;
+    const char* end = NULL;
+    const char* p = NULL;
+
+    sprintf(pattern, "\"name\": \"%s\"", name);
+    entry = strstr(json, pattern);
+    if (!entry) {
+        return 1;
+    }
+    end = strchr(entry, '}');
+
+    sprintf(pattern, "\"%s\":", key);
+    p = strstr(entry, pattern);
+    if (!p || (end && p > end)) {
+        return 1;
+    }
+
+    return sscanf(p + strlen(pattern), "%lf", v) != 1;
+}
+
+static int mb_write_baseline
+(const char* filename, const mbsummary* evals, const mbsummary* inserts)
+{
+    int i = 0;
+    FILE* out = fopen(filename, "w");
+
+    if (!out) {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        return 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"build_type\": \"%s\",\n", MPL_BENCH_BUILD_TYPE);
+    fprintf(out, "  \"samples\": %i,\n", MB_GATE_SAMPLES);
+    fprintf(out, "  \"relative_to\": \"reference Fitch downpass\",\n");
+    fprintf(out, "  \"results\": [\n");
+    for (i = 0; i < MB_GATE_NCASES; ++i) {
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"name\": \"%s\",\n", mb_gate_cases[i].name);
+        fprintf(out, "      \"node_evals_rel\": %.4f,\n", evals[i].mean);
+        fprintf(out, "      \"node_evals_cv\": %.4f,\n", evals[i].cv);
+        fprintf(out, "      \"insertcosts_rel\": %.4f,\n", inserts[i].mean);
+        fprintf(out, "      \"insertcosts_cv\": %.4f\n", inserts[i].cv);
+        fprintf(out, "    }%s\n", i + 1 < MB_GATE_NCASES ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+    fclose(out);
+
+    return 0;
+}
+
+/* A metric fails if it is slower than the baseline by more than the
+ * threshold plus twice the combined standard error of the two means, so that
+ * a noisy machine widens the margin rather than raising false alarms. */
+static int mb_gate_compare
+(const char* json, const char* name, const char* metric, const char* cvkey,
+ const mbsummary* now, const double threshold)
+{
+    double base = 0.0;
+    double basecv = 0.0;
+    double slowdown = 0.0;
+    double limit = 0.0;
+    bool fail = false;
+
+    if (mb_baseline_value(json, name, metric, &base) ||
+        mb_baseline_value(json, name, cvkey, &basecv) || base <= 0.0) {
+        printf("%-10s %-18s missing from the baseline\n", name, metric);
+        return 1;
+    }
+
+    slowdown = 1.0 - now->mean / base;
+    limit = threshold + 2.0 * sqrt((now->cv * now->cv + basecv * basecv)
+                                   / MB_GATE_SAMPLES);
+    fail = slowdown > limit;
+
+    printf("%-10s %-18s baseline %7.4f  now %7.4f  cv %5.1f%%  "
+           "change %+6.1f%%  limit %+6.1f%%  %s\n", name, metric, base,
+           now->mean, 100.0 * now->cv, -100.0 * slowdown, -100.0 * limit,
+           fail ? "FAIL" : "ok");
+    if (now->cv > 0.1) {
+        printf("%-10s %-18s warning: samples vary by more than 10%%\n", name,
+               metric);
+    }
+
+    return fail;
+}
+
+static int mb_gate(const char* baseline, const double threshold,
+                   const bool update)
+{
+    int i = 0;
+    int j = 0;
+    int fails = 0;
+    char* json = NULL;
+    double ref[MB_GATE_SAMPLES + 1];
+    double evals[MB_GATE_SAMPLES];
+    double inserts[MB_GATE_SAMPLES];
+    mbsummary evalsum[MB_GATE_NCASES];
+    mbsummary insertsum[MB_GATE_NCASES];
+
+    // Without optimisation the ratios to the reference say little about an
+    // optimised build, so there is nothing meaningful to compare.
+    if (!MB_OPTIMISED) {
+        fprintf(stderr, "The performance gate needs an optimised build of "
+                "morphybench and morphy\n");
+        return 1;
+    }
+
+    if (!update) {
+        json = mb_read_file(baseline);
+        if (!json) {
+            fprintf(stderr, "Unable to read %s\n", baseline);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < MB_GATE_NCASES; ++i) {
+
+        const mbgatecase* gc = &mb_gate_cases[i];
+        mbconfig cfg;
+        mbresult res;
+
+        mb_gen_defaults(&cfg.gen);
+        cfg.chtype              = gc->chtype;
+        cfg.gen.ntax            = gc->ntax;
+        cfg.gen.nchar           = gc->nchar;
+        cfg.gen.maxstates       = gc->maxstates;
+        cfg.gen.inapplicable    = gc->inapplicable;
+        cfg.gen.missing         = 0.05;
+        cfg.gen.seed            = i + 1;
+
+        // One run to warm the caches and the allocator before sampling
+        mb_reference_rate(gc);
+        mb_run_config(&cfg, &res);
+
+        // Each sample is set against the mean of the reference timings on
+        // either side of it, so that any load on the machine at the time
+        // affects both alike.
+        ref[0] = mb_reference_rate(gc);
+        for (j = 0; j < MB_GATE_SAMPLES; ++j) {
+            mb_run_config(&cfg, &res);
+            ref[j + 1] = mb_reference_rate(gc);
+            // Each full pass calls four functions on every internal node and
+            // two on every tip. Both rates are per character, as is the
+            // reference.
+            evals[j] = (4.0 * (gc->ntax - 1) + 2.0 * gc->ntax) * gc->nchar
+                        * 1e9 / res.full_pass;
+            inserts[j] = 1e9 / res.insertcost;
+            evals[j] /= 0.5 * (ref[j] + ref[j + 1]);
+            inserts[j] /= 0.5 * (ref[j] + ref[j + 1]);
+        }
+
+        mb_summarise(evals, MB_GATE_SAMPLES, &evalsum[i]);
+        mb_summarise(inserts, MB_GATE_SAMPLES, &insertsum[i]);
+
+        if (!update) {
+            fails += mb_gate_compare(json, gc->name, "node_evals_rel",
+                                     "node_evals_cv", &evalsum[i], threshold);
+            fails += mb_gate_compare(json, gc->name, "insertcosts_rel",
+                                     "insertcosts_cv", &insertsum[i],
+                                     threshold);
+        }
+    }
+
+    free(json);
+
+    if (update) {
+        return mb_write_baseline(baseline, evalsum, insertsum);
+    }
+
+    printf("%i of %i measurements slower than the baseline allows\n", fails,
+           2 * MB_GATE_NCASES);
+
+    return fails ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int i = 0;
+    int a = 0;
+    int b = 0;
+    int c = 0;
+    int d = 0;
+    int e = 0;
+    int n = 0;
+    int ncfgs = 0;
+    bool quick = false;
+    const char* outname = NULL;
+    const char* tracename = NULL;
+    const char* baseline = NULL;
+    double threshold = 0.3;
+    bool update = false;
+    unsigned long long seed = 1;
+    FILE* out = stdout;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--quick")) {
+            quick = true;
+        }
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+            outname = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            tracename = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--gate") && i + 1 < argc) {
+            baseline = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+            threshold = strtod(argv[++i], NULL);
+        }
+        else if (!strcmp(argv[i], "--update")) {
+            update = true;
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--quick] [--seed n] [--output file] "
+                    "[--trace file]\n"
+                    "       %s --gate baseline [--threshold fraction] "
+                    "[--update]\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    if (baseline) {
+        return mb_gate(baseline, threshold, update);
+    }
+
+    int     taxa[]      = {32, 128, 512};
+    int     chars[]     = {100, 1000};
+    int     states[]    = {2, 4, 8};
+    double  inapplics[]   = {0.0, 0.5};
+    MPLchtype types[]   = {FITCH_T, WAGNER_T};
+
+    int ntaxa   = quick ? 2 : 3;
+    int nchars  = quick ? 1 : 2;
+    int nstates = quick ? 2 : 3;
+    int ninapplic = 2;
+    int ntypes  = 2;
+
+    if (outname) {
+        out = fopen(outname, "w");
+        if (!out) {
+            fprintf(stderr, "Unable to open %s\n", outname);
+            return 1;
+        }
+    }
+
+    ncfgs = ntaxa * nchars * nstates * ninapplic * ntypes;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"build_type\": \"%s\",\n", MPL_BENCH_BUILD_TYPE);
+    fprintf(out, "  \"seed\": %llu,\n", seed);
+    fprintf(out, "  \"results\": [\n");
+
+    for (a = 0; a < ntypes; ++a) {
+        for (b = 0; b < ntaxa; ++b) {
+            for (c = 0; c < nchars; ++c) {
+                for (d = 0; d < nstates; ++d) {
+                    for (e = 0; e < ninapplic; ++e) {
+
+                        mbconfig cfg;
+                        mbresult res;
+
+                        mb_gen_defaults(&cfg.gen);
+                        cfg.chtype          = types[a];
+                        cfg.gen.ntax        = taxa[b];
+                        cfg.gen.nchar       = chars[c];
+                        cfg.gen.maxstates   = states[d];
+                        cfg.gen.inapplicable = inapplics[e];
+                        cfg.gen.missing     = 0.05;
+
+                        // Each workload is reproducible on its own
+                        cfg.gen.seed = seed * 1000 + n;
+
+                        mb_run_config(&cfg, &res);
+                        ++n;
+                        mb_print_result(out, &cfg, &res, n == ncfgs);
+                        fflush(out);
+                    }
+                }
+            }
+        }
+    }
+
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    if (tracename && mpl_trace_dump(tracename)) {
+        fprintf(stderr, "Unable to write a trace: morphy must be built with "
+                "MORPHY_TRACE\n");
+        return 1;
+    }
+
+    return 0;
+}
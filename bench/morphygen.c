@@ -0,0 +1,135 @@
+//
+//  morphygen.c
+//  morphylib
+//
+//  Writes a generated matrix, and the tree on which it was simulated, so that
+//  a workload can be reproduced outside of the benchmarks.
+//
+//  Usage: morphygen [options]
+//      --taxa n            Number of taxa (32)
+//      --chars n           Number of characters (100)
+//      --states n          Maximum number of states per character (4)
+//      --missing f         Probability of a missing cell (0)
+//      --inapplicable f    Probability that a character is dependent (0)
+//      --polymorphism f    Probability of a polymorphic cell (0)
+//      --rate f            Probability of change on a branch (0.1)
+//      --random            Draw cells independently instead of simulating
+//      --seed n            Random seed (1)
+//      --matrix file       Write the matrix to file instead of stdout
+//      --tree file         Write the tree in Newick format to file
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mbgen.h"
+
+static int mb_write_string(const char* fname, const char* str)
+{
+    FILE* out = stdout;
+
+    if (fname) {
+        out = fopen(fname, "w");
+        if (!out) {
+            fprintf(stderr, "Unable to open %s\n", fname);
+            return 1;
+        }
+    }
+
+    fputs(str, out);
+    fputc('\n', out);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int i = 0;
+    int err = 0;
+    int* tips = NULL;
+    const char* matname = NULL;
+    const char* treename = NULL;
+    char* matrix = NULL;
+    char* newick = NULL;
+    mbgenparams p;
+    mbtree t;
+    mbrng rng;
+
+    mb_gen_defaults(&p);
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--random")) {
+            p.simulate = false;
+        }
+        else if (i + 1 >= argc) {
+            break;
+        }
+        else if (!strcmp(argv[i], "--taxa")) {
+            p.ntax = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--chars")) {
+            p.nchar = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--states")) {
+            p.maxstates = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--missing")) {
+            p.missing = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--inapplicable")) {
+            p.inapplicable = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--polymorphism")) {
+            p.polymorphism = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--rate")) {
+            p.rate = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--seed")) {
+            p.seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--matrix")) {
+            matname = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--tree")) {
+            treename = argv[++i];
+        }
+        else {
+            break;
+        }
+    }
+
+    if (i < argc || p.ntax < 2 || p.nchar < 1) {
+        fprintf(stderr, "Usage: %s [--taxa n] [--chars n] [--states n] "
+                "[--missing f] [--inapplicable f] [--polymorphism f] "
+                "[--rate f] [--random] [--seed n] [--matrix file] "
+                "[--tree file]\n", argv[0]);
+        return 1;
+    }
+
+    tips = (int*)malloc(p.ntax * sizeof(int));
+    for (i = 0; i < p.ntax; ++i) {
+        tips[i] = i;
+    }
+
+    mb_rng_seed(&rng, p.seed);
+    mb_gen_tree(&t, tips, p.ntax, p.ntax, &rng);
+
+    matrix = mb_gen_matrix(&p, &t);
+    err = mb_write_string(matname, matrix);
+
+    if (!err && treename) {
+        newick = mb_gen_newick(&t);
+        err = mb_write_string(treename, newick);
+        free(newick);
+    }
+
+    free(matrix);
+    mb_delete_tree(&t);
+    free(tips);
+
+    return err;
+}
@@ -46,9 +46,12 @@
 #endif /*__cplusplus */
 		
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 #include "mplerror.h"
 		
 typedef void* Morphy;
+typedef void* MPLnewick;
 
 typedef enum {
     
@@ -73,6 +76,49 @@ typedef enum {
     
 } MPLgap_t;
 
+/* The order in which taxa are added to a tree by stepwise addition. */
+typedef enum {
+    
+    ADDSEQ_ASIS,    // In the order of the matrix
+    ADDSEQ_RANDOM,
+    ADDSEQ_CLOSEST, // The taxon adding fewest steps to the tree first
+    
+    ADDSEQ_MAX,
+    
+} MPLaddseq_t;
+
+/* The passes for which hot-path counters are kept when the library is built
+ * with MPL_STATS. All of the incremental recalculations of inapplicable
+ * characters are counted together. */
+typedef enum {
+    
+    PASS_FIRST_DOWN,
+    PASS_FIRST_UP,
+    PASS_SECOND_DOWN,
+    PASS_SECOND_UP,
+    PASS_TIP_UPDATE,
+    PASS_TIP_FINALIZE,
+    PASS_TIPROOT,
+    PASS_LOCAL_REOPT,
+    PASS_NA_RECALC,
+    
+    PASS_MAX,
+    
+} MPLpass_t;
+
+typedef struct {
+    
+    MPLchtype           chtype;     /*!< Type of the partition, or NONE_T for a sum over all partitions */
+    bool                isNAtype;
+    unsigned long long  calls;      /*!< Number of calls to the partition's kernel */
+    unsigned long long  chars;      /*!< Characters passed to the kernel */
+    unsigned long long  steps;      /*!< Steps returned by the kernel */
+    unsigned long long  cutoffs;    /*!< Calls whose result exceeded a caller's cutoff */
+    unsigned long long  narecalcs;  /*!< Characters flagged for inapplicable recalculation */
+    unsigned long long  cycles;     /*!< Time stamp counter ticks in the kernel (MPL_STATS_CYCLES only) */
+    
+} MPLstats;
+
 	// Public functions
 
 	/*!
@@ -307,19 +353,50 @@ int     mpl_set_missing_symbol
  
  @param m An instance of the Morphy object.
  
- @return A Morphy error code.
+ @return A Morphy error code. ERR_UNKNOWN_CHTYPE if a USERTYPE_T character has
+ no step matrix, or ERR_OUT_OF_BOUNDS if it has states outside its matrix.
 */
 int     mpl_apply_tipdata
     
         (Morphy m);
 
 
+/*!
+ 
+ @brief Includes a previously excluded character.
+ 
+ @discussion Characters are all included by default. Inclusion and exclusion
+ can be changed at any time. Once tip data have been applied, only the order
+ of the characters within the affected partition changes: no nodal sets are
+ reallocated and the matrix is not read again. Lengths from the next set of
+ passes count only the included characters.
+ 
+ @param charID The index of the character.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return A Morphy error code.
+ 
+ */
 int     mpl_incl_charac
 
         (const int  charID,
          Morphy     m);
 
 
+/*!
+ 
+ @brief Excludes a character from the calculation of lengths.
+ 
+ @discussion See mpl_incl_charac.
+ 
+ @param charID The index of the character.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return A Morphy error code.
+ 
+ */
 int     mpl_excl_charac
 
         (const int  charID,
@@ -334,7 +411,11 @@ int     mpl_excl_charac
  floating point value. However, in the current implementation, fractional values 
  will be interpreted and estimated using an approximation of the rational 
  factors. In the current version, MorphyLib uses this method to circumvent any
- floating point calculations that aren't absolutely necessary.
+ floating point calculations that aren't absolutely necessary. Once tip data 
+ have been applied, the new weight takes effect immediately: only the weights
+ held by the partitions are updated, rescaled to the least common denominator
+ of the current weights. Lengths from the next set of passes reflect the new
+ weight, and are the same as those of a new handle with the same weights.
  
  @param charID The index of the character to be weighted.
  
@@ -383,6 +464,39 @@ int     mpl_set_parsim_t
          Morphy           m);
 
 
+/*!
+
+ @brief Sets the step matrix for a user-defined (USERTYPE_T) character.
+ 
+ @discussion Supplies the costs of changes between states of a character that
+ is (or will be) set to USERTYPE_T. The matrix is copied, so the caller keeps
+ ownership of costs. State i is the i-th symbol in the list returned by 
+ mpl_get_symbols(). Costs are directional: entry [i][j] is the cost of a change
+ from ancestral state i to descendant state j. Gaps are treated as missing data
+ in these characters. Every USERTYPE_T character must have a step matrix before
+ mpl_apply_tipdata() is called, and every state observed in the character must
+ be within the matrix.
+ 
+ @param charID The index of the character.
+ 
+ @param nstates The number of rows (and columns) in the matrix.
+ 
+ @param costs The costs as a row-major array of nstates * nstates non-negative
+ integers, none of which may exceed 65535.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return A Morphy error code.
+
+ */
+int     mpl_set_charac_stepmatrix
+
+        (const int  charID,
+         const int  nstates,
+         const int* costs,
+         Morphy     m);
+
+
 /*!
 
  @brief Tells MorphyLib how to treat the gap symbol.
@@ -598,7 +712,9 @@ int     mpl_second_up_recon
  
  @param m An instance of the Morphy object.
  
- @return A null value (for now).
+ @return The weighted number of steps counted on the tip's branch. This is 0
+ for all types except Dollo characters, which count gains of derived states
+ unique to a terminal here.
  */
 int     mpl_update_tip
     
@@ -839,6 +955,669 @@ const char*   mpl_get_stateset
          const int  passnum,
          Morphy     m);
 
+
+/*!
+ 
+ @brief Writes a packed state set as a string of state symbols.
+ 
+ @discussion Decodes a set returned by mpl_get_packed_states in the same way
+ as mpl_get_stateset, but into the caller's space, so that nothing is
+ allocated. Missing data, and any other set including states beyond the
+ symbols in use, are written as '?'. An empty set is written as an empty
+ string.
+ 
+ @param states The packed state set.
+ 
+ @param buf Space for the string.
+ 
+ @param size The size of buf, including the terminating null.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The length of the string, or ERR_OUT_OF_BOUNDS if buf is too small.
+ 
+ */
+int     mpl_translate_packed_states
+        
+        (const unsigned int states,
+         char*              buf,
+         const int          size,
+         Morphy             m);
+
+
+/*!
+ 
+ @brief Gets the packed state sets of one pass at a node.
+ 
+ @discussion Returns the sets themselves, not a copy, so that a client can
+ read a whole node without a call for each character. The pointer stays valid
+ until the tip data are applied again or the Morphy object is destroyed, and
+ the sets change whenever the node is evaluated.
+ 
+ @param nodeID The index of the node.
+ 
+ @param passnum The pass, from 1 to 4, as for mpl_get_packed_states.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The sets of the node, indexed by character number, or NULL if the
+ node or pass is out of range or the tip data have not been applied.
+ 
+ */
+const unsigned long*    mpl_get_nodal_sets
+        
+        (const int  nodeID,
+         const int  passnum,
+         Morphy     m);
+
+/*!
+ 
+ @brief Returns the number of data type partitions.
+ 
+ @discussion Partitions are created by mpl_apply_tipdata. Their indices can be
+ passed to mpl_get_stats.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The number of partitions or a negative error code.
+ 
+ */
+int     mpl_get_num_partitions
+        
+        (Morphy m);
+
+
+/*!
+ 
+ @brief Retrieves the hot-path counters for a pass.
+ 
+ @discussion The counters are only kept if the library was compiled with
+ MPL_STATS defined (the MORPHY_STATS option in CMake). Cycle counts also
+ require MPL_STATS_CYCLES. The counters are accumulated by the nodal functions
+ in this interface until they are cleared with mpl_reset_stats or the
+ partitions are rebuilt by mpl_apply_tipdata.
+ 
+ @param part_id The index of a partition, or -1 for the sum over all
+ partitions.
+ 
+ @param pass The pass to be queried.
+ 
+ @param stats A struct into which the counters are written. It is zeroed if
+ the counters are not available.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return 0 if success, ERR_CASE_NOT_IMPL if the library was built without
+ counters, or another Morphy error code.
+ 
+ */
+int     mpl_get_stats
+        
+        (const int          part_id,
+         const MPLpass_t    pass,
+         MPLstats*          stats,
+         Morphy             m);
+
+
+/*!
+ 
+ @brief Sets all hot-path counters to zero.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return 0 if success, ERR_CASE_NOT_IMPL if the library was built without
+ counters, or another Morphy error code.
+ 
+ */
+int     mpl_reset_stats
+        
+        (Morphy m);
+
+
+/*!
+ 
+ @brief Sets the space allowed for a cache of first downpass sets.
+ 
+ @discussion The first downpass sets of a node depend only on the subtree
+ below it. With the cache on, mpl_first_down_recon keeps the sets and steps of
+ recently seen subtrees and copies them back whenever the same subtree is seen
+ again, so that scoring many related trees, such as a posterior sample,
+ mostly recalculates only the clades that differ. Subtrees are identified by
+ a 64-bit hash of their topology. When the cache is full, the subtree used
+ least recently is dropped. The cache is emptied whenever the weights or the
+ included characters change, and is rebuilt by mpl_apply_tipdata. A node
+ whose first downpass sets are changed by any other nodal function isn't
+ looked up again until its first downpass is redone.
+ 
+ @param maxbytes The most memory the cache may use, or 0 to turn it off.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return 0 if success, ERR_BAD_PARAM if maxbytes is too small to hold the
+ sets of even one node, or another Morphy error code.
+ 
+ */
+int     mpl_set_downpass_cache
+        
+        (const size_t   maxbytes,
+         Morphy         m);
+
+
+/*!
+ 
+ @brief Retrieves the number of first downpass calls answered from the cache
+ and the number that missed it.
+ 
+ @discussion The counts are zeroed whenever the cache is emptied. Calls for
+ nodes with a descendant whose sets aren't known to be those of its subtree
+ are counted as neither.
+ 
+ @param hits Set to the number of calls answered from the cache.
+ 
+ @param misses Set to the number of calls that had to be recalculated.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return 0 if success, ERR_NO_DATA if the cache is off, or another Morphy
+ error code.
+ 
+ */
+int     mpl_get_downpass_cache_counts
+        
+        (unsigned long long*    hits,
+         unsigned long long*    misses,
+         Morphy                 m);
+
+/*!
+ 
+ @brief Builds a tree by stepwise addition.
+ 
+ @discussion Starting from a tree of the first two taxa, each remaining taxon
+ is added to the branch where it adds the fewest steps. The costs of all the
+ branches are found in a single sweep of insertion costs per taxon. Where that
+ sweep reports inapplicable characters needing recalculation, the placements
+ that could be best are checked with a full pass. Ties go to the first branch
+ found. The tree is returned as a parent vector (see mpl_spr_search), and on
+ return the nodal state sets are those of the tree.
+ 
+ @param addseq The order in which taxa are added.
+ 
+ @param seed Seeds the random order of addition; ignored for other orders.
+ The same seed always gives the same tree.
+ 
+ @param tree Space for the 2 * ntax - 1 entries of the parent vector.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The length of the tree, or a negative error code.
+ 
+ */
+int     mpl_stepwise_addition
+        
+        (const MPLaddseq_t        addseq,
+         const unsigned long long seed,
+         int*                     tree,
+         Morphy                   m);
+
+
+/*!
+ 
+ @brief Searches for the shortest trees by subtree pruning and regrafting
+ (SPR), starting from a given tree.
+ 
+ @discussion Trees are given as parent vectors of 2 * ntax - 1 entries: tips
+ are numbered 0 to ntax - 1, internal nodes ntax to 2 * ntax - 2, and the root
+ is the only node whose parent is -1. The subtree below each node in turn is
+ moved to every other branch, and any shorter tree found replaces the current
+ one, until no move gives an improvement. Trees as short as the best are kept
+ while there is room for them, and are only stored once however they are
+ rooted. The tip data must have been applied with at least ntax internal
+ nodes. On return, the nodal state sets are those of one of the best trees.
+ 
+ @param start The parent vector of the starting tree.
+ 
+ @param maxtrees The maximum number of trees to be returned.
+ 
+ @param trees Space for maxtrees parent vectors, into which the best trees
+ found are written.
+ 
+ @param ntrees Set to the number of trees written.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The length of the best trees, or a negative error code.
+ 
+ */
+int     mpl_spr_search
+        
+        (const int* start,
+         const int  maxtrees,
+         int*       trees,
+         int*       ntrees,
+         Morphy     m);
+
+
+/*!
+ 
+ @brief Searches for the shortest trees by tree bisection and reconnection
+ (TBR), starting from a given tree.
+ 
+ @discussion As mpl_spr_search, except that each subtree that is moved is
+ also rerooted on each of its branches before it is reattached. This finds
+ shorter trees than SPR more often, at the cost of a longer search.
+ 
+ @param start The parent vector of the starting tree.
+ 
+ @param maxtrees The maximum number of trees to be returned.
+ 
+ @param trees Space for maxtrees parent vectors, into which the best trees
+ found are written.
+ 
+ @param ntrees Set to the number of trees written.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The length of the best trees, or a negative error code.
+ 
+ */
+int     mpl_tbr_search
+        
+        (const int* start,
+         const int  maxtrees,
+         int*       trees,
+         int*       ntrees,
+         Morphy     m);
+
+
+/*!
+ 
+ @brief Searches for the shortest trees with the parsimony ratchet.
+ 
+ @discussion After a TBR search from the starting tree, each iteration
+ doubles the weights of a random subset of the characters, searches by TBR
+ from the current tree under the new weights, then restores the weights and
+ searches again. The weights are changed in place, so an iteration costs about
+ as much as two TBR searches. Only trees found under the original weights are
+ returned. The search is reproducible from the seed.
+ 
+ @param start The parent vector of the starting tree (see mpl_spr_search).
+ 
+ @param niter The number of reweighting iterations.
+ 
+ @param upweight The probability that a character is upweighted in an
+ iteration, greater than 0 and at most 1.
+ 
+ @param seed Seeds the choice of characters to upweight.
+ 
+ @param maxtrees The maximum number of trees to be returned.
+ 
+ @param trees Space for maxtrees parent vectors, into which the best trees
+ found are written.
+ 
+ @param ntrees Set to the number of trees written.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The length of the best trees, or a negative error code.
+ 
+ */
+int     mpl_ratchet_search
+        
+        (const int*               start,
+         const int                niter,
+         const double             upweight,
+         const unsigned long long seed,
+         const int                maxtrees,
+         int*                     trees,
+         int*                     ntrees,
+         Morphy                   m);
+
+
+/*!
+ 
+ @brief Runs independent searches from trees built by random addition, on
+ several threads.
+ 
+ @discussion Each replicate builds a tree by stepwise addition in a random
+ order, then searches from it by SPR or TBR. The threads share the prepared
+ data and keep only their own nodal state sets, so the tip data must not be
+ changed while the search runs, and the nodal sets of m are left as they
+ were. The best trees of all the replicates are collected in one store, and
+ the length of those trees is shared between the threads, so that a replicate
+ that can't reach it doesn't collect the trees of its own optimum. Replicate
+ i starts from the tree given by seed + i whichever thread runs it.
+ 
+ @param nreps The number of replicates.
+ 
+ @param nthreads The number of threads, including the calling thread.
+ 
+ @param tbr Searches by TBR if true, otherwise by SPR.
+ 
+ @param seed Seeds the addition sequences.
+ 
+ @param maxtrees The maximum number of trees to be returned.
+ 
+ @param trees Space for maxtrees parent vectors (see mpl_spr_search), into
+ which the best trees found are written.
+ 
+ @param ntrees Set to the number of trees written.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The length of the best trees, or a negative error code.
+ 
+ */
+int     mpl_replicate_search
+        
+        (const int                nreps,
+         const int                nthreads,
+         const bool               tbr,
+         const unsigned long long seed,
+         const int                maxtrees,
+         int*                     trees,
+         int*                     ntrees,
+         Morphy                   m);
+
+
+/*!
+ 
+ @brief Finds the shortest trees by branch and bound.
+ 
+ @discussion The search is exact: the trees returned are the shortest there
+ are, up to maxtrees of them. Partial trees are abandoned once their length,
+ plus the fewest steps that the taxa not yet added must contribute, exceeds
+ the best length found. Only Fitch and Wagner characters without inapplicable
+ data contribute to this bound, so the search takes longer the more of the
+ other characters there are. The time taken grows very quickly with the
+ number of taxa, and depends on the data; around twenty taxa is a practical
+ limit for most matrices. Threads are used as in mpl_replicate_search, and the
+ nodal sets of m are left as they were.
+ 
+ @param nthreads The number of threads, including the calling thread.
+ 
+ @param maxtrees The maximum number of trees to be returned.
+ 
+ @param trees Space for maxtrees parent vectors (see mpl_spr_search), into
+ which the shortest trees are written.
+ 
+ @param ntrees Set to the number of trees written.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The length of the shortest trees, or a negative error code.
+ 
+ */
+int     mpl_branch_and_bound
+        
+        (const int              nthreads,
+         const int              maxtrees,
+         int*                   trees,
+         int*                   ntrees,
+         Morphy                 m);
+
+
+/*!
+ 
+ @brief Scores a batch of trees.
+ 
+ @discussion The trees are shared out between nthreads threads, each
+ evaluating through a copy of the nodal sets of m, so the sets of m are left
+ as they were and the results don't depend on the number of threads. A tree
+ that isn't a binary tree on all the taxa is given ERR_BAD_PARAM as its
+ length. The steps of each character are found by scoring the tree once for
+ every character, which takes much longer than finding the lengths alone.
+ Only the passes the lengths depend on are done: the first uppass only for
+ characters with inapplicable data or of the Dollo type, and the second
+ downpass only for those with inapplicable data.
+ 
+ @param ntrees The number of trees.
+ 
+ @param trees ntrees parent vectors (see mpl_spr_search), one after another.
+ 
+ @param nthreads The number of threads, including the calling thread.
+ 
+ @param lengths Space for the length of each tree.
+ 
+ @param charsteps NULL, or space for the unweighted steps of every character
+ of each tree, the characters of one tree after another. Excluded characters
+ are counted too. Nothing is written for a tree that can't be read.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return 0 if success, or a negative error code.
+ 
+ */
+int     mpl_score_trees
+        
+        (const int              ntrees,
+         const int*             trees,
+         const int              nthreads,
+         int*                   lengths,
+         int*                   charsteps,
+         Morphy                 m);
+
+
+/*!
+ 
+ @brief Scores a tree through the nodal sets of m.
+ 
+ @discussion All the passes are made, so that the sets at each node can then
+ be read with mpl_get_nodal_sets or mpl_get_stateset.
+ 
+ @param tree A parent vector (see mpl_spr_search).
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The length of the tree, or a negative error code: ERR_BAD_PARAM if
+ the vector isn't a binary tree on all the taxa.
+ 
+ */
+int     mpl_score_tree
+        
+        (const int*             tree,
+         Morphy                 m);
+
+
+/*!
+ 
+ @brief Finds the length of a tree rooted on each of its branches in turn.
+ 
+ @discussion Fitch and Wagner characters without inapplicable data, and
+ characters with symmetric step matrices, have the same length however the
+ tree is rooted, so they are scored only once. Dollo and irreversible
+ characters, and those with asymmetric step matrices, are scored on every
+ rooting at once, in one pass down the tree and one back up. Only characters
+ with inapplicable data are scored again for each rooting. Without them,
+ scanning all the rootings takes time proportional to the number of nodes
+ times the number of characters, as scoring the tree does. With them, it
+ takes time proportional to the square of the number of nodes. The nodal
+ sets of m are left as they were.
+ 
+ @param tree A parent vector (see mpl_spr_search).
+ 
+ @param lengths Space for 2 * ntax - 1 lengths, one for each node: the length
+ of the tree rooted on the branch above that node. The root and its two
+ children, whose branches are one branch of the unrooted tree, are given the
+ length of the tree as it is rooted.
+ 
+ @param charsteps NULL, or space for the unweighted steps of every character
+ of each of those rootings, the characters of one node after another.
+ Excluded characters are counted too.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return 0 if success, or a negative error code: ERR_BAD_PARAM if the vector
+ isn't a binary tree on all the taxa.
+ 
+ */
+int     mpl_score_rootings
+        
+        (const int*             tree,
+         int*                   lengths,
+         int*                   charsteps,
+         Morphy                 m);
+
+
+/*!
+ 
+ @brief Opens a file of Newick trees for reading one at a time.
+ 
+ @discussion Trees are read from the current position of the file, in chunks,
+ so that files of any size can be read. Each tree must be binary, except that
+ a trichotomy at the base, as in trees written unrooted, is resolved
+ arbitrarily. Branch lengths, comments and the labels of internal nodes are
+ ignored, as is anything before the first parenthesis of each tree, so the
+ trees of a NEXUS trees block can be read if their labels are translated.
+ Underscores and blanks in labels are treated as the same.
+ 
+ @param fp An open file, which is not closed by the reader.
+ 
+ @param ntax The number of taxa in each tree.
+ 
+ @param labels The label of each taxon, in the order of the matrix, or NULL if
+ the trees are labelled with taxon numbers from 1 to ntax.
+ 
+ @return The reader, or NULL if it could not be created or two of the labels
+ are the same.
+ 
+ */
+MPLnewick   mpl_open_newick_file
+            
+            (FILE*              fp,
+             const int          ntax,
+             const char* const* labels);
+
+
+/*!
+ 
+ @brief Opens a buffer of Newick trees, such as a file mapped into memory,
+ for reading one at a time.
+ 
+ @discussion As for mpl_open_newick_file. The buffer must not be changed or
+ freed while the reader is used.
+ 
+ @param buf The trees, which need not end with a null character.
+ 
+ @param size The number of characters in the buffer.
+ 
+ @param ntax The number of taxa in each tree.
+ 
+ @param labels The label of each taxon, or NULL if the trees are labelled with
+ taxon numbers from 1 to ntax.
+ 
+ @return The reader, or NULL if it could not be created or two of the labels
+ are the same.
+ 
+ */
+MPLnewick   mpl_open_newick_buffer
+            
+            (const char*        buf,
+             const size_t       size,
+             const int          ntax,
+             const char* const* labels);
+
+
+/*!
+ 
+ @brief Destroys a Newick reader, without closing its file.
+ 
+ @param nwk A reader opened by mpl_open_newick_file or mpl_open_newick_buffer.
+ 
+ @return Error code.
+ 
+ */
+int     mpl_close_newick(MPLnewick nwk);
+
+
+/*!
+ 
+ @brief Reads the next tree from a Newick reader.
+ 
+ @discussion If a tree can't be read, the rest of it is skipped, so that the
+ next call reads the tree after it.
+ 
+ @param parents Space for the 2 * ntax - 1 entries of the parent vector (see
+ mpl_spr_search).
+ 
+ @param nwk A reader opened by mpl_open_newick_file or mpl_open_newick_buffer.
+ 
+ @return 1 if a tree was read, 0 if there are no more trees, or a negative
+ error code: ERR_SYMBOL_MISMATCH for a label not in the list,
+ ERR_MATCHING_PARENTHS for unbalanced parentheses, ERR_CASE_NOT_IMPL for a
+ polytomy, and ERR_BAD_PARAM for a tree that doesn't have each taxon exactly
+ once.
+ 
+ */
+int     mpl_read_newick(int* parents, MPLnewick nwk);
+
+
+/*!
+ 
+ @brief Scores the trees of a Newick reader in turn.
+ 
+ @discussion Each tree is scored as it is read, without being copied into a
+ parent vector. A tree that can't be read is given its error code as its
+ length, and reading carries on with the next. The tip data must have been
+ applied with at least ntax internal nodes. Only the passes the lengths depend
+ on are done, so the nodal state sets are left incomplete: a tree whose sets
+ are wanted should be scored again with mpl_score_tree.
+ 
+ @param lengths Space for the lengths of up to maxtrees trees.
+ 
+ @param maxtrees The most trees to be read.
+ 
+ @param nwk A reader opened for the number of taxa of m.
+ 
+ @param m An instance of the Morphy object.
+ 
+ @return The number of trees read, which is less than maxtrees only if there
+ are no more, or a negative error code.
+ 
+ */
+int     mpl_score_newick
+        
+        (int*                   lengths,
+         const int              maxtrees,
+         MPLnewick              nwk,
+         Morphy                 m);
+
+
+/*!
+ 
+ @brief Writes the recorded timeline as a Chrome trace file.
+ 
+ @discussion Tracing is only available if the library was compiled with
+ MPL_TRACE defined (the MORPHY_TRACE option in CMake). Each thread records the
+ stages of mpl_apply_tipdata and runs of consecutive calls to the same nodal
+ function, such as a full downpass or a batch of insertion costs. The file can
+ be opened in chrome://tracing or Perfetto. No thread should be calling into
+ the library while the file is written. Each thread keeps only its most recent
+ events. A thread that starts after another has exited carries on in the
+ exited thread's buffer, so the two share a row of the timeline.
+ 
+ @param filename The path of the file to be written.
+ 
+ @return 0 if success, ERR_CASE_NOT_IMPL if the library was built without
+ tracing, or another Morphy error code.
+ 
+ */
+int     mpl_trace_dump
+        
+        (const char* filename);
+
+
+/*!
+ 
+ @brief Discards all recorded trace events.
+ 
+ @return 0 if success, ERR_CASE_NOT_IMPL if the library was built without
+ tracing.
+ 
+ */
+int     mpl_trace_clear
+        
+        (void);
+
 int mpl_first_down_recon_fasttemp
         (const int node_id, const int left_id, const int right_id, int cutoff, Morphy m);
         
@@ -0,0 +1,595 @@
+// Python bindings for MorphyLib.
+//
+// Trees, lengths and step counts are passed as objects supporting the buffer
+// protocol, such as numpy arrays of C ints, so they are read and written in
+// place rather than converted element by element. The interpreter lock is
+// released while a batch of trees is scored, as that only reads the handle,
+// so several Python threads can score trees at once. Anything that changes
+// the handle is refused while a batch is being scored.
+//
+// The packed state sets of a node can be viewed without copying. The sets
+// are reallocated when tip data are applied, so that is refused while any
+// view of them is held.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <limits.h>
+#include <stdbool.h>
+#include "mpl.h"
+
+static PyObject* MorphyError = NULL;
+
+typedef struct {
+    PyObject_HEAD
+    Morphy      handl;
+    Py_ssize_t  nbatches;   /* Batches being scored without the lock */
+    Py_ssize_t  nviews;     /* Buffers held over the nodal sets */
+} PyMorphy;
+
+/* Exports the sets of one node and pass as a read-only buffer. */
+typedef struct {
+    PyObject_HEAD
+    PyMorphy*               owner;
+    const unsigned long*    sets;
+    Py_ssize_t              nchar;
+    Py_ssize_t              itemsize;
+} PyMorphySets;
+
+static PyTypeObject PyMorphyType;
+static PyTypeObject PyMorphySetsType;
+
+
+static PyObject* pymorphy_error(const int err)
+{
+    const char* msg = NULL;
+
+    switch (err) {
+        case ERR_INVALID_SYMBOL:    msg = "invalid symbol"; break;
+        case ERR_UNEXP_NULLPTR:     msg = "unexpected NULL pointer"; break;
+        case ERR_BAD_PARAM:         msg = "bad parameter"; break;
+        case ERR_BAD_MALLOC:        msg = "memory allocation failed"; break;
+        case ERR_NO_DATA:           msg = "no data"; break;
+        case ERR_DIMENS_OVER:       msg = "dimensions overestimate the data"; break;
+        case ERR_DIMENS_UNDER:      msg = "dimensions underestimate the data"; break;
+        case ERR_NO_DIMENSIONS:     msg = "no dimensions"; break;
+        case ERR_ATTEMPT_OVERWRITE: msg = "attempt to overwrite data"; break;
+        case ERR_MATCHING_PARENTHS: msg = "unmatched parentheses"; break;
+        case ERR_SYMBOL_MISMATCH:   msg = "symbol mismatch"; break;
+        case ERR_UNKNOWN_CHTYPE:    msg = "unknown character type"; break;
+        case ERR_CASE_NOT_IMPL:     msg = "case not implemented"; break;
+        case ERR_OUT_OF_BOUNDS:     msg = "out of bounds"; break;
+        case ERR_EX_DATA_CONF:      msg = "conflicts with existing data"; break;
+        default:                    msg = "error"; break;
+    }
+
+    PyObject* args = Py_BuildValue("(is)", err, msg);
+
+    if (args) {
+        PyErr_SetObject(MorphyError, args);
+        Py_DECREF(args);
+    }
+
+    return NULL;
+}
+
+/* Returns the result of a call as an int, or raises MorphyError. */
+static PyObject* pymorphy_result(const int ret)
+{
+    if (ret < 0) {
+        return pymorphy_error(ret);
+    }
+
+    return PyLong_FromLong(ret);
+}
+
+/* Checks that the handle can be changed. Calls that reallocate the nodal
+ * sets must also wait until no view of them is held. */
+static bool pymorphy_can_change(PyMorphy* self, const bool realloc)
+{
+    if (self->nbatches) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "the Morphy object is scoring a batch of trees");
+        return false;
+    }
+    if (realloc && self->nviews) {
+        PyErr_SetString(PyExc_BufferError,
+                        "views of the nodal sets are still held");
+        return false;
+    }
+
+    return true;
+}
+
+/* Gets a contiguous buffer of C ints. */
+static int pymorphy_get_ints
+(PyObject* obj, Py_buffer* view, const bool writable, const char* name)
+{
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    const char* f = NULL;
+
+    if (writable) {
+        flags |= PyBUF_WRITABLE;
+    }
+
+    if (PyObject_GetBuffer(obj, view, flags) < 0) {
+        return -1;
+    }
+
+    f = view->format ? view->format : "B";
+    if (*f == '@' || *f == '=' || (PY_LITTLE_ENDIAN && *f == '<') ||
+        (!PY_LITTLE_ENDIAN && (*f == '>' || *f == '!'))) {
+        ++f;
+    }
+
+    if (view->itemsize != sizeof(int) || strcmp(f, "i")) {
+        PyBuffer_Release(view);
+        PyErr_Format(PyExc_TypeError, "%s must be a buffer of C ints", name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int PyMorphy_init(PyMorphy* self, PyObject* args, PyObject* kwds)
+{
+    static char* kwlist[] = {"ntax", "nchar", NULL};
+    int ntax = 0;
+    int nchar = 0;
+    int ret = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ii", kwlist, &ntax, &nchar)) {
+        return -1;
+    }
+    if (!pymorphy_can_change(self, true)) {
+        return -1;
+    }
+
+    if (self->handl) {
+        mpl_delete_Morphy(self->handl);
+    }
+
+    if (!(self->handl = mpl_new_Morphy())) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    if ((ret = mpl_init_Morphy(ntax, nchar, self->handl)) < 0) {
+        pymorphy_error(ret);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void PyMorphy_dealloc(PyMorphy* self)
+{
+    if (self->handl) {
+        mpl_delete_Morphy(self->handl);
+    }
+
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* PyMorphy_attach_rawdata(PyMorphy* self, PyObject* args)
+{
+    const char* matrix = NULL;
+
+    if (!PyArg_ParseTuple(args, "s", &matrix) ||
+        !pymorphy_can_change(self, true)) {
+        return NULL;
+    }
+
+    return pymorphy_result(mpl_attach_rawdata(matrix, self->handl));
+}
+
+static PyObject* PyMorphy_attach_symbols(PyMorphy* self, PyObject* args)
+{
+    const char* symbols = NULL;
+
+    if (!PyArg_ParseTuple(args, "s", &symbols) ||
+        !pymorphy_can_change(self, true)) {
+        return NULL;
+    }
+
+    return pymorphy_result(mpl_attach_symbols(symbols, self->handl));
+}
+
+static PyObject* PyMorphy_set_parsim_t(PyMorphy* self, PyObject* args)
+{
+    int charid = 0;
+    int chtype = 0;
+
+    if (!PyArg_ParseTuple(args, "ii", &charid, &chtype) ||
+        !pymorphy_can_change(self, false)) {
+        return NULL;
+    }
+
+    return pymorphy_result(mpl_set_parsim_t(charid, (MPLchtype)chtype,
+                                            self->handl));
+}
+
+static PyObject* PyMorphy_set_gaphandl(PyMorphy* self, PyObject* args)
+{
+    int gaptype = 0;
+
+    if (!PyArg_ParseTuple(args, "i", &gaptype) ||
+        !pymorphy_can_change(self, false)) {
+        return NULL;
+    }
+
+    return pymorphy_result(mpl_set_gaphandl((MPLgap_t)gaptype, self->handl));
+}
+
+static PyObject* PyMorphy_set_charac_weight(PyMorphy* self, PyObject* args)
+{
+    int charid = 0;
+    double weight = 0.0;
+
+    if (!PyArg_ParseTuple(args, "id", &charid, &weight) ||
+        !pymorphy_can_change(self, false)) {
+        return NULL;
+    }
+
+    return pymorphy_result(mpl_set_charac_weight(charid, weight, self->handl));
+}
+
+static PyObject* PyMorphy_incl_charac(PyMorphy* self, PyObject* args)
+{
+    int charid = 0;
+
+    if (!PyArg_ParseTuple(args, "i", &charid) ||
+        !pymorphy_can_change(self, false)) {
+        return NULL;
+    }
+
+    return pymorphy_result(mpl_incl_charac(charid, self->handl));
+}
+
+static PyObject* PyMorphy_excl_charac(PyMorphy* self, PyObject* args)
+{
+    int charid = 0;
+
+    if (!PyArg_ParseTuple(args, "i", &charid) ||
+        !pymorphy_can_change(self, false)) {
+        return NULL;
+    }
+
+    return pymorphy_result(mpl_excl_charac(charid, self->handl));
+}
+
+static PyObject* PyMorphy_set_num_internal_nodes(PyMorphy* self, PyObject* args)
+{
+    int nnodes = 0;
+
+    if (!PyArg_ParseTuple(args, "i", &nnodes) ||
+        !pymorphy_can_change(self, true)) {
+        return NULL;
+    }
+
+    return pymorphy_result(mpl_set_num_internal_nodes(nnodes, self->handl));
+}
+
+static PyObject* PyMorphy_apply_tipdata(PyMorphy* self, PyObject* noargs)
+{
+    if (!pymorphy_can_change(self, true)) {
+        return NULL;
+    }
+
+    return pymorphy_result(mpl_apply_tipdata(self->handl));
+}
+
+static PyObject* PyMorphy_score(PyMorphy* self, PyObject* args)
+{
+    PyObject* tree = NULL;
+    Py_buffer tv;
+    int ret = 0;
+
+    if (!PyArg_ParseTuple(args, "O", &tree) ||
+        !pymorphy_can_change(self, false) ||
+        pymorphy_get_ints(tree, &tv, false, "tree") < 0) {
+        return NULL;
+    }
+
+    if (tv.len / (Py_ssize_t)sizeof(int)
+        != 2 * mpl_get_numtaxa(self->handl) - 1) {
+        PyBuffer_Release(&tv);
+        PyErr_SetString(PyExc_ValueError,
+                        "tree must have 2 * ntax - 1 entries");
+        return NULL;
+    }
+
+    ret = mpl_score_tree((const int*)tv.buf, self->handl);
+    PyBuffer_Release(&tv);
+
+    return pymorphy_result(ret);
+}
+
+static PyObject* PyMorphy_score_trees
+(PyMorphy* self, PyObject* args, PyObject* kwds)
+{
+    static char* kwlist[] = {"trees", "lengths", "charsteps", "nthreads", NULL};
+    PyObject* trees = NULL;
+    PyObject* lengths = NULL;
+    PyObject* charsteps = Py_None;
+    int nthreads = 1;
+    int size = 2 * mpl_get_numtaxa(self->handl) - 1;
+    int nchar = mpl_get_num_charac(self->handl);
+    int ret = 0;
+    Py_ssize_t ntrees = 0;
+    Py_buffer tv;
+    Py_buffer lv;
+    Py_buffer cv;
+    int* steps = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|Oi", kwlist, &trees,
+                                     &lengths, &charsteps, &nthreads)) {
+        return NULL;
+    }
+    if (size < 3) {
+        return pymorphy_error(ERR_NO_DATA);
+    }
+
+    if (pymorphy_get_ints(trees, &tv, false, "trees") < 0) {
+        return NULL;
+    }
+    if (pymorphy_get_ints(lengths, &lv, true, "lengths") < 0) {
+        PyBuffer_Release(&tv);
+        return NULL;
+    }
+    if (charsteps != Py_None) {
+        if (pymorphy_get_ints(charsteps, &cv, true, "charsteps") < 0) {
+            PyBuffer_Release(&tv);
+            PyBuffer_Release(&lv);
+            return NULL;
+        }
+        steps = (int*)cv.buf;
+    }
+
+    ntrees = tv.len / (Py_ssize_t)sizeof(int) / size;
+
+    if (ntrees * size != tv.len / (Py_ssize_t)sizeof(int) || ntrees > INT_MAX) {
+        PyErr_SetString(PyExc_ValueError,
+                        "trees must hold whole vectors of 2 * ntax - 1 entries");
+        ret = -1;
+    }
+    else if (lv.len / (Py_ssize_t)sizeof(int) < ntrees ||
+             (steps && cv.len / (Py_ssize_t)sizeof(int) < ntrees * nchar)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "lengths or charsteps is too small for the trees");
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        ++self->nbatches;
+        Py_BEGIN_ALLOW_THREADS
+        ret = mpl_score_trees((int)ntrees, (const int*)tv.buf, nthreads,
+                              (int*)lv.buf, steps, self->handl);
+        Py_END_ALLOW_THREADS
+        --self->nbatches;
+
+        if (ret < 0) {
+            pymorphy_error(ret);
+        }
+    }
+
+    PyBuffer_Release(&tv);
+    PyBuffer_Release(&lv);
+    if (steps) {
+        PyBuffer_Release(&cv);
+    }
+
+    if (ret < 0) {
+        return NULL;
+    }
+
+    Py_INCREF(lengths);
+    return lengths;
+}
+
+static PyObject* PyMorphy_sets(PyMorphy* self, PyObject* args)
+{
+    int node = 0;
+    int pass = 0;
+    const unsigned long* sets = NULL;
+    PyMorphySets* exporter = NULL;
+    PyObject* view = NULL;
+
+    if (!PyArg_ParseTuple(args, "ii", &node, &pass)) {
+        return NULL;
+    }
+
+    if (!(sets = mpl_get_nodal_sets(node, pass, self->handl))) {
+        PyErr_SetString(PyExc_IndexError, "no such node or pass, or no tip "
+                        "data have been applied");
+        return NULL;
+    }
+
+    if (!(exporter = PyObject_New(PyMorphySets, &PyMorphySetsType))) {
+        return NULL;
+    }
+
+    Py_INCREF(self);
+    exporter->owner     = self;
+    exporter->sets      = sets;
+    exporter->nchar     = mpl_get_num_charac(self->handl);
+    exporter->itemsize  = sizeof(unsigned long);
+
+    view = PyMemoryView_FromObject((PyObject*)exporter);
+    Py_DECREF(exporter);
+
+    return view;
+}
+
+static PyObject* PyMorphy_get_ntax(PyMorphy* self, void* closure)
+{
+    return PyLong_FromLong(mpl_get_numtaxa(self->handl));
+}
+
+static PyObject* PyMorphy_get_nchar(PyMorphy* self, void* closure)
+{
+    return PyLong_FromLong(mpl_get_num_charac(self->handl));
+}
+
+
+static void PyMorphySets_dealloc(PyMorphySets* self)
+{
+    Py_XDECREF(self->owner);
+    PyObject_Del(self);
+}
+
+static int PyMorphySets_getbuffer(PyMorphySets* self, Py_buffer* view, int flags)
+{
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "the nodal sets are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+
+    Py_INCREF(self);
+    view->obj           = (PyObject*)self;
+    view->buf           = (void*)self->sets;
+    view->len           = self->nchar * self->itemsize;
+    view->readonly      = 1;
+    view->itemsize      = self->itemsize;
+    view->format        = flags & PyBUF_FORMAT ? "L" : NULL;
+    view->ndim          = 1;
+    view->shape         = flags & PyBUF_ND ? &self->nchar : NULL;
+    view->strides       = (flags & PyBUF_STRIDES) == PyBUF_STRIDES
+                          ? &self->itemsize : NULL;
+    view->suboffsets    = NULL;
+    view->internal      = NULL;
+
+    ++self->owner->nviews;
+
+    return 0;
+}
+
+static void PyMorphySets_releasebuffer(PyMorphySets* self, Py_buffer* view)
+{
+    --self->owner->nviews;
+}
+
+
+static PyMethodDef PyMorphy_methods[] = {
+    {"attach_rawdata", (PyCFunction)PyMorphy_attach_rawdata, METH_VARARGS,
+     "attach_rawdata(matrix)\n\nAttaches a matrix of tip data, ending with ';'."},
+    {"attach_symbols", (PyCFunction)PyMorphy_attach_symbols, METH_VARARGS,
+     "attach_symbols(symbols)\n\nSets the order of the state symbols."},
+    {"set_parsim_t", (PyCFunction)PyMorphy_set_parsim_t, METH_VARARGS,
+     "set_parsim_t(char, chtype)\n\nSets the type of a character, such as FITCH_T."},
+    {"set_gaphandl", (PyCFunction)PyMorphy_set_gaphandl, METH_VARARGS,
+     "set_gaphandl(gaptype)\n\nSets how gaps are treated, such as GAP_INAPPLIC."},
+    {"set_charac_weight", (PyCFunction)PyMorphy_set_charac_weight, METH_VARARGS,
+     "set_charac_weight(char, weight)\n\nSets the weight of a character."},
+    {"incl_charac", (PyCFunction)PyMorphy_incl_charac, METH_VARARGS,
+     "incl_charac(char)\n\nIncludes a character that was excluded."},
+    {"excl_charac", (PyCFunction)PyMorphy_excl_charac, METH_VARARGS,
+     "excl_charac(char)\n\nExcludes a character from the lengths."},
+    {"set_num_internal_nodes", (PyCFunction)PyMorphy_set_num_internal_nodes,
+     METH_VARARGS,
+     "set_num_internal_nodes(n)\n\nSets the number of internal nodes, which "
+     "must be at least ntax for trees to be scored."},
+    {"apply_tipdata", (PyCFunction)PyMorphy_apply_tipdata, METH_NOARGS,
+     "apply_tipdata()\n\nPrepares the data for scoring."},
+    {"score", (PyCFunction)PyMorphy_score, METH_VARARGS,
+     "score(tree)\n\nScores a parent vector of 2 * ntax - 1 C ints, in which "
+     "the root's parent is -1, leaving the sets of the tree at its nodes."},
+    {"score_trees", (PyCFunction)(void(*)(void))PyMorphy_score_trees,
+     METH_VARARGS | METH_KEYWORDS,
+     "score_trees(trees, lengths, charsteps=None, nthreads=1)\n\n"
+     "Scores parent vectors laid end to end in a buffer of C ints, writing "
+     "the length of each into lengths and, if it is given, the unweighted "
+     "steps of every character of each tree into charsteps. A tree that "
+     "can't be read is given a negative error code as its length. The "
+     "interpreter lock is released while the trees are scored. Returns "
+     "lengths."},
+    {"sets", (PyCFunction)PyMorphy_sets, METH_VARARGS,
+     "sets(node, pass)\n\nReturns a read-only memoryview of the packed state "
+     "sets of a node for a pass from 1 to 4, indexed by character, without "
+     "copying them."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef PyMorphy_getset[] = {
+    {"ntax", (getter)PyMorphy_get_ntax, NULL, "The number of taxa.", NULL},
+    {"nchar", (getter)PyMorphy_get_nchar, NULL, "The number of characters.",
+     NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyTypeObject PyMorphyType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "pymorphy.Morphy",
+    .tp_basicsize   = sizeof(PyMorphy),
+    .tp_dealloc     = (destructor)PyMorphy_dealloc,
+    .tp_flags       = Py_TPFLAGS_DEFAULT,
+    .tp_doc         = "Morphy(ntax, nchar)\n\nA Morphy object for a matrix "
+                      "of ntax taxa and nchar characters.",
+    .tp_methods     = PyMorphy_methods,
+    .tp_getset      = PyMorphy_getset,
+    .tp_init        = (initproc)PyMorphy_init,
+    .tp_new         = PyType_GenericNew,
+};
+
+static PyBufferProcs PyMorphySets_as_buffer = {
+    (getbufferproc)PyMorphySets_getbuffer,
+    (releasebufferproc)PyMorphySets_releasebuffer,
+};
+
+static PyTypeObject PyMorphySetsType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "pymorphy._NodalSets",
+    .tp_basicsize   = sizeof(PyMorphySets),
+    .tp_dealloc     = (destructor)PyMorphySets_dealloc,
+    .tp_flags       = Py_TPFLAGS_DEFAULT,
+    .tp_as_buffer   = &PyMorphySets_as_buffer,
+};
+
+static struct PyModuleDef pymorphymodule = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "pymorphy",
+    .m_doc  = "Bindings for MorphyLib.",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_pymorphy(void)
+{
+    PyObject* m = NULL;
+
+    if (PyType_Ready(&PyMorphyType) < 0 ||
+        PyType_Ready(&PyMorphySetsType) < 0) {
+        return NULL;
+    }
+
+    if (!(m = PyModule_Create(&pymorphymodule))) {
+        return NULL;
+    }
+
+    MorphyError = PyErr_NewExceptionWithDoc("pymorphy.MorphyError",
+                                            "An error code from MorphyLib, "
+                                            "with its description.",
+                                            NULL, NULL);
+
+    Py_INCREF(&PyMorphyType);
+    if (!MorphyError ||
+        PyModule_AddObject(m, "Morphy", (PyObject*)&PyMorphyType) < 0 ||
+        PyModule_AddObject(m, "MorphyError", MorphyError) < 0) {
+        Py_DECREF(&PyMorphyType);
+        Py_XDECREF(MorphyError);
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(MorphyError);
+
+    PyModule_AddIntConstant(m, "FITCH_T", FITCH_T);
+    PyModule_AddIntConstant(m, "WAGNER_T", WAGNER_T);
+    PyModule_AddIntConstant(m, "DOLLO_T", DOLLO_T);
+    PyModule_AddIntConstant(m, "IRREVERSIBLE_T", IRREVERSIBLE_T);
+    PyModule_AddIntConstant(m, "USERTYPE_T", USERTYPE_T);
+    PyModule_AddIntConstant(m, "GAP_INAPPLIC", GAP_INAPPLIC);
+    PyModule_AddIntConstant(m, "GAP_MISSING", GAP_MISSING);
+    PyModule_AddIntConstant(m, "GAP_NEWSTATE", GAP_NEWSTATE);
+
+    return m;
+}
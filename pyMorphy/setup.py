@@ -0,0 +1,30 @@
+# Builds the pymorphy extension with MorphyLib compiled in:
+#
+#     python setup.py build_ext --inplace
+
+import glob
+import os
+import sys
+
+from setuptools import Extension, setup
+
+here = os.path.dirname(os.path.abspath(__file__))
+os.chdir(here)
+
+libraries = [] if sys.platform == "win32" else ["m"]
+link_args = [] if sys.platform == "win32" else ["-pthread"]
+
+pymorphy = Extension(
+    "pymorphy",
+    sources=["pymorphymodule.c"] + sorted(glob.glob("../src/*.c")),
+    include_dirs=["../include", "../src"],
+    libraries=libraries,
+    extra_link_args=link_args,
+)
+
+setup(
+    name="pymorphy",
+    version="0.1",
+    description="Python bindings for MorphyLib",
+    ext_modules=[pymorphy],
+)
@@ -0,0 +1,393 @@
+//
+//  dollo.c
+//  morphylib
+//
+//  Dollo characters are treated as ordered series in which each derived state
+//  (or 'level') can be gained only once, but lost any number of times. Every
+//  state bit is read as a level: a terminal with state s has all levels up to
+//  and including s. The lowest state observed in the character is taken as
+//  ancestral. A level is gained once at the most recent common ancestor (MRCA)
+//  of the terminals possessing it, and lost once at the base of every maximal
+//  subtree inside that clade which has no terminals possessing it.
+//
+//  Nodal sets are used as follows:
+//      downpass1:          highest known state in the subtree (0 if none)
+//      downpass2:          lowest known state in the subtree (MISSING if none)
+//      uppass1:            final state
+//      uppass2:            levels present somewhere outside the subtree
+//      subtree_actives:    levels for which the node is inside the clade
+//      temp_downpass1:     when every rooting is scored, levels absent from
+//                          the subtree only beyond nodes possessing them
+//                          (empty at the tips)
+//
+//  Whether a level is lost on a branch depends on what lies outside the
+//  subtree, so steps are counted on the first uppass and the tip updates
+//  rather than on the downpass.
+//
+//  Seen unrooted, the nodes joining the terminals possessing a level form a
+//  subtree, and the rest of the tree falls into pieces hanging from it. Each
+//  piece with a terminal lacking the level needs a loss, except the piece
+//  holding the root, which lies outside the clade. The length of a level is
+//  therefore one gain plus the number of such pieces, less one if the root is
+//  in one of them, and only that last term depends on the rooting.
+//
+#include "mpl.h"
+#include "morphydefs.h"
+#include "morphy.h"
+#include "mplerror.h"
+#include "dollo.h"
+
+static inline MPLstate mpl_dollo_levels(const MPLstate s)
+{
+    return mpl_states_to_highest(mpl_known_state_or_none(s));
+}
+
+/* Levels known to be absent from at least one terminal in the subtree. */
+static inline MPLstate mpl_dollo_absences(const MPLstate lowest)
+{
+    return ~mpl_states_to_highest(mpl_known_state_or_missing(lowest));
+}
+
+static inline int mpl_dollo_count(MPLstate levels)
+{
+    unsigned long c = 0;
+    MORPHY_PORTABLE_POPCOUNTLL(c, levels);
+    return (int)c;
+}
+
+int mpl_dollo_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* lhigh     = lset->downpass1;
+    MPLstate* rhigh     = rset->downpass1;
+    MPLstate* llow      = lset->downpass2;
+    MPLstate* rlow      = rset->downpass2;
+    MPLstate* nhigh     = nset->downpass1;
+    MPLstate* nlow      = nset->downpass2;
+    MPLstate  l         = 0;
+    MPLstate  r         = 0;
+
+#pragma clang loop vectorize(enable)
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        l = mpl_known_state_or_none(lhigh[j]);
+        r = mpl_known_state_or_none(rhigh[j]);
+        nhigh[j] = l > r ? l : r;
+
+        l = mpl_known_state_or_missing(llow[j]);
+        r = mpl_known_state_or_missing(rlow[j]);
+        nlow[j] = l < r ? l : r;
+    }
+
+    return 0;
+}
+
+
+int mpl_dollo_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int steps = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* nfin      = nset->uppass1;
+    MPLstate* nout      = nset->uppass2;
+    MPLstate* nclade    = nset->subtree_actives;
+    MPLstate* anc       = ancset->uppass1;
+    MPLstate* aclade    = ancset->subtree_actives;
+    MPLstate  lp        = 0;
+    MPLstate  rp        = 0;
+    MPLstate  la        = 0;
+    MPLstate  ra        = 0;
+    MPLstate  both      = 0;
+    MPLstate  present   = 0;
+    MPLstate  changes   = 0;
+    MPLstate  atnode    = 0;
+
+    unsigned long* weights = part->intwts;
+
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        lp = mpl_dollo_levels(lset->downpass1[j]);
+        rp = mpl_dollo_levels(rset->downpass1[j]);
+        la = mpl_dollo_absences(lset->downpass2[j]);
+        ra = mpl_dollo_absences(rset->downpass2[j]);
+        both    = lp & rp;
+        present = lp | rp;
+
+        // A descendant lacking a level is a loss if this node is in the clade,
+        // which (given the other descendant has it) means the level also
+        // occurs outside this subtree. A level on both sides but nowhere else
+        // is gained here.
+        changes = (((~lp & la & rp) | (~rp & ra & lp)) & nout[j])
+                  | (both & ~nout[j]);
+        steps += weights[i] * mpl_dollo_count(changes);
+
+        lset->uppass2[j] = nout[j] | rp;
+        rset->uppass2[j] = nout[j] | lp;
+
+        nclade[j] = both | (nout[j] & present) | (~present & aclade[j]);
+
+        atnode  = present & (nout[j] | both);
+        nfin[j] = atnode ? mpl_highest_state(atnode) : anc[j];
+    }
+
+    return steps;
+}
+
+
+int mpl_dollo_tip_update
+(MPLndsets* tset, MPLndsets* ancset, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int steps = 0;
+    int* indices        = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* tprelim   = tset->downpass1;
+    MPLstate* tfinal    = tset->uppass1;
+    MPLstate* tout      = tset->uppass2;
+    MPLstate* tclade    = tset->subtree_actives;
+    MPLstate* astates   = ancset->uppass1;
+    MPLstate* aclade    = ancset->subtree_actives;
+    MPLstate  state     = 0;
+    MPLstate  present   = 0;
+
+    unsigned long* weights = part->intwts;
+
+    for (i = nchars; i--;) {
+
+        j = indices[i];
+
+        state   = mpl_known_state_or_none(tprelim[j]);
+        present = mpl_states_to_highest(state);
+
+        // Levels found in this terminal and nowhere else are gained on its
+        // branch.
+        steps += weights[i] * mpl_dollo_count(present & ~tout[j]);
+
+        tclade[j] = present | aclade[j];
+        tfinal[j] = state ? state : astates[j];
+    }
+
+    return steps;
+}
+
+
+int mpl_dollo_update_root
+(MPLndsets* lower, MPLndsets* upper, MPLpartition* part)
+{
+    int i = 0;
+    int j = 0;
+    int nchar = part->ncharsinpart;
+    int *indices = part->charindices;
+    MPLstate ancestral = 0;
+
+    for (i = 0; i < nchar; ++i) {
+
+        j = indices[i];
+
+        // The lowest known state is taken as ancestral: its levels are present
+        // before the root and are never counted as gains.
+        ancestral = mpl_known_state_or_missing(upper->downpass2[j]);
+
+        lower->downpass1[j]         = upper->downpass1[j];
+        lower->downpass2[j]         = upper->downpass2[j];
+        lower->uppass1[j]           = ancestral;
+        lower->uppass2[j]           = mpl_states_to_highest(ancestral);
+        lower->subtree_actives[j]   = 0;
+        upper->uppass2[j]           = mpl_states_to_highest(ancestral);
+    }
+
+    return 0;
+}
+
+
+int mpl_dollo_one_branch
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int length = 0;
+    int* indices     = part->charindices;
+    int nchars       = part->ncharsinpart;
+    MPLstate tstate  = 0;
+    MPLstate tlow    = 0;
+    MPLstate nlow    = 0;
+    MPLstate tp      = 0;
+    MPLstate np      = 0;
+    MPLstate ancestral = 0;
+
+    unsigned long* weights = part->intwts;
+
+    for (i = nchars; i--;) {
+
+        j = indices[i];
+
+        // The root lies on the branch between the tip and the node
+        tstate  = mpl_known_state_or_none(tipanc->downpass1[j]);
+        tlow    = mpl_known_state_or_missing(tipanc->downpass1[j]);
+        nlow    = mpl_known_state_or_missing(node->downpass2[j]);
+        tp      = mpl_states_to_highest(tstate);
+        np      = mpl_dollo_levels(node->downpass1[j]);
+        ancestral = mpl_states_to_highest(tlow < nlow ? tlow : nlow);
+
+        // No descendant of the root can be a loss. Every level in the tip is
+        // gained either at the root or on the tip's own branch.
+        length += weights[i] * mpl_dollo_count(tp & ~ancestral);
+
+        tipanc->uppass2[j]          = ancestral | np;
+        tipanc->subtree_actives[j]  = (tp & np) | ancestral;
+        tipanc->uppass1[j]          = tstate ? tstate : (tlow < nlow ? tlow : nlow);
+        node->uppass2[j]            = ancestral | tp;
+    }
+
+    return length;
+}
+
+
+/*!
+ @brief Finds the sets of a subtree for scoring it rooted on every branch.
+ @discussion As the downpass, but also finds the levels whose absences in the
+ subtree all lie beyond terminals or nodes possessing them, so that none of
+ them is in the same piece (see above) as the branch above the subtree.
+ @return 0, as the steps depend on the root.
+ */
+int mpl_dollo_edge_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* lhidden   = lset->temp_downpass1;
+    MPLstate* rhidden   = rset->temp_downpass1;
+    MPLstate* nhidden   = nset->temp_downpass1;
+    MPLstate  la        = 0;
+    MPLstate  ra        = 0;
+    MPLstate  both      = 0;
+
+    mpl_dollo_downpass(lset, rset, nset, part);
+
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        la   = mpl_dollo_absences(lset->downpass2[j]);
+        ra   = mpl_dollo_absences(rset->downpass2[j]);
+        both = mpl_dollo_levels(lset->downpass1[j])
+               & mpl_dollo_levels(rset->downpass1[j]);
+
+        // A node with the level on both sides cuts off every absence below
+        // it. Otherwise, absences on one side stay hidden only if there are
+        // none on the other.
+        nhidden[j] = (both & (la | ra))
+                     | (~both & ((lhidden[j] & ~ra) | (rhidden[j] & ~la)));
+    }
+
+    return 0;
+}
+
+
+/*!
+ @brief Calculates the length, less a constant, of a tree rooted on the
+ branch between two subtrees.
+ @discussion The sets of both must come from mpl_dollo_edge_downpass, each
+ seen from the other. A level found on only one side is missing from the
+ piece holding the root, so one fewer loss is needed if that piece has an
+ absence in it.
+ @return The number of losses saved, negated.
+ */
+int mpl_dollo_edge_root
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int steps = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate  lopen     = 0;
+    MPLstate  ropen     = 0;
+    MPLstate  saved     = 0;
+
+    unsigned long* weights = part->intwts;
+
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        lopen = mpl_dollo_absences(lset->downpass2[j]) & ~lset->temp_downpass1[j];
+        ropen = mpl_dollo_absences(rset->downpass2[j]) & ~rset->temp_downpass1[j];
+        saved = (mpl_dollo_levels(lset->downpass1[j])
+                 ^ mpl_dollo_levels(rset->downpass1[j])) & (lopen | ropen);
+
+        steps -= (int)(weights[i] * mpl_dollo_count(saved));
+    }
+
+    return steps;
+}
+
+
+/*!
+ @brief Estimates the length added by inserting a subtree on a branch.
+ @discussion Exact for gains and for losses at the insertion point itself.
+ When the inserted subtree shares levels with the target tree, the clades of
+ those levels can also grow above the insertion point or into the subtree.
+ Those extra losses depend on nodes away from the insertion and are not
+ counted, so the result is a lower bound. tgt1set must be the descendant end
+ of the target branch and tgt2set its immediate ancestor.
+ */
+int mpl_dollo_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen)
+{
+    int i     = 0;
+    int j     = 0;
+    int steps = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* dout      = tgt1set->uppass2;
+    MPLstate* aclade    = tgt2set->subtree_actives;
+    MPLstate  sp        = 0;
+    MPLstate  sa        = 0;
+    MPLstate  dp        = 0;
+    MPLstate  da        = 0;
+    MPLstate  added     = 0;
+
+    unsigned long* weights = part->intwts;
+
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        sp = mpl_dollo_levels(srcset->downpass1[j]);
+        sa = mpl_dollo_absences(srcset->downpass2[j]);
+        dp = mpl_dollo_levels(tgt1set->downpass1[j]);
+        da = mpl_dollo_absences(tgt1set->downpass2[j]);
+
+        // Source lacks the level and lands inside its clade
+        added = ~sp & sa & ((dp & dout[j]) | (~dp & ~da & aclade[j]));
+        // Source carries the level and the target becomes a new loss
+        added |= sp & ~dp & da & dout[j] & ~aclade[j];
+        // Source carries a level not found anywhere in the target tree
+        added |= sp & ~dp & ~dout[j];
+
+        steps += weights[i] * mpl_dollo_count(added);
+
+        if (domaxlen == true && steps > maxlen) {
+            return steps;
+        }
+    }
+
+    return steps;
+}
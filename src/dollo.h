@@ -0,0 +1,29 @@
+//
+//  dollo.h
+//  morphylib
+//
+//  Kernels for Dollo characters.
+//
+
+#ifndef dollo_h
+#define dollo_h
+
+int mpl_dollo_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part);
+int mpl_dollo_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part);
+int mpl_dollo_tip_update
+(MPLndsets* tset, MPLndsets* ancset, MPLpartition* part);
+int mpl_dollo_update_root
+(MPLndsets* lower, MPLndsets* upper, MPLpartition* part);
+int mpl_dollo_one_branch
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part);
+int mpl_dollo_edge_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part);
+int mpl_dollo_edge_root
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part);
+int mpl_dollo_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen);
+#endif /* dollo_h */
@@ -0,0 +1,337 @@
+//
+//  downcache.c
+//  morphylib
+//
+//  Each node carries the key of the subtree whose first downpass its sets hold.
+//  A tip's key is fixed, and an internal node's key is a mix of the sum of its
+//  descendants' keys, so that it is the same whichever way round they are, but
+//  differs between subtrees on the same tips that are resolved differently.
+//  A node whose sets were changed by anything other than a first downpass has
+//  no key, and nor do any of its ancestors until it gets one again.
+//
+//  Entries are kept in a hash table with chained buckets, and in a list from
+//  most to least recently used. When the cache is full, the least recently
+//  used entry is replaced.
+//
+#include <limits.h>
+#include "mpl.h"
+#include "morphydefs.h"
+#include "morphy.h"
+#include "mplerror.h"
+#include "downcache.h"
+
+
+static size_t mpl_downcache_entry_size(const MPLdowncache* c)
+{
+    return sizeof(MPLcacheentry) + sizeof(int)
+         + (c->haslow ? 2 : 1) * c->nchar * sizeof(MPLstate)
+         + c->ncosts * sizeof(MPLcost);
+}
+
+
+/*!
+ @brief Creates the cache for the partitions and nodes of a handle, replacing
+ any there was.
+ @discussion The number of entries is as many as fit in handl->cachebytes.
+ Must be called again whenever the partitions or nodal sets are rebuilt.
+ @return ERR_BAD_PARAM if not even one entry fits in the space allowed.
+ */
+int mpl_setup_downcache(Morphyp handl)
+{
+    int i = 0;
+    int ntax = handl->numtaxa;
+    size_t nsets = 0;
+    MPLpartition* stmx = mpl_get_stepmatrix_partition(handl);
+    MPLdowncache* c = NULL;
+
+    mpl_delete_downcache(handl);
+
+    if (!handl->cachebytes || !handl->statesets) {
+        return ERR_NO_ERROR;
+    }
+
+    if (!(c = (MPLdowncache*)calloc(1, sizeof(MPLdowncache)))) {
+        return ERR_BAD_MALLOC;
+    }
+
+    handl->downcache = c;
+
+    c->nchar    = handl->numcharacters;
+    c->numnodes = handl->numnodes;
+    c->ncosts   = stmx ? stmx->nstmxstates * stmx->ncharsinpart : 0;
+
+    for (i = 0; i < handl->numparts; ++i) {
+        if (handl->partitions[i]->chtype == DOLLO_T) {
+            c->haslow = true;
+        }
+    }
+
+    if (handl->cachebytes / mpl_downcache_entry_size(c) > INT_MAX / 2) {
+        c->nentries = INT_MAX / 2;
+    }
+    else {
+        c->nentries = (int)(handl->cachebytes / mpl_downcache_entry_size(c));
+    }
+
+    if (c->nentries < 1) {
+        mpl_delete_downcache(handl);
+        return ERR_BAD_PARAM;
+    }
+
+    c->nbuckets = 1;
+    while (c->nbuckets < c->nentries) {
+        c->nbuckets <<= 1;
+    }
+
+    nsets = (size_t)c->nentries * (c->haslow ? 2 : 1) * c->nchar;
+
+    c->buckets  = (int*)malloc(c->nbuckets * sizeof(int));
+    c->entries  = (MPLcacheentry*)calloc(c->nentries, sizeof(MPLcacheentry));
+    c->sets     = (MPLstate*)calloc(nsets, sizeof(MPLstate));
+    c->nodekeys = (unsigned long long*)calloc(c->numnodes,
+                                              sizeof(unsigned long long));
+    if (c->ncosts) {
+        c->costs = (MPLcost*)calloc((size_t)c->nentries * c->ncosts,
+                                    sizeof(MPLcost));
+    }
+
+    if (!c->buckets || !c->entries || !c->sets || !c->nodekeys ||
+        (c->ncosts && !c->costs)) {
+        mpl_delete_downcache(handl);
+        return ERR_BAD_MALLOC;
+    }
+
+    for (i = 0; i < ntax && i < c->numnodes; ++i) {
+        c->nodekeys[i] = mpl_mix_hash(i + 1) | 1;
+    }
+
+    mpl_downcache_clear(handl);
+
+    return ERR_NO_ERROR;
+}
+
+
+void mpl_delete_downcache(Morphyp handl)
+{
+    MPLdowncache* c = handl->downcache;
+
+    if (!c) {
+        return;
+    }
+
+    free(c->buckets);
+    free(c->entries);
+    free(c->sets);
+    free(c->costs);
+    free(c->nodekeys);
+    free(c);
+
+    handl->downcache = NULL;
+}
+
+
+/*!
+ @brief Empties the cache and zeroes its counters.
+ @discussion The steps held by the entries depend on the weights, so this must
+ be called whenever they change. The nodes keep their keys, as their sets are
+ still those of their subtrees.
+ */
+void mpl_downcache_clear(Morphyp handl)
+{
+    int i = 0;
+    MPLdowncache* c = handl->downcache;
+
+    if (!c) {
+        return;
+    }
+
+    for (i = 0; i < c->nbuckets; ++i) {
+        c->buckets[i] = -1;
+    }
+
+    c->nused    = 0;
+    c->newest   = -1;
+    c->oldest   = -1;
+    c->hits     = 0;
+    c->misses   = 0;
+}
+
+
+/* For a node whose first downpass sets have been changed in some other way. */
+void mpl_downcache_forget_node(const int node_id, Morphyp handl)
+{
+    if (handl->downcache) {
+        handl->downcache->nodekeys[node_id] = 0;
+    }
+}
+
+
+static void mpl_downcache_unlink(const int e, MPLdowncache* c)
+{
+    MPLcacheentry* ent = &c->entries[e];
+
+    if (ent->newer >= 0) {
+        c->entries[ent->newer].older = ent->older;
+    }
+    else {
+        c->newest = ent->older;
+    }
+    if (ent->older >= 0) {
+        c->entries[ent->older].newer = ent->newer;
+    }
+    else {
+        c->oldest = ent->newer;
+    }
+}
+
+
+static void mpl_downcache_push(const int e, MPLdowncache* c)
+{
+    MPLcacheentry* ent = &c->entries[e];
+
+    ent->newer  = -1;
+    ent->older  = c->newest;
+
+    if (c->newest >= 0) {
+        c->entries[c->newest].newer = e;
+    }
+    else {
+        c->oldest = e;
+    }
+
+    c->newest = e;
+}
+
+
+static void mpl_downcache_copy_in
+(const int e, MPLndsets* nset, Morphyp handl)
+{
+    int i = 0;
+    int k = 0;
+    int j = 0;
+    MPLdowncache* c = handl->downcache;
+    MPLpartition* part = NULL;
+    const MPLstate* sets = &c->sets[(size_t)e * (c->haslow ? 2 : 1) * c->nchar];
+    const MPLstate* low  = sets + c->nchar;
+
+    memcpy(nset->downpass1, sets, c->nchar * sizeof(MPLstate));
+
+    for (i = 0; i < handl->numparts; ++i) {
+
+        part = handl->partitions[i];
+
+        if (part->isNAtype == true) {
+            for (k = 0; k < part->ncharsinpart; ++k) {
+                j = part->charindices[k];
+                nset->temp_downpass1[j] = sets[j];
+                nset->changes[j]        = false;
+            }
+        }
+        else if (part->chtype == DOLLO_T) {
+            for (k = 0; k < part->ncharsinpart; ++k) {
+                j = part->charindices[k];
+                nset->downpass2[j] = low[j];
+            }
+        }
+    }
+
+    if (c->ncosts) {
+        memcpy(nset->downcosts, &c->costs[(size_t)e * c->ncosts],
+               c->ncosts * sizeof(MPLcost));
+    }
+}
+
+
+/*!
+ @brief Looks up the first downpass of a node from those of its descendants.
+ @discussion Whether or not the subtree is found, the node is given its key,
+ ready for the sets to be stored by mpl_downcache_store.
+ @return true if the sets and steps were found and copied into the node.
+ */
+bool mpl_downcache_fetch
+(const int node_id, const int left_id, const int right_id, int* steps,
+ Morphyp handl)
+{
+    int e = 0;
+    MPLdowncache* c = handl->downcache;
+    unsigned long long lkey = c->nodekeys[left_id];
+    unsigned long long rkey = c->nodekeys[right_id];
+    unsigned long long key  = 0;
+
+    if (!lkey || !rkey) {
+        c->nodekeys[node_id] = 0;
+        return false;
+    }
+
+    key = mpl_mix_hash(lkey + rkey) | 1;
+    c->nodekeys[node_id] = key;
+
+    for (e = c->buckets[key & (c->nbuckets - 1)]; e >= 0;
+         e = c->entries[e].chain) {
+        if (c->entries[e].key == key) {
+            break;
+        }
+    }
+
+    if (e < 0) {
+        ++c->misses;
+        return false;
+    }
+
+    if (e != c->newest) {
+        mpl_downcache_unlink(e, c);
+        mpl_downcache_push(e, c);
+    }
+
+    mpl_downcache_copy_in(e, handl->statesets[node_id], handl);
+    *steps = c->entries[e].steps;
+    ++c->hits;
+
+    return true;
+}
+
+
+/* Stores the sets just calculated for a node under the key given it by
+ * mpl_downcache_fetch. */
+void mpl_downcache_store(const int node_id, const int steps, Morphyp handl)
+{
+    int e = 0;
+    int* link = NULL;
+    MPLdowncache* c = handl->downcache;
+    MPLndsets* nset = handl->statesets[node_id];
+    unsigned long long key = c->nodekeys[node_id];
+    size_t nsets = (size_t)(c->haslow ? 2 : 1) * c->nchar;
+
+    if (!key) {
+        return;
+    }
+
+    if (c->nused < c->nentries) {
+        e = c->nused++;
+    }
+    else {
+        e = c->oldest;
+        mpl_downcache_unlink(e, c);
+        link = &c->buckets[c->entries[e].key & (c->nbuckets - 1)];
+        while (*link != e) {
+            link = &c->entries[*link].chain;
+        }
+        *link = c->entries[e].chain;
+    }
+
+    c->entries[e].key   = key;
+    c->entries[e].steps = steps;
+    c->entries[e].chain = c->buckets[key & (c->nbuckets - 1)];
+    c->buckets[key & (c->nbuckets - 1)] = e;
+    mpl_downcache_push(e, c);
+
+    memcpy(&c->sets[e * nsets], nset->downpass1, c->nchar * sizeof(MPLstate));
+    if (c->haslow) {
+        memcpy(&c->sets[e * nsets + c->nchar], nset->downpass2,
+               c->nchar * sizeof(MPLstate));
+    }
+    if (c->ncosts) {
+        memcpy(&c->costs[(size_t)e * c->ncosts], nset->downcosts,
+               c->ncosts * sizeof(MPLcost));
+    }
+}
@@ -0,0 +1,49 @@
+//
+//  downcache.h
+//  morphylib
+//
+//  A cache of first downpass results, keyed by the topology of the subtree
+//  below a node. The first downpass of a node depends only on its subtree, so
+//  when the same subtree turns up again, as it does in most of the trees of a
+//  posterior sample or a search, its sets can be copied rather than
+//  recalculated.
+//
+
+#ifndef downcache_h
+#define downcache_h
+
+typedef struct {
+    unsigned long long  key;
+    int                 steps;
+    int                 chain;  /*!< The next entry with the same bucket */
+    int                 newer;
+    int                 older;
+} MPLcacheentry;
+
+struct MPLdowncache {
+    int                 nentries;
+    int                 nused;
+    int                 nbuckets;
+    int*                buckets;
+    MPLcacheentry*      entries;
+    int                 newest;
+    int                 oldest;
+    int                 nchar;
+    bool                haslow;     /*!< Entries also hold the second downpass sets of Dollo characters */
+    int                 ncosts;     /*!< Step matrix costs held by an entry */
+    MPLstate*           sets;
+    MPLcost*            costs;
+    int                 numnodes;
+    unsigned long long* nodekeys;   /*!< The key of each node's current sets, or 0 if unknown */
+    unsigned long long  hits;
+    unsigned long long  misses;
+};
+
+int     mpl_setup_downcache(Morphyp handl);
+void    mpl_delete_downcache(Morphyp handl);
+void    mpl_downcache_clear(Morphyp handl);
+void    mpl_downcache_forget_node(const int node_id, Morphyp handl);
+bool    mpl_downcache_fetch(const int node_id, const int left_id, const int right_id, int* steps, Morphyp handl);
+void    mpl_downcache_store(const int node_id, const int steps, Morphyp handl);
+
+#endif /* downcache_h */
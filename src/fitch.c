@@ -12,16 +12,6 @@
 #include "fitch.h"
 #include "statedata.h"
 
-MPLstate* left;
-MPLstate* right;
-MPLstate* nifin;
-MPLstate* npre;
-MPLstate* npret;
-MPLstate* stacts;
-MPLstate* tstatcs;
-MPLstate* lacts;
-MPLstate* racts;
-
 /**/
 int mpl_fitch_downpass
 (MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part)
@@ -31,8 +21,8 @@ int mpl_fitch_downpass
     int steps = 0;
     const int* indices  = part->charindices;
     int nchars          = part->ncharsinpart;
-    left      = lset->downpass1;
-    right     = rset->downpass1;
+    MPLstate* left      = lset->downpass1;
+    MPLstate* right     = rset->downpass1;
     MPLstate* n         = nset->downpass1;
     
     unsigned long* weights = part->intwts;
@@ -64,8 +54,8 @@ int mpl_fitch_uppass
     int j     = 0;
     const int* indices  = part->charindices;
     int nchars      = part->ncharsinpart;
-    left  = lset->downpass1;
-    right = rset->downpass1;
+    MPLstate* left  = lset->downpass1;
+    MPLstate* right = rset->downpass1;
     MPLstate* npre  = nset->downpass1;
     MPLstate* nfin  = nset->uppass1;
     MPLstate* anc   = ancset->uppass1;
@@ -138,8 +128,8 @@ int mpl_NA_fitch_first_downpass
     int j               = 0;
     const int* indices  = part->charindices;
     int nchars          = part->ncharsinpart;
-    left      = lset->downpass1;
-    right     = rset->downpass1;
+    MPLstate* left      = lset->downpass1;
+    MPLstate* right     = rset->downpass1;
     MPLstate* n         = nset->downpass1;
     MPLstate* nt        = nset->temp_downpass1;
 
@@ -184,8 +174,8 @@ int mpl_nadown1_simpl
     int j               = 0;
     const int* indices  = part->charindices;
     int nchars          = part->ncharsinpart;
-    left      = lset->downpass1;
-    right     = rset->downpass1;
+    MPLstate* left      = lset->downpass1;
+    MPLstate* right     = rset->downpass1;
     MPLstate* n         = nset->downpass1;
     MPLstate* nt        = nset->temp_downpass1;
     
@@ -325,8 +315,8 @@ int mpl_NA_fitch_first_uppass
     int         j       = 0;
     const int*  indices = part->charindices;
     int         nchars  = part->ncharsinpart;
-    left    = lset->downpass1;
-    right   = rset->downpass1;
+    MPLstate* left    = lset->downpass1;
+    MPLstate* right   = rset->downpass1;
     MPLstate*   npre    = nset->downpass1;
     MPLstate*   nifin   = nset->uppass1;
     MPLstate*   anc     = ancset->uppass1;
@@ -484,15 +474,15 @@ int mpl_NA_fitch_second_downpass
     int             steps   = 0;
     const int*      indices = part->charindices;
     int             nchars  = part->ncharsinpart;
-    left    = lset->downpass2;
-    right   = rset->downpass2;
-    nifin   = nset->uppass1;
-    npre    = nset->downpass2;
-    npret   = nset->temp_downpass2;
-    stacts  = nset->subtree_actives;
-    tstatcs = nset->temp_subtr_actives;
-    lacts   = lset->subtree_actives;
-    racts   = rset->subtree_actives;
+    MPLstate* left    = lset->downpass2;
+    MPLstate* right   = rset->downpass2;
+    MPLstate* nifin   = nset->uppass1;
+    MPLstate* npre    = nset->downpass2;
+    MPLstate* npret   = nset->temp_downpass2;
+    MPLstate* stacts  = nset->subtree_actives;
+    MPLstate* tstatcs = nset->temp_subtr_actives;
+    MPLstate* lacts   = lset->subtree_actives;
+    MPLstate* racts   = rset->subtree_actives;
     MPLstate        temp    = 0;
     unsigned long*  weights = part->intwts;
     
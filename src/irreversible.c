@@ -0,0 +1,192 @@
+//
+//  irreversible.c
+//  morphylib
+//
+//  Irreversible (Camin-Sokal) characters are ordered, and may only change
+//  towards higher states. The optimal state of an internal node is the lowest
+//  state found among its descendants. The steps at a node are therefore the
+//  distance between the states of its two descendants. The state sets stored
+//  at internal nodes are always single states. A set containing only MISSING
+//  indicates a subtree with no known data.
+//
+#include "mpl.h"
+#include "morphydefs.h"
+#include "morphy.h"
+#include "mplerror.h"
+#include "irreversible.h"
+
+/* Number of ordered steps between two single states, where lo <= hi. */
+static inline int mpl_irrev_distance(const MPLstate lo, const MPLstate hi)
+{
+    unsigned long c = 0;
+    MPLstate d = (hi - lo) & -(MPLstate)(hi != MISSING);
+    MORPHY_PORTABLE_POPCOUNTLL(c, d);
+    return (int)c;
+}
+
+int mpl_irreversible_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int steps = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* left      = lset->downpass1;
+    MPLstate* right     = rset->downpass1;
+    MPLstate* n         = nset->downpass1;
+    MPLstate  l         = 0;
+    MPLstate  r         = 0;
+    MPLstate  hi        = 0;
+
+    unsigned long* weights = part->intwts;
+
+#pragma clang loop vectorize(enable)
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        l = mpl_known_state_or_missing(left[j]);
+        r = mpl_known_state_or_missing(right[j]);
+
+        n[j] = l < r ? l : r;
+        hi   = l < r ? r : l;
+
+        steps += weights[i] * mpl_irrev_distance(n[j], hi);
+    }
+
+    return steps;
+}
+
+
+int mpl_irreversible_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* npre      = nset->downpass1;
+    MPLstate* nfin      = nset->uppass1;
+    MPLstate* anc       = ancset->uppass1;
+
+#pragma clang loop vectorize(enable)
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        // The downpass state is already optimal; a subtree with no known data
+        // takes its ancestor's state.
+        nfin[j] = npre[j] != MISSING ? npre[j] : anc[j];
+    }
+
+    return 0;
+}
+
+
+int mpl_irreversible_tip_update
+(MPLndsets* tset, MPLndsets* ancset, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int* indices        = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* tprelim   = tset->downpass1;
+    MPLstate* tfinal    = tset->uppass1;
+    MPLstate* astates   = ancset->uppass1;
+
+    for (i = nchars; i--;) {
+        j = indices[i];
+        tfinal[j] = tprelim[j] != MISSING ?
+                    mpl_highest_state(tprelim[j]) : astates[j];
+    }
+
+    return 0;
+}
+
+
+int mpl_irreversible_one_branch
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int length = 0;
+    int* indices     = part->charindices;
+    int nchars       = part->ncharsinpart;
+    MPLstate t       = 0;
+    MPLstate n       = 0;
+    MPLstate root    = 0;
+
+    unsigned long* weights = part->intwts;
+
+    for (i = nchars; i--;) {
+
+        j = indices[i];
+
+        t = mpl_known_state_or_missing(tipanc->downpass1[j]);
+        n = mpl_known_state_or_missing(node->downpass1[j]);
+
+        root    = t < n ? t : n;
+        length += weights[i] * mpl_irrev_distance(root, t < n ? n : t);
+
+        tipanc->uppass1[j] = t != MISSING ? t : root;
+        node->uppass1[j]   = n != MISSING ? n : root;
+    }
+
+    return length;
+}
+
+
+/*!
+ @brief Calculates the length added by inserting a subtree on a branch.
+ @discussion A subtree whose state lies at or above the ancestral end of the
+ target branch can be inserted without changing any other node, so the cost
+ is exact. A lower state forces every ancestor above that state down to it.
+ Only the change at the ancestral end is counted in that case, so the result
+ is a lower bound.
+ */
+int mpl_irreversible_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen)
+{
+    int i     = 0;
+    int j     = 0;
+    int steps = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* tgt1      = tgt1set->uppass1;
+    MPLstate* tgt2      = tgt2set->uppass1;
+    MPLstate* src       = srcset->downpass1;
+    MPLstate  s         = 0;
+    MPLstate  a         = 0;
+    MPLstate  d         = 0;
+
+    unsigned long* weights = part->intwts;
+
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        s = mpl_known_state_or_missing(src[j]);
+        a = tgt1[j] < tgt2[j] ? tgt1[j] : tgt2[j];
+        d = tgt1[j] < tgt2[j] ? tgt2[j] : tgt1[j];
+
+        if (s == MISSING || a == MISSING) {
+            continue;
+        }
+
+        if (s < a) {
+            steps += weights[i] * mpl_irrev_distance(s, a);
+        }
+        else if (s > d) {
+            steps += weights[i] * mpl_irrev_distance(d, s);
+        }
+
+        if (domaxlen == true && steps > maxlen) {
+            return steps;
+        }
+    }
+
+    return steps;
+}
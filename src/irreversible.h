@@ -0,0 +1,23 @@
+//
+//  irreversible.h
+//  morphylib
+//
+//  Kernels for irreversible (Camin-Sokal) characters.
+//
+
+#ifndef irreversible_h
+#define irreversible_h
+
+int mpl_irreversible_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part);
+int mpl_irreversible_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part);
+int mpl_irreversible_tip_update
+(MPLndsets* tset, MPLndsets* ancset, MPLpartition* part);
+int mpl_irreversible_one_branch
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part);
+int mpl_irreversible_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen);
+#endif /* irreversible_h */
@@ -12,6 +12,9 @@
 #include "statedata.h"
 #include "fitch.h"
 #include "wagner.h"
+#include "dollo.h"
+#include "irreversible.h"
+#include "sankoff.h"
 
 void *mpl_alloc(size_t size, int setval)
 {
@@ -273,6 +276,22 @@ void mpl_scale_all_intweights(Morphyp handl)
         
 }
 
+/*!
+ @brief Rescales the integer weights after the real weight of a character has
+ changed.
+ @discussion The common denominator is found afresh from the current weights,
+ starting from the default base, rather than grown from the last one. It
+ therefore shrinks again when fractional weights are replaced or removed, and
+ stays bounded however many changes are made. The weights are those a new
+ handle with the same real weights would be given.
+ @param handl A pointer to an instance of Morphy.
+ */
+void mpl_update_intweights(Morphyp handl)
+{
+    handl->wtbase = handl->usrwtbase ? handl->usrwtbase : DEFAULTWTBASE;
+    mpl_scale_all_intweights(handl);
+}
+
 //MPLarray* mpl_new_array(size_t elemsize)
 //{
 //    MPLarray *new = calloc(1, sizeof(MPLarray));
@@ -344,8 +363,13 @@ void mpl_assign_fitch_fxns(MPLpartition* part)
         part->tipupdaterecalc   = mpl_fitch_NA_tip_recalc_update;
         part->tiprootrecalc     = mpl_fitch_NA_first_one_branch;
         part->tiprootupdaterecalc = mpl_fitch_NA_second_one_branch_recalc;
+        part->rootupdate        = mpl_update_NA_root;
+        part->uplength          = true;
+        part->edgedownfxn       = NULL;
+        part->edgerootfxn       = NULL;
     }
     else {
+        part->uplength          = false;
         part->prelimfxn         = mpl_fitch_downpass;
         part->finalfxn          = mpl_fitch_uppass;
         part->tipupdate         = mpl_fitch_tip_update;
@@ -354,10 +378,14 @@ void mpl_assign_fitch_fxns(MPLpartition* part)
         part->inappdownfxn      = NULL; // Not necessary, but safe & explicit
         part->inappupfxn        = NULL;
         part->loclfxn           = mpl_fitch_local_reopt;
+        part->rootupdate        = mpl_update_root;
         part->downrecalc1       = NULL;
         part->uprecalc1         = NULL;
         part->inappdownrecalc2  = NULL;
         part->inapuprecalc2     = NULL;
+        // The length doesn't depend on the root
+        part->edgedownfxn       = NULL;
+        part->edgerootfxn       = NULL;
     }
 }
 
@@ -365,16 +393,32 @@ void mpl_assign_wagner_fxns(MPLpartition* part)
 {
     assert(part);
     
-//    if (part->isNAtype) {
-//        part->inappdownfxn  = NULL;
-//        part->inappupfxn    = NULL;
-//        part->prelimfxn     = NULL; 
-//        part->finalfxn      = NULL;
-//        part->tipupdate     = NULL;
-//        part->tipfinalize   = NULL;
-//        part->loclfxn       = NULL;
-//    }
-//    else {
+    if (part->isNAtype) {
+        // The first passes only find the applicable regions of the tree, so
+        // they are shared with the Fitch type.
+        part->inappdownfxn      = mpl_NA_wagner_second_downpass;
+        part->inappupfxn        = mpl_NA_wagner_second_uppass;
+        part->prelimfxn         = mpl_NA_fitch_first_downpass;
+        part->finalfxn          = mpl_NA_fitch_first_uppass;
+        part->tipupdate         = mpl_fitch_NA_tip_update;
+        part->tipfinalize       = mpl_fitch_NA_tip_finalize;
+        part->tiproot           = mpl_fitch_NA_first_one_branch;
+        part->tiprootfinal      = mpl_wagner_NA_second_one_branch;
+        part->loclfxn           = mpl_wagner_NA_local_reopt;
+        part->downrecalc1       = mpl_NA_fitch_first_update_downpass;
+        part->uprecalc1         = mpl_NA_fitch_first_update_uppass;
+        part->inappdownrecalc2  = mpl_NA_wagner_second_update_downpass;
+        part->inapuprecalc2     = mpl_NA_wagner_second_update_uppass;
+        part->tipupdaterecalc   = mpl_fitch_NA_tip_recalc_update;
+        part->tiprootrecalc     = mpl_fitch_NA_first_one_branch;
+        part->tiprootupdaterecalc = mpl_wagner_NA_second_one_branch_recalc;
+        part->rootupdate        = mpl_update_NA_root;
+        part->uplength          = true;
+        part->edgedownfxn       = NULL;
+        part->edgerootfxn       = NULL;
+    }
+    else {
+        part->uplength      = false;
         part->prelimfxn     = mpl_wagner_downpass;
         part->finalfxn      = mpl_wagner_uppass;
         part->tipupdate     = mpl_wagner_tip_update;
@@ -382,8 +426,79 @@ void mpl_assign_wagner_fxns(MPLpartition* part)
         part->tipfinalize   = NULL;
         part->inappdownfxn  = NULL; // Not necessary, but safe & explicit
         part->inappupfxn    = NULL;
-        part->loclfxn       = NULL;
-//    }
+        part->loclfxn       = mpl_wagner_local_reopt;
+        part->rootupdate    = mpl_update_root;
+        part->edgedownfxn   = NULL;
+        part->edgerootfxn   = NULL;
+    }
+}
+
+void mpl_assign_dollo_fxns(MPLpartition* part)
+{
+    assert(part);
+    
+    // Inapplicable tokens are converted to missing for this type, so there is
+    // no NA variant. Steps are counted on the uppass, so it is always needed.
+    part->uplength      = true;
+    part->prelimfxn     = mpl_dollo_downpass;
+    part->finalfxn      = mpl_dollo_uppass;
+    part->tipupdate     = mpl_dollo_tip_update;
+    part->tiproot       = mpl_dollo_one_branch;
+    part->rootupdate    = mpl_dollo_update_root;
+    part->loclfxn       = mpl_dollo_local_reopt;
+    part->edgedownfxn   = mpl_dollo_edge_downpass;
+    part->edgerootfxn   = mpl_dollo_edge_root;
+    part->tipfinalize   = NULL;
+    part->inappdownfxn  = NULL;
+    part->inappupfxn    = NULL;
+}
+
+void mpl_assign_irreversible_fxns(MPLpartition* part)
+{
+    assert(part);
+    
+    part->uplength      = false;
+    part->prelimfxn     = mpl_irreversible_downpass;
+    part->finalfxn      = mpl_irreversible_uppass;
+    part->tipupdate     = mpl_irreversible_tip_update;
+    part->tiproot       = mpl_irreversible_one_branch;
+    part->rootupdate    = mpl_update_root;
+    part->loclfxn       = mpl_irreversible_local_reopt;
+    // The length is the sum of the downpass steps, wherever the root is
+    part->edgedownfxn   = mpl_irreversible_downpass;
+    part->edgerootfxn   = mpl_irreversible_downpass;
+    part->tipfinalize   = NULL;
+    part->inappdownfxn  = NULL;
+    part->inappupfxn    = NULL;
+}
+
+void mpl_assign_sankoff_fxns(MPLpartition* part)
+{
+    assert(part);
+    
+    part->uplength      = false;
+    part->prelimfxn     = mpl_sankoff_downpass;
+    part->finalfxn      = mpl_sankoff_uppass;
+    part->tipupdate     = mpl_sankoff_tip_update;
+    part->tiproot       = mpl_sankoff_one_branch;
+    part->rootupdate    = mpl_sankoff_update_root;
+    part->loclfxn       = mpl_sankoff_local_reopt;
+    part->edgedownfxn   = mpl_sankoff_downpass;
+    part->edgerootfxn   = mpl_sankoff_downpass;
+    part->tipfinalize   = NULL;
+    part->inappdownfxn  = NULL;
+    part->inappupfxn    = NULL;
+}
+
+
+/*!
+ @brief Indicates whether a character type has an inapplicable-data algorithm.
+ @discussion Gaps in characters of types without one are treated as missing
+ data, regardless of the gap handling set on the handle.
+ */
+bool mpl_chtype_supports_NA(const MPLchtype chtype)
+{
+    return chtype == FITCH_T || chtype == WAGNER_T;
 }
 
 
@@ -404,8 +519,22 @@ int mpl_fetch_parsim_fxn_setter
                 *pars_assign = mpl_assign_wagner_fxns;
             }
             break;
+        case DOLLO_T:
+            if (pars_assign) {
+                *pars_assign = mpl_assign_dollo_fxns;
+            }
+            break;
+        case IRREVERSIBLE_T:
+            if (pars_assign) {
+                *pars_assign = mpl_assign_irreversible_fxns;
+            }
+            break;
+        case USERTYPE_T:
+            if (pars_assign) {
+                *pars_assign = mpl_assign_sankoff_fxns;
+            }
+            break;
             
-            // TODO: Implement other functions here
         default:
             err = ERR_CASE_NOT_IMPL;
             break;
@@ -465,6 +594,8 @@ int mpl_part_push_index(int newint, MPLpartition* part)
         }
     }
     
+    part->nchartotal = part->ncharsinpart;
+    
     return err;
 }
 
@@ -483,6 +614,7 @@ int mpl_part_remove_index(int index, MPLpartition* part)
         part->charindices[i] = part->charindices[i + 1];
     }
     part->charindices[i] = MPLCHARMAX; // Gives some clue if an error occurs
+    part->nchartotal = part->ncharsinpart;
     
     return 0;
 }
@@ -514,6 +646,14 @@ int mpl_delete_partition(MPLpartition* part)
             free(part->intwts);
             part->intwts = NULL;
         }
+        if (part->stepmatrices) {
+            free(part->stepmatrices);
+            part->stepmatrices = NULL;
+        }
+        if (part->costbuffer) {
+            free(part->costbuffer);
+            part->costbuffer = NULL;
+        }
         part->maxnchars     = 0;
         part->ncharsinpart  = 0;
         part->chtype        = NONE_T;
@@ -523,6 +663,9 @@ int mpl_delete_partition(MPLpartition* part)
         part->inappupfxn    = NULL;
         part->prelimfxn     = NULL;
         part->finalfxn      = NULL;
+        part->rootupdate    = NULL;
+        part->edgedownfxn   = NULL;
+        part->edgerootfxn   = NULL;
         part->next          = NULL;
         free(part);
         err = ERR_NO_ERROR;
@@ -551,6 +694,9 @@ int mpl_delete_all_partitions(Morphyp handl)
         }
         free(handl->partitions);
         handl->partitions = NULL;
+        free(handl->upparts);
+        handl->upparts = NULL;
+        handl->numupparts = 0;
         
         return ERR_NO_ERROR;
     }
@@ -631,7 +777,8 @@ int mpl_compare_partition_with_char_info
     }
     
     if (gaphandl == GAP_INAPPLIC) {
-        if (chinfo->ninapplics <= NACUTOFF) {
+        if (chinfo->ninapplics <= NACUTOFF ||
+            !mpl_chtype_supports_NA(chinfo->chtype)) {
             if (part->isNAtype) {
                 ++ret;
             }
@@ -724,6 +871,37 @@ int mpl_put_partitions_in_handle(MPLpartition* first, Morphyp handl)
     qsort(handl->partitions, handl->numparts, sizeof(MPLpartition*), mpl_compare_partitions);
     handl->partstack = first;
     
+    return mpl_collect_upparts(handl);
+}
+
+
+/*!
+ @brief Lists the partitions whose length needs the first uppass.
+ @discussion The list is kept in the order of the partitions. Its space is
+ allocated on first use and reused after that, as the partitions can only be
+ dropped from a handle that already has one.
+ */
+int mpl_collect_upparts(Morphyp handl)
+{
+    int i = 0;
+    
+    if (!handl->upparts) {
+        handl->upparts = (MPLpartition**)calloc(handl->numparts,
+                                                sizeof(MPLpartition*));
+        if (!handl->upparts) {
+            handl->numupparts = 0;
+            return ERR_BAD_MALLOC;
+        }
+    }
+    
+    handl->numupparts = 0;
+    
+    for (i = 0; i < handl->numparts; ++i) {
+        if (handl->partitions[i]->uplength) {
+            handl->upparts[handl->numupparts++] = handl->partitions[i];
+        }
+    }
+    
     return ERR_NO_ERROR;
 }
 
@@ -842,7 +1020,8 @@ int mpl_setup_partitions(Morphyp handl)
         else {
             bool hasNA = false;
             if (handl->gaphandl == GAP_INAPPLIC) {
-                if (chinfo->ninapplics > NACUTOFF) {
+                if (chinfo->ninapplics > NACUTOFF &&
+                    mpl_chtype_supports_NA(chinfo->chtype)) {
                     hasNA = true;
                 }
             }
@@ -1072,6 +1251,14 @@ void mpl_free_stateset(const int nchars, MPLndsets* statesets)
         free(statesets->changes);
         statesets->changes = NULL;
     }
+    if (statesets->downcosts) {
+        free(statesets->downcosts);
+        statesets->downcosts = NULL;
+    }
+    if (statesets->upcosts) {
+        free(statesets->upcosts);
+        statesets->upcosts = NULL;
+    }
     
     mpl_delete_nodal_strings(nchars, statesets);
     
@@ -1175,6 +1362,171 @@ int mpl_copy_data_into_tips(Morphyp handl)
     return ERR_NO_ERROR;
 }
 
+/*!
+ @brief Finds the step matrix partition, if there is one.
+ @discussion USERTYPE_T characters have no inapplicable variant, so they always
+ fall into a single partition.
+ */
+MPLpartition* mpl_get_stepmatrix_partition(Morphyp handl)
+{
+    int i = 0;
+    
+    for (i = 0; i < handl->numparts; ++i) {
+        if (handl->partitions[i]->chtype == USERTYPE_T) {
+            return handl->partitions[i];
+        }
+    }
+    
+    return NULL;
+}
+
+
+/*!
+ @brief Copies the step matrices of each USERTYPE_T character into their
+ partition.
+ @discussion The matrices are interleaved so that entry [a][b] of every
+ character is contiguous. Matrices smaller than the largest in the partition are
+ padded with states that can never be entered or left.
+ @return ERR_UNKNOWN_CHTYPE if a character has no step matrix.
+ */
+int mpl_setup_stepmatrices(Morphyp handl)
+{
+    int i = 0;
+    int a = 0;
+    int b = 0;
+    int nst = 0;
+    int dim = 0;
+    MPLcharinfo* chinfo = NULL;
+    MPLpartition* part  = mpl_get_stepmatrix_partition(handl);
+    
+    if (!part) {
+        return ERR_NO_ERROR;
+    }
+    
+    int nchars = part->ncharsinpart;
+    
+    for (i = 0; i < nchars; ++i) {
+        chinfo = &handl->charinfo[part->charindices[i]];
+        if (!chinfo->stepmatrix) {
+            return ERR_UNKNOWN_CHTYPE;
+        }
+        if (chinfo->stmxdim > nst) {
+            nst = chinfo->stmxdim;
+        }
+    }
+    
+    if (part->stepmatrices) {
+        free(part->stepmatrices);
+    }
+    if (part->costbuffer) {
+        free(part->costbuffer);
+    }
+    
+    part->nstmxstates   = nst;
+    part->stmxshift     = handl->gaphandl == GAP_MISSING ? 0 : 1;
+    part->stepmatrices  = (MPLcost*)calloc(nst * nst * nchars, sizeof(MPLcost));
+    part->costbuffer    = (MPLcost*)calloc(2 * nst * nchars, sizeof(MPLcost));
+    
+    if (!part->stepmatrices || !part->costbuffer) {
+        return ERR_BAD_MALLOC;
+    }
+    
+    for (i = 0; i < nchars; ++i) {
+        
+        chinfo  = &handl->charinfo[part->charindices[i]];
+        dim     = chinfo->stmxdim;
+        
+        for (a = 0; a < nst; ++a) {
+            for (b = 0; b < nst; ++b) {
+                if (a < dim && b < dim) {
+                    part->stepmatrices[(a * nst + b) * nchars + i]
+                    = chinfo->stepmatrix[a * dim + b];
+                }
+                else {
+                    part->stepmatrices[(a * nst + b) * nchars + i]
+                    = a == b ? 0 : MPLCOSTINF;
+                }
+            }
+        }
+    }
+    
+    return ERR_NO_ERROR;
+}
+
+
+/*!
+ @brief Allocates the cost vectors of every node and sets them in the tips.
+ @discussion A tip costs nothing in any of its observed states and is
+ impossible in any other. Missing data and gaps cost nothing in any state.
+ @return ERR_OUT_OF_BOUNDS if a tip has a state outside its step matrix.
+ */
+int mpl_setup_nodal_costs(Morphyp handl)
+{
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    int a = 0;
+    int ntax = mpl_get_numtaxa((Morphy)handl);
+    MPLstate s = 0;
+    MPLndsets* set = NULL;
+    MPLpartition* part  = mpl_get_stepmatrix_partition(handl);
+    
+    if (!part) {
+        return ERR_NO_ERROR;
+    }
+    
+    int nchars  = part->ncharsinpart;
+    int nst     = part->nstmxstates;
+    
+    for (i = 0; i < handl->numnodes; ++i) {
+        
+        set = handl->statesets[i];
+        
+        if (set->downcosts) {
+            free(set->downcosts);
+        }
+        if (set->upcosts) {
+            free(set->upcosts);
+        }
+        
+        set->downcosts  = (MPLcost*)calloc(nst * nchars, sizeof(MPLcost));
+        set->upcosts    = (MPLcost*)calloc(nst * nchars, sizeof(MPLcost));
+        
+        if (!set->downcosts || !set->upcosts) {
+            return ERR_BAD_MALLOC;
+        }
+    }
+    
+    for (i = 0; i < ntax; ++i) {
+        
+        set = handl->statesets[i];
+        
+        for (k = 0; k < nchars; ++k) {
+            
+            j = part->charindices[k];
+            s = set->downpass1[j];
+            
+            if (s == MISSING || s == UNKNOWN || !(s >> part->stmxshift)) {
+                continue;
+            }
+            
+            s >>= part->stmxshift;
+            
+            if (handl->charinfo[j].stmxdim < (int)MAXSTATES &&
+                s >> handl->charinfo[j].stmxdim) {
+                return ERR_OUT_OF_BOUNDS;
+            }
+            
+            for (a = 0; a < nst; ++a) {
+                set->downcosts[a * nchars + k] = (s >> a) & 1 ? 0 : MPLCOSTINF;
+            }
+        }
+    }
+    
+    return ERR_NO_ERROR;
+}
+
+
 int mpl_assign_intwts_to_partitions(Morphyp handl)
 {
     int i = 0;
@@ -1198,13 +1550,288 @@ int mpl_assign_intwts_to_partitions(Morphyp handl)
         
         for (j = 0; j < handl->partitions[i]->ncharsinpart; ++j) {
             int charindex = handl->partitions[i]->charindices[j];
-            handl->partitions[i]->intwts[j] = handl->charinfo[charindex].intwt;
+            handl->partitions[i]->intwts[j] = mpl_get_active_intwt(charindex,
+                                                                   handl);
         }
     }
     
     return 0;
 }
 
+/* Copies the characters' integer weights into the partitions' existing weight
+ * vectors, for when the weights change after the tip data were applied. */
+void mpl_refresh_intwts_in_partitions(Morphyp handl)
+{
+    int i = 0;
+    int j = 0;
+    int numparts = mpl_get_numparts(handl);
+    MPLpartition* part = NULL;
+    
+    for (i = 0; i < numparts; ++i) {
+        part = handl->partitions[i];
+        for (j = 0; j < part->nchartotal; ++j) {
+            part->intwts[j] = mpl_get_active_intwt(part->charindices[j], handl);
+        }
+    }
+}
+
+/* Excluded characters are given no weight, so that they add nothing to the
+ * length even in partitions that can't be compacted. */
+unsigned long mpl_get_active_intwt(const int char_id, Morphyp handl)
+{
+    if (handl->charinfo[char_id].included == false) {
+        return 0;
+    }
+    
+    return handl->charinfo[char_id].intwt;
+}
+
+static void mpl_swap_int(int* a, int* b)
+{
+    int t = *a;
+    *a = *b;
+    *b = t;
+}
+
+/*!
+ @brief Moves a partition's included characters in front of its excluded ones.
+ @discussion Everything the evaluators index by a character's position in the
+ partition moves with it, and ncharsinpart becomes the number of included
+ characters, so the evaluators skip excluded characters without any change
+ to the nodal sets. Step matrix partitions keep their layout, because their
+ nodal costs are interleaved by position; their excluded characters are
+ still evaluated but have no weight.
+ @param part The partition to compact.
+ @param handl A pointer to an instance of Morphy.
+ */
+void mpl_compact_partition(MPLpartition* part, Morphyp handl)
+{
+    int i = 0;
+    int k = 0;
+    unsigned long w = 0;
+    
+    if (part->chtype == USERTYPE_T) {
+        for (i = 0; i < part->nchartotal; ++i) {
+            part->intwts[i] = mpl_get_active_intwt(part->charindices[i], handl);
+        }
+        return;
+    }
+    
+    part->ptminscore = 0;
+    
+    for (i = 0; i < part->nchartotal; ++i) {
+        
+        if (handl->charinfo[part->charindices[i]].included == false) {
+            continue;
+        }
+        
+        if (i != k) {
+            mpl_swap_int(&part->charindices[i], &part->charindices[k]);
+            mpl_swap_int(&part->nstates[i], &part->nstates[k]);
+            mpl_swap_int(&part->minscores[i], &part->minscores[k]);
+            mpl_swap_int(&part->steps_in_char[i], &part->steps_in_char[k]);
+            w = part->intwts[i];
+            part->intwts[i] = part->intwts[k];
+            part->intwts[k] = w;
+        }
+        
+        part->intwts[k] = handl->charinfo[part->charindices[k]].intwt;
+        part->ptminscore += part->minscores[k];
+        ++k;
+    }
+    
+    for (i = k; i < part->nchartotal; ++i) {
+        part->intwts[i] = 0;
+    }
+    
+    part->ncharsinpart = k;
+}
+
+/* Finds the partition holding a character and compacts it. */
+int mpl_compact_partition_of(const int char_id, Morphyp handl)
+{
+    int i = 0;
+    int j = 0;
+    int numparts = mpl_get_numparts(handl);
+    MPLpartition* part = NULL;
+    
+    for (i = 0; i < numparts; ++i) {
+        part = handl->partitions[i];
+        for (j = 0; j < part->nchartotal; ++j) {
+            if (part->charindices[j] == char_id) {
+                mpl_compact_partition(part, handl);
+                return ERR_NO_ERROR;
+            }
+        }
+    }
+    
+    return ERR_NO_DATA;
+}
+
+/* Frees what a worker owns: its partitions and their scratch buffers, but not
+ * the arrays they share with the handle the worker was made from. */
+static void mpl_delete_worker_partition(MPLpartition* p)
+{
+    free(p->update_indices);
+    free(p->update_NA_indices);
+    free(p->steps_in_char);
+    free(p->costbuffer);
+    free(p);
+}
+
+static void mpl_delete_worker_partitions(Morphyp w)
+{
+    int i = 0;
+    
+    if (!w->partitions) {
+        return;
+    }
+    
+    for (i = 0; i < w->numparts; ++i) {
+        if (w->partitions[i]) {
+            mpl_delete_worker_partition(w->partitions[i]);
+        }
+    }
+    
+    free(w->partitions);
+    w->partitions = NULL;
+}
+
+/*!
+ @brief Makes a handle through which another thread can evaluate the same data.
+ @discussion The character info, matrix, character indices, weights and step
+ matrices of src are shared, and must not change while the worker exists. The
+ worker has its own partitions, scratch buffers and nodal sets, with the tip
+ data copied in, so that it can be used alongside src and other workers
+ without any locking.
+ @param src A handle to which tip data have been applied.
+ @return The new handle, or NULL if memory could not be allocated.
+ */
+Morphyp mpl_new_worker(Morphyp src)
+{
+    int i = 0;
+    int n = 0;
+    MPLpartition* p = NULL;
+    Morphyp w = (Morphyp)calloc(1, sizeof(Morphy_t));
+    
+    if (!w) {
+        return NULL;
+    }
+    
+    *w = *src;
+    w->partstack        = NULL;
+    w->statesets        = NULL;
+    w->cachebytes       = 0;
+    w->downcache        = NULL;
+    w->nodesequence     = NULL;
+    w->upparts          = NULL;
+    w->numupparts       = 0;
+    w->steps_in_char    = (long*)calloc(src->numcharacters, sizeof(long));
+    w->partitions       = (MPLpartition**)calloc(src->numparts,
+                                                 sizeof(MPLpartition*));
+    
+    if (!w->steps_in_char || !w->partitions) {
+        mpl_delete_worker(w);
+        return NULL;
+    }
+    
+    for (i = 0; i < src->numparts; ++i) {
+        
+        if (!(p = (MPLpartition*)malloc(sizeof(MPLpartition)))) {
+            mpl_delete_worker(w);
+            return NULL;
+        }
+        
+        *p = *src->partitions[i];
+        p->next         = NULL;
+        p->ntoupdate    = 0;
+        p->nNAtoupdate  = 0;
+        p->costbuffer   = NULL;
+#ifdef MPL_STATS
+        memset(p->stats, 0, sizeof(p->stats));
+#endif
+        w->partitions[i] = p;
+        
+        n = p->nchartotal;
+        p->update_indices       = (int*)calloc(n, sizeof(int));
+        p->update_NA_indices    = (int*)calloc(n, sizeof(int));
+        p->steps_in_char        = (int*)calloc(n, sizeof(int));
+        
+        if (p->stepmatrices) {
+            p->costbuffer = (MPLcost*)calloc(2 * p->nstmxstates * n,
+                                             sizeof(MPLcost));
+        }
+        
+        if (!p->update_indices || !p->update_NA_indices || !p->steps_in_char
+            || (p->stepmatrices && !p->costbuffer)) {
+            mpl_delete_worker(w);
+            return NULL;
+        }
+    }
+    
+    if (mpl_collect_upparts(w) != ERR_NO_ERROR ||
+        mpl_setup_statesets(w) != ERR_NO_ERROR) {
+        mpl_delete_worker(w);
+        return NULL;
+    }
+    
+    mpl_copy_data_into_tips(w);
+    
+    if (mpl_setup_nodal_costs(w) != ERR_NO_ERROR) {
+        mpl_delete_worker(w);
+        return NULL;
+    }
+    
+    return w;
+}
+
+/*!
+ @brief Drops the partitions of a worker that are not wanted.
+ @discussion The nodal sets are left as they are, so the characters of the
+ dropped partitions are simply not evaluated by the worker.
+ @param keep Returns true for the partitions to be kept.
+ @param w A handle made by mpl_new_worker.
+ @return The number of partitions kept.
+ */
+int mpl_worker_keep_partitions
+(bool (*keep)(const MPLpartition* p, const Morphyp handl), Morphyp w)
+{
+    int i = 0;
+    int k = 0;
+    MPLpartition* p = NULL;
+    
+    for (i = 0; i < w->numparts; ++i) {
+        
+        p = w->partitions[i];
+        
+        if (keep(p, w)) {
+            w->partitions[k++] = p;
+        }
+        else {
+            mpl_delete_worker_partition(p);
+        }
+    }
+    
+    w->numparts = k;
+    mpl_collect_upparts(w);
+    
+    return k;
+}
+
+/* Destroys a handle made by mpl_new_worker. */
+void mpl_delete_worker(Morphyp w)
+{
+    if (!w) {
+        return;
+    }
+    
+    mpl_destroy_statesets(w);
+    mpl_delete_worker_partitions(w);
+    free(w->upparts);
+    free(w->steps_in_char);
+    free(w);
+}
+
 int mpl_update_root(MPLndsets* lower, MPLndsets* upper, MPLpartition* part)
 {
     int i = 0;
@@ -35,9 +35,11 @@ bool            mpl_almost_equal(double a, double b);
 bool            mpl_isreal(const double n);
 void            mpl_set_new_weight_public(const double wt, const int char_id, Morphyp handl);
 void            mpl_scale_all_intweights(Morphyp handl);
+void            mpl_update_intweights(Morphyp handl);
 MPLchtype*      mpl_get_charac_types(Morphyp handl);
 int             mpl_assign_partition_fxns(MPLpartition* part);
 int             mpl_fetch_parsim_fxn_setter (void(**pars_assign)(MPLpartition*), MPLchtype chtype);
+bool            mpl_chtype_supports_NA(const MPLchtype chtype);
 int             mpl_extend_intarray(int** array, size_t size);
 int             mpl_part_push_index(int newint, MPLpartition* part);
 int             mpl_part_remove_index(int index, MPLpartition* part);
@@ -45,6 +47,7 @@ int             mpl_delete_partition(MPLpartition* part);
 MPLpartition*   mpl_new_partition(const MPLchtype chtype, const bool hasNA);
 int             mpl_count_gaps_in_columns(Morphyp handl);
 int             mpl_put_partitions_in_handle(MPLpartition* first, Morphyp handl);
+int             mpl_collect_upparts(Morphyp handl);
 void            mpl_delete_all_update_buffers(Morphyp handl);
 int             mpl_allocate_update_buffers(Morphyp handl);
 int             mpl_setup_partitions(Morphyp handle);
@@ -57,6 +60,16 @@ int             mpl_setup_statesets(Morphyp handl);
 int             mpl_destroy_statesets(Morphyp handl);
 int             mpl_copy_data_into_tips(Morphyp handl);
 int             mpl_assign_intwts_to_partitions(Morphyp handl);
+void            mpl_refresh_intwts_in_partitions(Morphyp handl);
+unsigned long   mpl_get_active_intwt(const int char_id, Morphyp handl);
+void            mpl_compact_partition(MPLpartition* part, Morphyp handl);
+int             mpl_compact_partition_of(const int char_id, Morphyp handl);
+MPLpartition*   mpl_get_stepmatrix_partition(Morphyp handl);
+int             mpl_setup_stepmatrices(Morphyp handl);
+int             mpl_setup_nodal_costs(Morphyp handl);
+Morphyp         mpl_new_worker(Morphyp src);
+void            mpl_delete_worker(Morphyp w);
+int             mpl_worker_keep_partitions(bool (*keep)(const MPLpartition* p, const Morphyp handl), Morphyp w);
 int             mpl_update_root(MPLndsets* lower, MPLndsets* upper, MPLpartition* part);
 int             mpl_update_NA_root(MPLndsets* lower, MPLndsets* upper, MPLpartition* part);
 int             mpl_update_NA_root_recalculation(MPLndsets* lower, MPLndsets* upper, MPLpartition* part);
@@ -15,6 +15,7 @@ extern "C" {
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
     
 //#ifdef MPLDBL
 typedef double Mflt;
@@ -26,6 +27,7 @@ typedef double Mflt;
 //#endif
 
 typedef unsigned long MPLstate;
+typedef uint32_t MPLcost;   // Costs used by step matrix (Sankoff) characters
 
 //<<<<<<< HEAD
 #define NA              ((MPLstate)1)
@@ -49,6 +51,11 @@ typedef unsigned long MPLstate;
                                     this will be considered 0. */
 #define MPLWTMIN        (MPL_EPSILON * 10) /*! Safest (for me!) if calculations
                                                steer pretty clear of epsilon */
+#define MPLCOSTMAX      ((MPLcost)0xFFFF)   /*! Largest cost a caller can put in a
+                                                step matrix */
+#define MPLCOSTINF      ((MPLcost)0x3FFFFFFF) /*! An impossible state. Three of
+                                                  these can be summed without
+                                                  overflow. */
 
 #if defined(__GNUC__)
 #define MORPHY_PORTABLE_POPCOUNTLL(c, v) (c = __builtin_popcountl(v))
@@ -58,9 +65,61 @@ v = (v & (unsigned long)~(unsigned long)0/15*3) + ((v >> 2) & (unsigned long)~(u
 v = (v + (v >> 4)) & (unsigned long)~(unsigned long)0/255*15;\
 c = (unsigned long)(v * ((unsigned long)~(unsigned long)0/255)) >> (sizeof(unsigned long) - 1) * CHAR_BIT;
 #endif
-    
+
+/* Branch-free helpers for treating a state set as an ordered series. Each of
+ * these returns 0 for an empty set. */
+static inline MPLstate mpl_lowest_state(const MPLstate s)
+{
+    return s & (~s + 1);
+}
+
+/* All bits at or below the highest bit set in s. */
+static inline MPLstate mpl_states_to_highest(MPLstate s)
+{
+    s |= s >> 1;
+    s |= s >> 2;
+    s |= s >> 4;
+    s |= s >> 8;
+    s |= s >> 16;
+    s |= (s >> 16) >> 16; // Avoids an undefined shift if MPLstate is 32 bits
+    return s;
+}
+
+static inline MPLstate mpl_highest_state(const MPLstate s)
+{
+    MPLstate t = mpl_states_to_highest(s);
+    return t ^ (t >> 1);
+}
+
+/* Resolve a terminal set to a single state for the directional (Dollo and
+ * irreversible) types: polymorphic or uncertain sets take their highest state.
+ * Missing data resolve to either 0 or MISSING so that they drop out of a
+ * maximum or minimum respectively. Internal nodes of these types only ever
+ * store single states, so these are no-ops on them. */
+static inline MPLstate mpl_known_state_or_none(const MPLstate s)
+{
+    return mpl_highest_state(s) & -(MPLstate)(s != MISSING);
+}
+
+static inline MPLstate mpl_known_state_or_missing(const MPLstate s)
+{
+    return mpl_highest_state(s) | -(MPLstate)(s == MISSING);
+}
+
+/* Scrambles the bits of h, for building hash keys from small integers. */
+static inline unsigned long long mpl_mix_hash(unsigned long long h)
+{
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
+
 typedef struct MPLndsets MPLndsets;
 typedef struct MPLpartition MPLpartition;
+typedef struct MPLdowncache MPLdowncache;
 // Evaluator function pointers
 typedef int (*MPLdownfxn)
             (MPLndsets*     lset,
@@ -101,7 +160,7 @@ struct MPLcharinfo {
     int         charindex;
     int         ninapplics;
     int         nstates;
-//    bool        included;
+    bool        included;
     MPLchtype   chtype;
     double      realweight;
     unsigned long        basewt;
@@ -115,6 +174,8 @@ struct MPLcharinfo {
     Mflt         RCIndex;
     Mflt         HIndex;
     Mflt         RetIndex;
+    int          stmxdim;       /*!< Number of rows in the step matrix */
+    MPLcost*     stepmatrix;    /*!< User-supplied costs for a USERTYPE_T character */
     
 };
     
@@ -130,8 +191,10 @@ struct MPLpartition {
     
     MPLchtype       chtype;         /*!< The optimality type used for this partition. */
     bool            isNAtype;       /*!< This character should be treated as having inapplicable data. */ 
+    bool            uplength;       /*!< The first uppass is needed for the length, as it counts steps or feeds the second downpass */
     int             maxnchars;
-    int             ncharsinpart;
+    int             ncharsinpart;   /*!< The number of included characters, which come first in charindices */
+    int             nchartotal;     /*!< The number of characters, including excluded ones */
     int*            charindices;
     int*            nstates; /*!< The vector of state numbers of each character in this partition > */
     int*            minscores; /*!< The vector of minimum scores possible for each character in this partition > */
@@ -145,6 +208,10 @@ struct MPLpartition {
     bool            usingfltwt;
     unsigned long*  intwts;
     Mflt*           fltwts;
+    int             nstmxstates;    /*!< Number of states in the step matrices of a USERTYPE_T partition */
+    int             stmxshift;      /*!< Bit position of the first step matrix state */
+    MPLcost*        stepmatrices;   /*!< Step matrix costs, interleaved so that each entry is contiguous across characters */
+    MPLcost*        costbuffer;     /*!< Scratch space for the step matrix kernels */
     MPLtipfxn       tipupdate;
     MPLtipfxn       tipfinalize;
     MPLtipfxn       tiproot;        /*!< For the function that adds length at the base of an unrooted tree. */
@@ -153,6 +220,7 @@ struct MPLpartition {
     MPLtipfxn       tipfinalrecalc;
     MPLtipfxn       tiprootrecalc;
     MPLtipfxn       tiprootupdaterecalc;
+    MPLtipfxn       rootupdate;     /*!< Sets up the lower ('dummy') root of a rooted tree. */
     MPLdownfxn      inappdownfxn;
     MPLdownfxn      inappdownrecalc2;
     MPLupfxn        inappupfxn;
@@ -162,6 +230,11 @@ struct MPLpartition {
     MPLupfxn        finalfxn;
     MPLupfxn        uprecalc1;
     MPLloclfxn      loclfxn;
+    MPLdownfxn      edgedownfxn;    /*!< Sets of the subtree on one side of a branch, for scoring every rooting in two passes (NULL if that can't be done) */
+    MPLdownfxn      edgerootfxn;    /*!< Length, up to a constant, of the tree rooted between two such subtrees */
+#ifdef MPL_STATS
+    MPLstats        stats[PASS_MAX]; /*!< Hot-path counters for each pass */
+#endif
     MPLpartition*   next;
     
 };
@@ -182,6 +255,8 @@ struct MPLndsets {
     MPLstate*   temp_downpass2;
     MPLstate*   temp_uppass2;
     bool*       changes;
+    MPLcost*    downcosts;  /*!< Step matrix costs of the subtree for each state */
+    MPLcost*    upcosts;    /*!< Step matrix costs of the rest of the tree for each state */
     char**      downp1str;
     char**      downp2str;
     char**      upp1str;
@@ -218,6 +293,8 @@ typedef struct Morphy_t {
     int             numparts;   // The number of data type partitions
     MPLpartition*   partstack;  // A place for unused partitions
     MPLpartition**  partitions; // The array of partitions
+    int             numupparts; // The number of partitions whose length needs the first uppass
+    MPLpartition**  upparts;    // Those partitions, for scoring trees by length only
     MPLsymbols      symbols;    // The symbols used in the dataset
     MPLgap_t           gaphandl;   // The method of gap treatment
     union {
@@ -231,6 +308,8 @@ typedef struct Morphy_t {
     int*            nodesequence;   // The postorder sequence of nodes.
     int             nthreads;   // For programs that wish to multithread
     MPLndsets**     statesets;
+    size_t          cachebytes; // Space allowed for the downpass cache
+    MPLdowncache*   downcache;
     
 } Morphy_t, *Morphyp;
 
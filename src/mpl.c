@@ -11,6 +11,11 @@
 #include "morphy.h"
 #include "mplerror.h"
 #include "statedata.h"
+#include "mplstats.h"
+#include "mpltrace.h"
+#include "search.h"
+#include "downcache.h"
+#include "newick.h"
 
 // TODO: This is temporary
 #include "fitch.h"
@@ -38,6 +43,7 @@ int mpl_delete_Morphy(Morphy m)
     mpl_delete_charac_info(m1);
     mpl_delete_all_partitions(m1);
     mpl_destroy_statesets(m1);
+    mpl_delete_downcache(m1);
     free(m1);
     
     return ERR_NO_ERROR;
@@ -79,6 +85,9 @@ int mpl_init_Morphy(const int ntax, const int nchar, Morphy m)
         return ret;
     }
     
+    // Any existing character info is sized for the old number of characters
+    mpl_delete_charac_info(mi);
+    
     ret = mpl_set_num_charac(nchar, mi);
     if (ret) {
         return ret;
@@ -251,38 +260,106 @@ int mpl_apply_tipdata(Morphy m)
         return ERR_UNEXP_NULLPTR;
     }
     
+    int err = ERR_NO_ERROR;
     Morphyp mi = (Morphyp)m;
+    MPL_TRACE_BEGIN(t0);
+    MPL_TRACE_BEGIN(t1);
 
     // Create dictionary and convert
     mpl_create_state_dictionary(mi);
     mpl_convert_cells(mi);
+    MPL_TRACE_END("convert_cells", t1);
     
     // TODO: Check for existing partitions;
     // Call here
     
     // Setup the partitions
+    MPL_TRACE_BEGIN(t2);
     mpl_setup_partitions(mi);
     mpl_scale_all_intweights(mi);
     mpl_assign_intwts_to_partitions(mi);
+    MPL_TRACE_END("setup_partitions", t2);
     
     // Create all the internal data memory
+    MPL_TRACE_BEGIN(t3);
     mpl_setup_statesets(mi);
+    MPL_TRACE_END("setup_statesets", t3);
     
     // Apply the data to the tips
+    MPL_TRACE_BEGIN(t4);
     mpl_copy_data_into_tips(mi);
+    MPL_TRACE_END("copy_data_into_tips", t4);
     
-    return ERR_NO_ERROR;
+    // Step matrix characters also need cost vectors at every node
+    MPL_TRACE_BEGIN(t5);
+    if ((err = mpl_setup_stepmatrices(mi)) == ERR_NO_ERROR) {
+        err = mpl_setup_nodal_costs(mi);
+    }
+    MPL_TRACE_END("setup_costs", t5);
+    
+    // Tips hold data for every character, so that excluded characters can be
+    // included again without applying the data again.
+    int i = 0;
+    for (i = 0; i < mi->numparts; ++i) {
+        mpl_compact_partition(mi->partitions[i], mi);
+    }
+    
+    if (err == ERR_NO_ERROR) {
+        err = mpl_setup_downcache(mi);
+    }
+    MPL_TRACE_END("mpl_apply_tipdata", t0);
+    
+    return err;
 }
 
 
 //int     mpl_set_postorder(const int nodeID, const int index, Morphy m);
 //
 
-//int     mpl_incl_charac(const int charID, Morphy m);
-//
+static int mpl_set_charac_included
+(const int charID, const bool included, Morphy m)
+{
+    if (!m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    if (!mpl_get_num_charac(m)) {
+        return ERR_NO_DIMENSIONS;
+    }
+    
+    if (charID < 0 || charID >= mpl_get_num_charac(m)) {
+        return ERR_OUT_OF_BOUNDS;
+    }
+    
+    Morphyp mi = (Morphyp)m;
+    
+    if (mi->charinfo[charID].included == included) {
+        return ERR_NO_ERROR;
+    }
+    
+    mi->charinfo[charID].included = included;
+    
+    // Once the tip data are applied, only the character's partition changes
+    if (mi->partitions && mi->numparts && mi->partitions[0]->intwts) {
+        mpl_downcache_clear(mi);
+        return mpl_compact_partition_of(charID, mi);
+    }
+    
+    return ERR_NO_ERROR;
+}
+
+
+int mpl_incl_charac(const int charID, Morphy m)
+{
+    return mpl_set_charac_included(charID, true, m);
+}
+
+
+int mpl_excl_charac(const int charID, Morphy m)
+{
+    return mpl_set_charac_included(charID, false, m);
+}
 
-//int     mpl_excl_charac(const int charID, Morphy m);
-//
 
 int mpl_set_charac_weight(const int charID, const double weight, Morphy m)
 {
@@ -302,6 +379,13 @@ int mpl_set_charac_weight(const int charID, const double weight, Morphy m)
 //    mi->charinfo[charID].realweight = weight;
     mpl_set_new_weight_public(weight, charID, mi);
     
+    // Once the tip data are applied, only the weights need updating
+    if (mi->partitions && mi->numparts && mi->partitions[0]->intwts) {
+        mpl_update_intweights(mi);
+        mpl_refresh_intwts_in_partitions(mi);
+        mpl_downcache_clear(mi);
+    }
+    
     return ERR_NO_ERROR;
 }
 
@@ -362,6 +446,53 @@ int mpl_set_parsim_t(const int charID, const MPLchtype chtype, Morphy m)
 }
 
 
+int mpl_set_charac_stepmatrix
+(const int charID, const int nstates, const int* costs, Morphy m)
+{
+    if (!m || !costs) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    if (!mpl_get_num_charac(m)) {
+        return ERR_NO_DIMENSIONS;
+    }
+    
+    if (charID < 0 || charID >= mpl_get_num_charac(m)) {
+        return ERR_OUT_OF_BOUNDS;
+    }
+    
+    // One state is held back for gaps.
+    if (nstates < 1 || nstates >= (int)MAXSTATES) {
+        return ERR_BAD_PARAM;
+    }
+    
+    int i = 0;
+    for (i = 0; i < nstates * nstates; ++i) {
+        if (costs[i] < 0 || costs[i] > (int)MPLCOSTMAX) {
+            return ERR_BAD_PARAM;
+        }
+    }
+    
+    MPLcharinfo* chinfo = &((Morphyp)m)->charinfo[charID];
+    MPLcost* stmx = (MPLcost*)calloc(nstates * nstates, sizeof(MPLcost));
+    if (!stmx) {
+        return ERR_BAD_MALLOC;
+    }
+    
+    for (i = 0; i < nstates * nstates; ++i) {
+        stmx[i] = (MPLcost)costs[i];
+    }
+    
+    if (chinfo->stepmatrix) {
+        free(chinfo->stepmatrix);
+    }
+    chinfo->stepmatrix  = stmx;
+    chinfo->stmxdim     = nstates;
+    
+    return ERR_NO_ERROR;
+}
+
+
 // TODO: Document gap_t
 int mpl_set_gaphandl(const MPLgap_t gaptype, Morphy m)
 {
@@ -417,17 +548,34 @@ int mpl_first_down_recon
     MPLndsets*  rstates = handl->statesets[right_id];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLdownfxn downfxn = NULL;
     
     nstates->updated = false;
     
+    if (handl->downcache &&
+        mpl_downcache_fetch(node_id, left_id, right_id, &res, handl)) {
+        return res;
+    }
+    
+    MPL_TRACE_PASS(handl, PASS_FIRST_DOWN);
+    
     for (i = 0; i < numparts; ++i) {
         downfxn = handl->partitions[i]->prelimfxn;
-        res += downfxn(lstates, rstates, nstates, handl->partitions[i]);
+        MPL_STATS_START(t0);
+        steps = downfxn(lstates, rstates, nstates, handl->partitions[i]);
+        MPL_STATS_COUNT(handl->partitions[i], PASS_FIRST_DOWN,
+                        handl->partitions[i]->ncharsinpart, steps, t0);
+        res += steps;
+    }
+    
+    if (handl->downcache) {
+        mpl_downcache_store(node_id, res, handl);
     }
     
+    MPL_TRACE_PASS_END();
     return res; //
 }
 
@@ -444,22 +592,35 @@ int mpl_first_down_recon_fasttemp
     MPLndsets*  rstates = handl->statesets[right_id];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLdownfxn downfxn = NULL;
     
     nstates->updated = false;
     
+    // The sets are incomplete if the pass stops at the cutoff
+    mpl_downcache_forget_node(node_id, handl);
+    
+    MPL_TRACE_PASS(handl, PASS_FIRST_DOWN);
+    
     for (i = 0; i < numparts; ++i) {
         downfxn = handl->partitions[i]->prelimfxn;
-        res += downfxn(lstates, rstates, nstates, handl->partitions[i]);
+        MPL_STATS_START(t0);
+        steps = downfxn(lstates, rstates, nstates, handl->partitions[i]);
+        MPL_STATS_COUNT(handl->partitions[i], PASS_FIRST_DOWN,
+                        handl->partitions[i]->ncharsinpart, steps, t0);
+        res += steps;
         if (cutoff != UINT_MAX) {
             if (res > cutoff) {
+                MPL_STATS_CUTOFF(handl->partitions[i], PASS_FIRST_DOWN);
+                MPL_TRACE_PASS_END();
                 return res;
             }
         }
     }
     
+    MPL_TRACE_PASS_END();
     return res; //
 }
 
@@ -478,17 +639,25 @@ int mpl_first_up_recon
     MPLndsets*  astates = handl->statesets[anc_id];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLupfxn upfxn = NULL;
     
     nstates->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_FIRST_UP);
+    
     for (i = 0; i < numparts; ++i) {
         upfxn = handl->partitions[i]->finalfxn;
-        res += upfxn(lstates, rstates, nstates, astates, handl->partitions[i]);
+        MPL_STATS_START(t0);
+        steps = upfxn(lstates, rstates, nstates, astates, handl->partitions[i]);
+        MPL_STATS_COUNT(handl->partitions[i], PASS_FIRST_UP,
+                        handl->partitions[i]->ncharsinpart, steps, t0);
+        res += steps;
     }
     
+    MPL_TRACE_PASS_END();
     return res; //
 }
 
@@ -506,20 +675,28 @@ int mpl_second_down_recon
     MPLndsets*  rstates = handl->statesets[right_id];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLdownfxn downfxn = NULL;
     
     nstates->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_SECOND_DOWN);
+    
     for (i = 0; i < numparts; ++i) {
         downfxn = handl->partitions[i]->inappdownfxn;
         if (downfxn) {
-            res += downfxn(lstates, rstates, nstates, handl->partitions[i]);
+            MPL_STATS_START(t0);
+            steps = downfxn(lstates, rstates, nstates, handl->partitions[i]);
+            MPL_STATS_COUNT(handl->partitions[i], PASS_SECOND_DOWN,
+                            handl->partitions[i]->ncharsinpart, steps, t0);
+            res += steps;
         }
         downfxn = NULL;
     }
     
+    MPL_TRACE_PASS_END();
     return res;
 }
 
@@ -536,18 +713,27 @@ int mpl_second_down_recon_fasttemp
     MPLndsets*  rstates = handl->statesets[right_id];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLdownfxn downfxn = NULL;
     
     nstates->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_SECOND_DOWN);
+    
     for (i = 0; i < numparts; ++i) {
         downfxn = handl->partitions[i]->inappdownfxn;
         if (downfxn) {
-            res += downfxn(lstates, rstates, nstates, handl->partitions[i]);
+            MPL_STATS_START(t0);
+            steps = downfxn(lstates, rstates, nstates, handl->partitions[i]);
+            MPL_STATS_COUNT(handl->partitions[i], PASS_SECOND_DOWN,
+                            handl->partitions[i]->ncharsinpart, steps, t0);
+            res += steps;
             if (cutoff != UINT_MAX) {
                 if (res > cutoff) {
+                    MPL_STATS_CUTOFF(handl->partitions[i], PASS_SECOND_DOWN);
+                    MPL_TRACE_PASS_END();
                     return res;
                 }
             }
@@ -555,6 +741,7 @@ int mpl_second_down_recon_fasttemp
         downfxn = NULL;
     }
     
+    MPL_TRACE_PASS_END();
     return res;
 }
 
@@ -575,20 +762,28 @@ int mpl_second_up_recon
     MPLndsets*  astates = handl->statesets[anc_id];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLupfxn upfxn = NULL;
     
     nstates->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_SECOND_UP);
+    
     for (i = 0; i < numparts; ++i) {
         upfxn = handl->partitions[i]->inappupfxn;
         if (upfxn) {
-            res += upfxn(lstates, rstates, nstates, astates,
-                         handl->partitions[i]);
+            MPL_STATS_START(t0);
+            steps = upfxn(lstates, rstates, nstates, astates,
+                          handl->partitions[i]);
+            MPL_STATS_COUNT(handl->partitions[i], PASS_SECOND_UP,
+                            handl->partitions[i]->ncharsinpart, steps, t0);
+            res += steps;
         }
     }
     
+    MPL_TRACE_PASS_END();
     return res; //
 }
 
@@ -603,18 +798,27 @@ int mpl_update_tip(const int tip_id, const int anc_id, Morphy m)
     MPLndsets*  ancset  = handl->statesets[anc_id];
     
     int i = 0;
+    int steps = 0;
+    int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLtipfxn tipfxn = NULL;
     
     tipset->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_TIP_UPDATE);
+    
     for (i = 0; i < numparts; ++i) {
         tipfxn = handl->partitions[i]->tipupdate;
-        tipfxn(tipset, ancset, handl->partitions[i]);
+        MPL_STATS_START(t0);
+        steps = tipfxn(tipset, ancset, handl->partitions[i]);
+        MPL_STATS_COUNT(handl->partitions[i], PASS_TIP_UPDATE,
+                        handl->partitions[i]->ncharsinpart, steps, t0);
+        res += steps;
     }
 
     
-    return  ERR_NO_ERROR;
+    MPL_TRACE_PASS_END();
+    return res;
 }
 
 
@@ -629,19 +833,26 @@ int mpl_finalize_tip(const int tip_id, const int anc_id, Morphy m)
     MPLndsets*  ancset  = handl->statesets[anc_id];
     
     int i = 0;
+    int steps = 0;
     int numparts = mpl_get_numparts(handl);
     MPLtipfxn tipfxn = NULL;
     
     tipset->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_TIP_FINALIZE);
+    
     for (i = 0; i < numparts; ++i) {
         tipfxn = handl->partitions[i]->tipfinalize;
         if (tipfxn) {
-            tipfxn(tipset, ancset, handl->partitions[i]);
+            MPL_STATS_START(t0);
+            steps = tipfxn(tipset, ancset, handl->partitions[i]);
+            MPL_STATS_COUNT(handl->partitions[i], PASS_TIP_FINALIZE,
+                            handl->partitions[i]->ncharsinpart, steps, t0);
         }
     }
     
     
+    MPL_TRACE_PASS_END();
     return  ERR_NO_ERROR;
 }
 
@@ -660,12 +871,10 @@ int mpl_update_lower_root(const int l_root_id, const int root_id, Morphy m)
     int i = 0;
     int numparts = mpl_get_numparts(handl);
     
+    mpl_downcache_forget_node(l_root_id, handl);
+    
     for (i = 0; i < numparts; ++i) {
-        if (!parts[i]->isNAtype) {
-            mpl_update_root(lower, upper, parts[i]);
-        } else {
-            mpl_update_NA_root(lower, upper, parts[i]);
-        }
+        parts[i]->rootupdate(lower, upper, parts[i]);
     }
     
     return ERR_NO_ERROR;
@@ -684,17 +893,25 @@ int mpl_do_tiproot(const int tip_id, const int node_id, Morphy m)
     
     MPLtipfxn tiprootfxn = NULL;
     int i = 0;
+    int steps = 0;
     int numparts = mpl_get_numparts(handl);
     int res = 0;
     
     lower->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_TIPROOT);
+    
     for (i = 0; i < numparts; ++i) {
         
         tiprootfxn = parts[i]->tiproot;
-        res += tiprootfxn(lower, upper, parts[i]);
+        MPL_STATS_START(t0);
+        steps = tiprootfxn(lower, upper, parts[i]);
+        MPL_STATS_COUNT(parts[i], PASS_TIPROOT,
+                        parts[i]->ncharsinpart, steps, t0);
+        res += steps;
     }
     
+    MPL_TRACE_PASS_END();
     return res;
 }
 
@@ -712,18 +929,26 @@ int mpl_finalize_tiproot(const int tip_id, const int node_id, Morphy m)
     
     MPLtipfxn tiprootfxn = NULL;
     int i = 0;
+    int steps = 0;
     int numparts = mpl_get_numparts(handl);
     int res = 0;
     
     lower->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_TIPROOT);
+    
     for (i = 0; i < numparts; ++i) {
         if (handl->partitions[i]->isNAtype == true) {
             tiprootfxn = parts[i]->tiprootfinal;
-            res += tiprootfxn(lower, upper, parts[i]);
+            MPL_STATS_START(t0);
+            steps = tiprootfxn(lower, upper, parts[i]);
+            MPL_STATS_COUNT(parts[i], PASS_TIPROOT,
+                            parts[i]->ncharsinpart, steps, t0);
+            res += steps;
         }
     }
     
+    MPL_TRACE_PASS_END();
     return res;
 }
 
@@ -740,18 +965,26 @@ int mpl_na_tiproot_recalculation(const int tip_id, const int node_id, Morphy m)
     
     MPLtipfxn tiprootfxn = NULL;
     int i = 0;
+    int steps = 0;
     int numparts = mpl_get_numparts(handl);
     int res = 0;
     
     lower->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_NA_RECALC);
+    
     for (i = 0; i < numparts; ++i) {
         if (handl->partitions[i]->isNAtype == true) {
             tiprootfxn = parts[i]->tiprootrecalc;
-            res += tiprootfxn(lower, upper, parts[i]);
+            MPL_STATS_START(t0);
+            steps = tiprootfxn(lower, upper, parts[i]);
+            MPL_STATS_COUNT(parts[i], PASS_NA_RECALC,
+                            parts[i]->nNAtoupdate, steps, t0);
+            res += steps;
         }
     }
     
+    MPL_TRACE_PASS_END();
     return res;
 }
 
@@ -769,6 +1002,7 @@ int mpl_na_tiproot_final_recalculation
     
     MPLtipfxn tiprootfxn = NULL;
     int i = 0;
+    int steps = 0;
     int numparts = mpl_get_numparts(handl);
     int res = 0;
     
@@ -776,13 +1010,20 @@ int mpl_na_tiproot_final_recalculation
     
     lower->steps_to_recall = 0;
     
+    MPL_TRACE_PASS(handl, PASS_NA_RECALC);
+    
     for (i = 0; i < numparts; ++i) {
         if (handl->partitions[i]->isNAtype == true) {
             tiprootfxn = parts[i]->tiprootupdaterecalc;
-            res += tiprootfxn(lower, upper, parts[i]);
+            MPL_STATS_START(t0);
+            steps = tiprootfxn(lower, upper, parts[i]);
+            MPL_STATS_COUNT(parts[i], PASS_NA_RECALC,
+                            parts[i]->nNAtoupdate, steps, t0);
+            res += steps;
         }
     }
     
+    MPL_TRACE_PASS_END();
     return res;
 }
 
@@ -799,19 +1040,27 @@ int mpl_na_first_down_recalculation
     MPLndsets*  rstates = handl->statesets[right_id];
     
     int i = 0;
+    int steps = 0;
     //int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLdownfxn downfxn = NULL;
     
     nstates->updated = false;
+    mpl_downcache_forget_node(node_id, handl);
+    
+    MPL_TRACE_PASS(handl, PASS_NA_RECALC);
     
     for (i = 0; i < numparts; ++i) {
         if (handl->partitions[i]->isNAtype == true) {
             downfxn = handl->partitions[i]->downrecalc1;
-            downfxn(lstates, rstates, nstates, handl->partitions[i]);
+            MPL_STATS_START(t0);
+            steps = downfxn(lstates, rstates, nstates, handl->partitions[i]);
+            MPL_STATS_COUNT(handl->partitions[i], PASS_NA_RECALC,
+                            handl->partitions[i]->nNAtoupdate, steps, t0);
         }
     }
     
+    MPL_TRACE_PASS_END();
     return ERR_NO_ERROR;
 }
 
@@ -831,19 +1080,27 @@ int mpl_na_first_up_recalculation
     MPLndsets*  astates = handl->statesets[anc_id];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLupfxn upfxn = NULL;
     
     nstates->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_NA_RECALC);
+    
     for (i = 0; i < numparts; ++i) {
         if (handl->partitions[i]->isNAtype == true) {
             upfxn = handl->partitions[i]->uprecalc1; // Assign the appropriate recalculation function
-            upfxn(lstates, rstates, nstates, astates, handl->partitions[i]);
+            MPL_STATS_START(t0);
+            steps = upfxn(lstates, rstates, nstates, astates,
+                          handl->partitions[i]);
+            MPL_STATS_COUNT(handl->partitions[i], PASS_NA_RECALC,
+                            handl->partitions[i]->nNAtoupdate, steps, t0);
         }
     }
     
+    MPL_TRACE_PASS_END();
     return res; //
 }
 
@@ -861,6 +1118,7 @@ int mpl_na_second_down_recalculation
     MPLndsets*  rstates = handl->statesets[right_id];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLdownfxn downfxn = NULL;
@@ -868,13 +1126,20 @@ int mpl_na_second_down_recalculation
     nstates->updated            = false;
     nstates->steps_to_recall    = 0;
     
+    MPL_TRACE_PASS(handl, PASS_NA_RECALC);
+    
     for (i = 0; i < numparts; ++i) {
         if (handl->partitions[i]->isNAtype == true) {
             downfxn = handl->partitions[i]->inappdownrecalc2;
-            res += downfxn(lstates, rstates, nstates, handl->partitions[i]);
+            MPL_STATS_START(t0);
+            steps = downfxn(lstates, rstates, nstates, handl->partitions[i]);
+            MPL_STATS_COUNT(handl->partitions[i], PASS_NA_RECALC,
+                            handl->partitions[i]->nNAtoupdate, steps, t0);
+            res += steps;
         }
     }
     
+    MPL_TRACE_PASS_END();
     return res;
 }
 
@@ -894,6 +1159,7 @@ int mpl_na_second_up_recalculation
     MPLndsets*  astates = handl->statesets[anc_id];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLupfxn upfxn = NULL;
@@ -901,13 +1167,21 @@ int mpl_na_second_up_recalculation
     nstates->updated            = false;
     nstates->steps_to_recall    = 0;
     
+    MPL_TRACE_PASS(handl, PASS_NA_RECALC);
+    
     for (i = 0; i < numparts; ++i) {
         if (handl->partitions[i]->isNAtype == true) {
             upfxn = handl->partitions[i]->inapuprecalc2; // Assign the appropriate recalculation function
-            res += upfxn(lstates, rstates, nstates, astates, handl->partitions[i]);
+            MPL_STATS_START(t0);
+            steps = upfxn(lstates, rstates, nstates, astates,
+                          handl->partitions[i]);
+            MPL_STATS_COUNT(handl->partitions[i], PASS_NA_RECALC,
+                            handl->partitions[i]->nNAtoupdate, steps, t0);
+            res += steps;
         }
     }
     
+    MPL_TRACE_PASS_END();
     return res; //
 }
 
@@ -926,6 +1200,8 @@ int mpl_lower_root_recalculation(const int l_root_id, const int root_id, Morphy
     int i = 0;
     int numparts = mpl_get_numparts(handl);
     
+    mpl_downcache_forget_node(l_root_id, handl);
+    
     for (i = 0; i < numparts; ++i) {
         if (parts[i]->isNAtype) {
             mpl_update_NA_root_recalculation(lower, upper, parts[i]);
@@ -947,19 +1223,26 @@ int mpl_na_update_tip(const int tip_id, const int anc_id, Morphy m)
     MPLndsets*  ancset  = handl->statesets[anc_id];
     
     int i = 0;
+    int steps = 0;
     int numparts = mpl_get_numparts(handl);
     MPLtipfxn tipfxn = NULL;
     
     tipset->updated = false;
     
+    MPL_TRACE_PASS(handl, PASS_NA_RECALC);
+    
     for (i = 0; i < numparts; ++i) {
         if (handl->partitions[i]->isNAtype == true) {
             tipfxn = handl->partitions[i]->tipupdaterecalc;
-            tipfxn(tipset, ancset, handl->partitions[i]);
+            MPL_STATS_START(t0);
+            steps = tipfxn(tipset, ancset, handl->partitions[i]);
+            MPL_STATS_COUNT(handl->partitions[i], PASS_NA_RECALC,
+                            handl->partitions[i]->nNAtoupdate, steps, t0);
         }
     }
 
     
+    MPL_TRACE_PASS_END();
     return ERR_NO_ERROR;
 }
 
@@ -1004,17 +1287,33 @@ int mpl_get_insertcost
     MPLndsets*  tgt2set = handl->statesets[tgt2ID];
     
     int i = 0;
+    int steps = 0;
     int res = 0;
     int numparts = mpl_get_numparts(handl);
     MPLloclfxn loclfxn = NULL;
     
+    MPL_TRACE_PASS(handl, PASS_LOCAL_REOPT);
+    
     for (i = 0; i < numparts; ++i) {
         handl->partitions[i]->nNAtoupdate = 0;
         loclfxn = handl->partitions[i]->loclfxn;
-        res += loclfxn(srcset, tgt1set, tgt2set, handl->partitions[i], cutoff, max);
+        MPL_STATS_START(t0);
+        steps = loclfxn(srcset, tgt1set, tgt2set, handl->partitions[i],
+                        cutoff, max);
+        MPL_STATS_COUNT(handl->partitions[i], PASS_LOCAL_REOPT,
+                        handl->partitions[i]->ncharsinpart, steps, t0);
+        MPL_STATS_NARECALC(handl->partitions[i], PASS_LOCAL_REOPT,
+                           handl->partitions[i]->nNAtoupdate);
+#ifdef MPL_STATS
+        if (max == true && steps > cutoff) {
+            MPL_STATS_CUTOFF(handl->partitions[i], PASS_LOCAL_REOPT);
+        }
+#endif
+        res += steps;
         loclfxn = NULL;
     }
     
+    MPL_TRACE_PASS_END();
     return res;
 }
 
@@ -1058,6 +1357,8 @@ int mpl_restore_original_sets(const int node_id, Morphy m)
     int i = 0;
     int k = 0;
     
+    mpl_downcache_forget_node(node_id, mi);
+    
     for (i = 0; i < mi->numparts; ++i) {
         if (mi->partitions[i]->isNAtype) {
             
@@ -1155,3 +1456,659 @@ const char* mpl_get_stateset
     
     return ret;
 }
+
+int mpl_translate_packed_states
+(const unsigned int states, char* buf, const int size, Morphy m)
+{
+    if (!buf || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    char* symbols = mpl_get_symbols(m);
+    int nsymbols = symbols ? (int)strlen(symbols) : 0;
+    int gapshift = 0;
+    int nbits = 0;
+    int shift = 0;
+    int n = 0;
+    
+    if (size < 2) {
+        return ERR_OUT_OF_BOUNDS;
+    }
+    
+    if (mpl_get_gaphandl(handl) == GAP_INAPPLIC ||
+        mpl_get_gaphandl(handl) == GAP_NEWSTATE) {
+        gapshift = 1;
+    }
+    
+    nbits = nsymbols + gapshift;
+    
+    // Missing data, and any other set with states beyond the symbols
+    if (nbits < (int)(CHAR_BIT * sizeof(unsigned int)) && states >> nbits) {
+        buf[0] = DEFAULTMISSING;
+        buf[1] = '\0';
+        return 1;
+    }
+    
+    for (shift = 0; shift < nbits; ++shift) {
+        
+        if (!(states & (1u << shift))) {
+            continue;
+        }
+        
+        if (n == size - 1) {
+            return ERR_OUT_OF_BOUNDS;
+        }
+        
+        if (shift == 0 && gapshift) {
+            buf[n++] = mpl_get_gap_symbol(handl);
+        }
+        else {
+            buf[n++] = symbols[shift - gapshift];
+        }
+    }
+    
+    buf[n] = '\0';
+    
+    return n;
+}
+
+const unsigned long* mpl_get_nodal_sets
+(const int nodeID, const int passnum, Morphy m)
+{
+    if (!m) {
+        return NULL;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    
+    if (!handl->statesets || nodeID < 0 || nodeID >= handl->numnodes) {
+        return NULL;
+    }
+    
+    switch (passnum) {
+        case 1:
+            return handl->statesets[nodeID]->downpass1;
+        case 2:
+            return handl->statesets[nodeID]->uppass1;
+        case 3:
+            return handl->statesets[nodeID]->downpass2;
+        case 4:
+            return handl->statesets[nodeID]->uppass2;
+        default:
+            return NULL;
+    }
+}
+
+int mpl_get_num_partitions(Morphy m)
+{
+    if (!m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    return mpl_get_numparts((Morphyp)m);
+}
+
+int mpl_get_stats
+(const int part_id, const MPLpass_t pass, MPLstats* stats, Morphy m)
+{
+    if (!m || !stats) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    int numparts = mpl_get_numparts(handl);
+    
+    memset(stats, 0, sizeof(MPLstats));
+    
+    if (part_id < -1 || part_id >= numparts || pass < 0 || pass >= PASS_MAX) {
+        return ERR_OUT_OF_BOUNDS;
+    }
+    
+#ifdef MPL_STATS
+    int i = 0;
+    MPLstats* s = NULL;
+    
+    for (i = 0; i < numparts; ++i) {
+        
+        if (part_id >= 0 && i != part_id) {
+            continue;
+        }
+        
+        s = &handl->partitions[i]->stats[pass];
+        stats->calls        += s->calls;
+        stats->chars        += s->chars;
+        stats->steps        += s->steps;
+        stats->cutoffs      += s->cutoffs;
+        stats->narecalcs    += s->narecalcs;
+        stats->cycles       += s->cycles;
+    }
+    
+    if (part_id >= 0) {
+        stats->chtype   = handl->partitions[part_id]->chtype;
+        stats->isNAtype = handl->partitions[part_id]->isNAtype;
+    }
+    
+    return ERR_NO_ERROR;
+#else
+    return ERR_CASE_NOT_IMPL;
+#endif
+}
+
+int mpl_reset_stats(Morphy m)
+{
+    if (!m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+#ifdef MPL_STATS
+    Morphyp handl = (Morphyp)m;
+    int i = 0;
+    int numparts = mpl_get_numparts(handl);
+    
+    for (i = 0; i < numparts; ++i) {
+        memset(handl->partitions[i]->stats, 0,
+               PASS_MAX * sizeof(MPLstats));
+    }
+    
+    return ERR_NO_ERROR;
+#else
+    return ERR_CASE_NOT_IMPL;
+#endif
+}
+
+int mpl_set_downpass_cache(const size_t maxbytes, Morphy m)
+{
+    if (!m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    
+    handl->cachebytes = maxbytes;
+    
+    // Otherwise the cache is made when the tip data are applied
+    if (handl->statesets) {
+        return mpl_setup_downcache(handl);
+    }
+    
+    return ERR_NO_ERROR;
+}
+
+int mpl_get_downpass_cache_counts
+(unsigned long long* hits, unsigned long long* misses, Morphy m)
+{
+    if (!hits || !misses || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    
+    if (!handl->downcache) {
+        *hits   = 0;
+        *misses = 0;
+        return ERR_NO_DATA;
+    }
+    
+    *hits   = handl->downcache->hits;
+    *misses = handl->downcache->misses;
+    
+    return ERR_NO_ERROR;
+}
+
+int mpl_trace_dump(const char* filename)
+{
+    if (!filename) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+#ifdef MPL_TRACE
+    return mpl_trace_write(filename);
+#else
+    return ERR_CASE_NOT_IMPL;
+#endif
+}
+
+int mpl_trace_clear(void)
+{
+#ifdef MPL_TRACE
+    mpl_trace_reset();
+    return ERR_NO_ERROR;
+#else
+    return ERR_CASE_NOT_IMPL;
+#endif
+}
+
+/* Checks the arguments common to the searches and sets up the starting tree
+ * and the store for the trees found. */
+static int mpl_search_begin
+(const int* start, const int maxtrees, int* trees, int* ntrees, MPLtree** t,
+ MPLtreestore** store, Morphy m)
+{
+    if (!start || !trees || !ntrees || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    int ntax = mpl_get_numtaxa(m);
+    int ret = ERR_NO_ERROR;
+    
+    *ntrees = 0;
+    
+    if (maxtrees < 1) {
+        return ERR_BAD_PARAM;
+    }
+    if (!handl->statesets) {
+        return ERR_NO_DATA;
+    }
+    if (ntax < 2 || handl->numnodes < 2 * ntax) {
+        return ERR_DIMENS_UNDER;
+    }
+    
+    *t = mpl_new_tree(ntax);
+    *store = mpl_new_treestore(ntax, maxtrees);
+    
+    if (!*t || !*store) {
+        ret = ERR_BAD_MALLOC;
+    }
+    else {
+        ret = mpl_tree_read_parents(start, *t);
+    }
+    
+    if (ret != ERR_NO_ERROR) {
+        mpl_delete_tree(*t);
+        mpl_delete_treestore(*store);
+    }
+    
+    return ret;
+}
+
+/* Returns the stored trees to the caller if the search succeeded. */
+static int mpl_search_end
+(const int ret, int* trees, int* ntrees, MPLtree* t, MPLtreestore* store)
+{
+    if (ret >= 0) {
+        memcpy(trees, store->trees,
+               (size_t)store->ntrees * (2 * t->ntax - 1) * sizeof(int));
+        *ntrees = store->ntrees;
+    }
+    
+    mpl_delete_tree(t);
+    mpl_delete_treestore(store);
+    
+    return ret;
+}
+
+int mpl_spr_search
+(const int* start, const int maxtrees, int* trees, int* ntrees, Morphy m)
+{
+    int ret = ERR_NO_ERROR;
+    MPLtree* t = NULL;
+    MPLtreestore* store = NULL;
+    
+    if ((ret = mpl_search_begin(start, maxtrees, trees, ntrees, &t, &store, m))) {
+        return ret;
+    }
+    
+    ret = mpl_spr_hillclimb(t, store, (Morphyp)m);
+    
+    return mpl_search_end(ret, trees, ntrees, t, store);
+}
+
+int mpl_tbr_search
+(const int* start, const int maxtrees, int* trees, int* ntrees, Morphy m)
+{
+    int ret = ERR_NO_ERROR;
+    MPLtree* t = NULL;
+    MPLtreestore* store = NULL;
+    
+    if ((ret = mpl_search_begin(start, maxtrees, trees, ntrees, &t, &store, m))) {
+        return ret;
+    }
+    
+    ret = mpl_tbr_hillclimb(t, store, (Morphyp)m);
+    
+    return mpl_search_end(ret, trees, ntrees, t, store);
+}
+
+int mpl_ratchet_search
+(const int* start, const int niter, const double upweight,
+ const unsigned long long seed, const int maxtrees, int* trees, int* ntrees,
+ Morphy m)
+{
+    int ret = ERR_NO_ERROR;
+    MPLtree* t = NULL;
+    MPLtreestore* store = NULL;
+    MPLrng rng;
+    
+    if (niter < 0 || !(upweight > 0.0 && upweight <= 1.0)) {
+        return ERR_BAD_PARAM;
+    }
+    
+    if ((ret = mpl_search_begin(start, maxtrees, trees, ntrees, &t, &store, m))) {
+        return ret;
+    }
+    
+    mpl_rng_seed(seed, &rng);
+    ret = mpl_ratchet(t, store, niter, upweight, &rng, (Morphyp)m);
+    
+    return mpl_search_end(ret, trees, ntrees, t, store);
+}
+
+int mpl_replicate_search
+(const int nreps, const int nthreads, const bool tbr,
+ const unsigned long long seed, const int maxtrees, int* trees, int* ntrees,
+ Morphy m)
+{
+    if (!trees || !ntrees || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    int ntax = mpl_get_numtaxa(m);
+    int ret = ERR_NO_ERROR;
+    MPLtreestore* store = NULL;
+    
+    *ntrees = 0;
+    
+    if (nreps < 1 || nthreads < 1 || maxtrees < 1) {
+        return ERR_BAD_PARAM;
+    }
+    if (!handl->statesets) {
+        return ERR_NO_DATA;
+    }
+    if (ntax < 2 || handl->numnodes < 2 * ntax) {
+        return ERR_DIMENS_UNDER;
+    }
+    
+    if (!(store = mpl_new_treestore(ntax, maxtrees))) {
+        return ERR_BAD_MALLOC;
+    }
+    
+    ret = mpl_replicate(store, nreps, nthreads, tbr, seed, handl);
+    
+    if (ret >= 0) {
+        memcpy(trees, store->trees,
+               (size_t)store->ntrees * (2 * ntax - 1) * sizeof(int));
+        *ntrees = store->ntrees;
+    }
+    
+    mpl_delete_treestore(store);
+    
+    return ret;
+}
+
+int mpl_branch_and_bound
+(const int nthreads, const int maxtrees, int* trees, int* ntrees, Morphy m)
+{
+    if (!trees || !ntrees || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    int ntax = mpl_get_numtaxa(m);
+    int ret = ERR_NO_ERROR;
+    MPLtreestore* store = NULL;
+    
+    *ntrees = 0;
+    
+    if (nthreads < 1 || maxtrees < 1) {
+        return ERR_BAD_PARAM;
+    }
+    if (!handl->statesets) {
+        return ERR_NO_DATA;
+    }
+    if (ntax < 2 || handl->numnodes < 2 * ntax) {
+        return ERR_DIMENS_UNDER;
+    }
+    
+    if (!(store = mpl_new_treestore(ntax, maxtrees))) {
+        return ERR_BAD_MALLOC;
+    }
+    
+    ret = mpl_branch_bound(store, nthreads, handl);
+    
+    if (ret >= 0) {
+        memcpy(trees, store->trees,
+               (size_t)store->ntrees * (2 * ntax - 1) * sizeof(int));
+        *ntrees = store->ntrees;
+    }
+    
+    mpl_delete_treestore(store);
+    
+    return ret;
+}
+
+int mpl_score_trees
+(const int ntrees, const int* trees, const int nthreads, int* lengths,
+ int* charsteps, Morphy m)
+{
+    if (!trees || !lengths || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    int ntax = mpl_get_numtaxa(m);
+    
+    if (ntrees < 0 || nthreads < 1) {
+        return ERR_BAD_PARAM;
+    }
+    if (!handl->statesets) {
+        return ERR_NO_DATA;
+    }
+    if (ntax < 2 || handl->numnodes < 2 * ntax) {
+        return ERR_DIMENS_UNDER;
+    }
+    
+    return mpl_score_batch(ntrees, trees, nthreads, lengths, charsteps, handl);
+}
+
+int mpl_score_tree(const int* tree, Morphy m)
+{
+    if (!tree || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    int ntax = mpl_get_numtaxa(m);
+    int ret = ERR_NO_ERROR;
+    MPLtree* t = NULL;
+    
+    if (!handl->statesets) {
+        return ERR_NO_DATA;
+    }
+    if (ntax < 2 || handl->numnodes < 2 * ntax) {
+        return ERR_DIMENS_UNDER;
+    }
+    
+    if (!(t = mpl_new_tree(ntax))) {
+        return ERR_BAD_MALLOC;
+    }
+    
+    if ((ret = mpl_tree_read_parents(tree, t)) == ERR_NO_ERROR) {
+        ret = mpl_tree_score(t, handl);
+    }
+    
+    mpl_delete_tree(t);
+    
+    return ret;
+}
+
+int mpl_score_rootings
+(const int* tree, int* lengths, int* charsteps, Morphy m)
+{
+    if (!tree || !lengths || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    int ntax = mpl_get_numtaxa(m);
+    int ret = ERR_NO_ERROR;
+    MPLtree* t = NULL;
+    
+    if (!handl->statesets) {
+        return ERR_NO_DATA;
+    }
+    if (ntax < 2 || handl->numnodes < 2 * ntax) {
+        return ERR_DIMENS_UNDER;
+    }
+    
+    if (!(t = mpl_new_tree(ntax))) {
+        return ERR_BAD_MALLOC;
+    }
+    
+    if ((ret = mpl_tree_read_parents(tree, t)) == ERR_NO_ERROR) {
+        ret = mpl_score_all_rootings(t, lengths, charsteps, handl);
+    }
+    
+    mpl_delete_tree(t);
+    
+    return ret;
+}
+
+static MPLnewick mpl_open_newick
+(FILE* fp, const char* buf, const size_t size, const int ntax,
+ const char* const* labels)
+{
+    MPLnwkreader* r = NULL;
+    
+    if (ntax < 2 || !(r = mpl_new_nwkreader(ntax, labels))) {
+        return NULL;
+    }
+    
+    if (!fp) {
+        mpl_nwkreader_set_buffer(buf, size, r);
+    }
+    else if (mpl_nwkreader_set_file(fp, r) != ERR_NO_ERROR) {
+        mpl_delete_nwkreader(r);
+        return NULL;
+    }
+    
+    return (MPLnewick)r;
+}
+
+MPLnewick mpl_open_newick_file
+(FILE* fp, const int ntax, const char* const* labels)
+{
+    if (!fp) {
+        return NULL;
+    }
+    
+    return mpl_open_newick(fp, NULL, 0, ntax, labels);
+}
+
+MPLnewick mpl_open_newick_buffer
+(const char* buf, const size_t size, const int ntax, const char* const* labels)
+{
+    if (!buf) {
+        return NULL;
+    }
+    
+    return mpl_open_newick(NULL, buf, size, ntax, labels);
+}
+
+int mpl_close_newick(MPLnewick nwk)
+{
+    if (!nwk) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    mpl_delete_nwkreader((MPLnwkreader*)nwk);
+    
+    return ERR_NO_ERROR;
+}
+
+int mpl_read_newick(int* parents, MPLnewick nwk)
+{
+    if (!parents || !nwk) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    MPLnwkreader* r = (MPLnwkreader*)nwk;
+    int ret = mpl_nwkreader_read(r);
+    
+    if (ret == 1) {
+        mpl_tree_write_parents(r->tree, parents);
+    }
+    
+    return ret;
+}
+
+int mpl_score_newick
+(int* lengths, const int maxtrees, MPLnewick nwk, Morphy m)
+{
+    if (!lengths || !nwk || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    MPLnwkreader* r = (MPLnwkreader*)nwk;
+    int ntax = mpl_get_numtaxa(m);
+    int ret = 0;
+    int i = 0;
+    
+    if (maxtrees < 0 || r->ntax != ntax) {
+        return ERR_BAD_PARAM;
+    }
+    if (!handl->statesets) {
+        return ERR_NO_DATA;
+    }
+    if (handl->numnodes < 2 * ntax) {
+        return ERR_DIMENS_UNDER;
+    }
+    
+    for (i = 0; i < maxtrees; ++i) {
+        
+        if ((ret = mpl_nwkreader_read(r)) == 0) {
+            break;
+        }
+        
+        if (ret == 1) {
+            lengths[i] = mpl_tree_length(r->tree, handl);
+        }
+        else {
+            lengths[i] = ret;
+        }
+    }
+    
+    return i;
+}
+
+int mpl_stepwise_addition
+(const MPLaddseq_t addseq, const unsigned long long seed, int* tree, Morphy m)
+{
+    if (!tree || !m) {
+        return ERR_UNEXP_NULLPTR;
+    }
+    
+    Morphyp handl = (Morphyp)m;
+    int ntax = mpl_get_numtaxa(m);
+    int ret = ERR_NO_ERROR;
+    MPLtree* t = NULL;
+    MPLrng rng;
+    
+    if (addseq < 0 || addseq >= ADDSEQ_MAX) {
+        return ERR_BAD_PARAM;
+    }
+    if (!handl->statesets) {
+        return ERR_NO_DATA;
+    }
+    if (ntax < 2 || handl->numnodes < 2 * ntax) {
+        return ERR_DIMENS_UNDER;
+    }
+    
+    if (!(t = mpl_new_tree(ntax))) {
+        return ERR_BAD_MALLOC;
+    }
+    
+    mpl_rng_seed(seed, &rng);
+    
+    ret = mpl_stepwise_build(t, addseq, &rng, handl);
+    if (ret >= 0) {
+        mpl_tree_write_parents(t, tree);
+    }
+    
+    mpl_delete_tree(t);
+    
+    return ret;
+}
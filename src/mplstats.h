@@ -0,0 +1,65 @@
+//
+//  mplstats.h
+//  morphylib
+//
+//  Hot-path counters for the nodal functions in mpl.c. These are compiled in
+//  only if MPL_STATS is defined. Otherwise every macro here expands to nothing
+//  and the partitions carry no counters at all.
+//
+
+#ifndef mplstats_h
+#define mplstats_h
+
+#ifdef MPL_STATS
+
+#ifdef MPL_STATS_CYCLES
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+static inline unsigned long long mpl_stats_tick(void)
+{
+    return __rdtsc();
+}
+#else
+#include <time.h>
+// No cycle counter: fall back on nanoseconds
+static inline unsigned long long mpl_stats_tick(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+#else
+static inline unsigned long long mpl_stats_tick(void)
+{
+    return 0;
+}
+#endif
+
+static inline void mpl_stats_count
+(MPLstats* s, const int nchars, const int steps, const unsigned long long t0)
+{
+    ++s->calls;
+    s->chars += nchars;
+    s->steps += steps;
+#ifdef MPL_STATS_CYCLES
+    s->cycles += mpl_stats_tick() - t0;
+#endif
+}
+
+#define MPL_STATS_START(t) unsigned long long t = mpl_stats_tick()
+#define MPL_STATS_COUNT(part, pass, nchars, steps, t) \
+    mpl_stats_count(&(part)->stats[pass], (nchars), (steps), (t))
+#define MPL_STATS_CUTOFF(part, pass) (++(part)->stats[pass].cutoffs)
+#define MPL_STATS_NARECALC(part, pass, n) ((part)->stats[pass].narecalcs += (n))
+
+#else
+
+#define MPL_STATS_START(t)
+#define MPL_STATS_COUNT(part, pass, nchars, steps, t) ((void)(steps))
+#define MPL_STATS_CUTOFF(part, pass)
+#define MPL_STATS_NARECALC(part, pass, n)
+
+#endif /* MPL_STATS */
+
+#endif /* mplstats_h */
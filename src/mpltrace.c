@@ -0,0 +1,274 @@
+//
+//  mpltrace.c
+//  morphylib
+//
+//  A thread takes a buffer the first time it records an event. When the thread
+//  exits, the buffer is released through a thread-specific key's destructor,
+//  and the next new thread takes it over, adding its events to those already
+//  there. A new buffer is only made, and pushed onto a global list with a
+//  compare-and-swap, when none is free. So there are never more buffers than
+//  threads recording at once, however many threads the searches start. Buffers
+//  are not freed, so the list can be walked at any time, but the dump only
+//  gives a consistent picture if no thread is evaluating while it runs.
+//
+#include "mpl.h"
+
+#ifdef MPL_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "mplerror.h"
+#include "mpltrace.h"
+
+typedef struct {
+    const char*         name;
+    unsigned long long  start;
+    unsigned long long  dur;
+    unsigned long       calls;  // Number of merged nodal calls; 0 for a span
+} MPLtrevent;
+
+typedef struct MPLtracebuf MPLtracebuf;
+struct MPLtracebuf {
+    int                 tid;
+    atomic_bool         inuse;      // Taken by a thread that hasn't exited
+    unsigned long long  nevents;    // Total recorded, including overwritten
+    const void*         phasehandl; // The run of nodal calls still open
+    int                 phase;
+    unsigned long       phasecalls;
+    unsigned long long  phasestart;
+    unsigned long long  phaselast;
+    MPLtracebuf*        next;
+    MPLtrevent          events[MPL_TRACE_BUFSIZE];
+};
+
+static const char* mpl_trace_pass_names[PASS_MAX] = {
+    "first_down",
+    "first_up",
+    "second_down",
+    "second_up",
+    "tip_update",
+    "tip_finalize",
+    "tiproot",
+    "insertcost",
+    "na_recalc",
+};
+
+static _Atomic(MPLtracebuf*)    mpl_trace_bufs  = NULL;
+static atomic_int               mpl_trace_ntids = 0;
+static _Thread_local MPLtracebuf* mpl_trace_local = NULL;
+static pthread_key_t            mpl_trace_key;
+static pthread_once_t           mpl_trace_once  = PTHREAD_ONCE_INIT;
+
+
+unsigned long long mpl_trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void mpl_trace_push
+(MPLtracebuf* b, const char* name, const unsigned long long start,
+ const unsigned long long end, const unsigned long calls)
+{
+    MPLtrevent* e = &b->events[b->nevents % MPL_TRACE_BUFSIZE];
+
+    e->name     = name;
+    e->start    = start;
+    e->dur      = end - start;
+    e->calls    = calls;
+
+    ++b->nevents;
+}
+
+
+static void mpl_trace_close_phase(MPLtracebuf* b)
+{
+    if (b->phase >= 0) {
+        mpl_trace_push(b, mpl_trace_pass_names[b->phase], b->phasestart,
+                       b->phaselast, b->phasecalls);
+    }
+
+    b->phase        = -1;
+    b->phasehandl   = NULL;
+    b->phasecalls   = 0;
+}
+
+
+/* Runs as a thread that has recorded events exits. */
+static void mpl_trace_release(void* buf)
+{
+    MPLtracebuf* b = (MPLtracebuf*)buf;
+
+    mpl_trace_close_phase(b);
+    mpl_trace_local = NULL;
+    atomic_store(&b->inuse, false);
+}
+
+
+static void mpl_trace_make_key(void)
+{
+    pthread_key_create(&mpl_trace_key, mpl_trace_release);
+}
+
+
+static MPLtracebuf* mpl_trace_get_buffer(void)
+{
+    bool avail = false;
+    MPLtracebuf* b = mpl_trace_local;
+
+    if (b) {
+        return b;
+    }
+
+    pthread_once(&mpl_trace_once, mpl_trace_make_key);
+
+    // A buffer left by a thread that has exited
+    for (b = atomic_load(&mpl_trace_bufs); b; b = b->next) {
+        avail = false;
+        if (atomic_compare_exchange_strong(&b->inuse, &avail, true)) {
+            break;
+        }
+    }
+
+    if (!b) {
+
+        b = (MPLtracebuf*)calloc(1, sizeof(MPLtracebuf));
+        if (!b) {
+            return NULL;
+        }
+
+        b->tid      = atomic_fetch_add(&mpl_trace_ntids, 1) + 1;
+        b->phase    = -1;
+        atomic_init(&b->inuse, true);
+        b->next     = atomic_load(&mpl_trace_bufs);
+        while (!atomic_compare_exchange_weak(&mpl_trace_bufs, &b->next, b)) {
+            ;
+        }
+    }
+
+    mpl_trace_local = b;
+    pthread_setspecific(mpl_trace_key, b);
+
+    return b;
+}
+
+
+void mpl_trace_pass(const void* handl, const MPLpass_t pass)
+{
+    MPLtracebuf* b = mpl_trace_get_buffer();
+
+    if (!b) {
+        return;
+    }
+
+    if (b->phase != (int)pass || b->phasehandl != handl) {
+        mpl_trace_close_phase(b);
+        b->phase        = pass;
+        b->phasehandl   = handl;
+        b->phasestart   = mpl_trace_now();
+    }
+
+    ++b->phasecalls;
+}
+
+
+void mpl_trace_pass_end(void)
+{
+    if (mpl_trace_local) {
+        mpl_trace_local->phaselast = mpl_trace_now();
+    }
+}
+
+
+unsigned long long mpl_trace_span_begin(void)
+{
+    MPLtracebuf* b = mpl_trace_get_buffer();
+
+    if (b) {
+        mpl_trace_close_phase(b);
+    }
+
+    return mpl_trace_now();
+}
+
+
+void mpl_trace_span_end(const char* name, const unsigned long long start)
+{
+    MPLtracebuf* b = mpl_trace_get_buffer();
+
+    if (b) {
+        mpl_trace_close_phase(b);
+        mpl_trace_push(b, name, start, mpl_trace_now(), 0);
+    }
+}
+
+
+/* Writes the events of every thread in the Chrome trace event format, which
+ * can be loaded by chrome://tracing and Perfetto. Times are in microseconds. */
+int mpl_trace_write(const char* filename)
+{
+    FILE* out = fopen(filename, "w");
+    MPLtracebuf* b = NULL;
+    MPLtrevent* e = NULL;
+    unsigned long long i = 0;
+    unsigned long long first = 0;
+    const char* sep = "";
+
+    if (!out) {
+        return ERR_BAD_PARAM;
+    }
+
+    fprintf(out, "{\"traceEvents\":[\n");
+
+    for (b = atomic_load(&mpl_trace_bufs); b; b = b->next) {
+
+        mpl_trace_close_phase(b);
+
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%i,\"args\":{\"name\":\"morphy %i\"}}",
+                sep, b->tid, b->tid);
+        sep = ",\n";
+
+        first = 0;
+        if (b->nevents > MPL_TRACE_BUFSIZE) {
+            first = b->nevents - MPL_TRACE_BUFSIZE;
+        }
+
+        for (i = first; i < b->nevents; ++i) {
+            e = &b->events[i % MPL_TRACE_BUFSIZE];
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                    "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%i",
+                    sep, e->name, e->calls ? "pass" : "stage",
+                    e->start / 1000.0, e->dur / 1000.0, b->tid);
+            if (e->calls) {
+                fprintf(out, ",\"args\":{\"calls\":%lu}", e->calls);
+            }
+            fprintf(out, "}");
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+    fclose(out);
+
+    return ERR_NO_ERROR;
+}
+
+
+void mpl_trace_reset(void)
+{
+    MPLtracebuf* b = NULL;
+
+    for (b = atomic_load(&mpl_trace_bufs); b; b = b->next) {
+        b->nevents      = 0;
+        b->phase        = -1;
+        b->phasehandl   = NULL;
+        b->phasecalls   = 0;
+    }
+}
+
+#endif /* MPL_TRACE */
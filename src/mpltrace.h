@@ -0,0 +1,44 @@
+//
+//  mpltrace.h
+//  morphylib
+//
+//  Timeline tracing, compiled in only if MPL_TRACE is defined. Each thread
+//  records events into its own ring buffer, so nothing is shared between
+//  threads while a search is running. Consecutive calls to the same nodal
+//  function on the same Morphy object are merged into a single event, so that
+//  a full pass or a batch of insertion costs appears as one span on the
+//  timeline.
+//
+
+#ifndef mpltrace_h
+#define mpltrace_h
+
+#ifdef MPL_TRACE
+
+#ifndef MPL_TRACE_BUFSIZE
+#define MPL_TRACE_BUFSIZE (1 << 16) // Events kept per thread
+#endif
+
+unsigned long long  mpl_trace_now(void);
+void    mpl_trace_pass(const void* handl, const MPLpass_t pass);
+void    mpl_trace_pass_end(void);
+unsigned long long  mpl_trace_span_begin(void);
+void    mpl_trace_span_end(const char* name, const unsigned long long start);
+int     mpl_trace_write(const char* filename);
+void    mpl_trace_reset(void);
+
+#define MPL_TRACE_PASS(handl, pass) mpl_trace_pass((handl), (pass))
+#define MPL_TRACE_PASS_END()        mpl_trace_pass_end()
+#define MPL_TRACE_BEGIN(t)          unsigned long long t = mpl_trace_span_begin()
+#define MPL_TRACE_END(name, t)      mpl_trace_span_end((name), (t))
+
+#else
+
+#define MPL_TRACE_PASS(handl, pass)
+#define MPL_TRACE_PASS_END()
+#define MPL_TRACE_BEGIN(t)
+#define MPL_TRACE_END(name, t)
+
+#endif /* MPL_TRACE */
+
+#endif /* mpltrace_h */
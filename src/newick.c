@@ -0,0 +1,547 @@
+//
+//  newick.c
+//  morphylib
+//
+//  Trees are read in a single pass, one character at a time, from a buffer
+//  that for a file is refilled in large chunks. Tips are pushed onto a stack
+//  as their labels are read, and each closing parenthesis joins the nodes
+//  above the matching opening one to a new internal node. Internal nodes are
+//  therefore numbered in postorder as they are made, so the tree needs no
+//  traversal before it is scored. Labels are found in a hash table made when
+//  the reader is created. Nothing is allocated while reading, other than more
+//  space for a label longer than any before it.
+//
+//  Underscores and blanks in labels are treated as the same, as unquoted
+//  Newick labels can't contain blanks. Comments, branch lengths and the labels
+//  of internal nodes are skipped. Anything before the first parenthesis of a
+//  tree, such as the start of a NEXUS tree command, is ignored.
+//
+#include <stdlib.h>
+#include <string.h>
+#include "mpl.h"
+#include "morphydefs.h"
+#include "mplerror.h"
+#include "search.h"
+#include "newick.h"
+
+#define MPL_NWK_CHUNK   65536
+
+
+static inline int mpl_nwk_getc(MPLnwkreader* r)
+{
+    if (r->pos < r->len) {
+        return (unsigned char)r->buf[r->pos++];
+    }
+
+    if (!r->fp) {
+        return EOF;
+    }
+
+    r->len = fread(r->chunk, 1, MPL_NWK_CHUNK, r->fp);
+    r->pos = 0;
+
+    if (!r->len) {
+        return EOF;
+    }
+
+    return (unsigned char)r->buf[r->pos++];
+}
+
+
+/* Steps back over the character just read, which is always still in the
+ * buffer. */
+static inline void mpl_nwk_ungetc(MPLnwkreader* r)
+{
+    --r->pos;
+}
+
+
+static inline bool mpl_nwk_isdelim(const int c)
+{
+    return c == EOF || c <= ' ' || c == '(' || c == ')' || c == ',' ||
+           c == ':' || c == ';' || c == '[';
+}
+
+
+static unsigned long long mpl_nwk_hash(const char* s)
+{
+    unsigned long long h = 14695981039346656037ULL;
+
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+
+    return mpl_mix_hash(h);
+}
+
+
+/* The slot holding a label, or the empty slot where it would go. */
+static int mpl_nwk_slot(const char* label, const MPLnwkreader* r)
+{
+    int i = (int)(mpl_nwk_hash(label) & (unsigned long long)(r->nslots - 1));
+
+    while (r->slots[i] >= 0 && strcmp(r->names[r->slots[i]], label)) {
+        i = (i + 1) & (r->nslots - 1);
+    }
+
+    return i;
+}
+
+
+/*!
+ @brief Creates a reader for trees on ntax taxa.
+ @discussion The source must be set with mpl_nwkreader_set_file or
+ mpl_nwkreader_set_buffer before trees are read.
+ @param labels The label of each taxon, or NULL if the taxa are labelled with
+ their numbers from 1 to ntax.
+ @return The reader, or NULL if memory could not be allocated or two labels
+ are the same.
+ */
+MPLnwkreader* mpl_new_nwkreader(const int ntax, const char* const* labels)
+{
+    int i = 0;
+    int k = 0;
+    char* c = NULL;
+    MPLnwkreader* r = (MPLnwkreader*)calloc(1, sizeof(MPLnwkreader));
+
+    if (!r) {
+        return NULL;
+    }
+
+    r->ntax     = ntax;
+    r->maxlabel = 64;
+    r->label    = (char*)malloc(r->maxlabel);
+    r->stack    = (int*)malloc(2 * ntax * sizeof(int));
+    r->frames   = (int*)malloc(ntax * sizeof(int));
+    r->seen     = (int*)calloc(ntax, sizeof(int));
+    r->tree     = mpl_new_tree(ntax);
+
+    if (!r->label || !r->stack || !r->frames || !r->seen || !r->tree) {
+        mpl_delete_nwkreader(r);
+        return NULL;
+    }
+
+    if (!labels) {
+        return r;
+    }
+
+    r->nslots = 1;
+    while (r->nslots < 2 * ntax) {
+        r->nslots <<= 1;
+    }
+
+    r->slots = (int*)malloc(r->nslots * sizeof(int));
+    r->names = (char**)calloc(ntax, sizeof(char*));
+
+    if (!r->slots || !r->names) {
+        mpl_delete_nwkreader(r);
+        return NULL;
+    }
+
+    for (i = 0; i < r->nslots; ++i) {
+        r->slots[i] = -1;
+    }
+
+    for (i = 0; i < ntax; ++i) {
+
+        if (!labels[i] || !(r->names[i] = (char*)malloc(strlen(labels[i]) + 1))) {
+            mpl_delete_nwkreader(r);
+            return NULL;
+        }
+
+        strcpy(r->names[i], labels[i]);
+        for (c = r->names[i]; *c; ++c) {
+            if (*c == '_') {
+                *c = ' ';
+            }
+        }
+
+        k = mpl_nwk_slot(r->names[i], r);
+        if (r->slots[k] >= 0) {
+            mpl_delete_nwkreader(r);
+            return NULL;
+        }
+        r->slots[k] = i;
+    }
+
+    return r;
+}
+
+
+void mpl_delete_nwkreader(MPLnwkreader* r)
+{
+    int i = 0;
+
+    if (!r) {
+        return;
+    }
+
+    if (r->names) {
+        for (i = 0; i < r->ntax; ++i) {
+            free(r->names[i]);
+        }
+        free(r->names);
+    }
+
+    free(r->slots);
+    free(r->chunk);
+    free(r->label);
+    free(r->stack);
+    free(r->frames);
+    free(r->seen);
+    mpl_delete_tree(r->tree);
+    free(r);
+}
+
+
+/* Reads from the current position of a file, which is not closed by the
+ * reader. */
+int mpl_nwkreader_set_file(FILE* fp, MPLnwkreader* r)
+{
+    if (!r->chunk && !(r->chunk = (char*)malloc(MPL_NWK_CHUNK))) {
+        return ERR_BAD_MALLOC;
+    }
+
+    r->fp   = fp;
+    r->buf  = r->chunk;
+    r->len  = 0;
+    r->pos  = 0;
+
+    return ERR_NO_ERROR;
+}
+
+
+/* Reads from a buffer, such as a mapped file, which must outlive the reader's
+ * use of it. */
+void mpl_nwkreader_set_buffer(const char* buf, const size_t size,
+                              MPLnwkreader* r)
+{
+    r->fp   = NULL;
+    r->buf  = buf;
+    r->len  = size;
+    r->pos  = 0;
+}
+
+
+/* Skips a comment, whose opening bracket has been read. */
+static int mpl_nwk_skip_comment(MPLnwkreader* r)
+{
+    int c = 0;
+
+    while ((c = mpl_nwk_getc(r)) != ']') {
+        if (c == EOF) {
+            return ERR_MATCHING_PARENTHS;
+        }
+    }
+
+    return ERR_NO_ERROR;
+}
+
+
+/* The next character that isn't blank or in a comment. */
+static int mpl_nwk_next(MPLnwkreader* r, int* err)
+{
+    int c = 0;
+
+    while ((c = mpl_nwk_getc(r)) != EOF) {
+        if (c == '[') {
+            if ((*err = mpl_nwk_skip_comment(r)) != ERR_NO_ERROR) {
+                return EOF;
+            }
+        }
+        else if (c > ' ') {
+            break;
+        }
+    }
+
+    return c;
+}
+
+
+static int mpl_nwk_push_label_char(const int c, const int n, MPLnwkreader* r)
+{
+    char* label = NULL;
+
+    if (n + 1 >= r->maxlabel) {
+        if (!(label = (char*)realloc(r->label, 2 * r->maxlabel))) {
+            return ERR_BAD_MALLOC;
+        }
+        r->label     = label;
+        r->maxlabel *= 2;
+    }
+
+    r->label[n] = c == '_' ? ' ' : (char)c;
+
+    return ERR_NO_ERROR;
+}
+
+
+/* Reads a label or branch length whose first character, c, has been read. */
+static int mpl_nwk_read_label(int c, MPLnwkreader* r)
+{
+    int n = 0;
+    int err = ERR_NO_ERROR;
+
+    if (c == '\'') {
+        for (;;) {
+            if ((c = mpl_nwk_getc(r)) == EOF) {
+                return ERR_INVALID_SYMBOL;
+            }
+            if (c == '\'') {
+                // A doubled quote stands for itself
+                if ((c = mpl_nwk_getc(r)) != '\'') {
+                    if (c != EOF) {
+                        mpl_nwk_ungetc(r);
+                    }
+                    break;
+                }
+            }
+            if ((err = mpl_nwk_push_label_char(c, n++, r)) != ERR_NO_ERROR) {
+                return err;
+            }
+        }
+    }
+    else {
+        do {
+            if ((err = mpl_nwk_push_label_char(c, n++, r)) != ERR_NO_ERROR) {
+                return err;
+            }
+        } while (!mpl_nwk_isdelim(c = mpl_nwk_getc(r)));
+
+        if (c != EOF) {
+            mpl_nwk_ungetc(r);
+        }
+    }
+
+    r->label[n] = '\0';
+
+    return ERR_NO_ERROR;
+}
+
+
+/* Skips a branch length or the label of an internal node, whose first
+ * character has been read. */
+static int mpl_nwk_skip_label(int c, MPLnwkreader* r)
+{
+    if (c == '\'') {
+        return mpl_nwk_read_label(c, r);
+    }
+
+    while (!mpl_nwk_isdelim(c = mpl_nwk_getc(r)));
+
+    if (c != EOF) {
+        mpl_nwk_ungetc(r);
+    }
+
+    return ERR_NO_ERROR;
+}
+
+
+/* The taxon with the label just read, or a negative error code. */
+static int mpl_nwk_lookup(const MPLnwkreader* r)
+{
+    int k = 0;
+    long n = 0;
+    const char* c = r->label;
+
+    if (r->names) {
+        k = r->slots[mpl_nwk_slot(r->label, r)];
+        return k >= 0 ? k : ERR_SYMBOL_MISMATCH;
+    }
+
+    if (!*c) {
+        return ERR_SYMBOL_MISMATCH;
+    }
+
+    for (; *c; ++c) {
+        if (*c < '0' || *c > '9' || n > r->ntax) {
+            return ERR_SYMBOL_MISMATCH;
+        }
+        n = 10 * n + (*c - '0');
+    }
+
+    if (n < 1 || n > r->ntax) {
+        return ERR_SYMBOL_MISMATCH;
+    }
+
+    return (int)(n - 1);
+}
+
+
+static int mpl_nwk_join(const int a, const int b, int* next, MPLtree* t)
+{
+    int n = (*next)++;
+
+    t->left[n]  = a;
+    t->right[n] = b;
+    t->anc[a]   = n;
+    t->anc[b]   = n;
+    t->postorder[t->ninternal++] = n;
+
+    return n;
+}
+
+
+/* Joins the nodes pushed since the matching opening parenthesis. A basal
+ * trichotomy, as in trees written unrooted, is resolved arbitrarily. */
+static int mpl_nwk_close(const int depth, int* sp, int* next,
+                         MPLnwkreader* r, MPLtree* t)
+{
+    int frame = r->frames[depth];
+    int* s = &r->stack[frame];
+    int n = *sp - frame;
+
+    if (n == 2) {
+        s[0] = mpl_nwk_join(s[0], s[1], next, t);
+    }
+    else if (n == 3 && depth == 0) {
+        s[0] = mpl_nwk_join(mpl_nwk_join(s[0], s[1], next, t), s[2], next, t);
+    }
+    else if (n > 2) {
+        return ERR_CASE_NOT_IMPL;
+    }
+    else {
+        return ERR_BAD_PARAM;
+    }
+
+    *sp = frame + 1;
+
+    return ERR_NO_ERROR;
+}
+
+
+static int mpl_nwk_parse(MPLnwkreader* r, bool* ended)
+{
+    int c       = 0;
+    int k       = 0;
+    int sp      = 0;
+    int depth   = 0;
+    int next    = r->ntax;
+    int err     = ERR_NO_ERROR;
+    bool after  = false;    // A node has just been completed
+    bool closed = false;    // ...and it was internal
+    MPLtree* t  = r->tree;
+
+    t->ntips        = 0;
+    t->ninternal    = 0;
+    r->frames[depth++] = 0;
+
+    while ((c = mpl_nwk_next(r, &err)) != EOF) {
+
+        if (c == '(') {
+            if (after) {
+                return ERR_MATCHING_PARENTHS;
+            }
+            if (depth == r->ntax) {
+                return ERR_BAD_PARAM;
+            }
+            r->frames[depth++] = sp;
+        }
+        else if (c == ',') {
+            if (!after || depth < 1) {
+                return ERR_BAD_PARAM;
+            }
+            after = closed = false;
+        }
+        else if (c == ')') {
+            if (!after || depth < 1) {
+                return ERR_MATCHING_PARENTHS;
+            }
+            if ((err = mpl_nwk_close(--depth, &sp, &next, r, t))
+                != ERR_NO_ERROR) {
+                return err;
+            }
+            closed = true;
+        }
+        else if (c == ':') {
+            if (!after || (c = mpl_nwk_next(r, &err)) == EOF) {
+                return err != ERR_NO_ERROR ? err : ERR_BAD_PARAM;
+            }
+            if ((err = mpl_nwk_skip_label(c, r)) != ERR_NO_ERROR) {
+                return err;
+            }
+        }
+        else if (c == ';') {
+            *ended = true;
+            break;
+        }
+        else if (closed) {
+            // A label or support value of an internal node
+            if ((err = mpl_nwk_skip_label(c, r)) != ERR_NO_ERROR) {
+                return err;
+            }
+            closed = false;
+        }
+        else {
+            if ((err = mpl_nwk_read_label(c, r)) != ERR_NO_ERROR) {
+                return err;
+            }
+            if (after) {
+                return ERR_BAD_PARAM;
+            }
+            if ((k = mpl_nwk_lookup(r)) < 0) {
+                return k;
+            }
+            if (r->seen[k] == r->ntrees || sp == 2 * r->ntax) {
+                return ERR_BAD_PARAM;
+            }
+            r->seen[k] = r->ntrees;
+            t->tips[t->ntips++] = k;
+            r->stack[sp++] = k;
+            after = true;
+        }
+    }
+
+    if (err != ERR_NO_ERROR) {
+        return err;
+    }
+    if (depth != 0 || sp != 1) {
+        return ERR_MATCHING_PARENTHS;
+    }
+    if (t->ntips != r->ntax) {
+        return ERR_BAD_PARAM;
+    }
+
+    t->root = r->stack[0];
+    t->anc[t->root] = t->lroot;
+
+    return ERR_NO_ERROR;
+}
+
+
+/*!
+ @brief Reads the next tree into r->tree.
+ @discussion The tree is ready to be scored, with its internal nodes in
+ postorder. If it can't be read, the rest of it is skipped so that the next
+ call reads the tree after it.
+ @return 1 if a tree was read, 0 if there are no more, or a negative error
+ code.
+ */
+int mpl_nwkreader_read(MPLnwkreader* r)
+{
+    int c = 0;
+    int err = ERR_NO_ERROR;
+    bool ended = false;
+
+    // Find the start of the tree
+    while ((c = mpl_nwk_next(r, &err)) != '(') {
+        if (c == EOF) {
+            return err;
+        }
+    }
+
+    ++r->ntrees;
+
+    if ((err = mpl_nwk_parse(r, &ended)) == ERR_NO_ERROR) {
+        return 1;
+    }
+
+    while (!ended && (c = mpl_nwk_getc(r)) != ';' && c != EOF) {
+        if (c == '[') {
+            mpl_nwk_skip_comment(r);
+        }
+    }
+
+    return err;
+}
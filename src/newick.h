@@ -0,0 +1,39 @@
+//
+//  newick.h
+//  morphylib
+//
+//  Reads Newick trees one at a time from a file or a buffer, straight into the
+//  arrays used for scoring whole trees.
+//
+
+#ifndef newick_h
+#define newick_h
+
+#include <stdio.h>
+
+typedef struct {
+    int         ntax;
+    FILE*       fp;         /*!< NULL if reading from a buffer */
+    const char* buf;        /*!< The buffer, or the part of the file read so far */
+    size_t      len;
+    size_t      pos;
+    char*       chunk;      /*!< Space for reading the file */
+    int         nslots;     /*!< Size of the label table, a power of two */
+    int*        slots;      /*!< The taxon with each label, or -1 */
+    char**      names;      /*!< The labels by taxon, or NULL if taxa are numbered */
+    char*       label;      /*!< The label being read */
+    int         maxlabel;
+    int*        stack;      /*!< Nodes not yet joined to their parent */
+    int*        frames;     /*!< Where each open parenthesis starts on the stack */
+    int*        seen;       /*!< The tree in which each taxon was last seen */
+    int         ntrees;
+    MPLtree*    tree;       /*!< The last tree read */
+} MPLnwkreader;
+
+MPLnwkreader*   mpl_new_nwkreader(const int ntax, const char* const* labels);
+void            mpl_delete_nwkreader(MPLnwkreader* r);
+int             mpl_nwkreader_set_file(FILE* fp, MPLnwkreader* r);
+void            mpl_nwkreader_set_buffer(const char* buf, const size_t size, MPLnwkreader* r);
+int             mpl_nwkreader_read(MPLnwkreader* r);
+
+#endif /* newick_h */
@@ -0,0 +1,289 @@
+//
+//  sankoff.c
+//  morphylib
+//
+//  Step matrix (USERTYPE_T) characters are optimised with Sankoff's algorithm.
+//  Each node holds a vector of costs for every state: downcosts holds the cost
+//  of the subtree given the node is in that state, and upcosts holds the cost
+//  of the rest of the tree (including the node's own branch) given the same.
+//  A step matrix entry C[a][b] is the cost of a change from ancestral state a
+//  to descendant state b.
+//
+//  All cost vectors in a partition are stored with the state as the outer
+//  index and the character as the inner one, so that each min-plus product is
+//  a run of plain vector operations across characters. Node cost vectors are
+//  indexed by position in the partition, not by character number.
+//
+//  The state sets at nodes are written as the states of minimum cost so that
+//  they can be queried in the same way as for any other type.
+//
+#include "mpl.h"
+#include "morphydefs.h"
+#include "morphy.h"
+#include "mplerror.h"
+#include "sankoff.h"
+
+/* out[a] = min over b of (C[a][b] + v[b]) for all states a and characters.
+ * With transpose set, C[b][a] is used instead, which looks up the tree rather
+ * than down it. */
+static void mpl_sankoff_min_plus
+(MPLcost* out, const MPLcost* v, const MPLpartition* part, const bool transpose)
+{
+    int a = 0;
+    int b = 0;
+    int i = 0;
+    const int nchars    = part->ncharsinpart;
+    const int nst       = part->nstmxstates;
+    MPLcost* o          = NULL;
+    const MPLcost* c    = NULL;
+    const MPLcost* vb   = NULL;
+    MPLcost t           = 0;
+
+    for (a = 0; a < nst; ++a) {
+
+        o = &out[a * nchars];
+
+        for (i = 0; i < nchars; ++i) {
+            o[i] = MPLCOSTINF;
+        }
+
+        for (b = 0; b < nst; ++b) {
+
+            c  = transpose ? &part->stepmatrices[(b * nst + a) * nchars]
+                           : &part->stepmatrices[(a * nst + b) * nchars];
+            vb = &v[b * nchars];
+
+#pragma clang loop vectorize(enable)
+            for (i = 0; i < nchars; ++i) {
+                t    = c[i] + vb[i];
+                o[i] = t < o[i] ? t : o[i];
+            }
+        }
+    }
+}
+
+
+/* Finds the cheapest states for character i of the sum of two cost vectors (or
+ * of only one if w is NULL), returning them as a state set and the cost in
+ * best. */
+static MPLstate mpl_sankoff_best
+(const MPLcost* v, const MPLcost* w, const int i, const MPLpartition* part,
+ MPLcost* best)
+{
+    int a = 0;
+    const int nchars    = part->ncharsinpart;
+    const int nst       = part->nstmxstates;
+    MPLstate res        = 0;
+    MPLcost  min        = (MPLcost)~0;
+    MPLcost  t          = 0;
+
+    for (a = 0; a < nst; ++a) {
+        t = v[a * nchars + i] + (w ? w[a * nchars + i] : 0);
+        if (t < min) {
+            min = t;
+            res = 0;
+        }
+        if (t == min) {
+            res |= (MPLstate)1 << (a + part->stmxshift);
+        }
+    }
+
+    *best = min;
+
+    return res;
+}
+
+
+int mpl_sankoff_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int steps = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    int ncosts          = nchars * part->nstmxstates;
+    MPLcost* lcosts     = part->costbuffer;
+    MPLcost* rcosts     = part->costbuffer + ncosts;
+    MPLcost* n          = nset->downcosts;
+    MPLcost  nmin       = 0;
+    MPLcost  lmin       = 0;
+    MPLcost  rmin       = 0;
+
+    unsigned long* weights = part->intwts;
+
+    mpl_sankoff_min_plus(lcosts, lset->downcosts, part, false);
+    mpl_sankoff_min_plus(rcosts, rset->downcosts, part, false);
+
+#pragma clang loop vectorize(enable)
+    for (i = 0; i < ncosts; ++i) {
+        n[i] = lcosts[i] + rcosts[i];
+    }
+
+    // The steps at a node are the amount by which its minimum cost exceeds
+    // those of its descendants. Summed over a tree, these give its length.
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        mpl_sankoff_best(lset->downcosts, NULL, i, part, &lmin);
+        mpl_sankoff_best(rset->downcosts, NULL, i, part, &rmin);
+        nset->downpass1[j] = mpl_sankoff_best(n, NULL, i, part, &nmin);
+
+        steps += weights[i] * (nmin - lmin - rmin);
+    }
+
+    return steps;
+}
+
+
+int mpl_sankoff_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    int ncosts          = nchars * part->nstmxstates;
+    MPLcost* lcosts     = part->costbuffer;
+    MPLcost* rcosts     = part->costbuffer + ncosts;
+    MPLcost* nup        = nset->upcosts;
+    MPLcost  min        = 0;
+
+    mpl_sankoff_min_plus(lcosts, lset->downcosts, part, false);
+    mpl_sankoff_min_plus(rcosts, rset->downcosts, part, false);
+
+    // Everything outside a descendant's subtree is the rest of the tree plus
+    // its sibling's subtree.
+#pragma clang loop vectorize(enable)
+    for (i = 0; i < ncosts; ++i) {
+        lcosts[i] += nup[i];
+        rcosts[i] += nup[i];
+    }
+
+    mpl_sankoff_min_plus(lset->upcosts, rcosts, part, true);
+    mpl_sankoff_min_plus(rset->upcosts, lcosts, part, true);
+
+    for (i = 0; i < nchars; ++i) {
+        j = indices[i];
+        nset->uppass1[j] = mpl_sankoff_best(nset->downcosts, nup, i, part, &min);
+    }
+
+    return 0;
+}
+
+
+int mpl_sankoff_tip_update
+(MPLndsets* tset, MPLndsets* ancset, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int* indices    = part->charindices;
+    int nchars      = part->ncharsinpart;
+    MPLcost min     = 0;
+
+    for (i = 0; i < nchars; ++i) {
+        j = indices[i];
+        tset->uppass1[j] = mpl_sankoff_best(tset->downcosts, tset->upcosts, i,
+                                            part, &min);
+    }
+
+    return 0;
+}
+
+
+int mpl_sankoff_update_root
+(MPLndsets* lower, MPLndsets* upper, MPLpartition* part)
+{
+    // The root can take any state at no cost
+    memset(upper->upcosts, 0,
+           part->ncharsinpart * part->nstmxstates * sizeof(MPLcost));
+
+    return mpl_update_root(lower, upper, part);
+}
+
+
+/*!
+ @brief Calculates the length added by the branch between a tip and the rest
+ of an unrooted tree.
+ @discussion The tip is treated as the ancestor of the node. The tip's upcosts
+ are set as though the direction were reversed, which is only exact for a
+ symmetric step matrix.
+ */
+int mpl_sankoff_one_branch
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part)
+{
+    int i     = 0;
+    int j     = 0;
+    int length = 0;
+    int* indices    = part->charindices;
+    int nchars      = part->ncharsinpart;
+    MPLcost before  = 0;
+    MPLcost after   = 0;
+
+    unsigned long* weights = part->intwts;
+
+    mpl_sankoff_min_plus(node->upcosts, tipanc->downcosts, part, true);
+    mpl_sankoff_min_plus(tipanc->upcosts, node->downcosts, part, false);
+
+    for (i = 0; i < nchars; ++i) {
+
+        j = indices[i];
+
+        mpl_sankoff_best(node->downcosts, NULL, i, part, &before);
+        mpl_sankoff_best(node->downcosts, node->upcosts, i, part, &after);
+
+        length += weights[i] * (after - before);
+
+        tipanc->uppass1[j] = mpl_sankoff_best(tipanc->downcosts,
+                                              tipanc->upcosts, i, part, &after);
+    }
+
+    return length;
+}
+
+
+/*!
+ @brief Calculates the length added by inserting a subtree on a branch.
+ @discussion The cost is exact: the new node takes the state that minimises
+ the cost of the rest of the tree, the target subtree and the source subtree.
+ tgt1set must be the descendant end of the target branch.
+ */
+int mpl_sankoff_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen)
+{
+    int i     = 0;
+    int steps = 0;
+    int nchars          = part->ncharsinpart;
+    int ncosts          = nchars * part->nstmxstates;
+    MPLcost* scosts     = part->costbuffer;
+    MPLcost* tcosts     = part->costbuffer + ncosts;
+    MPLcost  before     = 0;
+    MPLcost  after      = 0;
+
+    unsigned long* weights = part->intwts;
+
+    mpl_sankoff_min_plus(scosts, srcset->downcosts, part, false);
+    mpl_sankoff_min_plus(tcosts, tgt1set->downcosts, part, false);
+
+#pragma clang loop vectorize(enable)
+    for (i = 0; i < ncosts; ++i) {
+        scosts[i] += tcosts[i];
+    }
+
+    for (i = 0; i < nchars; ++i) {
+
+        mpl_sankoff_best(tgt1set->downcosts, tgt1set->upcosts, i, part, &before);
+        mpl_sankoff_best(scosts, tgt1set->upcosts, i, part, &after);
+
+        steps += weights[i] * (after - before);
+
+        if (domaxlen == true && steps > maxlen) {
+            return steps;
+        }
+    }
+
+    return steps;
+}
@@ -0,0 +1,25 @@
+//
+//  sankoff.h
+//  morphylib
+//
+//  Kernels for characters with user-defined step matrices.
+//
+
+#ifndef sankoff_h
+#define sankoff_h
+
+int mpl_sankoff_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part);
+int mpl_sankoff_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part);
+int mpl_sankoff_tip_update
+(MPLndsets* tset, MPLndsets* ancset, MPLpartition* part);
+int mpl_sankoff_update_root
+(MPLndsets* lower, MPLndsets* upper, MPLpartition* part);
+int mpl_sankoff_one_branch
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part);
+int mpl_sankoff_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen);
+#endif /* sankoff_h */
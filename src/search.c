@@ -0,0 +1,3004 @@
+//
+//  search.c
+//  morphylib
+//
+//  Tree search by subtree pruning and regrafting (SPR). The subtree below each
+//  node in turn is pruned, and the cost of reinserting it on every branch is
+//  found in a single sweep of mpl_get_insertcost. A prune or regraft changes
+//  the downpass sets only on the path from the clip point to the root, and the
+//  uppass sets only where those changes reach, so for Fitch and Wagner
+//  characters without inapplicable data only those nodes are recalculated.
+//  Other types are rescored over the whole tree. Insertion costs are exact
+//  only for Fitch characters without inapplicable data, so with any others a
+//  rearrangement that appears to be no longer than the best tree is scored in
+//  full on a worker before it is accepted, and the lengths reported are always
+//  exact.
+//
+//  Tree bisection and reconnection (TBR) extends this by rerooting each
+//  pruned subtree on every one of its branches. Rather than repeating the
+//  passes over the subtree for each rooting, the root is walked from branch to
+//  branch and only the sets of the nodes it moves past are recalculated. As
+//  trying the candidates of a rooting leaves the sets of the rest of the tree
+//  as they were, nothing else is recalculated between rootings.
+//
+//  Starting trees are built by stepwise addition, using the same insertion
+//  costs to place each new taxon.
+//
+//  The ratchet perturbs the weights held in each partition directly, rather
+//  than through the character info, so that none of the partitions, nodal
+//  sets or tip data need to be set up again between iterations.
+//
+//  Replicates from random addition sequences can be run on several threads.
+//  Each thread evaluates through a worker handle sharing the prepared data
+//  with the caller's, and merges its trees into a common store under a lock.
+//
+//  Branch and bound adds the taxa one at a time in every possible way, and
+//  abandons a partial tree once it is longer than the best found, allowing for
+//  the steps the taxa still to come can't avoid. The partial trees at a level
+//  deep enough for there to be several per thread are shared out in the same
+//  way as replicates.
+//
+//  A batch of trees supplied by the caller is scored in the same way, each
+//  thread taking the next tree until there are none left.
+//
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "mpl.h"
+#include "morphydefs.h"
+#include "morphy.h"
+#include "mplerror.h"
+#include "search.h"
+#include "downcache.h"
+
+typedef struct {
+    int     tgt;
+    int     length;
+} MPLinsert;
+
+
+MPLtree* mpl_new_tree(const int ntax)
+{
+    MPLtree* t = (MPLtree*)calloc(1, sizeof(MPLtree));
+
+    if (!t) {
+        return NULL;
+    }
+
+    t->ntax         = ntax;
+    t->lroot        = 2 * ntax - 1;
+    t->anc          = (int*)calloc(2 * ntax, sizeof(int));
+    t->left         = (int*)calloc(2 * ntax, sizeof(int));
+    t->right        = (int*)calloc(2 * ntax, sizeof(int));
+    t->postorder    = (int*)calloc(ntax, sizeof(int));
+    t->tips         = (int*)calloc(ntax, sizeof(int));
+    t->nodesteps    = (int*)calloc(2 * ntax, sizeof(int));
+    t->stack        = (int*)calloc(2 * ntax, sizeof(int));
+
+    if (!t->anc || !t->left || !t->right || !t->postorder || !t->tips ||
+        !t->nodesteps || !t->stack) {
+        mpl_delete_tree(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+
+void mpl_delete_tree(MPLtree* t)
+{
+    if (!t) {
+        return;
+    }
+
+    free(t->anc);
+    free(t->left);
+    free(t->right);
+    free(t->postorder);
+    free(t->tips);
+    free(t->nodesteps);
+    free(t->stack);
+    free(t);
+}
+
+
+/* Lists the tips and internal nodes connected to the root. The internal nodes
+ * are found in preorder, which reversed is a postorder. */
+void mpl_tree_traverse(MPLtree* t)
+{
+    int i   = 0;
+    int n   = 0;
+    int sp  = 0;
+
+    t->ninternal    = 0;
+    t->ntips        = 0;
+    t->stack[sp++]  = t->root;
+
+    while (sp) {
+        n = t->stack[--sp];
+        if (n < t->ntax) {
+            t->tips[t->ntips++] = n;
+        }
+        else {
+            t->postorder[t->ninternal++] = n;
+            t->stack[sp++] = t->left[n];
+            t->stack[sp++] = t->right[n];
+        }
+    }
+
+    for (i = 0; i < t->ninternal / 2; ++i) {
+        n = t->postorder[i];
+        t->postorder[i] = t->postorder[t->ninternal - 1 - i];
+        t->postorder[t->ninternal - 1 - i] = n;
+    }
+}
+
+
+/*!
+ @brief Reads a tree from a vector giving the parent of each node.
+ @discussion The vector has 2 * ntax - 1 entries. Tips are 0 to ntax - 1 and
+ the root is the only node whose parent is -1.
+ @return ERR_BAD_PARAM if the vector does not describe a binary tree on all
+ the taxa.
+ */
+int mpl_tree_read_parents(const int* parents, MPLtree* t)
+{
+    int i = 0;
+    int p = 0;
+    int ntax = t->ntax;
+    int nnodes = 2 * ntax - 1;
+
+    t->root = -1;
+    for (i = 0; i < 2 * ntax; ++i) {
+        t->left[i]  = -1;
+        t->right[i] = -1;
+    }
+
+    for (i = 0; i < nnodes; ++i) {
+
+        p = parents[i];
+
+        if (p == -1) {
+            if (i < ntax || t->root != -1) {
+                return ERR_BAD_PARAM;
+            }
+            t->root = i;
+            continue;
+        }
+
+        if (p < ntax || p >= nnodes) {
+            return ERR_BAD_PARAM;
+        }
+
+        if (t->left[p] == -1) {
+            t->left[p] = i;
+        }
+        else if (t->right[p] == -1) {
+            t->right[p] = i;
+        }
+        else {
+            return ERR_BAD_PARAM;
+        }
+
+        t->anc[i] = p;
+    }
+
+    if (t->root == -1) {
+        return ERR_BAD_PARAM;
+    }
+
+    for (i = ntax; i < nnodes; ++i) {
+        if (t->left[i] == -1 || t->right[i] == -1) {
+            return ERR_BAD_PARAM;
+        }
+    }
+
+    t->anc[t->root] = t->lroot;
+    mpl_tree_traverse(t);
+
+    // Anything not reached from the root is in a cycle
+    if (t->ntips != ntax || t->ninternal != ntax - 1) {
+        return ERR_BAD_PARAM;
+    }
+
+    return ERR_NO_ERROR;
+}
+
+
+void mpl_tree_write_parents(const MPLtree* t, int* parents)
+{
+    int i = 0;
+
+    for (i = 0; i < t->ntips; ++i) {
+        parents[t->tips[i]] = t->anc[t->tips[i]];
+    }
+    for (i = 0; i < t->ninternal; ++i) {
+        parents[t->postorder[i]] = t->anc[t->postorder[i]];
+    }
+
+    parents[t->root] = -1;
+}
+
+
+/* Does a full set of passes over the connected part of the tree, as any
+ * caller of the nodal functions would, and returns its length. */
+int mpl_tree_score(MPLtree* t, Morphyp handl)
+{
+    int i = 0;
+    int n = 0;
+    int length = 0;
+    Morphy m = (Morphy)handl;
+
+    for (i = 0; i < t->ninternal; ++i) {
+        n = t->postorder[i];
+        t->nodesteps[n] = mpl_first_down_recon(n, t->left[n], t->right[n], m);
+    }
+
+    mpl_update_lower_root(t->lroot, t->root, m);
+
+    for (i = t->ninternal; i--;) {
+        n = t->postorder[i];
+        t->nodesteps[n] += mpl_first_up_recon(n, t->left[n], t->right[n],
+                                              t->anc[n], m);
+    }
+
+    for (i = 0; i < t->ntips; ++i) {
+        n = t->tips[i];
+        t->nodesteps[n] = mpl_update_tip(n, t->anc[n], m);
+    }
+
+    if (mpl_get_gaphandl(handl) == GAP_INAPPLIC) {
+
+        for (i = 0; i < t->ninternal; ++i) {
+            n = t->postorder[i];
+            t->nodesteps[n] += mpl_second_down_recon(n, t->left[n],
+                                                     t->right[n], m);
+        }
+
+        for (i = t->ninternal; i--;) {
+            n = t->postorder[i];
+            t->nodesteps[n] += mpl_second_up_recon(n, t->left[n], t->right[n],
+                                                   t->anc[n], m);
+        }
+
+        for (i = 0; i < t->ntips; ++i) {
+            n = t->tips[i];
+            mpl_finalize_tip(n, t->anc[n], m);
+        }
+    }
+
+    for (i = 0; i < t->ninternal; ++i) {
+        length += t->nodesteps[t->postorder[i]];
+    }
+    for (i = 0; i < t->ntips; ++i) {
+        length += t->nodesteps[t->tips[i]];
+    }
+
+    return length;
+}
+
+
+/* Finds the length of the tree with only the passes it depends on. Every
+ * partition needs the first downpass, but only those listed in upparts need
+ * the first uppass and tip updates, and only those with inapplicable data the
+ * second downpass. No second uppass adds steps, so it is left out. The sets
+ * are incomplete afterwards, so the tree must be scored in full before they or
+ * its insertion costs are used. */
+int mpl_tree_length(MPLtree* t, Morphyp handl)
+{
+    int i = 0;
+    int n = 0;
+    int length = 0;
+    int numparts = handl->numparts;
+    MPLpartition** parts = handl->partitions;
+    Morphy m = (Morphy)handl;
+
+    for (i = 0; i < t->ninternal; ++i) {
+        n = t->postorder[i];
+        t->nodesteps[n] = mpl_first_down_recon(n, t->left[n], t->right[n], m);
+        length += t->nodesteps[n];
+    }
+
+    mpl_update_lower_root(t->lroot, t->root, m);
+
+    for (i = 0; i < t->ntips; ++i) {
+        t->nodesteps[t->tips[i]] = 0;
+    }
+
+    if (!handl->numupparts) {
+        return length;
+    }
+
+    handl->partitions   = handl->upparts;
+    handl->numparts     = handl->numupparts;
+
+    for (i = t->ninternal; i--;) {
+        n = t->postorder[i];
+        t->nodesteps[n] += mpl_first_up_recon(n, t->left[n], t->right[n],
+                                              t->anc[n], m);
+    }
+
+    for (i = 0; i < t->ntips; ++i) {
+        n = t->tips[i];
+        t->nodesteps[n] = mpl_update_tip(n, t->anc[n], m);
+    }
+
+    if (mpl_get_gaphandl(handl) == GAP_INAPPLIC) {
+        for (i = 0; i < t->ninternal; ++i) {
+            n = t->postorder[i];
+            t->nodesteps[n] += mpl_second_down_recon(n, t->left[n],
+                                                     t->right[n], m);
+        }
+    }
+
+    handl->partitions   = parts;
+    handl->numparts     = numparts;
+
+    length = 0;
+    for (i = 0; i < t->ninternal; ++i) {
+        length += t->nodesteps[t->postorder[i]];
+    }
+    for (i = 0; i < t->ntips; ++i) {
+        length += t->nodesteps[t->tips[i]];
+    }
+
+    return length;
+}
+
+
+/*!
+ @brief Detaches the subtree below a node, along with the node joining it to
+ the rest of the tree.
+ @return The sibling of the pruned subtree, on whose branch it can be grafted
+ to restore the tree.
+ */
+int mpl_tree_prune(const int node, MPLtree* t)
+{
+    int a = t->anc[node];
+    int s = t->left[a] == node ? t->right[a] : t->left[a];
+    int g = t->anc[a];
+
+    if (a == t->root) {
+        t->root = s;
+        t->anc[s] = t->lroot;
+    }
+    else {
+        if (t->left[g] == a) {
+            t->left[g] = s;
+        }
+        else {
+            t->right[g] = s;
+        }
+        t->anc[s] = g;
+    }
+
+    t->left[a]  = node;
+    t->right[a] = -1;
+
+    mpl_tree_traverse(t);
+
+    return s;
+}
+
+
+/* Grafts a pruned subtree onto the branch below tgt. */
+void mpl_tree_graft(const int node, const int tgt, MPLtree* t)
+{
+    int a = t->anc[node];
+    int g = t->anc[tgt];
+
+    if (tgt == t->root) {
+        t->root = a;
+        t->anc[a] = t->lroot;
+    }
+    else {
+        if (t->left[g] == tgt) {
+            t->left[g] = a;
+        }
+        else {
+            t->right[g] = a;
+        }
+        t->anc[a] = g;
+    }
+
+    t->left[a]  = node;
+    t->right[a] = tgt;
+    t->anc[tgt] = a;
+
+    mpl_tree_traverse(t);
+}
+
+
+/* The steps counted within a subtree in the last full pass. */
+int mpl_subtree_steps(const int node, const MPLtree* t)
+{
+    int n       = 0;
+    int sp      = 0;
+    int steps   = 0;
+
+    t->stack[sp++] = node;
+
+    while (sp) {
+        n = t->stack[--sp];
+        steps += t->nodesteps[n];
+        if (n >= t->ntax) {
+            t->stack[sp++] = t->left[n];
+            t->stack[sp++] = t->right[n];
+        }
+    }
+
+    return steps;
+}
+
+
+void mpl_rng_seed(const unsigned long long seed, MPLrng* rng)
+{
+    // One round of splitmix64 so that nearby seeds give unrelated streams
+    unsigned long long s = seed + 0x9E3779B97F4A7C15ULL;
+    s = (s ^ (s >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    s = (s ^ (s >> 27)) * 0x94D049BB133111EBULL;
+    s ^= s >> 31;
+    rng->s = s ? s : 0x2545F4914F6CDD1DULL;
+}
+
+
+unsigned long long mpl_rng_next(MPLrng* rng)
+{
+    rng->s ^= rng->s >> 12;
+    rng->s ^= rng->s << 25;
+    rng->s ^= rng->s >> 27;
+    return rng->s * 0x2545F4914F6CDD1DULL;
+}
+
+
+int mpl_rng_below(const int n, MPLrng* rng)
+{
+    return (int)(mpl_rng_next(rng) % (unsigned long long)n);
+}
+
+
+MPLtreestore* mpl_new_treestore(const int ntax, const int maxtrees)
+{
+    int i = 0;
+    MPLtreestore* s = (MPLtreestore*)calloc(1, sizeof(MPLtreestore));
+
+    if (!s) {
+        return NULL;
+    }
+
+    s->ntax     = ntax;
+    s->maxtrees = maxtrees;
+    s->length   = INT_MAX;
+    s->capacity = maxtrees < 16 ? maxtrees : 16;
+    s->nslots   = 32;
+    s->hashes   = (MPLtreehash*)calloc(s->capacity, sizeof(MPLtreehash));
+    s->trees    = (int*)calloc((size_t)s->capacity * (2 * ntax - 1),
+                               sizeof(int));
+    s->slots    = (int*)malloc(s->nslots * sizeof(int));
+    s->splits   = (MPLtreehash*)calloc(2 * ntax, sizeof(MPLtreehash));
+    s->sizes    = (int*)calloc(2 * ntax, sizeof(int));
+
+    if (!s->hashes || !s->trees || !s->slots || !s->splits || !s->sizes) {
+        mpl_delete_treestore(s);
+        return NULL;
+    }
+
+    for (i = 0; i < s->nslots; ++i) {
+        s->slots[i] = -1;
+    }
+
+    return s;
+}
+
+
+void mpl_delete_treestore(MPLtreestore* s)
+{
+    if (!s) {
+        return;
+    }
+
+    free(s->hashes);
+    free(s->trees);
+    free(s->slots);
+    free(s->splits);
+    free(s->sizes);
+    free(s);
+}
+
+
+void mpl_treestore_reset(const int length, MPLtreestore* s)
+{
+    int i = 0;
+
+    for (i = 0; i < s->nslots; ++i) {
+        s->slots[i] = -1;
+    }
+
+    s->ntrees = 0;
+    s->length = length;
+}
+
+
+bool mpl_treestore_full(const MPLtreestore* s)
+{
+    return s->ntrees == s->maxtrees;
+}
+
+
+/* Each tip has two fixed random keys, and a subtree's keys are the XOR of
+ * those of its tips. A split is keyed by the side whose first key is the
+ * smaller, so that it doesn't matter which side holds the root. Each half of
+ * the tree's hash is the sum of the mixed keys of its non-trivial splits. */
+static MPLtreehash mpl_tree_hash(const MPLtree* t, MPLtreestore* s)
+{
+    int i = 0;
+    int n = 0;
+    MPLtreehash all;
+    MPLtreehash key;
+    MPLtreehash hash = {0, 0};
+    MPLtreehash* splits = s->splits;
+    int* sizes = s->sizes;
+
+    for (i = 0; i < t->ntips; ++i) {
+        n = t->tips[i];
+        splits[n].lo    = mpl_mix_hash(n + 1);
+        splits[n].hi    = mpl_mix_hash(~(unsigned long long)n);
+        sizes[n]        = 1;
+    }
+
+    for (i = 0; i < t->ninternal; ++i) {
+        n = t->postorder[i];
+        splits[n].lo    = splits[t->left[n]].lo ^ splits[t->right[n]].lo;
+        splits[n].hi    = splits[t->left[n]].hi ^ splits[t->right[n]].hi;
+        sizes[n]        = sizes[t->left[n]] + sizes[t->right[n]];
+    }
+
+    all = splits[t->root];
+
+    for (i = 0; i < t->ninternal; ++i) {
+
+        n = t->postorder[i];
+
+        if (n == t->root || sizes[n] >= t->ntax - 1) {
+            continue;
+        }
+
+        // Both sides of the root describe the same split
+        if (n == t->right[t->root] && t->left[t->root] >= t->ntax) {
+            continue;
+        }
+
+        key = splits[n];
+        if ((key.lo ^ all.lo) < key.lo) {
+            key.lo ^= all.lo;
+            key.hi ^= all.hi;
+        }
+
+        hash.lo += mpl_mix_hash(key.lo);
+        hash.hi += mpl_mix_hash(key.hi);
+    }
+
+    return hash;
+}
+
+
+/* The slot holding a tree with the hash given, or the empty slot where it
+ * would go. */
+static int mpl_treestore_slot(const MPLtreehash* hash, const MPLtreestore* s)
+{
+    int i = (int)(hash->lo & (unsigned long long)(s->nslots - 1));
+    int k = 0;
+
+    while ((k = s->slots[i]) >= 0) {
+        if (s->hashes[k].lo == hash->lo && s->hashes[k].hi == hash->hi) {
+            break;
+        }
+        i = (i + 1) & (s->nslots - 1);
+    }
+
+    return i;
+}
+
+
+/* Makes space for more trees, keeping the table at most half full. */
+static bool mpl_treestore_grow(MPLtreestore* s)
+{
+    int i = 0;
+    int cap = s->capacity < s->maxtrees / 2 ? 2 * s->capacity : s->maxtrees;
+    int nslots = s->nslots;
+    int* trees = NULL;
+    int* slots = NULL;
+    MPLtreehash* hashes = NULL;
+
+    hashes = (MPLtreehash*)realloc(s->hashes, cap * sizeof(MPLtreehash));
+    if (!hashes) {
+        return false;
+    }
+    s->hashes = hashes;
+
+    trees = (int*)realloc(s->trees, (size_t)cap * (2 * s->ntax - 1) *
+                          sizeof(int));
+    if (!trees) {
+        return false;
+    }
+    s->trees = trees;
+
+    while (nslots < 2 * cap) {
+        nslots *= 2;
+    }
+
+    if (nslots != s->nslots) {
+
+        if (!(slots = (int*)malloc(nslots * sizeof(int)))) {
+            return false;
+        }
+
+        free(s->slots);
+        s->slots    = slots;
+        s->nslots   = nslots;
+
+        for (i = 0; i < nslots; ++i) {
+            slots[i] = -1;
+        }
+        for (i = 0; i < s->ntrees; ++i) {
+            slots[mpl_treestore_slot(&s->hashes[i], s)] = i;
+        }
+    }
+
+    s->capacity = cap;
+
+    return true;
+}
+
+
+/* Enters a hash that isn't already in the store.
+ * @return The index at which the tree must be written, or -1 if it is there
+ * already or there is no room. */
+static int mpl_treestore_put(const MPLtreehash* hash, MPLtreestore* s)
+{
+    int i = mpl_treestore_slot(hash, s);
+
+    if (s->slots[i] >= 0 || mpl_treestore_full(s)) {
+        return -1;
+    }
+
+    if (s->ntrees == s->capacity) {
+        if (!mpl_treestore_grow(s)) {
+            return -1;
+        }
+        i = mpl_treestore_slot(hash, s);
+    }
+
+    s->hashes[s->ntrees]    = *hash;
+    s->slots[i]             = s->ntrees;
+
+    return s->ntrees++;
+}
+
+
+/* Adds a tree to the store if there is room and it isn't already there. */
+bool mpl_treestore_add(const MPLtree* t, MPLtreestore* s)
+{
+    int i = 0;
+    MPLtreehash hash;
+
+    if (mpl_treestore_full(s)) {
+        return false;
+    }
+
+    hash = mpl_tree_hash(t, s);
+
+    if ((i = mpl_treestore_put(&hash, s)) < 0) {
+        return false;
+    }
+
+    mpl_tree_write_parents(t, &s->trees[(size_t)i * (2 * s->ntax - 1)]);
+
+    return true;
+}
+
+
+/* Offers all the trees of src to dst. The tips' keys are the same in every
+ * store, so the trees don't need to be hashed again. */
+void mpl_treestore_merge(const MPLtreestore* src, MPLtreestore* dst)
+{
+    int i = 0;
+    int k = 0;
+    size_t size = 2 * dst->ntax - 1;
+
+    if (src->length < dst->length) {
+        mpl_treestore_reset(src->length, dst);
+    }
+    if (src->length != dst->length) {
+        return;
+    }
+
+    for (i = 0; i < src->ntrees && !mpl_treestore_full(dst); ++i) {
+        if ((k = mpl_treestore_put(&src->hashes[i], dst)) >= 0) {
+            memcpy(&dst->trees[k * size], &src->trees[i * size],
+                   size * sizeof(int));
+        }
+    }
+}
+
+
+/* Keeps a tree if it is at least as short as those already stored. */
+void mpl_treestore_offer(const int length, const MPLtree* t, MPLtreestore* s)
+{
+    if (length < s->length) {
+        mpl_treestore_reset(length, s);
+    }
+    if (length == s->length) {
+        mpl_treestore_add(t, s);
+    }
+}
+
+
+static int mpl_compare_inserts(const void* a, const void* b)
+{
+    return ((const MPLinsert*)a)->length - ((const MPLinsert*)b)->length;
+}
+
+
+/* Fitch and Wagner characters without inapplicable data. Their length can't
+ * fall as taxa are added, and none of their sets depend on nodes other than
+ * the neighbours of the node. */
+static bool mpl_bb_keep_partition(const MPLpartition* p, const Morphyp handl)
+{
+    return p->isNAtype == false && (p->chtype == FITCH_T ||
+                                    p->chtype == WAGNER_T);
+}
+
+
+/* The state of a hill climb. The partitions that mpl_bb_keep_partition
+ * accepts have sets that depend only on neighbouring nodes and lengths that
+ * don't depend on the rooting, so their sets are brought up to date after
+ * each move only where it changes them. The rest are rescored over the whole
+ * tree. Insertion costs are exact only for Fitch characters without
+ * inapplicable data. Otherwise each candidate is scored in full on a worker,
+ * so that trying candidates never disturbs the sets of the handle. */
+typedef struct {
+    Morphyp         handl;
+    MPLtree*        t;
+    MPLpartition**  parts;      /*!< All the partitions of the handle */
+    int             numparts;
+    MPLpartition**  incr;       /*!< Those updated node by node */
+    int             nincr;
+    MPLpartition**  rest;       /*!< Those rescored over the whole tree */
+    int             nrest;
+    int*            chars;      /*!< The characters of incr */
+    int             nchars;
+    MPLstate*       before;     /*!< Their sets at a node before it is redone */
+    int*            steps;      /*!< The steps of incr at each node */
+    int             length;     /*!< Their sum, including any pruned subtree */
+    bool*           dirty;      /*!< Nodes whose uppass must be redone */
+    bool*           below;      /*!< Nodes with a dirty node below them */
+    bool*           changed;    /*!< Nodes whose uppass sets have changed */
+    int*            stack;
+    int*            visited;
+    Morphyp         exact;      /*!< Scores candidates in full, unless every insertion cost is exact */
+    MPLdowncache*   downcache;  /*!< Set aside while the sets are partial */
+} MPLclimb;
+
+
+static void mpl_climb_use
+(MPLpartition** parts, const int numparts, MPLclimb* cl)
+{
+    cl->handl->partitions   = parts;
+    cl->handl->numparts     = numparts;
+}
+
+
+static void mpl_climb_save(const MPLstate* sets, MPLclimb* cl)
+{
+    int i = 0;
+
+    for (i = 0; i < cl->nchars; ++i) {
+        cl->before[i] = sets[cl->chars[i]];
+    }
+}
+
+
+static bool mpl_climb_changed(const MPLstate* sets, const MPLclimb* cl)
+{
+    int i = 0;
+
+    for (i = 0; i < cl->nchars; ++i) {
+        if (sets[cl->chars[i]] != cl->before[i]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/* Marks a node whose uppass must be redone, and the path down to it. */
+static void mpl_climb_mark(int n, MPLclimb* cl)
+{
+    MPLtree* t = cl->t;
+
+    cl->dirty[n] = true;
+
+    while (n != t->root && !cl->below[t->anc[n]]) {
+        n = t->anc[n];
+        cl->below[n] = true;
+    }
+}
+
+
+/* Redoes the downpass of incr at n and the nforced - 1 nodes above it, whose
+ * descendants have changed. Further up, a node can only change if the one
+ * below it did, so the pass stops at the first whose sets are unchanged. */
+static void mpl_climb_down(int n, int nforced, MPLclimb* cl)
+{
+    int steps       = 0;
+    bool changed    = true;
+    MPLtree* t      = cl->t;
+    MPLndsets** sets = cl->handl->statesets;
+    Morphy m        = (Morphy)cl->handl;
+
+    while (n != t->lroot && (nforced > 0 || changed)) {
+
+        mpl_climb_save(sets[n]->downpass1, cl);
+        steps = mpl_first_down_recon(n, t->left[n], t->right[n], m);
+        changed = mpl_climb_changed(sets[n]->downpass1, cl);
+
+        cl->length += steps - cl->steps[n];
+        cl->steps[n] = steps;
+        mpl_climb_mark(n, cl);
+
+        if (n == t->root) {
+            mpl_update_lower_root(t->lroot, n, m);
+        }
+
+        n = t->anc[n];
+        --nforced;
+    }
+}
+
+
+/* Redoes the uppass of incr at the marked nodes, and below any node whose
+ * uppass sets change as a result. */
+static void mpl_climb_up(MPLclimb* cl)
+{
+    int i           = 0;
+    int n           = 0;
+    int sp          = 0;
+    int nvisited    = 0;
+    bool redo       = false;
+    MPLtree* t      = cl->t;
+    MPLndsets** sets = cl->handl->statesets;
+    Morphy m        = (Morphy)cl->handl;
+
+    cl->stack[sp++] = t->root;
+
+    while (sp) {
+
+        n = cl->stack[--sp];
+        cl->visited[nvisited++] = n;
+        redo = cl->dirty[n] || cl->changed[t->anc[n]];
+
+        if (redo) {
+            mpl_climb_save(sets[n]->uppass1, cl);
+            if (n < t->ntax) {
+                mpl_update_tip(n, t->anc[n], m);
+            }
+            else {
+                mpl_first_up_recon(n, t->left[n], t->right[n], t->anc[n], m);
+            }
+            cl->changed[n] = mpl_climb_changed(sets[n]->uppass1, cl);
+        }
+
+        if (n >= t->ntax && (cl->changed[n] || cl->below[n])) {
+            cl->stack[sp++] = t->right[n];
+            cl->stack[sp++] = t->left[n];
+        }
+
+        cl->dirty[n] = false;
+        cl->below[n] = false;
+    }
+
+    for (i = 0; i < nvisited; ++i) {
+        cl->changed[cl->visited[i]] = false;
+    }
+}
+
+
+/* Rescores the partitions in rest over the connected part of the tree,
+ * leaving their steps in t->nodesteps. Unless full, only the passes their
+ * length depends on are done, so their sets must be rescored in full before
+ * they are used. */
+static int mpl_climb_rest(const bool full, MPLclimb* cl)
+{
+    int length = 0;
+
+    if (!cl->nrest) {
+        return 0;
+    }
+
+    mpl_climb_use(cl->rest, cl->nrest, cl);
+    if (full) {
+        length = mpl_tree_score(cl->t, cl->handl);
+    }
+    else {
+        length = mpl_tree_length(cl->t, cl->handl);
+    }
+    mpl_climb_use(cl->parts, cl->numparts, cl);
+
+    return length;
+}
+
+
+/* Rescores every partition over the whole tree. */
+static int mpl_climb_score(MPLclimb* cl)
+{
+    int i       = 0;
+    MPLtree* t  = cl->t;
+
+    mpl_climb_use(cl->incr, cl->nincr, cl);
+    cl->length = mpl_tree_score(t, cl->handl);
+    mpl_climb_use(cl->parts, cl->numparts, cl);
+
+    for (i = 0; i < t->ntips; ++i) {
+        cl->steps[t->tips[i]] = t->nodesteps[t->tips[i]];
+    }
+    for (i = 0; i < t->ninternal; ++i) {
+        cl->steps[t->postorder[i]] = t->nodesteps[t->postorder[i]];
+    }
+
+    return cl->length + mpl_climb_rest(true, cl);
+}
+
+
+/* Prunes the subtree below c as mpl_tree_prune does. Of incr, only the nodes
+ * on the path from the clip point to the root are passed down again, and only
+ * those whose uppass sets depend on them are passed up again. */
+static int mpl_climb_prune(const int c, MPLclimb* cl)
+{
+    MPLtree* t  = cl->t;
+    int a       = t->anc[c];
+    int s       = mpl_tree_prune(c, t);
+
+    cl->length -= cl->steps[a];
+    cl->steps[a] = 0;
+
+    mpl_climb_use(cl->incr, cl->nincr, cl);
+    mpl_climb_mark(s, cl);
+
+    if (s == t->root) {
+        mpl_update_lower_root(t->lroot, s, (Morphy)cl->handl);
+    }
+    else {
+        mpl_climb_down(t->anc[s], 1, cl);
+    }
+
+    mpl_climb_up(cl);
+    mpl_climb_use(cl->parts, cl->numparts, cl);
+
+    return s;
+}
+
+
+/* Grafts the pruned subtree below c onto the branch below tgt, updating incr
+ * as mpl_climb_prune does. The rest are next used once the following subtree
+ * is pruned, which rescores them in full, so until then only their steps are
+ * needed. The subtree must have the rooting it had when it was pruned. */
+static void mpl_climb_regraft(const int c, const int tgt, MPLclimb* cl)
+{
+    MPLtree* t = cl->t;
+
+    mpl_tree_graft(c, tgt, t);
+
+    mpl_climb_use(cl->incr, cl->nincr, cl);
+    mpl_climb_mark(c, cl);
+    mpl_climb_mark(tgt, cl);
+    mpl_climb_down(t->anc[c], 2, cl);
+    mpl_climb_up(cl);
+    mpl_climb_use(cl->parts, cl->numparts, cl);
+
+    mpl_climb_rest(false, cl);
+}
+
+
+/* The length of the tree with the pruned subtree below c grafted onto the
+ * branch below tgt, scored in full on the worker. The subtree is pruned again
+ * afterwards. */
+static int mpl_climb_exact(const int c, const int tgt, MPLclimb* cl)
+{
+    int length = 0;
+
+    mpl_tree_graft(c, tgt, cl->t);
+    length = mpl_tree_length(cl->t, cl->exact);
+    mpl_tree_prune(c, cl->t);
+
+    return length;
+}
+
+
+static void mpl_climb_end(MPLclimb* cl)
+{
+    if (cl->parts) {
+        mpl_climb_use(cl->parts, cl->numparts, cl);
+    }
+    cl->handl->downcache = cl->downcache;
+
+    mpl_delete_worker(cl->exact);
+    free(cl->incr);
+    free(cl->rest);
+    free(cl->chars);
+    free(cl->before);
+    free(cl->steps);
+    free(cl->dirty);
+    free(cl->below);
+    free(cl->changed);
+    free(cl->stack);
+    free(cl->visited);
+}
+
+
+/* Sorts the partitions of the handle into those updated node by node and the
+ * rest, and scores t with them. */
+static int mpl_climb_start(MPLtree* t, MPLclimb* cl, Morphyp handl)
+{
+    int i       = 0;
+    int j       = 0;
+    int nnodes  = 2 * t->ntax;
+    bool exact  = true;
+    MPLpartition* p = NULL;
+
+    memset(cl, 0, sizeof(MPLclimb));
+
+    cl->handl       = handl;
+    cl->t           = t;
+    cl->parts       = handl->partitions;
+    cl->numparts    = handl->numparts;
+    cl->downcache   = handl->downcache;
+
+    // The cache is keyed by whole subtrees, which a partial pass would leave
+    // out of step with the sets
+    handl->downcache = NULL;
+
+    cl->incr    = (MPLpartition**)calloc(cl->numparts + 1,
+                                         sizeof(MPLpartition*));
+    cl->rest    = (MPLpartition**)calloc(cl->numparts + 1,
+                                         sizeof(MPLpartition*));
+    cl->chars   = (int*)calloc(handl->numcharacters + 1, sizeof(int));
+    cl->before  = (MPLstate*)calloc(handl->numcharacters + 1,
+                                    sizeof(MPLstate));
+    cl->steps   = (int*)calloc(nnodes, sizeof(int));
+    cl->dirty   = (bool*)calloc(nnodes, sizeof(bool));
+    cl->below   = (bool*)calloc(nnodes, sizeof(bool));
+    cl->changed = (bool*)calloc(nnodes, sizeof(bool));
+    cl->stack   = (int*)calloc(nnodes, sizeof(int));
+    cl->visited = (int*)calloc(nnodes, sizeof(int));
+
+    if (!cl->incr || !cl->rest || !cl->chars || !cl->before || !cl->steps ||
+        !cl->dirty || !cl->below || !cl->changed || !cl->stack ||
+        !cl->visited) {
+        mpl_climb_end(cl);
+        return ERR_BAD_MALLOC;
+    }
+
+    for (i = 0; i < cl->numparts; ++i) {
+        p = cl->parts[i];
+        if (mpl_bb_keep_partition(p, handl)) {
+            cl->incr[cl->nincr++] = p;
+            for (j = 0; j < p->ncharsinpart; ++j) {
+                cl->chars[cl->nchars++] = p->charindices[j];
+            }
+        }
+        else {
+            cl->rest[cl->nrest++] = p;
+        }
+
+        exact = exact && p->chtype == FITCH_T && !p->isNAtype;
+    }
+
+    if (!exact) {
+        if (!(cl->exact = mpl_new_worker(handl))) {
+            mpl_climb_end(cl);
+            return ERR_BAD_MALLOC;
+        }
+    }
+
+    return mpl_climb_score(cl);
+}
+
+
+/* Finds the branches on which a pruned subtree might be placed without
+ * making the tree longer than best. */
+static int mpl_spr_candidates
+(const int src, const int orig, const int base, const int best,
+ const MPLtreestore* store, MPLinsert* cands, const MPLclimb* cl)
+{
+    int i = 0;
+    int x = 0;
+    int cost = 0;
+    int est = 0;
+    int ncands = 0;
+    bool flagged = false;
+    MPLtree* t = cl->t;
+    Morphy m = (Morphy)cl->handl;
+
+    for (i = 0; i < t->ntips + t->ninternal; ++i) {
+
+        x = i < t->ntips ? t->tips[i] : t->postorder[i - t->ntips];
+
+        if (x == orig) {
+            continue;
+        }
+
+        cost = mpl_get_insertcost(src, x, t->anc[x], true, best - base, m);
+        flagged = mpl_check_reopt_inapplics(m) > 0;
+        est = base + cost;
+
+        // Trees as long as the best are only of interest while they can still
+        // be stored.
+        if (est < best || (est == best && (flagged ||
+            (best == store->length && !mpl_treestore_full(store))))) {
+            cands[ncands].tgt       = x;
+            cands[ncands].length    = est;
+            ++ncands;
+        }
+    }
+
+    qsort(cands, ncands, sizeof(MPLinsert), mpl_compare_inserts);
+
+    return ncands;
+}
+
+
+/* Tries each candidate branch in turn, taking its length from the sweep if
+ * the insertion costs are exact. The first placement that makes the tree
+ * shorter than best is grafted and the sets brought up to date for it.
+ * Otherwise the subtree is left pruned and the sets are untouched. */
+static bool mpl_try_regrafts
+(const int src, const MPLinsert* cands, const int ncands, const bool rerooted,
+ int* best, MPLtreestore* store, MPLclimb* cl)
+{
+    int i   = 0;
+    int len = 0;
+    MPLtree* t = cl->t;
+
+    for (i = 0; i < ncands; ++i) {
+
+        len = cands[i].length;
+
+        if (cl->exact) {
+            len = mpl_climb_exact(src, cands[i].tgt, cl);
+        }
+
+        if (len > *best) {
+            continue;
+        }
+
+        if (len < *best) {
+            // A rerooted subtree has new sets throughout
+            if (rerooted) {
+                mpl_tree_graft(src, cands[i].tgt, t);
+                mpl_climb_score(cl);
+            }
+            else {
+                mpl_climb_regraft(src, cands[i].tgt, cl);
+            }
+            mpl_treestore_offer(len, t, store);
+            *best = len;
+            return true;
+        }
+
+        mpl_tree_graft(src, cands[i].tgt, t);
+        mpl_treestore_offer(len, t, store);
+        mpl_tree_prune(src, t);
+    }
+
+    return false;
+}
+
+
+/* Moves the root of the subtree below c onto the branch above x, where x is
+ * a node of the subtree in its current rooting. Only the nodes on the path
+ * from x to c change their descendants. They are left in t->stack from x
+ * upwards, and their number is returned. */
+static int mpl_tree_reroot(const int c, const int x, MPLtree* t)
+{
+    int i       = 0;
+    int k       = 0;
+    int n       = x;
+    int p       = 0;
+    int repl    = 0;
+    int* path   = t->stack;
+
+    while (n != c) {
+        path[k++] = n;
+        n = t->anc[n];
+    }
+
+    // x is already next to the root
+    if (k < 2) {
+        return k;
+    }
+
+    repl = t->left[c] == path[k - 1] ? t->right[c] : t->left[c];
+
+    for (i = k - 1; i > 0; --i) {
+        p = path[i];
+        if (t->left[p] == path[i - 1]) {
+            t->left[p] = repl;
+        }
+        else {
+            t->right[p] = repl;
+        }
+        t->anc[repl] = p;
+        repl = p;
+    }
+
+    t->left[c]  = x;
+    t->right[c] = path[1];
+    t->anc[x]   = c;
+    t->anc[path[1]] = c;
+
+    return k;
+}
+
+
+/* Reroots the subtree below c as mpl_tree_reroot does, recalculating only the
+ * downpass sets of the nodes whose descendants change. */
+static void mpl_reroot_subtree
+(const int c, const int x, MPLtree* t, Morphyp handl)
+{
+    int i       = 0;
+    int p       = 0;
+    int* path   = t->stack;
+    int k       = mpl_tree_reroot(c, x, t);
+    Morphy m    = (Morphy)handl;
+
+    if (k < 2) {
+        return;
+    }
+
+    for (i = k - 1; i > 0; --i) {
+        p = path[i];
+        mpl_first_down_recon(p, t->left[p], t->right[p], m);
+    }
+    mpl_first_down_recon(c, t->left[c], t->right[c], m);
+
+    // The second downpass sets are built on the uppass sets the subtree had
+    // before it was pruned, so insertion costs of inapplicable characters are
+    // estimates.
+    if (mpl_get_gaphandl(handl) == GAP_INAPPLIC) {
+        for (i = k - 1; i > 0; --i) {
+            p = path[i];
+            mpl_second_down_recon(p, t->left[p], t->right[p], m);
+        }
+        mpl_second_down_recon(c, t->left[c], t->right[c], m);
+    }
+}
+
+
+/* Roots the subtree below c on the branch joining u and v. */
+static void mpl_reroot_subtree_on
+(const int c, const int u, const int v, MPLtree* t, Morphyp handl)
+{
+    if (t->anc[u] == v) {
+        mpl_reroot_subtree(c, u, t, handl);
+    }
+    else if (t->anc[v] == u) {
+        mpl_reroot_subtree(c, v, t, handl);
+    }
+}
+
+
+/* Lists the branches of the subtree below c, other than the one on which it
+ * is rooted, in preorder. Consecutive branches in this order are close
+ * together, so rerooting on each of them in turn takes only about as many
+ * recalculations as one traversal of the subtree. */
+static int mpl_subtree_branches(const int c, int* branches, MPLtree* t)
+{
+    int n   = 0;
+    int sp  = 0;
+    int nb  = 0;
+    int* stack = t->stack;
+
+    stack[sp++] = t->right[c];
+    stack[sp++] = t->left[c];
+
+    while (sp) {
+        n = stack[--sp];
+        if (t->anc[n] != c) {
+            branches[nb++] = n;
+            branches[nb++] = t->anc[n];
+        }
+        if (n >= t->ntax) {
+            stack[sp++] = t->right[n];
+            stack[sp++] = t->left[n];
+        }
+    }
+
+    return nb / 2;
+}
+
+
+/* Improves a tree by SPR, and optionally TBR, until no rearrangement makes
+ * it shorter. */
+static int mpl_hillclimb
+(MPLtree* t, MPLtreestore* store, const bool tbr, Morphyp handl)
+{
+    int i       = 0;
+    int c       = 0;
+    int c1      = 0;
+    int c2      = 0;
+    int orig    = 0;
+    int base    = 0;
+    int best    = 0;
+    int ncands  = 0;
+    int nbranch = 0;
+    bool improved = false;
+    bool accepted = false;
+    int nnodes  = 2 * t->ntax - 1;
+    MPLinsert* cands = NULL;
+    int* branches = NULL;
+    MPLclimb cl;
+
+    best = mpl_tree_score(t, handl);
+    mpl_treestore_offer(best, t, store);
+
+    // With fewer than four taxa there is only one unrooted tree
+    if (t->ntax < 4) {
+        return best;
+    }
+
+    cands = (MPLinsert*)calloc(nnodes, sizeof(MPLinsert));
+    branches = (int*)calloc(2 * nnodes, sizeof(int));
+
+    if (!cands || !branches || mpl_climb_start(t, &cl, handl) < 0) {
+        free(cands);
+        free(branches);
+        return ERR_BAD_MALLOC;
+    }
+
+    do {
+        improved = false;
+
+        for (c = 0; c < nnodes; ++c) {
+
+            if (c == t->root) {
+                continue;
+            }
+
+            // The last rescore of the rest left their steps in t->nodesteps
+            base = cl.nrest ? mpl_subtree_steps(c, t) : 0;
+            orig = mpl_climb_prune(c, &cl);
+            base += cl.length + mpl_climb_rest(true, &cl);
+
+            ncands = mpl_spr_candidates(c, orig, base, best, store, cands,
+                                        &cl);
+            accepted = mpl_try_regrafts(c, cands, ncands, false, &best, store,
+                                        &cl);
+
+            // A subtree of two tips has only one rooting
+            if (!accepted && tbr && c >= t->ntax && (t->left[c] >= t->ntax
+                                                     || t->right[c] >= t->ntax))
+            {
+                c1 = t->left[c];
+                c2 = t->right[c];
+                nbranch = mpl_subtree_branches(c, branches, t);
+
+                for (i = 0; i < nbranch && !accepted; ++i) {
+
+                    mpl_reroot_subtree_on(c, branches[2 * i],
+                                          branches[2 * i + 1], t, handl);
+
+                    ncands = mpl_spr_candidates(c, -1, base, best, store,
+                                                cands, &cl);
+                    accepted = mpl_try_regrafts(c, cands, ncands, true, &best,
+                                                store, &cl);
+                }
+
+                if (!accepted) {
+                    mpl_reroot_subtree_on(c, c1, c2, t, handl);
+                }
+            }
+
+            if (accepted) {
+                improved = true;
+            }
+            else {
+                mpl_climb_regraft(c, orig, &cl);
+            }
+        }
+    } while (improved);
+
+    mpl_climb_end(&cl);
+    free(cands);
+    free(branches);
+
+    // Leaves the steps of every partition in t->nodesteps, and the cache
+    // keyed to the tree again
+    mpl_tree_score(t, handl);
+
+    return best;
+}
+
+
+/*!
+ @brief Improves a tree by SPR until no rearrangement makes it shorter.
+ @discussion Every tree found that is as short as those in the store is
+ offered to it. On return, t is the best tree found by this climb and the
+ nodal sets are those of t.
+ @return The length of the best tree.
+ */
+int mpl_spr_hillclimb(MPLtree* t, MPLtreestore* store, Morphyp handl)
+{
+    return mpl_hillclimb(t, store, false, handl);
+}
+
+
+/*!
+ @brief Improves a tree by TBR until no rearrangement makes it shorter.
+ @discussion As mpl_spr_hillclimb, but each pruned subtree is also rerooted
+ on each of its branches before being regrafted.
+ @return The length of the best tree.
+ */
+int mpl_tbr_hillclimb(MPLtree* t, MPLtreestore* store, Morphyp handl)
+{
+    return mpl_hillclimb(t, store, true, handl);
+}
+
+
+/* Copies the weights held in each partition to or from a buffer of one
+ * weight per character in the partitions' order. */
+static void mpl_copy_intwts
+(unsigned long* buf, const bool restore, Morphyp handl)
+{
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    MPLpartition* part = NULL;
+
+    for (i = 0; i < handl->numparts; ++i) {
+        part = handl->partitions[i];
+        for (j = 0; j < part->ncharsinpart; ++j, ++k) {
+            if (restore == true) {
+                part->intwts[j] = buf[k];
+            }
+            else {
+                buf[k] = part->intwts[j];
+            }
+        }
+    }
+
+    if (restore == true) {
+        mpl_downcache_clear(handl);
+    }
+}
+
+
+/* Doubles the weight of each character with probability upweight. */
+static void mpl_upweight_intwts
+(const unsigned long* orig, const double upweight, MPLrng* rng,
+ Morphyp handl)
+{
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    MPLpartition* part = NULL;
+
+    for (i = 0; i < handl->numparts; ++i) {
+        part = handl->partitions[i];
+        for (j = 0; j < part->ncharsinpart; ++j, ++k) {
+            part->intwts[j] = orig[k];
+            if ((mpl_rng_next(rng) >> 11) * (1.0 / 9007199254740992.0)
+                < upweight) {
+                part->intwts[j] *= 2;
+            }
+        }
+    }
+
+    mpl_downcache_clear(handl);
+}
+
+
+/*!
+ @brief Searches by the parsimony ratchet, starting from t.
+ @discussion Only trees found under the original weights are offered to the
+ store. On return, t is the tree from the last search under the original
+ weights.
+ @return The length of the best tree found.
+ */
+int mpl_ratchet
+(MPLtree* t, MPLtreestore* store, const int niter, const double upweight,
+ MPLrng* rng, Morphyp handl)
+{
+    int i       = 0;
+    int len     = 0;
+    int best    = 0;
+    int nchar   = mpl_get_num_charac((Morphy)handl);
+    unsigned long* orig = (unsigned long*)calloc(nchar, sizeof(unsigned long));
+    MPLtreestore* scratch = mpl_new_treestore(t->ntax, 1);
+
+    if (!orig || !scratch) {
+        free(orig);
+        mpl_delete_treestore(scratch);
+        return ERR_BAD_MALLOC;
+    }
+
+    mpl_copy_intwts(orig, false, handl);
+
+    best = mpl_tbr_hillclimb(t, store, handl);
+
+    for (i = 0; i < niter && best >= 0; ++i) {
+
+        mpl_upweight_intwts(orig, upweight, rng, handl);
+        mpl_treestore_reset(INT_MAX, scratch);
+        len = mpl_tbr_hillclimb(t, scratch, handl);
+        mpl_copy_intwts(orig, true, handl);
+
+        if (len < 0) {
+            best = len;
+            break;
+        }
+
+        len = mpl_tbr_hillclimb(t, store, handl);
+
+        if (len < best) {
+            best = len;
+        }
+    }
+
+    mpl_copy_intwts(orig, true, handl);
+
+    free(orig);
+    mpl_delete_treestore(scratch);
+
+    return best;
+}
+
+
+/* Finds the cheapest branch on which to place a pruned subtree. Costs of
+ * branches flagged for recalculation of inapplicable characters leave those
+ * characters out. If exact is set, the flagged branches that might still be
+ * cheapest are grafted and scored in full, cheapest estimate first; the
+ * remaining tree must be rescored afterwards if any were. */
+static int mpl_best_insertion
+(const int src, const int length, const bool exact, int* cost, int* nexact,
+ MPLinsert* flagged, MPLtree* t, Morphyp handl)
+{
+    int i       = 0;
+    int x       = 0;
+    int c       = 0;
+    int len     = 0;
+    int best    = INT_MAX;
+    int tgt     = -1;
+    int nflagged = 0;
+    Morphy m    = (Morphy)handl;
+
+    *nexact = 0;
+
+    for (i = 0; i < t->ntips + t->ninternal; ++i) {
+
+        x = i < t->ntips ? t->tips[i] : t->postorder[i - t->ntips];
+        c = mpl_get_insertcost(src, x, t->anc[x], false, 0, m);
+
+        if (mpl_check_reopt_inapplics(m) > 0) {
+            flagged[nflagged].tgt       = x;
+            flagged[nflagged].length    = c;
+            ++nflagged;
+        }
+        else if (c < best) {
+            best    = c;
+            tgt     = x;
+        }
+    }
+
+    if (exact == false || !nflagged) {
+        for (i = 0; i < nflagged; ++i) {
+            if (flagged[i].length < best) {
+                best    = flagged[i].length;
+                tgt     = flagged[i].tgt;
+            }
+        }
+        *cost = best;
+        return tgt;
+    }
+
+    qsort(flagged, nflagged, sizeof(MPLinsert), mpl_compare_inserts);
+
+    for (i = 0; i < nflagged && flagged[i].length < best; ++i) {
+
+        mpl_tree_graft(src, flagged[i].tgt, t);
+        len = mpl_tree_score(t, handl) - length;
+        mpl_tree_prune(src, t);
+        ++*nexact;
+
+        if (len < best) {
+            best    = len;
+            tgt     = flagged[i].tgt;
+        }
+    }
+
+    *cost = best;
+
+    return tgt;
+}
+
+
+/* Joins a taxon to the tree through a new internal node, ready to be grafted
+ * by mpl_tree_graft. */
+static void mpl_tree_detach_tip(const int tip, const int node, MPLtree* t)
+{
+    t->anc[tip]     = node;
+    t->left[node]   = tip;
+    t->right[node]  = -1;
+}
+
+
+/*!
+ @brief Builds a tree on all the taxa by stepwise addition.
+ @discussion Each taxon is added where it adds fewest steps, as estimated by a
+ sweep of insertion costs. Flagged branches are checked in full only for the
+ taxon actually being placed, so choosing the closest taxon costs one sweep
+ per remaining taxon. On return, the nodal sets are those of t.
+ @return The length of the tree.
+ */
+int mpl_stepwise_build
+(MPLtree* t, const MPLaddseq_t addseq, MPLrng* rng, Morphyp handl)
+{
+    int i       = 0;
+    int j       = 0;
+    int k       = 0;
+    int x       = 0;
+    int tgt     = 0;
+    int cost    = 0;
+    int mincost = 0;
+    int length  = 0;
+    int nexact  = 0;
+    int ntax    = t->ntax;
+    int* order  = (int*)calloc(ntax, sizeof(int));
+    MPLinsert* flagged = (MPLinsert*)calloc(2 * ntax, sizeof(MPLinsert));
+
+    if (!order || !flagged) {
+        free(order);
+        free(flagged);
+        return ERR_BAD_MALLOC;
+    }
+
+    for (i = 0; i < ntax; ++i) {
+        order[i] = i;
+    }
+
+    if (addseq == ADDSEQ_RANDOM) {
+        for (i = ntax - 1; i > 0; --i) {
+            j = mpl_rng_below(i + 1, rng);
+            x = order[i];
+            order[i] = order[j];
+            order[j] = x;
+        }
+    }
+
+    for (i = 0; i < 2 * ntax; ++i) {
+        t->left[i]  = -1;
+        t->right[i] = -1;
+    }
+
+    t->root         = ntax;
+    t->anc[ntax]    = t->lroot;
+    t->left[ntax]   = order[0];
+    t->right[ntax]  = order[1];
+    t->anc[order[0]] = ntax;
+    t->anc[order[1]] = ntax;
+
+    mpl_tree_traverse(t);
+    length = mpl_tree_score(t, handl);
+
+    for (k = 2; k < ntax; ++k) {
+
+        if (addseq == ADDSEQ_CLOSEST && k < ntax - 1) {
+
+            mincost = INT_MAX;
+            j = k;
+
+            for (i = k; i < ntax; ++i) {
+                mpl_tree_detach_tip(order[i], ntax + k - 1, t);
+                mpl_best_insertion(order[i], length, false, &cost, &nexact,
+                                   flagged, t, handl);
+                if (cost < mincost) {
+                    mincost = cost;
+                    j = i;
+                }
+            }
+
+            x = order[k];
+            order[k] = order[j];
+            order[j] = x;
+        }
+
+        x = order[k];
+        mpl_tree_detach_tip(x, ntax + k - 1, t);
+        tgt = mpl_best_insertion(x, length, true, &cost, &nexact, flagged, t,
+                                 handl);
+
+        mpl_tree_graft(x, tgt, t);
+        length = mpl_tree_score(t, handl);
+    }
+
+    free(order);
+    free(flagged);
+
+    return length;
+}
+
+
+/* What the threads of a set of replicates share. Everything but the store is
+ * either fixed or atomic; the store is only touched with the lock held. */
+typedef struct {
+    Morphyp             handl;
+    int                 nreps;
+    bool                tbr;
+    unsigned long long  seed;
+    atomic_int          next;   /*!< The next replicate to be started */
+    atomic_int          best;   /*!< The length of the trees in the store */
+    atomic_int          err;
+    pthread_mutex_t     lock;
+    MPLtreestore*       store;
+} MPLreplicates;
+
+
+static void mpl_replicate_error(const int err, MPLreplicates* r)
+{
+    int none = ERR_NO_ERROR;
+    atomic_compare_exchange_strong(&r->err, &none, err);
+}
+
+
+/* Runs replicates until there are none left. A replicate's trees are kept in
+ * a store of the thread's own, which starts out at the best length found by
+ * any thread so far. Trees longer than that are never stored, so a replicate
+ * stuck on a worse island climbs to its optimum without swapping through
+ * the trees of equal length on the way. */
+static void* mpl_replicate_thread(void* arg)
+{
+    int i   = 0;
+    int len = 0;
+    MPLreplicates* r = (MPLreplicates*)arg;
+    int ntax = r->store->ntax;
+    Morphyp handl = mpl_new_worker(r->handl);
+    MPLtree* t = mpl_new_tree(ntax);
+    MPLtreestore* local = mpl_new_treestore(ntax, r->store->maxtrees);
+    MPLrng rng;
+
+    if (!handl || !t || !local) {
+        mpl_replicate_error(ERR_BAD_MALLOC, r);
+    }
+
+    while (atomic_load(&r->err) == ERR_NO_ERROR &&
+           (i = atomic_fetch_add(&r->next, 1)) < r->nreps) {
+
+        // Each replicate has its own seed, so that the starting trees don't
+        // depend on which thread builds them.
+        mpl_rng_seed(r->seed + i, &rng);
+
+        len = mpl_stepwise_build(t, ADDSEQ_RANDOM, &rng, handl);
+
+        if (len >= 0) {
+            mpl_treestore_reset(atomic_load(&r->best), local);
+            len = mpl_hillclimb(t, local, r->tbr, handl);
+        }
+
+        if (len < 0) {
+            mpl_replicate_error(len, r);
+            break;
+        }
+
+        if (local->ntrees) {
+            pthread_mutex_lock(&r->lock);
+            mpl_treestore_merge(local, r->store);
+            atomic_store(&r->best, r->store->length);
+            pthread_mutex_unlock(&r->lock);
+        }
+    }
+
+    mpl_delete_worker(handl);
+    mpl_delete_tree(t);
+    mpl_delete_treestore(local);
+
+    return NULL;
+}
+
+
+/*!
+ @brief Runs independent searches from trees built by random addition.
+ @discussion The replicates are shared out between nthreads threads, each
+ evaluating through its own worker handle, so handl itself is not changed. The
+ starting trees depend only on the seed, but the trees stored can depend on
+ the order in which the threads finish their replicates.
+ @return The length of the trees in the store, or a negative error code.
+ */
+int mpl_replicate
+(MPLtreestore* store, const int nreps, const int nthreads, const bool tbr,
+ const unsigned long long seed, Morphyp handl)
+{
+    int i = 0;
+    int nstarted = 0;
+    int n = nthreads < nreps ? nthreads : nreps;
+    pthread_t* threads = (pthread_t*)calloc(n, sizeof(pthread_t));
+    MPLreplicates r;
+
+    if (!threads) {
+        return ERR_BAD_MALLOC;
+    }
+
+    r.handl = handl;
+    r.nreps = nreps;
+    r.tbr   = tbr;
+    r.seed  = seed;
+    r.store = store;
+    atomic_init(&r.next, 0);
+    atomic_init(&r.best, store->length);
+    atomic_init(&r.err, ERR_NO_ERROR);
+    pthread_mutex_init(&r.lock, NULL);
+
+    // The calling thread runs replicates too
+    for (i = 1; i < n; ++i) {
+        if (pthread_create(&threads[i], NULL, mpl_replicate_thread, &r)) {
+            break;
+        }
+        ++nstarted;
+    }
+
+    mpl_replicate_thread(&r);
+
+    for (i = 1; i <= nstarted; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&r.lock);
+    free(threads);
+
+    if (atomic_load(&r.err) != ERR_NO_ERROR) {
+        return atomic_load(&r.err);
+    }
+
+    return store->length;
+}
+
+
+/* What the threads of a branch and bound search share. As for replicates,
+ * the store is only touched with the lock held. */
+typedef struct {
+    Morphyp             handl;
+    int                 ntax;
+    int*                order;      /*!< The order in which taxa are added */
+    int*                remaining;  /*!< The fewest steps the taxa from order[k] on can add */
+    bool                exact;      /*!< The bound covers all the partitions */
+    int                 split;      /*!< The number of taxa in the trees shared out */
+    int                 ntasks;
+    int                 maxtasks;
+    int*                tasks;
+    atomic_int          next;
+    atomic_int          best;
+    atomic_bool         full;       /*!< The store is full at the best length */
+    atomic_int          err;
+    pthread_mutex_t     lock;
+    MPLtreestore*       store;
+} MPLbranchbound;
+
+/* A thread's own handles and tree. The bounding handle evaluates only the
+ * partitions whose length can't fall as taxa are added. */
+typedef struct {
+    MPLbranchbound*     bb;
+    Morphyp             bound;
+    Morphyp             full;       /*!< All the partitions, if bound doesn't cover them */
+    MPLtree*            t;
+    MPLinsert*          cands;      /*!< 2 * ntax for each number of taxa */
+    bool                collect;    /*!< Trees reaching the split are kept as tasks */
+} MPLbbthread;
+
+
+static void mpl_bb_delete_thread(MPLbbthread* th)
+{
+    mpl_delete_worker(th->bound);
+    mpl_delete_worker(th->full);
+    mpl_delete_tree(th->t);
+    free(th->cands);
+}
+
+
+static int mpl_bb_new_thread(MPLbranchbound* bb, MPLbbthread* th)
+{
+    int ntax = bb->ntax;
+
+    th->bb      = bb;
+    th->bound   = mpl_new_worker(bb->handl);
+    th->full    = NULL;
+    th->t       = mpl_new_tree(ntax);
+    th->cands   = (MPLinsert*)calloc((size_t)2 * ntax * (ntax + 1),
+                                     sizeof(MPLinsert));
+    th->collect = false;
+
+    if (!th->bound || !th->t || !th->cands) {
+        mpl_bb_delete_thread(th);
+        return ERR_BAD_MALLOC;
+    }
+
+    if (mpl_worker_keep_partitions(mpl_bb_keep_partition, th->bound)
+        < bb->handl->numparts) {
+        if (!(th->full = mpl_new_worker(bb->handl))) {
+            mpl_bb_delete_thread(th);
+            return ERR_BAD_MALLOC;
+        }
+    }
+
+    return ERR_NO_ERROR;
+}
+
+
+/* Trees as long as the best are only of interest while they can still be
+ * stored. */
+static bool mpl_bb_bounded(const int lowerbound, MPLbranchbound* bb)
+{
+    int best = atomic_load(&bb->best);
+
+    return lowerbound > best || (lowerbound == best && atomic_load(&bb->full));
+}
+
+
+/* The position of the state in a set of one. */
+static int mpl_bb_state_index(MPLstate s)
+{
+    int n = 0;
+
+    s -= 1;
+    MORPHY_PORTABLE_POPCOUNTLL(n, s);
+
+    return n;
+}
+
+
+/*!
+ @brief The fewest steps that the taxa not yet placed must add to a character.
+ @discussion For an unordered character, a state that some remaining taxon
+ has on its own, and no placed taxon has at all, must arise at least once
+ more. For an ordered character, the range of the placed taxa must be
+ stretched to reach each such state.
+ */
+static int mpl_bb_char_bound
+(const MPLpartition* p, const int j, const int k, MPLbranchbound* bb,
+ Morphyp handl)
+{
+    int i = 0;
+    int n = 0;
+    int lo = 0;
+    int hi = 0;
+    int x = 0;
+    int steps = 0;
+    MPLstate s = 0;
+    MPLstate placed = 0;
+    MPLstate fresh = 0;
+
+    for (i = 0; i < k; ++i) {
+        placed |= handl->statesets[bb->order[i]]->downpass1[j];
+    }
+
+    for (i = k; i < bb->ntax; ++i) {
+        s = handl->statesets[bb->order[i]]->downpass1[j];
+        if (s && !(s & (s - 1)) && !(s & placed)) {
+            fresh |= s;
+        }
+    }
+
+    if (!fresh) {
+        return 0;
+    }
+
+    if (p->chtype == FITCH_T || !placed) {
+        MORPHY_PORTABLE_POPCOUNTLL(n, fresh);
+        return n;
+    }
+
+    lo = mpl_bb_state_index(mpl_lowest_state(placed));
+    hi = mpl_bb_state_index(mpl_highest_state(placed));
+
+    if ((x = mpl_bb_state_index(mpl_lowest_state(fresh))) < lo) {
+        steps += lo - x;
+    }
+    if ((x = mpl_bb_state_index(mpl_highest_state(fresh))) > hi) {
+        steps += x - hi;
+    }
+
+    return steps;
+}
+
+
+static void mpl_bb_remaining(MPLbranchbound* bb, Morphyp handl)
+{
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    MPLpartition* p = NULL;
+
+    for (k = 0; k <= bb->ntax; ++k) {
+        bb->remaining[k] = 0;
+        for (i = 0; i < handl->numparts; ++i) {
+            p = handl->partitions[i];
+            for (j = 0; j < p->ncharsinpart; ++j) {
+                bb->remaining[k] += (int)p->intwts[j] * mpl_bb_char_bound
+                    (p, p->charindices[j], k, bb, handl);
+            }
+        }
+    }
+}
+
+
+/* Orders the taxa so that those adding most steps to the tree so far come
+ * first, which raises the bound on partial trees as early as possible. */
+static void mpl_bb_order(MPLbbthread* th)
+{
+    int i       = 0;
+    int j       = 0;
+    int k       = 0;
+    int x       = 0;
+    int tgt     = 0;
+    int cost    = 0;
+    int maxcost = 0;
+    int nexact  = 0;
+    int ntax    = th->bb->ntax;
+    int* order  = th->bb->order;
+    MPLtree* t  = th->t;
+
+    for (i = 0; i < ntax; ++i) {
+        order[i] = i;
+    }
+
+    for (i = 0; i < 2 * ntax; ++i) {
+        t->left[i]  = -1;
+        t->right[i] = -1;
+    }
+
+    t->root         = ntax;
+    t->anc[ntax]    = t->lroot;
+    t->left[ntax]   = order[0];
+    t->right[ntax]  = order[1];
+    t->anc[order[0]] = ntax;
+    t->anc[order[1]] = ntax;
+
+    mpl_tree_traverse(t);
+    mpl_tree_score(t, th->bound);
+
+    for (k = 2; k < ntax - 1; ++k) {
+
+        maxcost = -1;
+        j = k;
+
+        for (i = k; i < ntax; ++i) {
+            mpl_tree_detach_tip(order[i], ntax + k - 1, t);
+            mpl_best_insertion(order[i], 0, false, &cost, &nexact, th->cands,
+                               t, th->bound);
+            if (cost > maxcost) {
+                maxcost = cost;
+                j = i;
+            }
+        }
+
+        x = order[k];
+        order[k] = order[j];
+        order[j] = x;
+
+        mpl_tree_detach_tip(x = order[k], ntax + k - 1, t);
+        tgt = mpl_best_insertion(x, 0, false, &cost, &nexact, th->cands, t,
+                                 th->bound);
+        mpl_tree_graft(x, tgt, t);
+        mpl_tree_score(t, th->bound);
+    }
+}
+
+
+/* Builds the only unrooted tree on the first three taxa. The root stays
+ * between order[1] and the rest, so that each unrooted tree is reached only
+ * once. */
+static void mpl_bb_start(MPLbbthread* th)
+{
+    int i       = 0;
+    int ntax    = th->bb->ntax;
+    int* order  = th->bb->order;
+    MPLtree* t  = th->t;
+
+    for (i = 0; i < 2 * ntax; ++i) {
+        t->left[i]  = -1;
+        t->right[i] = -1;
+    }
+
+    t->root         = ntax;
+    t->anc[ntax]    = t->lroot;
+    t->left[ntax]   = order[0];
+    t->right[ntax]  = order[1];
+    t->anc[order[0]] = ntax;
+    t->anc[order[1]] = ntax;
+
+    mpl_tree_detach_tip(order[2], ntax + 1, t);
+    mpl_tree_graft(order[2], order[0], t);
+}
+
+
+static int mpl_bb_task_size(const int ntax)
+{
+    return 1 + 6 * ntax;
+}
+
+
+static int mpl_bb_save_task(MPLbranchbound* bb, const MPLtree* t)
+{
+    int ntax = bb->ntax;
+    int size = mpl_bb_task_size(ntax);
+    int* task = NULL;
+
+    if (bb->ntasks == bb->maxtasks) {
+        bb->maxtasks = bb->maxtasks ? 2 * bb->maxtasks : 16;
+        task = (int*)realloc(bb->tasks, (size_t)bb->maxtasks * size *
+                             sizeof(int));
+        if (!task) {
+            return ERR_BAD_MALLOC;
+        }
+        bb->tasks = task;
+    }
+
+    task = &bb->tasks[(size_t)bb->ntasks * size];
+    task[0] = t->root;
+    memcpy(task + 1, t->anc, 2 * ntax * sizeof(int));
+    memcpy(task + 1 + 2 * ntax, t->left, 2 * ntax * sizeof(int));
+    memcpy(task + 1 + 4 * ntax, t->right, 2 * ntax * sizeof(int));
+    ++bb->ntasks;
+
+    return ERR_NO_ERROR;
+}
+
+
+static void mpl_bb_load_task(const int i, MPLbranchbound* bb, MPLtree* t)
+{
+    int ntax = bb->ntax;
+    const int* task = &bb->tasks[(size_t)i * mpl_bb_task_size(ntax)];
+
+    t->root = task[0];
+    memcpy(t->anc, task + 1, 2 * ntax * sizeof(int));
+    memcpy(t->left, task + 1 + 2 * ntax, 2 * ntax * sizeof(int));
+    memcpy(t->right, task + 1 + 4 * ntax, 2 * ntax * sizeof(int));
+
+    mpl_tree_traverse(t);
+}
+
+
+static void mpl_bb_offer(const int length, MPLbbthread* th)
+{
+    MPLbranchbound* bb = th->bb;
+
+    pthread_mutex_lock(&bb->lock);
+    mpl_treestore_offer(length, th->t, bb->store);
+    atomic_store(&bb->best, bb->store->length);
+    atomic_store(&bb->full, mpl_treestore_full(bb->store));
+    pthread_mutex_unlock(&bb->lock);
+}
+
+
+/*!
+ @brief Searches all the ways of adding the remaining taxa to a tree on the
+ first k of them.
+ @discussion The nodal sets of the bounding handle must be those of the tree,
+ and len its length. The cost of each placement of the next taxon is found in
+ one sweep, which is exact for the partitions of the bounding handle, and the
+ placements are followed cheapest first.
+ */
+static int mpl_bb_search(const int k, const int len, MPLbbthread* th)
+{
+    int i       = 0;
+    int x       = 0;
+    int n       = 0;
+    int est     = 0;
+    int ncands  = 0;
+    int err     = ERR_NO_ERROR;
+    MPLbranchbound* bb = th->bb;
+    MPLtree* t  = th->t;
+    int ntax    = bb->ntax;
+    MPLinsert* cands = &th->cands[(size_t)2 * ntax * k];
+
+    if (k == ntax) {
+        n = th->full ? mpl_tree_length(t, th->full) : len;
+        if (!mpl_bb_bounded(n, bb)) {
+            mpl_bb_offer(n, th);
+        }
+        return ERR_NO_ERROR;
+    }
+
+    if (th->collect && k == bb->split) {
+        return mpl_bb_save_task(bb, t);
+    }
+
+    x = bb->order[k];
+    mpl_tree_detach_tip(x, ntax + k - 1, t);
+
+    for (i = 0; i < t->ntips + t->ninternal; ++i) {
+
+        n = i < t->ntips ? t->tips[i] : t->postorder[i - t->ntips];
+
+        if (n == t->root || n == t->right[t->root]) {
+            continue;
+        }
+
+        est = len + mpl_get_insertcost(x, n, t->anc[n], false, 0,
+                                       (Morphy)th->bound);
+
+        if (!mpl_bb_bounded(est + bb->remaining[k + 1], bb)) {
+            cands[ncands].tgt       = n;
+            cands[ncands].length    = est;
+            ++ncands;
+        }
+    }
+
+    qsort(cands, ncands, sizeof(MPLinsert), mpl_compare_inserts);
+
+    for (i = 0; i < ncands && err == ERR_NO_ERROR; ++i) {
+
+        // The best length may have fallen since the sweep
+        if (mpl_bb_bounded(cands[i].length + bb->remaining[k + 1], bb)) {
+            continue;
+        }
+
+        mpl_tree_graft(x, cands[i].tgt, t);
+
+        if (k + 1 < ntax) {
+            est = mpl_tree_score(t, th->bound);
+        }
+        else {
+            est = cands[i].length;
+        }
+
+        err = mpl_bb_search(k + 1, est, th);
+
+        mpl_tree_prune(x, t);
+    }
+
+    return err;
+}
+
+
+static void mpl_bb_error(const int err, MPLbranchbound* bb)
+{
+    int none = ERR_NO_ERROR;
+    atomic_compare_exchange_strong(&bb->err, &none, err);
+}
+
+
+/* Takes the trees left after the split in turn until there are none. */
+static void* mpl_bb_thread(void* arg)
+{
+    int i   = 0;
+    int len = 0;
+    int err = ERR_NO_ERROR;
+    MPLbranchbound* bb = (MPLbranchbound*)arg;
+    MPLbbthread th;
+
+    if ((err = mpl_bb_new_thread(bb, &th)) != ERR_NO_ERROR) {
+        mpl_bb_error(err, bb);
+        return NULL;
+    }
+
+    while (atomic_load(&bb->err) == ERR_NO_ERROR &&
+           (i = atomic_fetch_add(&bb->next, 1)) < bb->ntasks) {
+
+        mpl_bb_load_task(i, bb, th.t);
+        len = mpl_tree_score(th.t, th.bound);
+
+        if (mpl_bb_bounded(len + bb->remaining[bb->split], bb)) {
+            continue;
+        }
+
+        if ((err = mpl_bb_search(bb->split, len, &th)) != ERR_NO_ERROR) {
+            mpl_bb_error(err, bb);
+        }
+    }
+
+    mpl_bb_delete_thread(&th);
+
+    return NULL;
+}
+
+
+/* The number of unrooted binary trees on n taxa, or INT_MAX if that is
+ * more. */
+static int mpl_num_unrooted_trees(const int n)
+{
+    int i = 0;
+    long long count = 1;
+
+    for (i = 3; i < n && count < INT_MAX; ++i) {
+        count *= 2 * i - 3;
+    }
+
+    return count < INT_MAX ? (int)count : INT_MAX;
+}
+
+
+/* Starts the bound at the length of a tree found by stepwise addition and TBR,
+ * orders the taxa, and searches down to the split, saving the trees reached
+ * there for the threads to share out. */
+static int mpl_bb_prepare(const int nthreads, MPLbranchbound* bb)
+{
+    int len = 0;
+    int err = ERR_NO_ERROR;
+    MPLbbthread th;
+
+    if ((err = mpl_bb_new_thread(bb, &th)) != ERR_NO_ERROR) {
+        return err;
+    }
+
+    bb->exact = th.full == NULL;
+
+    len = mpl_stepwise_build(th.t, ADDSEQ_CLOSEST, NULL,
+                             th.full ? th.full : th.bound);
+    if (len >= 0) {
+        len = mpl_tbr_hillclimb(th.t, bb->store,
+                                th.full ? th.full : th.bound);
+    }
+    if (len < 0) {
+        mpl_bb_delete_thread(&th);
+        return len;
+    }
+
+    atomic_init(&bb->best, bb->store->length);
+    atomic_init(&bb->full, mpl_treestore_full(bb->store));
+
+    // There is only one unrooted tree
+    if (bb->ntax <= 3) {
+        mpl_bb_delete_thread(&th);
+        return ERR_NO_ERROR;
+    }
+
+    mpl_bb_order(&th);
+    mpl_bb_remaining(bb, th.bound);
+
+    bb->split = 3;
+    while (bb->split < bb->ntax &&
+           mpl_num_unrooted_trees(bb->split) < 4 * nthreads) {
+        ++bb->split;
+    }
+
+    mpl_bb_start(&th);
+    len = mpl_tree_score(th.t, th.bound);
+
+    th.collect = true;
+    if (!mpl_bb_bounded(len + bb->remaining[3], bb)) {
+        err = mpl_bb_search(3, len, &th);
+    }
+
+    mpl_bb_delete_thread(&th);
+
+    return err;
+}
+
+
+/*!
+ @brief Finds the shortest trees by branch and bound.
+ @discussion Taxa are added in turn to a tree on the first three, and a
+ partial tree is abandoned once its length, plus the fewest steps the
+ remaining taxa can add, exceeds that of the best tree found. Only Fitch and
+ Wagner characters without inapplicable data are used in the bound, as the
+ length of the others can fall when a taxon is added; they are scored only
+ on complete trees. The partial trees at the level where there are enough of
+ them are shared out between nthreads threads, which share the best length.
+ @return The length of the trees in the store, or a negative error code.
+ */
+int mpl_branch_bound
+(MPLtreestore* store, const int nthreads, Morphyp handl)
+{
+    int i = 0;
+    int err = ERR_NO_ERROR;
+    int nstarted = 0;
+    int ntax = store->ntax;
+    pthread_t* threads = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+    MPLbranchbound bb;
+
+    bb.handl        = handl;
+    bb.ntax         = ntax;
+    bb.order        = (int*)calloc(ntax, sizeof(int));
+    bb.remaining    = (int*)calloc(ntax + 1, sizeof(int));
+    bb.ntasks       = 0;
+    bb.maxtasks     = 0;
+    bb.tasks        = NULL;
+    bb.store        = store;
+    atomic_init(&bb.next, 0);
+    atomic_init(&bb.err, ERR_NO_ERROR);
+    pthread_mutex_init(&bb.lock, NULL);
+
+    if (!threads || !bb.order || !bb.remaining) {
+        err = ERR_BAD_MALLOC;
+    }
+    else {
+        err = mpl_bb_prepare(nthreads, &bb);
+    }
+
+    if (err == ERR_NO_ERROR && bb.ntasks) {
+
+        for (i = 1; i < nthreads && i < bb.ntasks; ++i) {
+            if (pthread_create(&threads[i], NULL, mpl_bb_thread, &bb)) {
+                break;
+            }
+            ++nstarted;
+        }
+
+        mpl_bb_thread(&bb);
+
+        for (i = 1; i <= nstarted; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+
+        err = atomic_load(&bb.err);
+    }
+
+    pthread_mutex_destroy(&bb.lock);
+    free(threads);
+    free(bb.order);
+    free(bb.remaining);
+    free(bb.tasks);
+
+    if (err != ERR_NO_ERROR) {
+        return err;
+    }
+
+    return store->length;
+}
+
+
+typedef int (*MPLcharfxn)(const int c, void* data, Morphyp handl);
+
+/*!
+ @brief Calls a function for each character of a handle on its own, unweighted.
+ @discussion Each partition in turn is made the only one the handle evaluates,
+ through a copy narrowed to a single character. Step matrix partitions keep
+ their layout, as their nodal costs are interleaved by position, and are
+ narrowed instead by giving every character but one a weight of zero.
+ Excluded characters are visited too.
+ @param fxn Called with the index of the character and data.
+ @return ERR_BAD_MALLOC if there was no room for the step matrix weights, or
+ the first error returned by fxn.
+ */
+static int mpl_each_char(MPLcharfxn fxn, void* data, Morphyp handl)
+{
+    int i = 0;
+    int k = 0;
+    int err = ERR_NO_ERROR;
+    int numparts = handl->numparts;
+    int numupparts = handl->numupparts;
+    MPLpartition** parts = handl->partitions;
+    MPLpartition** upparts = handl->upparts;
+    MPLpartition* p = NULL;
+    MPLpartition one;
+    MPLpartition* onep = &one;
+    unsigned long unit = 1;
+    unsigned long* wts = NULL;
+
+    handl->partitions   = &onep;
+    handl->numparts     = 1;
+    handl->upparts      = &onep;
+
+    for (i = 0; i < numparts && err == ERR_NO_ERROR; ++i) {
+
+        p   = parts[i];
+        one = *p;
+        handl->numupparts = p->uplength ? 1 : 0;
+
+        if (p->chtype == USERTYPE_T) {
+
+            if (!(wts = (unsigned long*)calloc(p->nchartotal,
+                                               sizeof(unsigned long)))) {
+                err = ERR_BAD_MALLOC;
+                break;
+            }
+
+            one.intwts = wts;
+
+            for (k = 0; k < p->nchartotal && err == ERR_NO_ERROR; ++k) {
+                wts[k] = 1;
+                err = fxn(p->charindices[k], data, handl);
+                wts[k] = 0;
+            }
+
+            free(wts);
+            wts = NULL;
+            continue;
+        }
+
+        one.ncharsinpart    = 1;
+        one.intwts          = &unit;
+
+        for (k = 0; k < p->nchartotal && err == ERR_NO_ERROR; ++k) {
+            one.charindices     = &p->charindices[k];
+            one.nstates         = &p->nstates[k];
+            one.minscores       = &p->minscores[k];
+            one.steps_in_char   = &p->steps_in_char[k];
+            err = fxn(p->charindices[k], data, handl);
+        }
+    }
+
+    handl->partitions   = parts;
+    handl->numparts     = numparts;
+    handl->upparts      = upparts;
+    handl->numupparts   = numupparts;
+
+    return err;
+}
+
+
+typedef struct {
+    MPLtree*    t;
+    int*        steps;
+} MPLcharsteps;
+
+static int mpl_char_length(const int c, void* data, Morphyp handl)
+{
+    MPLcharsteps* cs = (MPLcharsteps*)data;
+    cs->steps[c] = mpl_tree_length(cs->t, handl);
+    return ERR_NO_ERROR;
+}
+
+/*!
+ @brief Finds the steps of each character of a tree on its own, unweighted.
+ @discussion The tree is scored once per character (see mpl_each_char).
+ @param steps Space for the steps of every character of handl.
+ @return ERR_BAD_MALLOC if there was no room for the step matrix weights.
+ */
+static int mpl_char_steps(MPLtree* t, int* steps, Morphyp handl)
+{
+    MPLcharsteps cs;
+
+    cs.t        = t;
+    cs.steps    = steps;
+
+    return mpl_each_char(mpl_char_length, &cs, handl);
+}
+
+
+/* What the threads scoring a batch of trees share. Each tree is written to by
+ * only the thread that took it. */
+typedef struct {
+    Morphyp             handl;
+    int                 ntrees;
+    const int*          trees;
+    int*                lengths;
+    int*                charsteps;
+    atomic_int          next;   /*!< The next tree to be scored */
+    atomic_int          err;
+} MPLbatch;
+
+
+static void* mpl_batch_thread(void* arg)
+{
+    int i   = 0;
+    int ret = 0;
+    MPLbatch* b = (MPLbatch*)arg;
+    int ntax = b->handl->numtaxa;
+    int nchar = b->handl->numcharacters;
+    Morphyp handl = mpl_new_worker(b->handl);
+    MPLtree* t = mpl_new_tree(ntax);
+    int none = ERR_NO_ERROR;
+
+    if (!handl || !t) {
+        atomic_compare_exchange_strong(&b->err, &none, ERR_BAD_MALLOC);
+    }
+
+    while (atomic_load(&b->err) == ERR_NO_ERROR &&
+           (i = atomic_fetch_add(&b->next, 1)) < b->ntrees) {
+
+        ret = mpl_tree_read_parents(&b->trees[(size_t)i * (2 * ntax - 1)], t);
+
+        if (ret != ERR_NO_ERROR) {
+            b->lengths[i] = ret;
+            continue;
+        }
+
+        b->lengths[i] = mpl_tree_length(t, handl);
+
+        if (b->charsteps &&
+            (ret = mpl_char_steps(t, &b->charsteps[(size_t)i * nchar], handl))
+            != ERR_NO_ERROR) {
+            atomic_compare_exchange_strong(&b->err, &none, ret);
+        }
+    }
+
+    mpl_delete_worker(handl);
+    mpl_delete_tree(t);
+
+    return NULL;
+}
+
+
+/*!
+ @brief Scores a batch of trees given as parent vectors.
+ @discussion The trees are shared out between nthreads threads, each
+ evaluating through its own worker handle, so handl itself is not changed and
+ the results don't depend on the number of threads. A tree that can't be read
+ is given its error code as its length.
+ @param charsteps NULL, or space for the steps of each character of each tree
+ (see mpl_char_steps), one tree after another.
+ @return ERR_NO_ERROR, or an error code if the scoring couldn't be finished.
+ */
+int mpl_score_batch
+(const int ntrees, const int* trees, const int nthreads, int* lengths,
+ int* charsteps, Morphyp handl)
+{
+    int i = 0;
+    int nstarted = 0;
+    int n = nthreads < ntrees ? nthreads : ntrees;
+    pthread_t* threads = NULL;
+    MPLbatch b;
+
+    if (n < 1) {
+        return ERR_NO_ERROR;
+    }
+
+    if (!(threads = (pthread_t*)calloc(n, sizeof(pthread_t)))) {
+        return ERR_BAD_MALLOC;
+    }
+
+    b.handl     = handl;
+    b.ntrees    = ntrees;
+    b.trees     = trees;
+    b.lengths   = lengths;
+    b.charsteps = charsteps;
+    atomic_init(&b.next, 0);
+    atomic_init(&b.err, ERR_NO_ERROR);
+
+    for (i = 1; i < n; ++i) {
+        if (pthread_create(&threads[i], NULL, mpl_batch_thread, &b)) {
+            break;
+        }
+        ++nstarted;
+    }
+
+    mpl_batch_thread(&b);
+
+    for (i = 1; i <= nstarted; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+
+    return atomic_load(&b.err);
+}
+
+
+/* Whether the length of a partition can depend on where the tree is rooted.
+ * That of Fitch and Wagner characters can't, unless they have inapplicable
+ * data, and nor can that of characters whose step matrices are symmetric. */
+static bool mpl_root_sensitive(const MPLpartition* p, const Morphyp handl)
+{
+    int a = 0;
+    int b = 0;
+    int i = 0;
+    int nst = p->nstmxstates;
+    int nchars = p->ncharsinpart;
+    const MPLcost* c = p->stepmatrices;
+
+    if (p->isNAtype) {
+        return true;
+    }
+    if (p->chtype == FITCH_T || p->chtype == WAGNER_T) {
+        return false;
+    }
+    if (p->chtype != USERTYPE_T) {
+        return true;
+    }
+
+    for (a = 0; a < nst; ++a) {
+        for (b = a + 1; b < nst; ++b) {
+            for (i = 0; i < nchars; ++i) {
+                if (c[(a * nst + b) * nchars + i] !=
+                    c[(b * nst + a) * nchars + i]) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+
+/* Whether the length of every rooting of a partition follows from the sets of
+ * the subtrees on either side of each branch. */
+static bool mpl_root_edge_scored(const MPLpartition* p, const Morphyp handl)
+{
+    return p->edgedownfxn && mpl_root_sensitive(p, handl);
+}
+
+/* Whether a partition has to be scored again on each rooting. */
+static bool mpl_root_rescored(const MPLpartition* p, const Morphyp handl)
+{
+    return !p->edgedownfxn && mpl_root_sensitive(p, handl);
+}
+
+
+/* The state of a scan of every rooting by the subtrees either side of each
+ * branch. The sets of the subtree below a node are those of the handle doing
+ * the scan, and those of the rest of the tree, seen from the node, are up. */
+typedef struct {
+    MPLtree*    t;
+    MPLndsets** up;
+    MPLndsets** upsets;     /*!< Where the sets in up are kept, by node */
+    int*        downsteps;  /*!< Steps inside the subtree below each node */
+    int*        upsteps;    /*!< Steps inside the rest of the tree */
+    int*        length;     /*!< Length rooted above each node, less a constant */
+    int*        charsteps;
+    int         nchar;
+} MPLedgescan;
+
+static int mpl_edge_down
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, Morphyp handl)
+{
+    int i = 0;
+    int steps = 0;
+
+    for (i = 0; i < handl->numparts; ++i) {
+        steps += handl->partitions[i]->edgedownfxn(lset, rset, nset,
+                                                   handl->partitions[i]);
+    }
+
+    return steps;
+}
+
+static int mpl_edge_root
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, Morphyp handl)
+{
+    int i = 0;
+    int steps = 0;
+
+    for (i = 0; i < handl->numparts; ++i) {
+        steps += handl->partitions[i]->edgerootfxn(lset, rset, nset,
+                                                   handl->partitions[i]);
+    }
+
+    return steps;
+}
+
+/* Finds the length of the tree rooted above each node, up to a constant, in
+ * one pass down the tree and one back up. The rest of the tree seen from a
+ * node is its sibling's subtree joined to the rest of the tree seen from its
+ * parent. */
+static void mpl_edge_lengths(MPLedgescan* s, Morphyp handl)
+{
+    int i   = 0;
+    int n   = 0;
+    int l   = 0;
+    int r   = 0;
+    MPLtree* t          = s->t;
+    MPLndsets** down    = handl->statesets;
+    MPLndsets** up      = s->up;
+    MPLndsets* scratch  = s->upsets[t->root];
+
+    for (i = 0; i < t->ntips; ++i) {
+        s->downsteps[t->tips[i]] = 0;
+    }
+
+    for (i = 0; i < t->ninternal; ++i) {
+        n = t->postorder[i];
+        l = t->left[n];
+        r = t->right[n];
+        s->downsteps[n] = s->downsteps[l] + s->downsteps[r]
+                          + mpl_edge_down(down[l], down[r], down[n], handl);
+    }
+
+    l = t->left[t->root];
+    r = t->right[t->root];
+    up[l] = down[r];
+    up[r] = down[l];
+    s->upsteps[l] = s->downsteps[r];
+    s->upsteps[r] = s->downsteps[l];
+
+    // The root is last in postorder
+    for (i = t->ninternal - 1; i--;) {
+        n = t->postorder[i];
+        l = t->left[n];
+        r = t->right[n];
+        up[l] = s->upsets[l];
+        up[r] = s->upsets[r];
+        s->upsteps[l] = s->downsteps[r] + s->upsteps[n]
+                        + mpl_edge_down(down[r], up[n], up[l], handl);
+        s->upsteps[r] = s->downsteps[l] + s->upsteps[n]
+                        + mpl_edge_down(down[l], up[n], up[r], handl);
+    }
+
+    for (i = 0; i < t->ntips; ++i) {
+        n = t->tips[i];
+        s->length[n] = s->downsteps[n] + s->upsteps[n]
+                       + mpl_edge_root(down[n], up[n], scratch, handl);
+    }
+    for (i = 0; i < t->ninternal - 1; ++i) {
+        n = t->postorder[i];
+        s->length[n] = s->downsteps[n] + s->upsteps[n]
+                       + mpl_edge_root(down[n], up[n], scratch, handl);
+    }
+}
+
+/* Adds the change in length from the rooting of t to that above each node to
+ * out, at intervals of stride. */
+static void mpl_add_edge_lengths
+(const MPLedgescan* s, int* out, const size_t stride)
+{
+    int i   = 0;
+    int n   = 0;
+    const MPLtree* t = s->t;
+    int base = s->length[t->left[t->root]];
+
+    for (i = 0; i < t->ntips; ++i) {
+        n = t->tips[i];
+        out[n * stride] += s->length[n] - base;
+    }
+    for (i = 0; i < t->ninternal - 1; ++i) {
+        n = t->postorder[i];
+        out[n * stride] += s->length[n] - base;
+    }
+}
+
+static int mpl_char_edge_lengths(const int c, void* data, Morphyp handl)
+{
+    MPLedgescan* s = (MPLedgescan*)data;
+
+    mpl_edge_lengths(s, handl);
+    mpl_add_edge_lengths(s, &s->charsteps[c], s->nchar);
+
+    return ERR_NO_ERROR;
+}
+
+/* Adds the changes in length, and in the steps of each character, from the
+ * rooting of t to every other rooting for the partitions that can be scored by
+ * mpl_edge_lengths. */
+static int mpl_edge_rootings
+(MPLtree* t, int* lengths, int* charsteps, Morphyp handl)
+{
+    int i       = 0;
+    int nnodes  = 2 * t->ntax - 1;
+    int nchar   = handl->numcharacters;
+    int err     = ERR_NO_ERROR;
+    Morphyp w   = mpl_new_worker(handl);
+    Morphyp wu  = NULL;
+    MPLedgescan s;
+
+    if (!w) {
+        return ERR_BAD_MALLOC;
+    }
+
+    if (!mpl_worker_keep_partitions(mpl_root_edge_scored, w)) {
+        mpl_delete_worker(w);
+        return ERR_NO_ERROR;
+    }
+
+    wu          = mpl_new_worker(handl);
+    s.t         = t;
+    s.up        = (MPLndsets**)calloc(nnodes, sizeof(MPLndsets*));
+    s.downsteps = (int*)calloc(3 * nnodes, sizeof(int));
+    s.upsteps   = s.downsteps + nnodes;
+    s.length    = s.upsteps + nnodes;
+    s.charsteps = charsteps;
+    s.nchar     = nchar;
+
+    if (!wu || !s.up || !s.downsteps) {
+        err = ERR_BAD_MALLOC;
+    }
+    else {
+
+        s.upsets = wu->statesets;
+
+        // Sets kept by the scan beyond those of the downpass start empty
+        for (i = 0; i < t->ntips; ++i) {
+            memset(w->statesets[t->tips[i]]->temp_downpass1, 0,
+                   nchar * sizeof(MPLstate));
+        }
+
+        mpl_edge_lengths(&s, w);
+        mpl_add_edge_lengths(&s, lengths, 1);
+
+        if (charsteps) {
+            err = mpl_each_char(mpl_char_edge_lengths, &s, w);
+        }
+    }
+
+    free(s.up);
+    free(s.downsteps);
+    mpl_delete_worker(wu);
+    mpl_delete_worker(w);
+
+    return err;
+}
+
+
+/*!
+ @brief Finds the length of a tree rooted on each of its branches.
+ @discussion Characters whose length can't depend on the rooting are scored
+ once. Those with step matrices, and Dollo and irreversible characters, are
+ scored on every rooting together in one pass down the tree and one back up,
+ from the sets of the subtrees on either side of each branch. Only
+ characters with inapplicable data are scored again for each rooting, through
+ a worker keeping just their partitions, with the branches taken in preorder
+ so that each rerooting moves the root only a short way. For n nodes, the
+ scan therefore takes time in O(n) for each character, other than those
+ with inapplicable data, for which it is O(n^2). With charsteps, each
+ character is scanned on its own, except that a step matrix partition is
+ scanned in full for each of its characters (see mpl_each_char). t is left
+ rooted as it was, but the order of some children may change, and handl
+ itself is not changed.
+ @param lengths Space for 2 * ntax - 1 lengths: that of rooting on the branch
+ above each node of t. The root and its two children, whose branches are one
+ branch of the unrooted tree, are given the length of t as it is rooted.
+ @param charsteps NULL, or space for the unweighted steps of every character
+ (see mpl_char_steps) for each of those rootings, one node after another.
+ @return ERR_NO_ERROR, or ERR_BAD_MALLOC.
+ */
+int mpl_score_all_rootings
+(MPLtree* t, int* lengths, int* charsteps, Morphyp handl)
+{
+    int i       = 0;
+    int u       = 0;
+    int v       = 0;
+    int nb      = 0;
+    int base    = 0;
+    int c1      = t->left[t->root];
+    int c2      = t->right[t->root];
+    int nnodes  = 2 * t->ntax - 1;
+    int nchar   = handl->numcharacters;
+    int err     = ERR_NO_ERROR;
+    int* branches = (int*)calloc(2 * nnodes, sizeof(int));
+    Morphyp w   = mpl_new_worker(handl);
+
+    if (!branches || !w) {
+        free(branches);
+        mpl_delete_worker(w);
+        return ERR_BAD_MALLOC;
+    }
+
+    base = mpl_tree_length(t, w);
+
+    if (charsteps) {
+        err = mpl_char_steps(t, charsteps, w);
+    }
+
+    for (i = 0; i < nnodes; ++i) {
+        lengths[i] = base;
+        if (charsteps && i) {
+            memcpy(&charsteps[(size_t)i * nchar], charsteps,
+                   nchar * sizeof(int));
+        }
+    }
+
+    if (err == ERR_NO_ERROR) {
+        err = mpl_edge_rootings(t, lengths, charsteps, handl);
+    }
+
+    if (err == ERR_NO_ERROR &&
+        mpl_worker_keep_partitions(mpl_root_rescored, w)) {
+
+        base = mpl_tree_length(t, w);
+        nb = mpl_subtree_branches(t->root, branches, t);
+
+        for (i = 0; i < nb && err == ERR_NO_ERROR; ++i) {
+
+            u = branches[2 * i];
+            v = branches[2 * i + 1];
+
+            mpl_tree_reroot(t->root, t->anc[u] == v ? u : v, t);
+            mpl_tree_traverse(t);
+
+            lengths[u] += mpl_tree_length(t, w) - base;
+
+            // Only the characters of the partitions kept are overwritten
+            if (charsteps) {
+                err = mpl_char_steps(t, &charsteps[(size_t)u * nchar], w);
+            }
+        }
+
+        mpl_tree_reroot(t->root, t->anc[c1] == c2 ? c1 : c2, t);
+        mpl_tree_traverse(t);
+    }
+
+    free(branches);
+    mpl_delete_worker(w);
+
+    return err;
+}
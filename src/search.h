@@ -0,0 +1,104 @@
+//
+//  search.h
+//  morphylib
+//
+//  Whole trees, their scoring and the tree searches built on them.
+//
+
+#ifndef search_h
+#define search_h
+
+/* A rooted binary tree on which the search engine works. Tips are numbered
+ * from 0 to ntax - 1 and internal nodes from ntax to 2 * ntax - 2, so that the
+ * indices can be used directly with the nodal state sets. The root's ancestor
+ * is the lower ('dummy') root, 2 * ntax - 1. A pruned subtree keeps its link
+ * to the node that joined it to the rest of the tree, which is reused when it
+ * is grafted back. */
+typedef struct {
+    int     ntax;
+    int     root;
+    int     lroot;
+    int*    anc;
+    int*    left;
+    int*    right;
+    int     ninternal;  /*!< Number of internal nodes connected to the root */
+    int*    postorder;  /*!< The connected internal nodes in postorder */
+    int     ntips;
+    int*    tips;       /*!< The connected tips */
+    int*    nodesteps;  /*!< Steps counted at each node in the last full pass */
+    int*    stack;
+} MPLtree;
+
+/* A 128-bit hash of the splits of a tree, made of two independent halves. */
+typedef struct {
+    unsigned long long  lo;
+    unsigned long long  hi;
+} MPLtreehash;
+
+/* The best trees found so far, identified by a hash of their splits so that
+ * trees differing only in the position of the root count as the same. The
+ * hashes are indexed by an open-addressed table, so that finding whether a
+ * tree is already stored takes the same time however many there are. Space
+ * for trees is added as it is needed, up to maxtrees. */
+typedef struct {
+    int                 ntax;
+    int                 maxtrees;
+    int                 ntrees;
+    int                 length;
+    int                 capacity;   /*!< The number of trees there is space for */
+    MPLtreehash*        hashes;
+    int*                trees;      /*!< Parent vectors of 2 * ntax - 1 nodes */
+    int                 nslots;     /*!< A power of two, at least twice the capacity */
+    int*                slots;      /*!< The index of the tree hashed to each slot, or -1 */
+    MPLtreehash*        splits;     /*!< Scratch space for hashing */
+    int*                sizes;
+} MPLtreestore;
+
+MPLtree*    mpl_new_tree(const int ntax);
+void        mpl_delete_tree(MPLtree* t);
+int         mpl_tree_read_parents(const int* parents, MPLtree* t);
+void        mpl_tree_write_parents(const MPLtree* t, int* parents);
+void        mpl_tree_traverse(MPLtree* t);
+int         mpl_tree_score(MPLtree* t, Morphyp handl);
+int         mpl_tree_length(MPLtree* t, Morphyp handl);
+int         mpl_tree_prune(const int node, MPLtree* t);
+void        mpl_tree_graft(const int node, const int tgt, MPLtree* t);
+int         mpl_subtree_steps(const int node, const MPLtree* t);
+
+/* A small, fast generator, so that searches are reproducible from a seed and
+ * don't share state between threads. */
+typedef struct {
+    unsigned long long s;
+} MPLrng;
+
+void                mpl_rng_seed(const unsigned long long seed, MPLrng* rng);
+unsigned long long  mpl_rng_next(MPLrng* rng);
+int                 mpl_rng_below(const int n, MPLrng* rng);
+
+MPLtreestore*   mpl_new_treestore(const int ntax, const int maxtrees);
+void            mpl_delete_treestore(MPLtreestore* s);
+void            mpl_treestore_reset(const int length, MPLtreestore* s);
+bool            mpl_treestore_add(const MPLtree* t, MPLtreestore* s);
+bool            mpl_treestore_full(const MPLtreestore* s);
+void            mpl_treestore_offer(const int length, const MPLtree* t, MPLtreestore* s);
+void            mpl_treestore_merge(const MPLtreestore* src, MPLtreestore* dst);
+
+int mpl_spr_hillclimb(MPLtree* t, MPLtreestore* store, Morphyp handl);
+int mpl_tbr_hillclimb(MPLtree* t, MPLtreestore* store, Morphyp handl);
+int mpl_ratchet
+(MPLtree* t, MPLtreestore* store, const int niter, const double upweight,
+ MPLrng* rng, Morphyp handl);
+int mpl_stepwise_build
+(MPLtree* t, const MPLaddseq_t addseq, MPLrng* rng, Morphyp handl);
+int mpl_replicate
+(MPLtreestore* store, const int nreps, const int nthreads, const bool tbr,
+ const unsigned long long seed, Morphyp handl);
+int mpl_branch_bound
+(MPLtreestore* store, const int nthreads, Morphyp handl);
+int mpl_score_batch
+(const int ntrees, const int* trees, const int nthreads, int* lengths,
+ int* charsteps, Morphyp handl);
+int mpl_score_all_rootings
+(MPLtree* t, int* lengths, int* charsteps, Morphyp handl);
+
+#endif /* search_h */
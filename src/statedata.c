@@ -247,7 +247,8 @@ int mpl_convert_cells(Morphyp handl)
                 
                 bool over_cutoff = false;
                 
-                if (chinfo[i].ninapplics > NACUTOFF) {
+                if (chinfo[i].ninapplics > NACUTOFF &&
+                    mpl_chtype_supports_NA(chinfo[i].chtype)) {
                     over_cutoff = true;
                 }
                 
@@ -703,6 +704,49 @@ char *mpl_translate_state2char(MPLstate cstates, Morphyp handl)
     return res;
 }
 
+/* A lower bound on the length of a step matrix character: every observed state
+ * except the one at the root has to be entered at least once. */
+static int mpl_stepmatrix_minscore
+(const MPLcharinfo* chinfo, MPLstate observed, const int shift)
+{
+    int a = 0;
+    int b = 0;
+    int dim = chinfo->stmxdim;
+    MPLcost entry   = 0;
+    MPLcost sum     = 0;
+    MPLcost maxentry = 0;
+    
+    if (!chinfo->stepmatrix) {
+        return 0;
+    }
+    
+    observed >>= shift;
+    
+    for (b = 0; b < dim; ++b) {
+        
+        if (!((observed >> b) & 1)) {
+            continue;
+        }
+        
+        entry = MPLCOSTINF;
+        for (a = 0; a < dim; ++a) {
+            if (a != b && chinfo->stepmatrix[a * dim + b] < entry) {
+                entry = chinfo->stepmatrix[a * dim + b];
+            }
+        }
+        if (entry == MPLCOSTINF) {
+            entry = 0;
+        }
+        
+        sum += entry;
+        if (entry > maxentry) {
+            maxentry = entry;
+        }
+    }
+    
+    return (int)(sum - maxentry);
+}
+
 int mpl_count_states_in_parts(Morphyp handl)
 {
     int res = ERR_NO_ERROR;
@@ -742,7 +786,18 @@ int mpl_count_states_in_parts(Morphyp handl)
             MORPHY_PORTABLE_POPCOUNTLL(handl->partitions[i]->nstates[j], total);
             
             // Assign the minscores
-            if (handl->partitions[i]->nstates[j] != 0) {
+            if (handl->partitions[i]->chtype == DOLLO_T ||
+                handl->partitions[i]->chtype == IRREVERSIBLE_T) {
+                // Every state between the lowest and highest must be passed
+                total = mpl_highest_state(total) - mpl_lowest_state(total);
+                MORPHY_PORTABLE_POPCOUNTLL(handl->partitions[i]->minscores[j], total);
+            }
+            else if (handl->partitions[i]->chtype == USERTYPE_T) {
+                handl->partitions[i]->minscores[j] = mpl_stepmatrix_minscore
+                    (&handl->charinfo[index], total,
+                     handl->gaphandl == GAP_MISSING ? 0 : 1);
+            }
+            else if (handl->partitions[i]->nstates[j] != 0) {
                 handl->partitions[i]->minscores[j] = handl->partitions[i]->nstates[j] - 1;
             }
             else {
@@ -763,7 +818,7 @@ int mpl_init_charac_info(Morphyp handl)
     int nchar = mpl_get_num_charac((Morphy)handl);
     
     if (handl->charinfo) {
-        free(handl->charinfo);
+        mpl_delete_charac_info(handl);
     }
     
     handl->charinfo = (MPLcharinfo*)calloc(nchar, sizeof(MPLcharinfo));
@@ -775,6 +830,7 @@ int mpl_init_charac_info(Morphyp handl)
     for (i = 0; i < nchar; ++i) {
         handl->charinfo[i].charindex    = i;
         handl->charinfo[i].chtype       = DEFAULCHARTYPE;
+        handl->charinfo[i].included     = true;
         handl->charinfo[i].realweight   = 1.0;
         handl->charinfo[i].basewt       = 1;
         handl->charinfo[i].intwt        = 1;
@@ -796,5 +852,14 @@ void mpl_delete_charac_info(Morphyp handl)
     if (!handl->charinfo) {
         return;
     }
+    
+    int i = 0;
+    for (i = 0; i < mpl_get_num_charac((Morphy)handl); ++i) {
+        if (handl->charinfo[i].stepmatrix) {
+            free(handl->charinfo[i].stepmatrix);
+        }
+    }
+    
     free(handl->charinfo);
+    handl->charinfo = NULL;
 }
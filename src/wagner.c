@@ -10,31 +10,65 @@
 #include "morphy.h"
 #include "wagner.h"
 
-static inline unsigned mpl_closed_interval(MPLstate* res, MPLstate a, MPLstate b)
+/* The closed interval between two disjoint state sets. Whichever set holds the
+ * higher state is taken as the upper one. The interval runs from the highest
+ * state of the lower set to the first state of the upper set above it. The
+ * number of steps across the interval is written to steps. If the sets
+ * intersect, the result is meaningless and should be masked off by the
+ * caller. */
+static inline MPLstate mpl_closed_interval
+(unsigned long* steps, const MPLstate a, const MPLstate b)
 {
-    unsigned steps = 0;
-    MPLstate c = 0;
+    MPLstate upper  = 0;
+    MPLstate lower  = 0;
+    MPLstate top    = 0;
+    MPLstate bottom = 0;
+    MPLstate sel    = -(MPLstate)(a > b);
+    MPLstate span   = 0;
     
-#ifdef DEBUG
-    assert(*res == 0);
-#endif
+    upper   = (a & sel) | (b & ~sel);
+    lower   = a ^ b ^ upper;
+    bottom  = mpl_highest_state(lower);
+    top     = mpl_lowest_state(upper & ~mpl_states_to_highest(lower));
+    span    = top - bottom;
     
-    if (b > a) {
-        c = b;
-        b = a;
-        a = c;
-    }
+    MORPHY_PORTABLE_POPCOUNTLL(*steps, span);
+    
+    return (top - bottom) | top;
+}
+
+
+/* The median of three intervals: the states that minimise the summed distance
+ * to all three. This is the range between the third and fourth of their six
+ * endpoints. Each endpoint is represented by the mask of all positions at or
+ * above it, and the masks are summed one bit position at a time. */
+static inline MPLstate mpl_median_interval
+(const MPLstate a, const MPLstate b, const MPLstate c)
+{
+    MPLstate m1 = -mpl_lowest_state(a);
+    MPLstate m2 = -mpl_highest_state(a);
+    MPLstate m3 = -mpl_lowest_state(b);
+    MPLstate m4 = -mpl_highest_state(b);
+    MPLstate m5 = -mpl_lowest_state(c);
+    MPLstate m6 = -mpl_highest_state(c);
     
-    *res = a & (-a);
+    MPLstate s1 = m1 ^ m2 ^ m3;
+    MPLstate c1 = (m1 & m2) | (m3 & (m1 ^ m2));
+    MPLstate s2 = m4 ^ m5 ^ m6;
+    MPLstate c2 = (m4 & m5) | (m6 & (m4 ^ m5));
     
-    while(!(*res & b)) {
-        ++steps;
-        *res |= a >> steps;
-    }
+    MPLstate ones   = s1 ^ s2;
+    MPLstate k      = s1 & s2;
+    MPLstate twos   = c1 ^ c2 ^ k;
+    MPLstate fours  = (c1 & c2) | (k & (c1 ^ c2));
     
-    return steps;
+    MPLstate atleast3 = fours | (twos & ones);
+    MPLstate atleast4 = fours;
+    
+    return atleast3 & ~(atleast4 << 1);
 }
 
+
 int mpl_wagner_downpass
 (MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part)
 {
@@ -46,21 +80,24 @@ int mpl_wagner_downpass
     MPLstate* left  = lset->downpass1;
     MPLstate* right = rset->downpass1;
     MPLstate* n     = nset->downpass1;
+    MPLstate  isect = 0;
+    MPLstate  empty = 0;
+    MPLstate  interval  = 0;
+    unsigned long span  = 0;
     
     unsigned long* weights = part->intwts;
     
+#pragma clang loop vectorize(enable)
     for (i = 0; i < nchars; ++i) {
         
         j = indices[i];
         
-        if (left[j] & right[j]) {
-            n[j] = left[j] & right[j];
-        }
-        else {
-            
-            n[j] = 0;
-            steps += weights[i] * mpl_closed_interval(&n[j], left[j], right[j]);
-        }
+        isect       = left[j] & right[j];
+        empty       = -(MPLstate)(isect == 0);
+        interval    = mpl_closed_interval(&span, left[j], right[j]);
+        
+        n[j]   = isect | (interval & empty);
+        steps += weights[i] * (span & empty);
     }
     
     return steps;
@@ -76,24 +113,15 @@ int mpl_wagner_uppass
     int nchars      = part->ncharsinpart;
     MPLstate* left  = lset->downpass1;
     MPLstate* right = rset->downpass1;
-    MPLstate* npre  = nset->downpass1;
     MPLstate* nfin  = nset->uppass1;
     MPLstate* anc   = ancset->uppass1;
     
+    // The final set is the median of the sets of the node's three neighbours
+    // (Swofford & Maddison, 1987).
+#pragma clang loop vectorize(enable)
     for (i = 0; i < nchars; ++i) {
-        
         j = indices[i];
-        
-        if ((anc[j] & npre[j]) == anc[j]) {
-            nfin[j] = anc[j] & npre[j];
-        }
-        else {
-            MPLstate res = 0;
-            mpl_closed_interval(&res, left[j], right[j]);
-            nfin[j] = (res & anc[j]) | npre[j];
-        }
-       
-        assert(nfin[j]);
+        nfin[j] = mpl_median_interval(left[j], right[j], anc[j]);
     }
     
     return 0;
@@ -102,25 +130,363 @@ int mpl_wagner_uppass
 int mpl_wagner_tip_update
 (MPLndsets* tset, MPLndsets* ancset, MPLpartition* part)
 {
-    // TODO: Must change this to a Wagner-specific option
     int i     = 0;
     int j     = 0;
     int* indices    = part->charindices;
     int nchars      = part->ncharsinpart;
-    // TODO: Check these!!!!!!!
     MPLstate* tprelim = tset->downpass1;
     MPLstate* tfinal  = tset->uppass1;
     MPLstate* astates = ancset->uppass1;
+    MPLstate  isect   = 0;
     
+    // A polymorphic or uncertain tip takes whichever of its states are
+    // shared with its ancestor, if any.
+#pragma clang loop vectorize(enable)
     for (i = 0; i < nchars; ++i) {
         j = indices[i];
-        if (tprelim[j] & astates[j]) {
-            tfinal[j] = tprelim[j] & astates[j];
+        isect     = tprelim[j] & astates[j];
+        tfinal[j] = isect | (tprelim[j] & -(MPLstate)(isect == 0));
+    }
+    
+    return 0;
+}
+
+
+/* All states between the lowest and highest in s, inclusive. */
+static inline MPLstate mpl_state_range(const MPLstate s)
+{
+    return mpl_states_to_highest(s) & -mpl_lowest_state(s);
+}
+
+
+/*!
+ @brief Calculates the length added by inserting a subtree on a branch.
+ @discussion Any state between the final sets at either end of the target
+ branch can be reached without extra cost, so the added length is the distance
+ from the source subtree to that range.
+ */
+int mpl_wagner_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen)
+{
+    int i     = 0;
+    int j     = 0;
+    int steps = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* tgt1      = tgt1set->uppass1;
+    MPLstate* tgt2      = tgt2set->uppass1;
+    MPLstate* src       = srcset->downpass1;
+    MPLstate  range     = 0;
+    MPLstate  apart     = 0;
+    unsigned long span  = 0;
+    
+    unsigned long* weights = part->intwts;
+    
+    for (i = 0; i < nchars; ++i) {
+        
+        j = indices[i];
+        
+        range = mpl_state_range(tgt1[j] | tgt2[j]);
+        apart = -(MPLstate)((src[j] & range) == 0);
+        mpl_closed_interval(&span, src[j], range);
+        
+        steps += weights[i] * (span & apart);
+        
+        if (domaxlen == true && steps > maxlen) {
+            return steps;
+        }
+    }
+    
+    return steps;
+}
+
+
+/*
+ * Inapplicable-aware Wagner optimisation.
+ *
+ * The first downpass and uppass only establish which regions of the tree are
+ * applicable, which does not depend on the ordering of the states, so the
+ * Fitch versions of those passes (and of the tip updates) are used. The
+ * functions below replace the second passes: within an applicable region,
+ * sets are resolved by intervals and medians as in the ordinary Wagner passes
+ * and changes are counted as distances. An additional region of applicability
+ * costs a single step, as it does for Fitch characters.
+ */
+static inline int mpl_NA_wagner_second_down_core
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part,
+ const int* indices, const int nchars, const bool record)
+{
+    int             i       = 0;
+    int             j       = 0;
+    int             steps   = 0;
+    int             cost    = 0;
+    MPLstate*       left    = lset->downpass2;
+    MPLstate*       right   = rset->downpass2;
+    MPLstate*       nifin   = nset->uppass1;
+    MPLstate*       npre    = nset->downpass2;
+    MPLstate*       npret   = nset->temp_downpass2;
+    MPLstate*       stacts  = nset->subtree_actives;
+    MPLstate*       tstatcs = nset->temp_subtr_actives;
+    MPLstate*       lacts   = lset->subtree_actives;
+    MPLstate*       racts   = rset->subtree_actives;
+    MPLstate        temp    = 0;
+    unsigned long   span    = 0;
+    unsigned long*  weights = part->intwts;
+    
+    for (i = nchars; i--;) {
+        
+        j = indices[i];
+        
+        cost = 0;
+        
+        if (nifin[j] & ISAPPLIC) {
+            if ((temp = (left[j] & right[j]))) {
+                if (temp & ISAPPLIC) {
+                    npre[j] = temp & ISAPPLIC;
+                } else {
+                    npre[j] = temp;
+                }
+            }
+            else if (left[j] & ISAPPLIC && right[j] & ISAPPLIC) {
+                npre[j] = mpl_closed_interval(&span, left[j] & ISAPPLIC,
+                                              right[j] & ISAPPLIC);
+                cost = weights[i] * span;
+            }
+            else {
+                npre[j] = (left[j] | right[j]) & ISAPPLIC;
+                if (lacts[j] && racts[j]) {
+                    cost = weights[i];
+                }
+            }
         }
         else {
-            tfinal[j] = tprelim[j];
+            npre[j] = nifin[j];
+            if (lacts[j] && racts[j]) {
+                cost = weights[i];
+            }
         }
-        assert(tfinal[j]);
+        
+        nset->changes[j] = cost > 0;
+        steps += cost;
+        if (record) {
+            part->steps_in_char[i] += cost;
+        }
+        
+        /* Store the states active on this subtree */
+        stacts[j]   = (lacts[j] | racts[j]) & ISAPPLIC;
+        
+        npret[j]    = npre[j]; // Storage for temporary updates.
+        tstatcs[j]  = stacts[j];
+        
+#ifdef DEBUG
+        assert(npre[j]);
+#endif
     }
+    
+    return steps;
+}
+
+
+int mpl_NA_wagner_second_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part)
+{
+    return mpl_NA_wagner_second_down_core(lset, rset, nset, part,
+                                          part->charindices,
+                                          part->ncharsinpart, true);
+}
+
+
+int mpl_NA_wagner_second_update_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part)
+{
+    return mpl_NA_wagner_second_down_core(lset, rset, nset, part,
+                                          part->update_NA_indices,
+                                          part->nNAtoupdate, false);
+}
+
+
+static inline int mpl_NA_wagner_second_up_core
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ const int* indices, const int nchars)
+{
+    int         i       = 0;
+    int         j       = 0;
+    MPLstate*   left    = lset->downpass2;
+    MPLstate*   right   = rset->downpass2;
+    MPLstate*   npre    = nset->downpass2;
+    MPLstate*   nfin    = nset->uppass2;
+    MPLstate*   nfint   = nset->temp_uppass2;
+    MPLstate*   anc     = ancset->uppass2;
+    MPLstate    l       = 0;
+    MPLstate    r       = 0;
+    
+    for (i = nchars; i--;) {
+        
+        j = indices[i];
+        
+        if (npre[j] & ISAPPLIC && anc[j] & ISAPPLIC) {
+            // A descendant with no applicable states places no constraint
+            // on the median, which is the same as it being entirely unknown.
+            l = left[j] & ISAPPLIC;
+            r = right[j] & ISAPPLIC;
+            nfin[j] = mpl_median_interval(l ? l : ISAPPLIC, r ? r : ISAPPLIC,
+                                          anc[j] & ISAPPLIC);
+        }
+        else {
+            nfin[j] = npre[j];
+        }
+        
+        nfint[j] = nfin[j]; // Storage of states for undoing temp updates
+#ifdef DEBUG
+        assert(nfin[j]);
+#endif
+    }
+    
     return 0;
 }
+
+
+int mpl_NA_wagner_second_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part)
+{
+    return mpl_NA_wagner_second_up_core(lset, rset, nset, ancset,
+                                        part->charindices, part->ncharsinpart);
+}
+
+
+int mpl_NA_wagner_second_update_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part)
+{
+    return mpl_NA_wagner_second_up_core(lset, rset, nset, ancset,
+                                        part->update_NA_indices,
+                                        part->nNAtoupdate);
+}
+
+
+static inline int mpl_wagner_NA_second_branch_core
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part, const bool record)
+{
+    int i     = 0;
+    int j     = 0;
+    int cost  = 0;
+    int length = 0;
+    int* indices            = part->charindices;
+    int nchars              = part->ncharsinpart;
+    MPLstate* tipset        = tipanc->downpass1;
+    MPLstate* tipifin       = tipanc->uppass1;
+    MPLstate* ndset         = node->downpass2;
+    MPLstate* ndacts        = node->subtree_actives;
+    MPLstate  temp          = 0;
+    unsigned long span      = 0;
+    unsigned long* weights  = part->intwts;
+    
+    for (i = nchars; i--;) {
+        
+        j = indices[i];
+        
+        cost = 0;
+        temp = tipset[j] & ndset[j];
+        
+        if (temp == 0) {
+            if (tipset[j] & ISAPPLIC) {
+                if (ndset[j] & ISAPPLIC) {
+                    mpl_closed_interval(&span, tipset[j] & ISAPPLIC,
+                                        ndset[j] & ISAPPLIC);
+                    cost = weights[i] * span;
+                }
+                else if (ndacts[j]) {
+                    cost = weights[i];
+                }
+            }
+            
+            tipifin[j] = tipset[j];
+        }
+        else {
+            tipifin[j] = temp;
+        }
+        
+        length += cost;
+        
+        if (record) {
+            tipanc->changes[j] = cost > 0;
+            part->steps_in_char[i] += cost;
+            
+            tipanc->temp_downpass1[j]   = tipanc->downpass1[j];
+            tipanc->temp_uppass1[j]     = tipanc->uppass1[j];
+            tipanc->temp_downpass2[j]   = tipanc->downpass2[j];
+            tipanc->temp_uppass2[j]     = tipanc->uppass2[j];
+        }
+        else if (tipanc->changes[j] == true) {
+            tipanc->steps_to_recall += weights[i];
+        }
+    }
+    
+    return length;
+}
+
+
+int mpl_wagner_NA_second_one_branch
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part)
+{
+    return mpl_wagner_NA_second_branch_core(tipanc, node, part, true);
+}
+
+
+int mpl_wagner_NA_second_one_branch_recalc
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part)
+{
+    return mpl_wagner_NA_second_branch_core(tipanc, node, part, false);
+}
+
+
+/*!
+ @brief Calculates the length added by inserting a subtree on a branch.
+ @discussion Any state between the final sets at either end of the target
+ branch can be reached without extra cost, so the added length is the distance
+ from the source subtree to that range. Characters for which either the source
+ or the target is inapplicable are listed for a full recalculation instead.
+ */
+int mpl_wagner_NA_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen)
+{
+    part->ntoupdate = 0;
+    
+    int i           = 0;
+    int j           = 0;
+    int need_update = 0;
+    int steps       = 0;
+    const int* indices  = part->charindices;
+    int nchars          = part->ncharsinpart;
+    MPLstate* tgt1f     = tgt1set->uppass2;
+    MPLstate* tgt2f     = tgt2set->uppass2;
+    MPLstate* src       = srcset->downpass2;
+    MPLstate  range     = 0;
+    unsigned long span  = 0;
+    
+    unsigned long* weights = part->intwts;
+    
+    for (i = 0; i < nchars; ++i) {
+        
+        j = indices[i];
+        
+        if ((tgt1f[j] | tgt2f[j]) & ISAPPLIC && src[j] & ISAPPLIC) {
+            range = mpl_state_range((tgt1f[j] | tgt2f[j]) & ISAPPLIC);
+            if (!(src[j] & range)) {
+                mpl_closed_interval(&span, src[j] & ISAPPLIC, range);
+                steps += weights[i] * span;
+            }
+        }
+        else {
+            part->update_NA_indices[need_update] = j;
+            ++need_update;
+        }
+    }
+    
+    part->nNAtoupdate = need_update;
+    
+    return steps;
+}
@@ -16,4 +16,24 @@ int mpl_wagner_uppass
  MPLpartition* part);
 int mpl_wagner_tip_update
 (MPLndsets* tset, MPLndsets* ancset, MPLpartition* part);
+int mpl_wagner_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen);
+int mpl_NA_wagner_second_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part);
+int mpl_NA_wagner_second_update_downpass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLpartition* part);
+int mpl_NA_wagner_second_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part);
+int mpl_NA_wagner_second_update_uppass
+(MPLndsets* lset, MPLndsets* rset, MPLndsets* nset, MPLndsets* ancset,
+ MPLpartition* part);
+int mpl_wagner_NA_second_one_branch
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part);
+int mpl_wagner_NA_second_one_branch_recalc
+(MPLndsets* tipanc, MPLndsets* node, MPLpartition* part);
+int mpl_wagner_NA_local_reopt
+(MPLndsets* srcset, MPLndsets* tgt1set, MPLndsets* tgt2set, MPLpartition* part,
+ int maxlen, bool domaxlen);
 #endif /* wagner_h */
@@ -13,6 +13,12 @@
 #include "testmpl.h"
 #include "testfitch.h"
 #include "testwagner.h"
+#include "testdollo.h"
+#include "testirreversible.h"
+#include "testsankoff.h"
+#include "testsearch.h"
+#include "testdowncache.h"
+#include "testnewick.h"
 
 int main (void)
 {
@@ -36,6 +42,8 @@ int main (void)
     fails += test_almost_equal();
     fails += test_resetting_weights();
     fails += test_resetting_frac_weights();
+    fails += test_weights_without_reapply();
+    fails += test_repeated_weight_changes();
     fails += test_count_gaps_basic();
     fails += test_partition_push_index();
     fails += test_data_partitioning_simple();
@@ -56,6 +64,11 @@ int main (void)
     //fails += test_inapplic_state_restoration();
     // TODO: set this test up to return
     test_state_retrieval();
+    fails += test_hot_path_stats();
+    fails += test_trace_dump();
+    fails += test_trace_thread_reuse();
+    fails += test_charac_exclusion();
+    fails += test_translate_packed_states();
     
     // fitch.c tests
     fails += test_small_fitch();
@@ -74,6 +87,58 @@ int main (void)
     // wagner.c tests 
     fails += test_small_wagner();
     fails += test_wagner_extended();
+    fails += test_wagner_final_sets();
+    fails += test_wagner_NA_binary_matches_fitch();
+    fails += test_wagner_NA_ordered();
+    fails += test_wagner_local_reopt();
+    
+    // dollo.c tests
+    fails += test_small_dollo();
+    fails += test_dollo_unrooted();
+    fails += test_dollo_local_reopt();
+    
+    // irreversible.c tests
+    fails += test_small_irreversible();
+    fails += test_irreversible_local_reopt();
+    
+    // sankoff.c tests
+    fails += test_sankoff_matches_fitch_and_wagner();
+    fails += test_sankoff_asymmetric();
+    fails += test_sankoff_unrooted();
+    fails += test_sankoff_local_reopt();
+    fails += test_sankoff_bad_stepmatrix();
+    fails += test_sankoff_exclusion();
+    
+    // search.c tests
+    fails += test_spr_finds_compatible_tree();
+    fails += test_spr_bad_start_tree();
+    fails += test_spr_keeps_equal_trees();
+    fails += test_spr_inapplic_lengths_exact();
+    fails += test_tbr_finds_compatible_tree();
+    fails += test_tbr_optimum_is_spr_optimum();
+    fails += test_tbr_inapplic_lengths_exact();
+    fails += test_search_mixed_lengths_exact();
+    fails += test_stepwise_addition_orders();
+    fails += test_stepwise_addition_inapplic();
+    fails += test_ratchet_search();
+    fails += test_replicate_search();
+    fails += test_branch_and_bound_exhaustive();
+    fails += test_branch_and_bound_threads();
+    fails += test_treestore_many_trees();
+    fails += test_score_trees_batch();
+    fails += test_score_tree_sets();
+    fails += test_tree_length_passes();
+    fails += test_score_rootings();
+    
+    // downcache.c tests
+    fails += test_downcache_lengths_exact();
+    fails += test_downcache_repeated_tree();
+    fails += test_downcache_weight_change();
+    
+    // newick.c tests
+    fails += test_newick_read_labels();
+    fails += test_newick_errors_skipped();
+    fails += test_newick_score_file();
     
     printf("\n\nTest summary:\n\n");
     if (fails) {
@@ -20,5 +20,6 @@
 #define theader(testname) printf("\n\n\t%s\n\n", testname);
 
 int test_do_fullpass_on_tree(TLtree* t, Morphy m);
+int test_do_fullpass_all_steps(TLtree* t, Morphy m);
 int test_full_reoptimization_for_inapplics(TLtree* t, Morphy m);
 int test_do_fullpass_for_NAs(TLtree* t, Morphy m);
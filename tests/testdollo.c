@@ -0,0 +1,200 @@
+//
+//  testdollo.c
+//  morphylib
+//
+//  Tests of the Dollo character type.
+//
+
+#include <string.h>
+#include "mpltest.h"
+#include "mpl.h"
+#include "morphydefs.h"
+#include "testdollo.h"
+
+static char* dollomatrix =
+"0?31\
+ 0131\
+ 1001\
+ 2201\
+ 2?01\
+ 3201;";
+
+int test_small_dollo(void)
+{
+    theader("A simple test of Dollo counting");
+    int failn   = 0;
+    int numtaxa = 6;
+    int nchar   = 4;
+    int i       = 0;
+    int length  = 0;
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(numtaxa, nchar, m);
+    mpl_attach_rawdata(dollomatrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, DOLLO_T, m);
+    }
+    mpl_set_num_internal_nodes(numtaxa, m);
+    mpl_apply_tipdata(m);
+    
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    if (length != 10) {
+        printf("Calculated: %i, expected: %i\n", length, 10);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Taxon 3 has lost the derived state of the first character
+    if (strcmp(mpl_get_stateset(2, 0, 2, m), "1")) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+int test_dollo_unrooted(void)
+{
+    theader("Testing Dollo counting on a tree rooted on a terminal branch");
+    int failn   = 0;
+    int ntax    = 12;
+    int nchar   = 3;
+    int i       = 0;
+    int length  = 0;
+    
+    char *rawmatrix =
+    "010\
+     100\
+     101\
+     001\
+     001\
+     001\
+     001\
+     001\
+     001\
+     001\
+     101\
+     101;";
+    
+    int tipancs[]= {    21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 12};
+    int ancs[]   = {13, 14, 15, 16, 17, 18, 19, 20, 21, 0};
+    int nodes[]  = {12, 13, 14, 15, 16, 17, 18, 19, 20, 21};
+    int ldescs[] = {10,  9,  8,  7,  6,  5,  4,  3,  2,  1};
+    int rdescs[] = {11, 12, 13, 14, 15, 16, 17, 18, 19, 20};
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m);
+    mpl_attach_rawdata(rawmatrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, DOLLO_T, m);
+    }
+    mpl_set_num_internal_nodes(13, m);
+    mpl_apply_tipdata(m);
+    
+    for (i = 0; i < (ntax-2); ++i) {
+        length += mpl_first_down_recon(nodes[i], ldescs[i], rdescs[i], m);
+    }
+    
+    length += mpl_do_tiproot(0, 21, m);
+    
+    for (i = (ntax-3); i >= 0; --i) {
+        length += mpl_first_up_recon(nodes[i], ldescs[i], rdescs[i], ancs[i], m);
+    }
+    
+    for (i = 1; i < ntax; ++i) {
+        length += mpl_update_tip(i, tipancs[i-1], m);
+    }
+    
+    // First character: one gain and seven losses. The other two characters
+    // each need only a single gain.
+    if (length != 10) {
+        printf("Calculated: %i, expected: %i\n", length, 10);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_dollo_local_reopt(void)
+{
+    theader("Testing local reoptimization of Dollo characters");
+    int failn   = 0;
+    int numtaxa = 6;
+    int nchar   = 4;
+    int i       = 0;
+    int length  = 0;
+    int diff    = 0;
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(numtaxa, nchar, m);
+    mpl_attach_rawdata(dollomatrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, DOLLO_T, m);
+    }
+    mpl_set_num_internal_nodes(numtaxa, m);
+    mpl_apply_tipdata(m);
+    
+    test_do_fullpass_all_steps(tree, m);
+    
+    TLnode* src  = &tree->trnodes[5];
+    TLnode* orig = tl_remove_branch(src, tree);
+    
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    // Reinsertion at the original site restores the original length
+    diff = mpl_get_insertcost(src->index, orig->index, orig->anc->index, false, 100, m);
+    if (length + diff != 10) {
+        printf("Calculated: %i, expected: %i\n", length + diff, 10);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Away from the original site the estimate can only be a lower bound, as
+    // the clades of the derived states grow above the insertion point.
+    diff = mpl_get_insertcost(src->index, 0, tree->trnodes[0].anc->index, false, 100, m);
+    tl_insert_branch(src, 0, tree);
+    
+    if (diff <= 0 || test_do_fullpass_all_steps(tree, m) < length + diff) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
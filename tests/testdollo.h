@@ -0,0 +1,15 @@
+//
+//  testdollo.h
+//  morphylib
+//
+//  Tests of the Dollo character type.
+//
+
+#ifndef testdollo_h
+#define testdollo_h
+
+int test_small_dollo(void);
+int test_dollo_unrooted(void);
+int test_dollo_local_reopt(void);
+
+#endif /* testdollo_h */
@@ -0,0 +1,254 @@
+//
+//  testdowncache.c
+//  morphylib
+//
+//  Tests of the downpass cache.
+//
+
+#include "mpltest.h"
+#include "mpl.h"
+#include "morphydefs.h"
+#include "search.h"
+#include "testdowncache.h"
+
+#define DCNTAX  10
+#define DCNCHAR 11
+#define DCNTREE 24
+
+// Columns 0-5 are Fitch with inapplicable data, 6-7 Wagner, 8 Dollo, 9
+// irreversible and 10 has a step matrix.
+static char* dcmatrix =
+"10-0-121012\
+ 10-1-102100\
+ 0-1-0021021\
+ 0-1-0110110\
+ 1111-020101\
+ 1011-112102\
+ 0-0-1011011\
+ 0-0-1122000\
+ 1120-010112\
+ 0-01-121101;";
+
+static int dccosts[] = {
+    0, 1, 3,
+    2, 0, 1,
+    1, 2, 0
+};
+
+static Morphy test_downcache_setup(void)
+{
+    int i = 0;
+    Morphy m = mpl_new_Morphy();
+    
+    mpl_init_Morphy(DCNTAX, DCNCHAR, m);
+    mpl_attach_rawdata(dcmatrix, m);
+    for (i = 0; i < 6; ++i) {
+        mpl_set_parsim_t(i, FITCH_T, m);
+    }
+    mpl_set_parsim_t(6, WAGNER_T, m);
+    mpl_set_parsim_t(7, WAGNER_T, m);
+    mpl_set_parsim_t(8, DOLLO_T, m);
+    mpl_set_parsim_t(9, IRREVERSIBLE_T, m);
+    mpl_set_parsim_t(10, USERTYPE_T, m);
+    mpl_set_charac_stepmatrix(10, 3, dccosts, m);
+    mpl_set_gaphandl(GAP_INAPPLIC, m);
+    mpl_set_num_internal_nodes(DCNTAX, m);
+    mpl_apply_tipdata(m);
+    
+    return m;
+}
+
+static int test_downcache_score(const int* parents, Morphy m)
+{
+    int length = 0;
+    MPLtree* t = mpl_new_tree(DCNTAX);
+    
+    mpl_tree_read_parents(parents, t);
+    length = mpl_tree_score(t, (Morphyp)m);
+    mpl_delete_tree(t);
+    
+    return length;
+}
+
+/* Trees built by stepwise addition from different orders share many of their
+ * clades. */
+static void test_downcache_trees(int* trees, Morphy m)
+{
+    int i = 0;
+    
+    for (i = 0; i < DCNTREE; ++i) {
+        mpl_stepwise_addition(ADDSEQ_RANDOM, i, &trees[i * (2 * DCNTAX - 1)],
+                              m);
+    }
+}
+
+int test_downcache_lengths_exact(void)
+{
+    theader("Testing lengths with the downpass cache");
+    
+    int failn   = 0;
+    int i       = 0;
+    int bad     = 0;
+    int trees[DCNTREE * (2 * DCNTAX - 1)];
+    int lengths[DCNTREE];
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    
+    Morphy m = test_downcache_setup();
+    
+    test_downcache_trees(trees, m);
+    for (i = 0; i < DCNTREE; ++i) {
+        lengths[i] = test_downcache_score(&trees[i * (2 * DCNTAX - 1)], m);
+    }
+    
+    if (mpl_set_downpass_cache(1 << 20, m) != ERR_NO_ERROR) {
+        ++failn;
+        pfail;
+    }
+    
+    for (i = 0; i < DCNTREE; ++i) {
+        if (test_downcache_score(&trees[i * (2 * DCNTAX - 1)], m)
+            != lengths[i]) {
+            ++bad;
+        }
+    }
+    
+    mpl_get_downpass_cache_counts(&hits, &misses, m);
+    
+    if (bad || !hits || !misses) {
+        printf("Wrong lengths: %i, hits: %llu, misses: %llu\n", bad, hits,
+               misses);
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // With room for only a few subtrees, most are replaced before they recur
+    bad = 0;
+    mpl_set_downpass_cache(3 * sizeof(MPLstate) * (DCNCHAR + 16) + 64, m);
+    for (i = 0; i < DCNTREE; ++i) {
+        if (test_downcache_score(&trees[i * (2 * DCNTAX - 1)], m)
+            != lengths[i]) {
+            ++bad;
+        }
+    }
+    
+    if (bad) {
+        failn += bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_set_downpass_cache(1, m) != ERR_BAD_PARAM ||
+        mpl_get_downpass_cache_counts(&hits, &misses, m) != ERR_NO_DATA) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_downcache_repeated_tree(void)
+{
+    theader("Testing that a repeated tree comes from the downpass cache");
+    
+    int failn   = 0;
+    int first   = 0;
+    int again   = 0;
+    int tree[2 * DCNTAX - 1];
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    
+    Morphy m = test_downcache_setup();
+    
+    mpl_set_downpass_cache(1 << 16, m);
+    mpl_stepwise_addition(ADDSEQ_ASIS, 0, tree, m);
+    mpl_set_downpass_cache(1 << 16, m); // Empties it
+    
+    first = test_downcache_score(tree, m);
+    mpl_get_downpass_cache_counts(&hits, &misses, m);
+    
+    if (hits || misses != DCNTAX - 1) {
+        printf("First pass: %llu hits, %llu misses\n", hits, misses);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    again = test_downcache_score(tree, m);
+    mpl_get_downpass_cache_counts(&hits, &misses, m);
+    
+    if (again != first || hits != DCNTAX - 1 || misses != DCNTAX - 1) {
+        printf("Second pass: %llu hits, %llu misses\n", hits, misses);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_downcache_weight_change(void)
+{
+    theader("Testing the downpass cache after weights change");
+    
+    int failn   = 0;
+    int i       = 0;
+    int bad     = 0;
+    int trees[DCNTREE * (2 * DCNTAX - 1)];
+    int lengths[DCNTREE];
+    
+    Morphy m = test_downcache_setup();
+    
+    test_downcache_trees(trees, m);
+    
+    mpl_set_charac_weight(0, 3.0, m);
+    mpl_excl_charac(7, m);
+    for (i = 0; i < DCNTREE; ++i) {
+        lengths[i] = test_downcache_score(&trees[i * (2 * DCNTAX - 1)], m);
+    }
+    mpl_set_charac_weight(0, 1.0, m);
+    mpl_incl_charac(7, m);
+    
+    mpl_set_downpass_cache(1 << 20, m);
+    
+    for (i = 0; i < DCNTREE; ++i) {
+        test_downcache_score(&trees[i * (2 * DCNTAX - 1)], m);
+    }
+    
+    mpl_set_charac_weight(0, 3.0, m);
+    mpl_excl_charac(7, m);
+    for (i = 0; i < DCNTREE; ++i) {
+        if (test_downcache_score(&trees[i * (2 * DCNTAX - 1)], m)
+            != lengths[i]) {
+            ++bad;
+        }
+    }
+    
+    if (bad) {
+        failn += bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
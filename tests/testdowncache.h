@@ -0,0 +1,15 @@
+//
+//  testdowncache.h
+//  morphylib
+//
+//  Tests of the downpass cache.
+//
+
+#ifndef testdowncache_h
+#define testdowncache_h
+
+int test_downcache_lengths_exact(void);
+int test_downcache_repeated_tree(void);
+int test_downcache_weight_change(void);
+
+#endif /* testdowncache_h */
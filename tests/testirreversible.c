@@ -0,0 +1,139 @@
+//
+//  testirreversible.c
+//  morphylib
+//
+//  Tests of the irreversible character type.
+//
+
+#include "mpltest.h"
+#include "mpl.h"
+#include "morphydefs.h"
+#include "testirreversible.h"
+
+static char* irrevmatrix =
+"0?31\
+ 0131\
+ 1001\
+ 2201\
+ 2?01\
+ 3201;";
+
+int test_small_irreversible(void)
+{
+    theader("A simple test of irreversible (Camin-Sokal) counting");
+    int failn   = 0;
+    int numtaxa = 6;
+    int nchar   = 4;
+    int i       = 0;
+    int length  = 0;
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(numtaxa, nchar, m);
+    mpl_attach_rawdata(irrevmatrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, IRREVERSIBLE_T, m);
+    }
+    mpl_set_num_internal_nodes(numtaxa, m);
+    mpl_apply_tipdata(m);
+    
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    if (length != 10) {
+        printf("Calculated: %i, expected: %i\n", length, 10);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // The same tree under Wagner is shorter, as reversals are permitted
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, WAGNER_T, m);
+    }
+    mpl_apply_tipdata(m);
+    
+    length = test_do_fullpass_on_tree(tree, m);
+    
+    if (length != 8) {
+        printf("Calculated: %i, expected: %i\n", length, 8);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+int test_irreversible_local_reopt(void)
+{
+    theader("Testing local reoptimization of irreversible characters");
+    int failn   = 0;
+    int numtaxa = 6;
+    int nchar   = 4;
+    int i       = 0;
+    int length  = 0;
+    int diff    = 0;
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(numtaxa, nchar, m);
+    mpl_attach_rawdata(irrevmatrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, IRREVERSIBLE_T, m);
+    }
+    mpl_set_num_internal_nodes(numtaxa, m);
+    mpl_apply_tipdata(m);
+    
+    test_do_fullpass_all_steps(tree, m);
+    
+    TLnode* src  = &tree->trnodes[5];
+    TLnode* orig = tl_remove_branch(src, tree);
+    
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    // Reinsertion at the original site restores the original length
+    diff = mpl_get_insertcost(src->index, orig->index, orig->anc->index, false, 100, m);
+    if (length + diff != 10) {
+        printf("Calculated: %i, expected: %i\n", length + diff, 10);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Inserting beside taxon 1 lowers the ancestor of taxon 1 for the third
+    // character, which is the only node that changes.
+    diff = mpl_get_insertcost(src->index, 0, tree->trnodes[0].anc->index, false, 100, m);
+    tl_insert_branch(src, 0, tree);
+    
+    if (test_do_fullpass_all_steps(tree, m) != length + diff || diff != 7) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
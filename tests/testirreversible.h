@@ -0,0 +1,14 @@
+//
+//  testirreversible.h
+//  morphylib
+//
+//  Tests of the irreversible character type.
+//
+
+#ifndef testirreversible_h
+#define testirreversible_h
+
+int test_small_irreversible(void);
+int test_irreversible_local_reopt(void);
+
+#endif /* testirreversible_h */
@@ -273,6 +273,139 @@ int test_resetting_frac_weights(void)
 }
 
 
+int test_weights_without_reapply(void)
+{
+    theader("Testing weight changes after tip data are applied");
+    
+    int failn = 0;
+    int ntax	= 2;
+    int nchar	= 10;
+    int length  = 0;
+    double wt   = 0.0;
+    char *rawmatrix =
+    "0000000010\
+     1111111111;";
+    
+    Morphy m1 = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m1);
+    mpl_attach_rawdata(rawmatrix, m1);
+    mpl_set_num_internal_nodes(1, m1);
+    mpl_apply_tipdata(m1);
+    
+    // An integer weight changes only that character
+    mpl_set_charac_weight(1, 3, m1);
+    length = mpl_first_down_recon(2, 1, 0, m1);
+    if (length != 11) {
+        printf("The length: %i, expected: 11\n", length);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // A fraction doubles the base for all the others
+    mpl_set_charac_weight(1, 0.5, m1);
+    length = mpl_first_down_recon(2, 1, 0, m1);
+    if (length != 17 || mpl_get_charac_weight(&wt, 1, m1) != 1 || wt != 0.5) {
+        printf("The length: %i, expected: 17\n", length);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Removing the last fraction restores the original base
+    mpl_set_charac_weight(1, 1, m1);
+    length = mpl_first_down_recon(2, 1, 0, m1);
+    if (length != 9) {
+        printf("The length: %i, expected: 9\n", length);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m1);
+    
+    return failn;
+}
+
+
+
+int test_repeated_weight_changes(void)
+{
+    theader("Testing many weight changes after tip data are applied");
+    
+    int failn   = 0;
+    int i       = 0;
+    int k       = 0;
+    int ntax    = 2;
+    int nchar   = 3;
+    int length  = 0;
+    int expect  = 0;
+    int denoms[] = {3, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43};
+    double wts[] = {0.5, 1.0 / 3.0, 2.0, 0.25, 1.0};
+    char *rawmatrix =
+    "012\
+     120;";
+    
+    Morphy m1 = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m1);
+    mpl_attach_rawdata(rawmatrix, m1);
+    mpl_set_num_internal_nodes(1, m1);
+    mpl_apply_tipdata(m1);
+    
+    // Each fraction needs a new denominator, none of which is needed once
+    // the weight is changed again
+    for (i = 0; i < (int)(sizeof(denoms) / sizeof(int)); ++i) {
+        mpl_set_charac_weight(0, 1.0 / denoms[i], m1);
+    }
+    mpl_set_charac_weight(0, 0.5, m1);
+    length = mpl_first_down_recon(2, 1, 0, m1);
+    
+    if (length != 5) {
+        printf("The length: %i, expected: 5\n", length);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Thousands of changes give the same length as a new handle would
+    for (k = 0; k < 5000; ++k) {
+        mpl_set_charac_weight(k % nchar, wts[k % 5], m1);
+    }
+    
+    Morphy m2 = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m2);
+    mpl_attach_rawdata(rawmatrix, m2);
+    mpl_set_num_internal_nodes(1, m2);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_charac_weight(i, wts[(5000 - nchar + i) % 5], m2);
+    }
+    mpl_apply_tipdata(m2);
+    
+    length = mpl_first_down_recon(2, 1, 0, m1);
+    expect = mpl_first_down_recon(2, 1, 0, m2);
+    
+    if (length != expect || length <= 0) {
+        printf("The length: %i, expected: %i\n", length, expect);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m1);
+    mpl_delete_Morphy(m2);
+    
+    return failn;
+}
 
 int test_count_gaps_basic(void)
 {
@@ -13,6 +13,8 @@ int test_isreal(void);
 int test_almost_equal(void);
 int test_resetting_weights(void);
 int test_resetting_frac_weights(void);
+int test_weights_without_reapply(void);
+int test_repeated_weight_changes(void);
 int test_count_gaps_basic(void);
 int test_partition_push_index(void);
 int test_data_partitioning_simple(void);
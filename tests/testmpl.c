@@ -6,6 +6,8 @@
 //  Copyright © 2017 brazeaulab. All rights reserved.
 //
 
+#include <string.h>
+#include <pthread.h>
 #include "mpltest.h"
 #include "testmpl.h"
 
@@ -293,9 +295,27 @@ int test_simple_chtype_setting(void)
     /* The code of your test */
     Morphy m = mpl_new_Morphy();
     mpl_init_Morphy(5, 10, m);
+    err = mpl_set_parsim_t(0, USERTYPE_T, m);
+    
+    if (err != ERR_NO_ERROR) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
     err = mpl_set_parsim_t(0, DOLLO_T, m);
+    if (err != ERR_NO_ERROR) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
     
-    if (err != ERR_CASE_NOT_IMPL) {
+    err = mpl_set_parsim_t(1, IRREVERSIBLE_T, m);
+    if (err != ERR_NO_ERROR) {
         ++failn;
         pfail;
     }
@@ -732,5 +752,519 @@ int test_inapplic_prototype_local_reopt_with_unrooted_tree(void)
     }
     
     
+    return failn;
+}
+
+int test_hot_path_stats(void)
+{
+    theader("Testing the hot-path counters");
+    int failn   = 0;
+    int err     = 0;
+    int ntax    = 6;
+    int nchar   = 3;
+    int i       = 0;
+    int nparts  = 0;
+    int length  = 0;
+    unsigned long long steps = 0;
+    MPLstats stats;
+    
+    char* matrix =
+    "00-\
+     01-\
+     1--\
+     1-0\
+     0-1\
+     111;";
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(ntax, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, FITCH_T, m);
+    }
+    mpl_set_num_internal_nodes(ntax, m);
+    mpl_apply_tipdata(m);
+    
+    length = test_do_fullpass_on_tree(tree, m);
+    
+    nparts = mpl_get_num_partitions(m);
+    if (nparts != 2) {
+        printf("Partitions: %i, expected: %i\n", nparts, 2);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_get_stats(nparts, PASS_FIRST_DOWN, &stats, m) != ERR_OUT_OF_BOUNDS ||
+        mpl_get_stats(-1, PASS_MAX, &stats, m) != ERR_OUT_OF_BOUNDS) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    err = mpl_get_stats(-1, PASS_FIRST_DOWN, &stats, m);
+    
+    if (err == ERR_CASE_NOT_IMPL) {
+        
+        // Built without counters: nothing is reported
+        if (stats.calls || stats.chars || stats.steps ||
+            mpl_reset_stats(m) != ERR_CASE_NOT_IMPL) {
+            ++failn;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+        
+        mpl_delete_Morphy(m);
+        tl_delete_TL(tlp);
+        
+        return failn;
+    }
+    
+    // Every partition is visited once at each of the ntax - 1 internal nodes
+    if (err || stats.calls != 2 * (ntax - 1) || stats.chars != nchar * (ntax - 1)) {
+        printf("Calls: %llu, characters: %llu\n", stats.calls, stats.chars);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // The steps counted in the downpasses add up to the length of the tree
+    steps = stats.steps;
+    mpl_get_stats(-1, PASS_SECOND_DOWN, &stats, m);
+    steps += stats.steps;
+    
+    if (steps != (unsigned long long)length) {
+        printf("Counted: %llu, expected: %i\n", steps, length);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Only the partition with inapplicables has a second pass
+    for (i = 0; i < nparts; ++i) {
+        mpl_get_stats(i, PASS_SECOND_UP, &stats, m);
+        if (stats.calls != (stats.isNAtype ? ntax - 1 : 0)) {
+            ++failn;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+    }
+    
+    mpl_reset_stats(m);
+    mpl_get_stats(-1, PASS_FIRST_DOWN, &stats, m);
+    
+    if (stats.calls || stats.chars || stats.steps) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+int test_trace_dump(void)
+{
+    theader("Testing the export of a trace");
+    int failn   = 0;
+    int err     = 0;
+    int ntax    = 6;
+    int nchar   = 3;
+    int i       = 0;
+    long size   = 0;
+    char* json  = NULL;
+    FILE* f     = NULL;
+    const char* fname = "morphytest_trace.json";
+    
+    char* matrix =
+    "00-\
+     01-\
+     1--\
+     1-0\
+     0-1\
+     111;";
+    
+    if (mpl_trace_dump(NULL) != ERR_UNEXP_NULLPTR) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(ntax, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, FITCH_T, m);
+    }
+    mpl_set_num_internal_nodes(ntax, m);
+    
+    mpl_trace_clear();
+    mpl_apply_tipdata(m);
+    test_do_fullpass_on_tree(tree, m);
+    
+    err = mpl_trace_dump(fname);
+    
+    if (err == ERR_CASE_NOT_IMPL) {
+        // Built without tracing
+        if (mpl_trace_clear() != ERR_CASE_NOT_IMPL) {
+            ++failn;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+    }
+    else {
+        
+        f = fopen(fname, "r");
+        if (f) {
+            fseek(f, 0, SEEK_END);
+            size = ftell(f);
+            rewind(f);
+            json = (char*)calloc(size + 1, sizeof(char));
+            size = fread(json, 1, size, f);
+            fclose(f);
+        }
+        
+        // A whole downpass is a single event covering each internal node
+        if (err || !json || !strstr(json, "\"traceEvents\"") ||
+            !strstr(json, "\"mpl_apply_tipdata\"") ||
+            !strstr(json, "\"name\":\"first_down\"") ||
+            !strstr(json, "\"calls\":5")) {
+            ++failn;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+        
+        free(json);
+        remove(fname);
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+/* The number of threads in a dump of the trace, or -1 if there isn't one */
+static int test_trace_nthreads(void)
+{
+    int n       = 0;
+    long size   = 0;
+    char* json  = NULL;
+    char* c     = NULL;
+    FILE* f     = NULL;
+    const char* fname = "morphytest_trace.json";
+    
+    if (mpl_trace_dump(fname) != ERR_NO_ERROR || !(f = fopen(fname, "r"))) {
+        return -1;
+    }
+    
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    json = (char*)calloc(size + 1, sizeof(char));
+    if (json) {
+        size = fread(json, 1, size, f);
+        for (c = strstr(json, "thread_name"); c; c = strstr(c, "thread_name")) {
+            ++n;
+            ++c;
+        }
+    }
+    else {
+        n = -1;
+    }
+    fclose(f);
+    remove(fname);
+    free(json);
+    
+    return n;
+}
+
+/* Applies some tip data on a handle of its own, which records a few events */
+static void* test_trace_thread(void* arg)
+{
+    int i       = 0;
+    int ntax    = 4;
+    int nchar   = 2;
+    char* matrix = "00 01 10 11;";
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, FITCH_T, m);
+    }
+    mpl_set_num_internal_nodes(ntax, m);
+    mpl_apply_tipdata(m);
+    mpl_delete_Morphy(m);
+    
+    return arg;
+}
+
+int test_trace_thread_reuse(void)
+{
+    theader("Testing the reuse of the trace buffers of exited threads");
+    int failn       = 0;
+    int nthreads    = 3;
+    int i           = 0;
+    int j           = 0;
+    int before      = 0;
+    int after       = 0;
+    pthread_t threads[3];
+    
+    if (mpl_trace_clear() == ERR_CASE_NOT_IMPL) {
+        // Built without tracing
+        ppass;
+        return failn;
+    }
+    
+    before = test_trace_nthreads();
+    
+    // Threads that don't overlap with those of earlier rounds
+    for (i = 0; i < 20; ++i) {
+        for (j = 0; j < nthreads; ++j) {
+            pthread_create(&threads[j], NULL, test_trace_thread, NULL);
+        }
+        for (j = 0; j < nthreads; ++j) {
+            pthread_join(threads[j], NULL);
+        }
+    }
+    
+    after = test_trace_nthreads();
+    
+    if (before < 0 || after < 0 || after > before + nthreads) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    return failn;
+}
+
+static Morphy test_new_mixed_Morphy
+(const char* matrix, const int ntax, const int nchar, const int nwagner)
+{
+    int i = 0;
+    Morphy m = mpl_new_Morphy();
+    
+    mpl_init_Morphy(ntax, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, i < nchar - nwagner ? FITCH_T : WAGNER_T, m);
+    }
+    mpl_set_num_internal_nodes(ntax, m);
+    
+    return m;
+}
+
+int test_charac_exclusion(void)
+{
+    theader("Testing inclusion and exclusion of characters");
+    int failn       = 0;
+    int ntax        = 6;
+    int nchar       = 6;
+    int full        = 0;
+    int length      = 0;
+    int expected    = 0;
+    
+    // The last two characters of each are Wagner
+    char* matrix =
+    "0-0-02\
+     0-1-12\
+     1-1-21\
+     10-0-0\
+     1101-1\
+     0011-0;";
+    
+    char* reduced =
+    "0-02\
+     0-12\
+     1-21\
+     10-0\
+     11-1\
+     00-0;";
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(ntax, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy r = test_new_mixed_Morphy(reduced, ntax, 4, 2);
+    mpl_apply_tipdata(r);
+    expected = test_do_fullpass_on_tree(tree, r);
+    mpl_delete_Morphy(r);
+    
+    Morphy m = test_new_mixed_Morphy(matrix, ntax, nchar, 2);
+    mpl_apply_tipdata(m);
+    full = test_do_fullpass_on_tree(tree, m);
+    
+    // Excluding columns 2 and 3 after the data are applied...
+    mpl_excl_charac(2, m);
+    mpl_excl_charac(3, m);
+    length = test_do_fullpass_on_tree(tree, m);
+    if (length != expected || length == full) {
+        printf("Length: %i, expected: %i\n", length, expected);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // ...and including them again
+    mpl_incl_charac(3, m);
+    mpl_incl_charac(2, m);
+    length = test_do_fullpass_on_tree(tree, m);
+    if (length != full) {
+        printf("Length: %i, expected: %i\n", length, full);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Exclusions made before the data are applied are kept
+    mpl_excl_charac(2, m);
+    mpl_excl_charac(3, m);
+    mpl_apply_tipdata(m);
+    length = test_do_fullpass_on_tree(tree, m);
+    if (length != expected) {
+        printf("Length: %i, expected: %i\n", length, expected);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_excl_charac(nchar, m) != ERR_OUT_OF_BOUNDS ||
+        mpl_incl_charac(-1, m) != ERR_OUT_OF_BOUNDS) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+int test_translate_packed_states(void)
+{
+    theader("Testing the decoding of packed state sets");
+    int failn   = 0;
+    int ntax    = 6;
+    int nchar   = 6;
+    int i       = 0;
+    int j       = 0;
+    int k       = 0;
+    int bad     = 0;
+    unsigned int states = 0;
+    unsigned int all    = 0;
+    const char* expected = NULL;
+    char buf[40];
+    
+    char* matrix =
+    "0-0-02\
+     0-1-12\
+     1-1-21\
+     10-0-0\
+     1101-1\
+     0011-0;";
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(ntax, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = test_new_mixed_Morphy(matrix, ntax, nchar, 2);
+    mpl_apply_tipdata(m);
+    test_do_fullpass_on_tree(tree, m);
+    
+    // Every set of every pass reads as it does through mpl_get_stateset,
+    // except that sets with more than the gap and symbols are missing data
+    all = (1u << (strlen(mpl_get_symbols(m)) + 1)) - 1;
+    for (i = 0; i < 2 * ntax - 1; ++i) {
+        for (j = 0; j < nchar; ++j) {
+            for (k = 1; k <= 4; ++k) {
+                states = mpl_get_packed_states(i, j, k, m);
+                expected = states & ~all ? "?" : mpl_get_stateset(i, j, k, m);
+                if (mpl_translate_packed_states(states, buf, sizeof(buf), m)
+                    < 0 || strcmp(buf, expected)) {
+                    printf("Node %i, character %i, pass %i: %s, expected %s\n",
+                           i, j, k, buf, expected);
+                    ++bad;
+                }
+            }
+        }
+    }
+    
+    if (bad) {
+        failn += bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_translate_packed_states(~0u, buf, sizeof(buf), m) != 1 ||
+        strcmp(buf, "?") ||
+        mpl_translate_packed_states(0, buf, sizeof(buf), m) != 0 ||
+        strcmp(buf, "") ||
+        mpl_translate_packed_states(7, buf, sizeof(buf), m) != 3 ||
+        strcmp(buf, "-01") ||
+        mpl_translate_packed_states(7, buf, 3, m) != ERR_OUT_OF_BOUNDS ||
+        mpl_translate_packed_states(7, NULL, 3, m) != ERR_UNEXP_NULLPTR) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
     return failn;
 }
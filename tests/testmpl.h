@@ -21,5 +21,10 @@ int test_inapplic_state_restoration(void);
 int test_inapplic_prototype_local_reopt_with_unrooted_tree(void);
 
 int test_state_retrieval(void);
+int test_hot_path_stats(void);
+int test_trace_dump(void);
+int test_trace_thread_reuse(void);
+int test_charac_exclusion(void);
+int test_translate_packed_states(void);
 
 #endif /* testmpl_h */
@@ -0,0 +1,302 @@
+//
+//  testnewick.c
+//  morphylib
+//
+//  Tests of the Newick reader and Newick scoring.
+//
+
+#include <string.h>
+#include "mpltest.h"
+#include "mpl.h"
+#include "morphydefs.h"
+#include "search.h"
+#include "newick.h"
+#include "testnewick.h"
+
+static const char* nwklabels[] = {"A", "B", "Taxon C", "D"};
+
+static int test_newick_compare(const int* parents, const int* expected,
+                               const int n)
+{
+    int i = 0;
+    
+    for (i = 0; i < n; ++i) {
+        if (parents[i] != expected[i]) {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+int test_newick_read_labels(void)
+{
+    theader("Testing reading Newick trees by label");
+    
+    int failn = 0;
+    int i = 0;
+    int ret = 0;
+    int parents[7];
+    int balanced[] = {4, 4, 5, 5, 6, 6, -1};
+    int unrooted[] = {5, 5, 4, 4, 6, 6, -1};
+    MPLnewick nwk = NULL;
+    
+    // The same tree written in several ways, then a tree written unrooted
+    char* trees =
+    "((A:0.1,B:0.2)90:0.3,(Taxon_C,D)[a comment]);\n"
+    "tree one = [&U] ((A, 'B'), ('Taxon C', D)) ;\n"
+    "((A,B)'internal (label)',(Taxon_C:1e-3,D));"
+    "(A,B,(Taxon_C,D));";
+    
+    nwk = mpl_open_newick_buffer(trees, strlen(trees), 4, nwklabels);
+    
+    for (i = 0; i < 3; ++i) {
+        ret = mpl_read_newick(parents, nwk);
+        if (ret != 1 || test_newick_compare(parents, balanced, 7)) {
+            printf("Tree %i returned %i\n", i, ret);
+            ++failn;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+    }
+    
+    ret = mpl_read_newick(parents, nwk);
+    if (ret != 1 || test_newick_compare(parents, unrooted, 7)) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_read_newick(parents, nwk) != 0) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_close_newick(nwk);
+    
+    // Taxon numbers
+    trees = "((1,2),(3,4));";
+    nwk = mpl_open_newick_buffer(trees, strlen(trees), 4, NULL);
+    ret = mpl_read_newick(parents, nwk);
+    if (ret != 1 || test_newick_compare(parents, balanced, 7)) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    mpl_close_newick(nwk);
+    
+    // Labels must be distinct, counting underscores as blanks
+    const char* same[] = {"A", "B", "Taxon C", "Taxon_C"};
+    if (mpl_open_newick_buffer(trees, strlen(trees), 4, same) != NULL) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    return failn;
+}
+
+int test_newick_errors_skipped(void)
+{
+    theader("Testing that unreadable Newick trees are skipped");
+    
+    int failn = 0;
+    int i = 0;
+    int ret = 0;
+    int parents[7];
+    int balanced[] = {4, 4, 5, 5, 6, 6, -1};
+    int expected[] = {
+        ERR_SYMBOL_MISMATCH, 1, ERR_CASE_NOT_IMPL, ERR_BAD_PARAM,
+        ERR_BAD_PARAM, 1, ERR_MATCHING_PARENTHS, 0
+    };
+    
+    char* trees =
+    "((A,B),(Taxon_C,X));"
+    "((A,B),(Taxon_C,D));"
+    "((A,B,Taxon_C),D);"
+    "((A,B),(Taxon_C,A));"
+    "((A,B),Taxon_C);"
+    "((A,B),(Taxon_C,D));"
+    "((A,B),(Taxon_C,D);";
+    
+    MPLnewick nwk = mpl_open_newick_buffer(trees, strlen(trees), 4, nwklabels);
+    
+    for (i = 0; i < 8; ++i) {
+        ret = mpl_read_newick(parents, nwk);
+        if (ret != expected[i] ||
+            (ret == 1 && test_newick_compare(parents, balanced, 7))) {
+            printf("Tree %i returned %i, not %i\n", i, ret, expected[i]);
+            ++failn;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+    }
+    
+    mpl_close_newick(nwk);
+    
+    return failn;
+}
+
+static void test_write_newick(const int n, const MPLtree* t, FILE* fp)
+{
+    if (n < t->ntax) {
+        fprintf(fp, "taxon_%i:0.%i", n, n);
+        return;
+    }
+    
+    fputc('(', fp);
+    test_write_newick(t->left[n], t, fp);
+    fputc(',', fp);
+    test_write_newick(t->right[n], t, fp);
+    fputc(')', fp);
+}
+
+int test_newick_score_file(void)
+{
+    theader("Testing scoring a file of Newick trees");
+    
+    int failn   = 0;
+    int ntax    = 10;
+    int nchar   = 10;
+    int ntrees  = 3000;
+    int i       = 0;
+    int k       = 0;
+    int x       = 0;
+    int bad     = 0;
+    int nread   = 0;
+    char names[10][16];
+    const char* labels[10];
+    int* lengths = (int*)calloc(ntrees + 1, sizeof(int));
+    int* expect  = (int*)calloc(ntrees, sizeof(int));
+    MPLtree* t = mpl_new_tree(ntax);
+    MPLtreestore* s = mpl_new_treestore(ntax, ntrees);
+    MPLrng rng;
+    FILE* fp = tmpfile();
+    MPLnewick nwk = NULL;
+    
+    char* matrix =
+    "10-0-12100\
+     10-1-10211\
+     0-1-002102\
+     0-1-011021\
+     1111-02012\
+     1011-11201\
+     0-0-101120\
+     0-0-112200\
+     1120-01011\
+     0-01-12110;";
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, FITCH_T, m);
+    }
+    mpl_set_gaphandl(GAP_INAPPLIC, m);
+    mpl_set_num_internal_nodes(ntax, m);
+    mpl_apply_tipdata(m);
+    
+    for (i = 0; i < ntax; ++i) {
+        sprintf(names[i], "taxon %i", i);
+        labels[i] = names[i];
+    }
+    
+    // Trees in a file larger than the reader's buffer, each built by adding
+    // the taxa at random
+    mpl_rng_seed(3, &rng);
+    mpl_treestore_reset(0, s);
+    
+    for (i = 0; i < ntrees; ++i) {
+        
+        for (k = 0; k < 2 * ntax; ++k) {
+            t->left[k] = -1;
+            t->right[k] = -1;
+        }
+        t->root = ntax;
+        t->anc[ntax] = t->lroot;
+        t->left[ntax] = 0;
+        t->right[ntax] = 1;
+        t->anc[0] = ntax;
+        t->anc[1] = ntax;
+        mpl_tree_traverse(t);
+        
+        for (k = 2; k < ntax; ++k) {
+            x = mpl_rng_below(t->ntips + t->ninternal, &rng);
+            t->anc[k] = ntax + k - 1;
+            t->left[ntax + k - 1] = k;
+            t->right[ntax + k - 1] = -1;
+            mpl_tree_graft(k, x < t->ntips ? t->tips[x] :
+                           t->postorder[x - t->ntips], t);
+        }
+        
+        expect[i] = mpl_tree_score(t, (Morphyp)m);
+        mpl_treestore_add(t, s);
+        
+        fprintf(fp, "tree t%i = ", i);
+        test_write_newick(t->root, t, fp);
+        fputs(";\n", fp);
+    }
+    
+    rewind(fp);
+    nwk = mpl_open_newick_file(fp, ntax, labels);
+    nread = mpl_score_newick(lengths, ntrees + 1, nwk, m);
+    
+    for (i = 0; i < nread && i < ntrees; ++i) {
+        if (lengths[i] != expect[i]) {
+            ++bad;
+        }
+    }
+    
+    if (nread != ntrees || bad) {
+        printf("Read %i trees, %i with the wrong length\n", nread, bad);
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_close_newick(nwk);
+    
+    // The trees read are the trees written
+    rewind(fp);
+    nwk = mpl_open_newick_file(fp, ntax, labels);
+    bad = 0;
+    for (i = 0; i < ntrees; ++i) {
+        if (mpl_nwkreader_read(nwk) != 1 ||
+            mpl_treestore_add(((MPLnwkreader*)nwk)->tree, s)) {
+            ++bad;
+        }
+    }
+    
+    if (bad) {
+        failn += bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_close_newick(nwk);
+    fclose(fp);
+    mpl_delete_treestore(s);
+    mpl_delete_tree(t);
+    mpl_delete_Morphy(m);
+    free(lengths);
+    free(expect);
+    
+    return failn;
+}
@@ -0,0 +1,15 @@
+//
+//  testnewick.h
+//  morphylib
+//
+//  Tests of the Newick reader and Newick scoring.
+//
+
+#ifndef testnewick_h
+#define testnewick_h
+
+int test_newick_read_labels(void);
+int test_newick_errors_skipped(void);
+int test_newick_score_file(void);
+
+#endif /* testnewick_h */
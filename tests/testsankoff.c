@@ -0,0 +1,404 @@
+//
+//  testsankoff.c
+//  morphylib
+//
+//  Tests of characters with step matrices.
+//
+
+#include <string.h>
+#include "mpltest.h"
+#include "mpl.h"
+#include "morphydefs.h"
+#include "testsankoff.h"
+
+static char* sankmatrix =
+"0?31\
+ 0131\
+ 1001\
+ 2201\
+ 2?01\
+ 3201;";
+
+static int unordered[] = {
+    0, 1, 1, 1,
+    1, 0, 1, 1,
+    1, 1, 0, 1,
+    1, 1, 1, 0
+};
+
+static int ordered[] = {
+    0, 1, 2, 3,
+    1, 0, 1, 2,
+    2, 1, 0, 1,
+    3, 2, 1, 0
+};
+
+// Changes to a lower state are too costly to ever be used
+static int irreversible[] = {
+       0,    1,    2, 3,
+    1000,    0,    1, 2,
+    1000, 1000,    0, 1,
+    1000, 1000, 1000, 0
+};
+
+static Morphy test_new_sankoff_Morphy
+(const char* matrix, const int ntax, const int nchar, const int nnodes,
+ const int* costs)
+{
+    int i = 0;
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, USERTYPE_T, m);
+        mpl_set_charac_stepmatrix(i, 4, costs, m);
+    }
+    mpl_set_num_internal_nodes(nnodes, m);
+    mpl_apply_tipdata(m);
+    
+    return m;
+}
+
+int test_sankoff_matches_fitch_and_wagner(void)
+{
+    theader("Testing step matrices equivalent to Fitch and Wagner types");
+    int failn   = 0;
+    int numtaxa = 6;
+    int nchar   = 4;
+    int i       = 0;
+    int length  = 0;
+    int expected = 0;
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = test_new_sankoff_Morphy(sankmatrix, numtaxa, nchar, numtaxa, unordered);
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, FITCH_T, m);
+    }
+    mpl_apply_tipdata(m);
+    expected = test_do_fullpass_on_tree(tree, m);
+    
+    if (length != expected || length != 6) {
+        printf("Calculated: %i, expected: %i\n", length, expected);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    m = test_new_sankoff_Morphy(sankmatrix, numtaxa, nchar, numtaxa, ordered);
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    // The root state of the first character is 1 or 2
+    if (strcmp(mpl_get_stateset(tree->start->index, 0, 2, m), "12")) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, WAGNER_T, m);
+    }
+    mpl_apply_tipdata(m);
+    expected = test_do_fullpass_on_tree(tree, m);
+    
+    if (length != expected || length != 8) {
+        printf("Calculated: %i, expected: %i\n", length, expected);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+int test_sankoff_asymmetric(void)
+{
+    theader("Testing an asymmetric step matrix against irreversible counting");
+    int failn   = 0;
+    int numtaxa = 6;
+    int nchar   = 4;
+    int i       = 0;
+    int length  = 0;
+    int expected = 0;
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = test_new_sankoff_Morphy(sankmatrix, numtaxa, nchar, numtaxa, irreversible);
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, IRREVERSIBLE_T, m);
+    }
+    mpl_apply_tipdata(m);
+    expected = test_do_fullpass_all_steps(tree, m);
+    
+    if (length != expected || length != 10) {
+        printf("Calculated: %i, expected: %i\n", length, expected);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+static int test_sankoff_tiprooted_length(Morphy m)
+{
+    int i = 0;
+    int ntax = 12;
+    int length = 0;
+    
+    int tipancs[]= {    21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 12};
+    int ancs[]   = {13, 14, 15, 16, 17, 18, 19, 20, 21, 0};
+    int nodes[]  = {12, 13, 14, 15, 16, 17, 18, 19, 20, 21};
+    int ldescs[] = {10,  9,  8,  7,  6,  5,  4,  3,  2,  1};
+    int rdescs[] = {11, 12, 13, 14, 15, 16, 17, 18, 19, 20};
+    
+    for (i = 0; i < (ntax-2); ++i) {
+        length += mpl_first_down_recon(nodes[i], ldescs[i], rdescs[i], m);
+    }
+    
+    length += mpl_do_tiproot(0, 21, m);
+    
+    for (i = (ntax-3); i >= 0; --i) {
+        length += mpl_first_up_recon(nodes[i], ldescs[i], rdescs[i], ancs[i], m);
+    }
+    
+    for (i = 1; i < ntax; ++i) {
+        length += mpl_update_tip(i, tipancs[i-1], m);
+    }
+    
+    return length;
+}
+
+int test_sankoff_unrooted(void)
+{
+    theader("Testing step matrix characters on a tree rooted on a terminal branch");
+    int failn   = 0;
+    int ntax    = 12;
+    int nchar   = 3;
+    int i       = 0;
+    int length  = 0;
+    int expected = 0;
+    
+    char *rawmatrix =
+    "030\
+     100\
+     121\
+     003\
+     201\
+     021\
+     331\
+     002\
+     321\
+     001\
+     131\
+     101;";
+    
+    Morphy m = test_new_sankoff_Morphy(rawmatrix, ntax, nchar, 13, ordered);
+    
+    length = test_sankoff_tiprooted_length(m);
+    
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, WAGNER_T, m);
+    }
+    mpl_apply_tipdata(m);
+    
+    for (i = 0; i < (ntax-2); ++i) {
+        expected += mpl_first_down_recon(12 + i, 10 - i, 11 + i, m);
+    }
+    
+    // Wagner has no function for the tip root, so root the tree on taxon 1 by
+    // joining it to the top of the tree.
+    expected += mpl_first_down_recon(22, 0, 21, m);
+    
+    if (length != expected) {
+        printf("Calculated: %i, expected: %i\n", length, expected);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_sankoff_local_reopt(void)
+{
+    theader("Testing local reoptimization of step matrix characters");
+    int failn   = 0;
+    int numtaxa = 6;
+    int nchar   = 4;
+    int length  = 0;
+    int diff    = 0;
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = test_new_sankoff_Morphy(sankmatrix, numtaxa, nchar, numtaxa, irreversible);
+    
+    test_do_fullpass_all_steps(tree, m);
+    
+    TLnode* src  = &tree->trnodes[5];
+    TLnode* orig = tl_remove_branch(src, tree);
+    
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    // Reinsertion at the original site restores the original length
+    diff = mpl_get_insertcost(src->index, orig->index, orig->anc->index, false, 10000, m);
+    if (length + diff != 10) {
+        printf("Calculated: %i, expected: %i\n", length + diff, 10);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Insertion costs are exact, so rescoring the tree must agree
+    diff = mpl_get_insertcost(src->index, 0, tree->trnodes[0].anc->index, false, 10000, m);
+    tl_insert_branch(src, 0, tree);
+    
+    if (test_do_fullpass_all_steps(tree, m) != length + diff || diff != 7) {
+        printf("Calculated: %i, expected: %i\n", diff, 7);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+int test_sankoff_bad_stepmatrix(void)
+{
+    theader("Testing step matrix error handling");
+    int failn   = 0;
+    int err     = 0;
+    int costs[] = {0, 1, -1, 0};
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(6, 4, m);
+    mpl_attach_rawdata(sankmatrix, m);
+    
+    if (mpl_set_charac_stepmatrix(0, 2, costs, m) != ERR_BAD_PARAM) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_set_charac_stepmatrix(4, 4, ordered, m) != ERR_OUT_OF_BOUNDS) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // No step matrix for the character
+    mpl_set_parsim_t(1, USERTYPE_T, m);
+    mpl_set_num_internal_nodes(6, m);
+    err = mpl_apply_tipdata(m);
+    if (err != ERR_UNKNOWN_CHTYPE) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Character 1 has a state '2', which is outside a two-state matrix
+    costs[2] = 1;
+    mpl_set_charac_stepmatrix(1, 2, costs, m);
+    err = mpl_apply_tipdata(m);
+    if (err != ERR_OUT_OF_BOUNDS) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_sankoff_exclusion(void)
+{
+    theader("Testing exclusion of step matrix characters");
+    int failn   = 0;
+    int numtaxa = 6;
+    int nchar   = 4;
+    int i       = 0;
+    int length  = 0;
+    int expected = 0;
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = test_new_sankoff_Morphy(sankmatrix, numtaxa, nchar, numtaxa, unordered);
+    mpl_excl_charac(0, m);
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, FITCH_T, m);
+    }
+    mpl_apply_tipdata(m);
+    expected = test_do_fullpass_on_tree(tree, m);
+    
+    if (length != expected || length >= 6) {
+        printf("Calculated: %i, expected: %i\n", length, expected);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
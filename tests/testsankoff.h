@@ -0,0 +1,18 @@
+//
+//  testsankoff.h
+//  morphylib
+//
+//  Tests of characters with step matrices.
+//
+
+#ifndef testsankoff_h
+#define testsankoff_h
+
+int test_sankoff_matches_fitch_and_wagner(void);
+int test_sankoff_asymmetric(void);
+int test_sankoff_unrooted(void);
+int test_sankoff_local_reopt(void);
+int test_sankoff_bad_stepmatrix(void);
+int test_sankoff_exclusion(void);
+
+#endif /* testsankoff_h */
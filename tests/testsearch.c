@@ -0,0 +1,1570 @@
+//
+//  testsearch.c
+//  morphylib
+//
+//  Tests of tree scoring and the tree searches.
+//
+
+#include <string.h>
+#include "mpltest.h"
+#include "mpl.h"
+#include "morphydefs.h"
+#include "search.h"
+#include "testsearch.h"
+
+// (1,(5,(2,(6,(3,(7,(4,8))))))) as a parent vector
+static int caterpillar8[] = {
+    8, 10, 12, 14, 9, 11, 13, 14,
+    -1, 8, 9, 10, 11, 12, 13
+};
+
+static Morphy test_search_setup
+(const int ntax, const int nchar, char* matrix, const MPLchtype chtype)
+{
+    int i = 0;
+    Morphy m = mpl_new_Morphy();
+    
+    mpl_init_Morphy(ntax, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    for (i = 0; i < nchar; ++i) {
+        mpl_set_parsim_t(i, chtype, m);
+    }
+    mpl_set_gaphandl(GAP_INAPPLIC, m);
+    mpl_set_num_internal_nodes(ntax, m);
+    mpl_apply_tipdata(m);
+    
+    return m;
+}
+
+/* Scores a parent vector independently of the search. */
+static int test_search_score(const int* parents, const int ntax, Morphy m)
+{
+    int length = 0;
+    MPLtree* t = mpl_new_tree(ntax);
+    
+    if (mpl_tree_read_parents(parents, t) == ERR_NO_ERROR) {
+        length = mpl_tree_score(t, (Morphyp)m);
+    }
+    else {
+        length = -1;
+    }
+    
+    mpl_delete_tree(t);
+    
+    return length;
+}
+
+int test_spr_finds_compatible_tree(void)
+{
+    theader("Testing that SPR finds the tree for perfectly compatible data");
+    
+    int failn   = 0;
+    int ntax    = 8;
+    int nchar   = 5;
+    int ntrees  = 0;
+    int length  = 0;
+    int trees[4 * 15];
+    
+    char* matrix =
+    "10001\
+     10001\
+     01001\
+     01001\
+     00100\
+     00100\
+     00010\
+     00010;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    length = mpl_spr_search(caterpillar8, 4, trees, &ntrees, m);
+    
+    // One step per character, on the only tree with all five splits
+    if (length != nchar || ntrees != 1) {
+        printf("Length: %i, expected: %i; trees: %i\n", length, nchar, ntrees);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (test_search_score(trees, ntax, m) != nchar) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_spr_bad_start_tree(void)
+{
+    theader("Testing that SPR rejects malformed starting trees");
+    
+    int failn   = 0;
+    int ntax    = 8;
+    int nchar   = 5;
+    int ntrees  = 0;
+    int trees[15];
+    int bad[15];
+    
+    char* matrix =
+    "10001\
+     10001\
+     01001\
+     01001\
+     00100\
+     00100\
+     00010\
+     00010;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    // Two roots
+    memcpy(bad, caterpillar8, sizeof(bad));
+    bad[9] = -1;
+    if (mpl_spr_search(bad, 1, trees, &ntrees, m) != ERR_BAD_PARAM) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // A node with three descendants
+    memcpy(bad, caterpillar8, sizeof(bad));
+    bad[7] = 12;
+    if (mpl_spr_search(bad, 1, trees, &ntrees, m) != ERR_BAD_PARAM) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // A cycle, disconnected from the root
+    memcpy(bad, caterpillar8, sizeof(bad));
+    bad[12] = 8;
+    bad[9] = 11;
+    if (mpl_spr_search(bad, 1, trees, &ntrees, m) != ERR_BAD_PARAM) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_spr_search(caterpillar8, 0, trees, &ntrees, m) != ERR_BAD_PARAM ||
+        mpl_spr_search(NULL, 1, trees, &ntrees, m) != ERR_UNEXP_NULLPTR) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    // Too few taxa for a tree
+    m = mpl_new_Morphy();
+    mpl_init_Morphy(1, 2, m);
+    mpl_attach_rawdata("01;", m);
+    mpl_set_num_internal_nodes(2, m);
+    mpl_apply_tipdata(m);
+    bad[0] = -1;
+    if (mpl_spr_search(bad, 1, trees, &ntrees, m) != ERR_DIMENS_UNDER) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_spr_keeps_equal_trees(void)
+{
+    theader("Testing that SPR keeps distinct trees of equal length");
+    
+    int failn   = 0;
+    int ntax    = 5;
+    int nchar   = 2;
+    int ntrees  = 0;
+    int length  = 0;
+    int i       = 0;
+    int j       = 0;
+    int bad     = 0;
+    int trees[9 * 15];
+    int start[] = {6, 6, 7, 8, 8, -1, 5, 5, 7};
+    
+    // No informative characters: every tree is as long as any other
+    char* matrix =
+    "10\
+     00\
+     01\
+     00\
+     00;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    length = mpl_spr_search(start, 3, trees, &ntrees, m);
+    
+    if (length != 2 || ntrees != 3) {
+        printf("Length: %i, trees: %i\n", length, ntrees);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    for (i = 0; i < ntrees; ++i) {
+        for (j = i + 1; j < ntrees; ++j) {
+            if (!memcmp(&trees[i * 9], &trees[j * 9], 9 * sizeof(int))) {
+                ++bad;
+            }
+        }
+        if (test_search_score(&trees[i * 9], ntax, m) != length) {
+            ++bad;
+        }
+    }
+    
+    if (bad) {
+        failn += bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_spr_inapplic_lengths_exact(void)
+{
+    theader("Testing SPR lengths with inapplicable data");
+    
+    int failn   = 0;
+    int ntax    = 8;
+    int nchar   = 6;
+    int ntrees  = 0;
+    int length  = 0;
+    int i       = 0;
+    int bad     = 0;
+    int trees[10 * 15];
+    
+    char* matrix =
+    "10-0-1\
+     10-1-1\
+     0-1-00\
+     0-1-01\
+     1111-0\
+     1011-1\
+     0-0-10\
+     0-0-11;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    length = mpl_spr_search(caterpillar8, 10, trees, &ntrees, m);
+    
+    if (length <= 0 || length > test_search_score(caterpillar8, ntax, m) ||
+        ntrees < 1) {
+        printf("Length: %i, trees: %i\n", length, ntrees);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Lengths estimated from insertion costs are always checked in full
+    for (i = 0; i < ntrees; ++i) {
+        if (test_search_score(&trees[i * 15], ntax, m) != length) {
+            ++bad;
+        }
+    }
+    
+    if (bad) {
+        failn += bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_tbr_finds_compatible_tree(void)
+{
+    theader("Testing that TBR finds the tree for perfectly compatible data");
+    
+    int failn   = 0;
+    int ntax    = 8;
+    int nchar   = 5;
+    int ntrees  = 0;
+    int length  = 0;
+    int trees[4 * 15];
+    
+    char* matrix =
+    "10001\
+     10001\
+     01001\
+     01001\
+     00100\
+     00100\
+     00010\
+     00010;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    length = mpl_tbr_search(caterpillar8, 4, trees, &ntrees, m);
+    
+    if (length != nchar || ntrees != 1 ||
+        test_search_score(trees, ntax, m) != nchar) {
+        printf("Length: %i, expected: %i; trees: %i\n", length, nchar, ntrees);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_tbr_optimum_is_spr_optimum(void)
+{
+    theader("Testing that SPR cannot improve on a tree found by TBR");
+    
+    int failn   = 0;
+    int ntax    = 10;
+    int nchar   = 12;
+    int ntrees  = 0;
+    int tbrlen  = 0;
+    int sprlen  = 0;
+    int i       = 0;
+    int bad     = 0;
+    int trees[8 * 19];
+    int sprtrees[8 * 19];
+    // (1,(2,(3,(4,(5,(6,(7,(8,(9,10)))))))))
+    int start[] = {
+        10, 11, 12, 13, 14, 15, 16, 17, 18, 18,
+        -1, 10, 11, 12, 13, 14, 15, 16, 17
+    };
+    
+    char* matrix =
+    "001012100201\
+     011110210110\
+     101021021012\
+     110102102120\
+     120110011201\
+     011200120021\
+     102011202110\
+     210120010212\
+     021102101101\
+     112021210020;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    tbrlen = mpl_tbr_search(start, 8, trees, &ntrees, m);
+    
+    for (i = 0; i < ntrees; ++i) {
+        if (test_search_score(&trees[i * 19], ntax, m) != tbrlen) {
+            ++bad;
+        }
+    }
+    
+    sprlen = mpl_spr_search(trees, 8, sprtrees, &ntrees, m);
+    
+    if (tbrlen <= 0 || sprlen != tbrlen || bad) {
+        printf("TBR length: %i, SPR length: %i\n", tbrlen, sprlen);
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_tbr_inapplic_lengths_exact(void)
+{
+    theader("Testing TBR lengths with inapplicable data");
+    
+    int failn   = 0;
+    int ntax    = 8;
+    int nchar   = 6;
+    int ntrees  = 0;
+    int length  = 0;
+    int i       = 0;
+    int bad     = 0;
+    int trees[10 * 15];
+    
+    char* matrix =
+    "10-0-1\
+     10-1-1\
+     0-1-00\
+     0-1-01\
+     1111-0\
+     1011-1\
+     0-0-10\
+     0-0-11;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    length = mpl_tbr_search(caterpillar8, 10, trees, &ntrees, m);
+    
+    for (i = 0; i < ntrees; ++i) {
+        if (test_search_score(&trees[i * 15], ntax, m) != length) {
+            ++bad;
+        }
+    }
+    
+    if (length <= 0 || ntrees < 1 || bad) {
+        printf("Length: %i, trees: %i\n", length, ntrees);
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_search_mixed_lengths_exact(void)
+{
+    theader("Testing search lengths with Wagner and inapplicable data");
+    
+    int failn   = 0;
+    int ntax    = 9;
+    int nchar   = 17;
+    int ntrees  = 0;
+    int length  = 0;
+    int i       = 0;
+    int j       = 0;
+    int bad     = 0;
+    int trees[10 * 17];
+    int start[] = {
+        10, 9, 16, 12, 12, 13, 14, 15, 16,
+        13, 14, 9, 11, 15, 11, -1, 10
+    };
+    // Wagner insertion costs can be too high, and those of inapplicable data
+    // too low without being flagged
+    int wagner[] = {1, 6, 9, 11, 16};
+    
+    char* matrix =
+    "?21012--1000101-0\
+     1230-3?--12--0201\
+     00?0-21021---2310\
+     12111112-011-20-0\
+     110102123-2200-10\
+     0100-20?200311?02\
+     -13-2312011-0101-\
+     1?3-100101101-0-2\
+     0011211011?0?-012;";
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    for (i = 0; i < 5; ++i) {
+        mpl_set_parsim_t(wagner[i], WAGNER_T, m);
+    }
+    mpl_set_charac_weight(4, 2, m);
+    mpl_set_charac_weight(13, 3, m);
+    mpl_set_gaphandl(GAP_INAPPLIC, m);
+    mpl_set_num_internal_nodes(ntax, m);
+    mpl_apply_tipdata(m);
+    
+    for (j = 0; j < 2; ++j) {
+    
+        if (j == 0) {
+            length = mpl_spr_search(start, 10, trees, &ntrees, m);
+        }
+        else {
+            length = mpl_tbr_search(start, 10, trees, &ntrees, m);
+        }
+    
+        bad = 0;
+        for (i = 0; i < ntrees; ++i) {
+            if (test_search_score(&trees[i * 17], ntax, m) != length) {
+                ++bad;
+            }
+        }
+    
+        if (length <= 0 || ntrees < 1 || bad) {
+            printf("Length: %i, trees: %i\n", length, ntrees);
+            failn += 1 + bad;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_stepwise_addition_orders(void)
+{
+    theader("Testing stepwise addition in each order");
+    
+    int failn   = 0;
+    int ntax    = 8;
+    int nchar   = 5;
+    int length  = 0;
+    int i       = 0;
+    int tree[15];
+    int again[15];
+    
+    char* matrix =
+    "10001\
+     10001\
+     01001\
+     01001\
+     00100\
+     00100\
+     00010\
+     00010;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    // Perfectly compatible data leave only one place for each taxon
+    for (i = 0; i < ADDSEQ_MAX; ++i) {
+        length = mpl_stepwise_addition(i, 17, tree, m);
+        if (length != nchar || test_search_score(tree, ntax, m) != nchar) {
+            printf("Order %i: length %i, expected: %i\n", i, length, nchar);
+            ++failn;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+    }
+    
+    // The same seed gives the same tree
+    mpl_stepwise_addition(ADDSEQ_RANDOM, 5, tree, m);
+    mpl_stepwise_addition(ADDSEQ_RANDOM, 5, again, m);
+    if (memcmp(tree, again, sizeof(tree))) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_stepwise_addition(ADDSEQ_MAX, 0, tree, m) != ERR_BAD_PARAM ||
+        mpl_stepwise_addition(ADDSEQ_ASIS, 0, NULL, m) != ERR_UNEXP_NULLPTR) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_stepwise_addition_inapplic(void)
+{
+    theader("Testing stepwise addition with inapplicable data");
+    
+    int failn   = 0;
+    int ntax    = 8;
+    int nchar   = 6;
+    int length  = 0;
+    int i       = 0;
+    int tree[15];
+    
+    char* matrix =
+    "10-0-1\
+     10-1-1\
+     0-1-00\
+     0-1-01\
+     1111-0\
+     1011-1\
+     0-0-10\
+     0-0-11;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    for (i = 0; i < 4; ++i) {
+        length = mpl_stepwise_addition(ADDSEQ_RANDOM, i, tree, m);
+        if (length <= 0 || test_search_score(tree, ntax, m) != length) {
+            printf("Seed %i: length %i\n", i, length);
+            ++failn;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_ratchet_search(void)
+{
+    theader("Testing the parsimony ratchet");
+    
+    int failn   = 0;
+    int ntax    = 10;
+    int nchar   = 12;
+    int ntrees  = 0;
+    int tbrlen  = 0;
+    int length  = 0;
+    int again   = 0;
+    int i       = 0;
+    int bad     = 0;
+    int trees[8 * 19];
+    int others[8 * 19];
+    int start[] = {
+        10, 11, 12, 13, 14, 15, 16, 17, 18, 18,
+        -1, 10, 11, 12, 13, 14, 15, 16, 17
+    };
+    
+    char* matrix =
+    "001012100201\
+     011110210110\
+     101021021012\
+     110102102120\
+     120110011201\
+     011200120021\
+     102011202110\
+     210120010212\
+     021102101101\
+     112021210020;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    tbrlen = mpl_tbr_search(start, 8, trees, &ntrees, m);
+    length = mpl_ratchet_search(start, 10, 0.25, 3, 8, trees, &ntrees, m);
+    
+    // The weights must be back to their original values for these to match
+    for (i = 0; i < ntrees; ++i) {
+        if (test_search_score(&trees[i * 19], ntax, m) != length) {
+            ++bad;
+        }
+    }
+    
+    if (length <= 0 || length > tbrlen || !ntrees || bad) {
+        printf("Ratchet length: %i, TBR length: %i\n", length, tbrlen);
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    again = mpl_ratchet_search(start, 10, 0.25, 3, 8, others, &i, m);
+    if (again != length || i != ntrees ||
+        memcmp(trees, others, ntrees * 19 * sizeof(int))) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_ratchet_search(start, 10, 0.0, 3, 8, trees, &ntrees, m)
+        != ERR_BAD_PARAM ||
+        mpl_ratchet_search(start, -1, 0.25, 3, 8, trees, &ntrees, m)
+        != ERR_BAD_PARAM) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_replicate_search(void)
+{
+    theader("Testing search replicates on several threads");
+    
+    int failn   = 0;
+    int ntax    = 10;
+    int nchar   = 10;
+    int ntrees  = 0;
+    int nsingle = 0;
+    int length  = 0;
+    int single  = 0;
+    int first   = 0;
+    int i       = 0;
+    int bad     = 0;
+    int start[19];
+    int trees[16 * 19];
+    int others[16 * 19];
+    
+    char* matrix =
+    "10-0-12100\
+     10-1-10211\
+     0-1-002102\
+     0-1-011021\
+     1111-02012\
+     1011-11201\
+     0-0-101120\
+     0-0-112200\
+     1120-01011\
+     0-01-12110;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    // The first replicate starts from the same tree as a single search
+    mpl_stepwise_addition(ADDSEQ_RANDOM, 5, start, m);
+    first = mpl_tbr_search(start, 16, trees, &ntrees, m);
+    
+    length = mpl_replicate_search(12, 4, true, 5, 16, trees, &ntrees, m);
+    
+    for (i = 0; i < ntrees; ++i) {
+        if (test_search_score(&trees[i * 19], ntax, m) != length) {
+            ++bad;
+        }
+    }
+    
+    if (length <= 0 || length > first || !ntrees || bad) {
+        printf("Replicates: %i, single search: %i\n", length, first);
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Which climbs collect trees depends on the order in which the threads
+    // finish, so the two searches need not give the same trees.
+    single = mpl_replicate_search(12, 1, true, 5, 16, others, &nsingle, m);
+    bad = 0;
+    for (i = 0; i < nsingle; ++i) {
+        if (test_search_score(&others[i * 19], ntax, m) != single) {
+            ++bad;
+        }
+    }
+    if (single <= 0 || single > first || !nsingle || bad) {
+        printf("One thread: %i, four threads: %i\n", single, length);
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    length = mpl_replicate_search(6, 3, false, 9, 16, trees, &ntrees, m);
+    bad = 0;
+    for (i = 0; i < ntrees; ++i) {
+        if (test_search_score(&trees[i * 19], ntax, m) != length) {
+            ++bad;
+        }
+    }
+    if (length <= 0 || !ntrees || bad) {
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_replicate_search(0, 2, true, 5, 16, trees, &ntrees, m)
+        != ERR_BAD_PARAM ||
+        mpl_replicate_search(4, 0, true, 5, 16, trees, &ntrees, m)
+        != ERR_BAD_PARAM) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+
+/* Scores every tree that can be made by adding the taxa from k on to t,
+ * keeping the shortest length and how many trees have it. If rooted is false,
+ * the root and the branch to its right are skipped so that each unrooted
+ * tree is scored once. */
+static void test_all_trees
+(const int k, const bool rooted, int* best, int* nbest, MPLtree* t, Morphy m)
+{
+    int i = 0;
+    int n = 0;
+    int len = 0;
+    int ntax = t->ntax;
+    int nnodes = t->ntips + t->ninternal;
+    int nodes[32];
+    
+    if (k == ntax) {
+        len = mpl_tree_score(t, (Morphyp)m);
+        if (len < *best) {
+            *best = len;
+            *nbest = 0;
+        }
+        if (len == *best) {
+            ++*nbest;
+        }
+        return;
+    }
+    
+    for (i = 0; i < nnodes; ++i) {
+        nodes[i] = i < t->ntips ? t->tips[i] : t->postorder[i - t->ntips];
+    }
+    
+    for (i = 0; i < nnodes; ++i) {
+        
+        n = nodes[i];
+        
+        if (!rooted && (n == t->root || n == t->right[t->root])) {
+            continue;
+        }
+        
+        t->anc[k] = ntax + k - 1;
+        t->left[ntax + k - 1] = k;
+        t->right[ntax + k - 1] = -1;
+        
+        mpl_tree_graft(k, n, t);
+        test_all_trees(k + 1, rooted, best, nbest, t, m);
+        mpl_tree_prune(k, t);
+    }
+}
+
+static void test_exhaustive_search
+(const bool rooted, int* best, int* nbest, const int ntax, Morphy m)
+{
+    MPLtree* t = mpl_new_tree(ntax);
+    int i = 0;
+    
+    // ((2,0),1) with the root fixed above 1
+    t->root = ntax;
+    t->anc[ntax] = t->lroot;
+    t->left[ntax] = ntax + 1;
+    t->right[ntax] = 1;
+    t->anc[1] = ntax;
+    t->anc[ntax + 1] = ntax;
+    t->left[ntax + 1] = 2;
+    t->right[ntax + 1] = 0;
+    t->anc[0] = ntax + 1;
+    t->anc[2] = ntax + 1;
+    for (i = ntax + 2; i < 2 * ntax; ++i) {
+        t->left[i] = -1;
+        t->right[i] = -1;
+    }
+    mpl_tree_traverse(t);
+    
+    *best = 1 << 30;
+    *nbest = 0;
+    
+    test_all_trees(3, rooted, best, nbest, t, m);
+    
+    mpl_delete_tree(t);
+}
+
+int test_branch_and_bound_exhaustive(void)
+{
+    theader("Testing branch and bound against scoring every tree");
+    
+    int failn   = 0;
+    int ntax    = 8;
+    int nchar   = 9;
+    int ntrees  = 0;
+    int length  = 0;
+    int best    = 0;
+    int nbest   = 0;
+    int rbest   = 0;
+    int rnbest  = 0;
+    int bad     = 0;
+    int i       = 0;
+    int j       = 0;
+    int trees[200 * 15];
+    MPLchtype types[] = {FITCH_T, WAGNER_T, DOLLO_T};
+    
+    char* matrix =
+    "10-0-1210\
+     10-1-1021\
+     0-1-00210\
+     0-1-01102\
+     1111-0201\
+     1011-1120\
+     0-0-10112\
+     0-0-11220;";
+    
+    char* nogaps =
+    "102012101\
+     101110211\
+     012100210\
+     012101102\
+     111120201\
+     101111120\
+     000010112\
+     001011220;";
+    
+    for (j = 0; j < 4; ++j) {
+        
+        Morphy m = mpl_new_Morphy();
+        
+        mpl_init_Morphy(ntax, nchar, m);
+        mpl_attach_rawdata(j < 2 ? matrix : nogaps, m);
+        for (i = 0; i < nchar; ++i) {
+            // The last set mixes bounded and unbounded types
+            mpl_set_parsim_t(i, j == 3 ? types[i % 3] :
+                             (j == 1 ? WAGNER_T : FITCH_T), m);
+        }
+        if (j == 3) {
+            mpl_set_charac_weight(4, 3.0, m);
+        }
+        mpl_set_gaphandl(j == 1 ? GAP_NEWSTATE : GAP_INAPPLIC, m);
+        mpl_set_num_internal_nodes(ntax, m);
+        mpl_apply_tipdata(m);
+        
+        test_exhaustive_search(false, &best, &nbest, ntax, m);
+        test_exhaustive_search(true, &rbest, &rnbest, ntax, m);
+        
+        length = mpl_branch_and_bound(1, 200, trees, &ntrees, m);
+        
+        bad = 0;
+        for (i = 0; i < ntrees; ++i) {
+            if (test_search_score(&trees[i * 15], ntax, m) != length) {
+                ++bad;
+            }
+        }
+        
+        if (length != best || ntrees != nbest || rbest != best || bad) {
+            printf("Set %i: branch and bound %i (%i trees), all trees %i "
+                   "(%i trees), all rooted trees %i\n", j, length, ntrees,
+                   best, nbest, rbest);
+            failn += 1 + bad;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+        
+        mpl_delete_Morphy(m);
+    }
+    
+    return failn;
+}
+
+int test_branch_and_bound_threads(void)
+{
+    theader("Testing branch and bound on several threads");
+    
+    int failn   = 0;
+    int ntax    = 10;
+    int nchar   = 10;
+    int ntrees  = 0;
+    int nsingle = 0;
+    int length  = 0;
+    int single  = 0;
+    int heur    = 0;
+    int i       = 0;
+    int bad     = 0;
+    int trees[64 * 19];
+    
+    char* matrix =
+    "10-0-12100\
+     10-1-10211\
+     0-1-002102\
+     0-1-011021\
+     1111-02012\
+     1011-11201\
+     0-0-101120\
+     0-0-112200\
+     1120-01011\
+     0-01-12110;";
+    
+    Morphy m = test_search_setup(ntax, nchar, matrix, FITCH_T);
+    
+    heur = mpl_replicate_search(8, 1, true, 3, 64, trees, &ntrees, m);
+    single = mpl_branch_and_bound(1, 64, trees, &nsingle, m);
+    length = mpl_branch_and_bound(4, 64, trees, &ntrees, m);
+    
+    for (i = 0; i < ntrees; ++i) {
+        if (test_search_score(&trees[i * 19], ntax, m) != length) {
+            ++bad;
+        }
+    }
+    
+    // With room for all the shortest trees, both searches find all of them
+    if (length <= 0 || length > heur || length != single || ntrees != nsingle
+        || ntrees == 64 || bad) {
+        printf("Four threads: %i (%i trees), one thread: %i (%i trees), "
+               "replicates: %i\n", length, ntrees, single, nsingle, heur);
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_branch_and_bound(0, 16, trees, &ntrees, m) != ERR_BAD_PARAM ||
+        mpl_branch_and_bound(2, 0, trees, &ntrees, m) != ERR_BAD_PARAM) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+/* A random tree on all the taxa, built by adding each taxon to a random
+ * branch. */
+static void test_random_tree(MPLtree* t, MPLrng* rng)
+{
+    int i = 0;
+    int k = 0;
+    int ntax = t->ntax;
+    
+    for (i = 0; i < 2 * ntax; ++i) {
+        t->left[i] = -1;
+        t->right[i] = -1;
+    }
+    
+    t->root = ntax;
+    t->anc[ntax] = t->lroot;
+    t->left[ntax] = 0;
+    t->right[ntax] = 1;
+    t->anc[0] = ntax;
+    t->anc[1] = ntax;
+    mpl_tree_traverse(t);
+    
+    for (k = 2; k < ntax; ++k) {
+        i = mpl_rng_below(t->ntips + t->ninternal, rng);
+        t->anc[k] = ntax + k - 1;
+        t->left[ntax + k - 1] = k;
+        t->right[ntax + k - 1] = -1;
+        mpl_tree_graft(k, i < t->ntips ? t->tips[i] :
+                       t->postorder[i - t->ntips], t);
+    }
+}
+
+int test_treestore_many_trees(void)
+{
+    theader("Testing the tree store with many trees");
+    
+    int failn   = 0;
+    int ntax    = 16;
+    int ntrees  = 20000;
+    int size    = 2 * ntax - 1;
+    int i       = 0;
+    int l       = 0;
+    int r       = 0;
+    int ll      = 0;
+    int nadded  = 0;
+    int* parents = (int*)malloc(size * sizeof(int));
+    MPLtree* t  = mpl_new_tree(ntax);
+    MPLtreestore* s = mpl_new_treestore(ntax, 100000);
+    MPLrng rng;
+    
+    mpl_rng_seed(11, &rng);
+    mpl_treestore_reset(100, s);
+    
+    for (i = 0; i < ntrees; ++i) {
+        test_random_tree(t, &rng);
+        nadded += mpl_treestore_add(t, s);
+    }
+    
+    // Random trees on this many taxa are all but certainly different
+    if (nadded != ntrees || s->ntrees != ntrees) {
+        printf("Added %i of %i trees\n", nadded, ntrees);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Each tree again, and rerooted on the other side of its root's left
+    // child, is already there
+    nadded = 0;
+    for (i = 0; i < ntrees; ++i) {
+        
+        memcpy(parents, &s->trees[i * size], size * sizeof(int));
+        mpl_tree_read_parents(parents, t);
+        nadded += mpl_treestore_add(t, s);
+        
+        l = t->left[t->root];
+        r = t->right[t->root];
+        if (l < ntax) {
+            l = r;
+            r = t->left[t->root];
+        }
+        ll = t->left[l];
+        parents[ll] = t->root;
+        parents[r]  = l;
+        if (mpl_tree_read_parents(parents, t) != ERR_NO_ERROR) {
+            ++nadded;
+            continue;
+        }
+        nadded += mpl_treestore_add(t, s);
+    }
+    
+    if (nadded || s->ntrees != ntrees) {
+        printf("%i trees were added again\n", nadded);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_treestore(s);
+    s = mpl_new_treestore(ntax, 100);
+    mpl_treestore_reset(100, s);
+    
+    for (i = 0; i < 500; ++i) {
+        test_random_tree(t, &rng);
+        mpl_treestore_add(t, s);
+    }
+    
+    if (s->ntrees != 100 || !mpl_treestore_full(s)) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_treestore(s);
+    mpl_delete_tree(t);
+    free(parents);
+    
+    return failn;
+}
+
+// Columns 0-5 are Fitch with inapplicable data, 6-7 Wagner, 8 Dollo, 9
+// irreversible and 10-11 have a step matrix.
+static char* batchmatrix =
+"10-0-1210121\
+ 10-1-1021002\
+ 0-1-00210210\
+ 0-1-01101101\
+ 1111-0201012\
+ 1011-1121020\
+ 0-0-10110111\
+ 0-0-11220002\
+ 1120-0101120\
+ 0-01-1211010;";
+
+static int batchcosts[] = {
+    0, 1, 3,
+    2, 0, 1,
+    1, 2, 0
+};
+
+static Morphy test_batch_setup(void)
+{
+    int i = 0;
+    Morphy m = mpl_new_Morphy();
+    
+    mpl_init_Morphy(10, 12, m);
+    mpl_attach_rawdata(batchmatrix, m);
+    for (i = 0; i < 6; ++i) {
+        mpl_set_parsim_t(i, FITCH_T, m);
+    }
+    mpl_set_parsim_t(6, WAGNER_T, m);
+    mpl_set_parsim_t(7, WAGNER_T, m);
+    mpl_set_parsim_t(8, DOLLO_T, m);
+    mpl_set_parsim_t(9, IRREVERSIBLE_T, m);
+    mpl_set_parsim_t(10, USERTYPE_T, m);
+    mpl_set_charac_stepmatrix(10, 3, batchcosts, m);
+    mpl_set_parsim_t(11, USERTYPE_T, m);
+    mpl_set_charac_stepmatrix(11, 3, batchcosts, m);
+    mpl_set_gaphandl(GAP_INAPPLIC, m);
+    mpl_set_num_internal_nodes(10, m);
+    mpl_apply_tipdata(m);
+    
+    return m;
+}
+
+int test_score_trees_batch(void)
+{
+    theader("Testing the scoring of a batch of trees");
+    
+    int failn   = 0;
+    int ntax    = 10;
+    int nchar   = 12;
+    int ntrees  = 200;
+    int size    = 2 * ntax - 1;
+    int i       = 0;
+    int k       = 0;
+    int bad     = 0;
+    int* trees      = (int*)malloc(ntrees * size * sizeof(int));
+    int* lengths    = (int*)malloc(ntrees * sizeof(int));
+    int* single     = (int*)malloc(ntrees * sizeof(int));
+    int* steps      = (int*)malloc(ntrees * nchar * sizeof(int));
+    int* expected   = (int*)malloc(ntrees * nchar * sizeof(int));
+    MPLtree* t = mpl_new_tree(ntax);
+    MPLrng rng;
+    
+    Morphy m    = test_batch_setup();
+    Morphy ref  = test_batch_setup();
+    
+    mpl_set_charac_weight(2, 2.0, m);
+    mpl_excl_charac(4, m);
+    mpl_excl_charac(11, m);
+    
+    mpl_rng_seed(11, &rng);
+    for (i = 0; i < ntrees; ++i) {
+        test_random_tree(t, &rng);
+        mpl_tree_write_parents(t, &trees[i * size]);
+    }
+    
+    // The steps of each character, found by excluding all the others
+    for (k = 0; k < nchar; ++k) {
+        mpl_excl_charac(k, ref);
+    }
+    for (k = 0; k < nchar; ++k) {
+        mpl_incl_charac(k, ref);
+        for (i = 0; i < ntrees; ++i) {
+            expected[i * nchar + k] = test_search_score(&trees[i * size],
+                                                        ntax, ref);
+        }
+        mpl_excl_charac(k, ref);
+    }
+    
+    // A tree that isn't binary
+    trees[(ntrees - 1) * size + 1] = trees[(ntrees - 1) * size];
+    
+    if (mpl_score_trees(ntrees, trees, 3, lengths, steps, m) != ERR_NO_ERROR
+        || mpl_score_trees(ntrees, trees, 1, single, NULL, m) != ERR_NO_ERROR) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    for (i = 0; i < ntrees - 1; ++i) {
+        if (lengths[i] != test_search_score(&trees[i * size], ntax, m) ||
+            single[i] != lengths[i]) {
+            ++bad;
+        }
+        for (k = 0; k < nchar; ++k) {
+            if (steps[i * nchar + k] != expected[i * nchar + k]) {
+                ++bad;
+            }
+        }
+    }
+    
+    if (bad || lengths[ntrees - 1] != ERR_BAD_PARAM ||
+        single[ntrees - 1] != ERR_BAD_PARAM) {
+        printf("%i wrong lengths or steps\n", bad);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    if (mpl_score_trees(ntrees, trees, 0, lengths, NULL, m) != ERR_BAD_PARAM ||
+        mpl_score_trees(0, trees, 2, lengths, NULL, m) != ERR_NO_ERROR) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_tree(t);
+    mpl_delete_Morphy(m);
+    mpl_delete_Morphy(ref);
+    free(trees);
+    free(lengths);
+    free(single);
+    free(steps);
+    free(expected);
+    
+    return failn;
+}
+
+int test_score_tree_sets(void)
+{
+    theader("Testing the nodal sets of a tree scored through the handle");
+    
+    int failn   = 0;
+    int ntax    = 10;
+    int nchar   = 12;
+    int size    = 2 * ntax - 1;
+    int i       = 0;
+    int j       = 0;
+    int k       = 0;
+    int bad     = 0;
+    int length  = 0;
+    int tree[19];
+    const unsigned long* sets = NULL;
+    MPLtree* t = mpl_new_tree(ntax);
+    MPLrng rng;
+    
+    Morphy m = test_batch_setup();
+    
+    mpl_rng_seed(5, &rng);
+    test_random_tree(t, &rng);
+    mpl_tree_write_parents(t, tree);
+    
+    length = mpl_score_tree(tree, m);
+    if (length <= 0 || length != test_search_score(tree, ntax, m)) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    for (k = 1; k <= 4; ++k) {
+        for (i = 0; i < size; ++i) {
+            if (!(sets = mpl_get_nodal_sets(i, k, m))) {
+                ++bad;
+                continue;
+            }
+            for (j = 0; j < nchar; ++j) {
+                if ((unsigned int)sets[j] != mpl_get_packed_states(i, j, k, m)) {
+                    ++bad;
+                }
+            }
+        }
+    }
+    
+    if (bad || mpl_get_nodal_sets(0, 5, m) || mpl_get_nodal_sets(-1, 1, m) ||
+        mpl_get_nodal_sets(2 * ntax, 1, m)) {
+        failn += 1 + bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    tree[0] = tree[1];
+    tree[2] = tree[1];
+    if (mpl_score_tree(tree, m) != ERR_BAD_PARAM) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_tree(t);
+    mpl_delete_Morphy(m);
+    
+    return failn;
+}
+
+int test_tree_length_passes(void)
+{
+    theader("Testing the lengths of trees scored with only the passes needed");
+    
+    int failn   = 0;
+    int ntax    = 10;
+    int ntrees  = 200;
+    int i       = 0;
+    int k       = 0;
+    int bad     = 0;
+    MPLgap_t gaps[] = {GAP_INAPPLIC, GAP_MISSING, GAP_NEWSTATE};
+    MPLtree* t = mpl_new_tree(ntax);
+    Morphyp handl = NULL;
+    MPLrng rng;
+    
+    mpl_rng_seed(17, &rng);
+    
+    for (k = 0; k < 3; ++k) {
+        
+        Morphy m = test_batch_setup();
+        handl = (Morphyp)m;
+        mpl_set_gaphandl(gaps[k], m);
+        mpl_set_charac_weight(7, 3.0, m);
+        mpl_excl_charac(1, m);
+        mpl_apply_tipdata(m);
+        
+        for (i = 0; i < ntrees; ++i) {
+            test_random_tree(t, &rng);
+            if (mpl_tree_length(t, handl) != mpl_tree_score(t, handl)) {
+                ++bad;
+            }
+        }
+        
+        // The Fitch characters with inapplicable data and the Dollo character
+        if (handl->numupparts != (k ? 1 : 2)) {
+            ++bad;
+        }
+        
+        mpl_delete_Morphy(m);
+    }
+    
+    if (bad) {
+        printf("%i wrong lengths\n", bad);
+        failn += bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_tree(t);
+    
+    return failn;
+}
+
+/* Roots a parent vector on the branch above node n, which must not be the
+ * root or one of its children. */
+static void test_reroot_parents(const int* parents, const int n, int* rerooted,
+                                const int ntax)
+{
+    int i       = 0;
+    int x       = 0;
+    int up      = 0;
+    int next    = 0;
+    int root    = 0;
+    int size    = 2 * ntax - 1;
+    
+    for (i = 0; i < size; ++i) {
+        rerooted[i] = parents[i];
+        if (parents[i] < 0) {
+            root = i;
+        }
+    }
+    
+    up = root;
+    x = parents[n];
+    rerooted[n] = root;
+    
+    while (1) {
+        next = parents[x];
+        rerooted[x] = up;
+        if (next == root) {
+            break;
+        }
+        up = x;
+        x = next;
+    }
+    
+    // The sibling of x below the old root now hangs from x
+    for (i = 0; i < size; ++i) {
+        if (i != x && parents[i] == root) {
+            rerooted[i] = x;
+        }
+    }
+}
+
+int test_score_rootings(void)
+{
+    theader("Testing the lengths of a tree rooted on each of its branches");
+    
+    int failn   = 0;
+    int ntax    = 10;
+    int nchar   = 12;
+    int size    = 2 * ntax - 1;
+    int i       = 0;
+    int j       = 0;
+    int k       = 0;
+    int bad     = 0;
+    int root    = 0;
+    int length  = 0;
+    int tree[19];
+    int rerooted[19];
+    int lengths[19];
+    int steps[12];
+    int* charsteps = (int*)malloc(size * nchar * sizeof(int));
+    MPLtree* t = mpl_new_tree(ntax);
+    MPLrng rng;
+    
+    mpl_rng_seed(23, &rng);
+    
+    for (k = 0; k < 2; ++k) {
+        
+        Morphy m = test_batch_setup();
+        
+        // The second time, only characters whose length can't depend on the
+        // rooting are left
+        if (k) {
+            mpl_set_gaphandl(GAP_MISSING, m);
+            mpl_set_parsim_t(8, FITCH_T, m);
+            mpl_set_parsim_t(9, WAGNER_T, m);
+            mpl_set_parsim_t(10, FITCH_T, m);
+            mpl_set_parsim_t(11, FITCH_T, m);
+        }
+        mpl_set_charac_weight(3, 2.0, m);
+        mpl_excl_charac(5, m);
+        mpl_apply_tipdata(m);
+        
+        for (j = 0; j < 10; ++j) {
+            
+            test_random_tree(t, &rng);
+            mpl_tree_write_parents(t, tree);
+            root = t->root;
+            
+            if (mpl_score_rootings(tree, lengths, charsteps, m)
+                != ERR_NO_ERROR) {
+                ++bad;
+                continue;
+            }
+            
+            for (i = 0; i < size; ++i) {
+                
+                if (i == root || tree[i] == root) {
+                    memcpy(rerooted, tree, sizeof(tree));
+                }
+                else {
+                    test_reroot_parents(tree, i, rerooted, ntax);
+                }
+                
+                if (mpl_score_trees(1, rerooted, 1, &length, steps, m)
+                    != ERR_NO_ERROR || length != lengths[i] ||
+                    memcmp(steps, &charsteps[i * nchar], sizeof(steps))) {
+                    ++bad;
+                }
+            }
+        }
+        
+        mpl_delete_Morphy(m);
+    }
+    
+    if (bad) {
+        printf("%i wrong rootings\n", bad);
+        failn += bad;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    free(charsteps);
+    mpl_delete_tree(t);
+    
+    return failn;
+}
@@ -0,0 +1,31 @@
+//
+//  testsearch.h
+//  morphylib
+//
+//  Tests of tree scoring and the tree searches.
+//
+
+#ifndef testsearch_h
+#define testsearch_h
+
+int test_spr_finds_compatible_tree(void);
+int test_spr_bad_start_tree(void);
+int test_spr_keeps_equal_trees(void);
+int test_spr_inapplic_lengths_exact(void);
+int test_tbr_finds_compatible_tree(void);
+int test_tbr_optimum_is_spr_optimum(void);
+int test_tbr_inapplic_lengths_exact(void);
+int test_search_mixed_lengths_exact(void);
+int test_stepwise_addition_orders(void);
+int test_stepwise_addition_inapplic(void);
+int test_ratchet_search(void);
+int test_replicate_search(void);
+int test_branch_and_bound_exhaustive(void);
+int test_branch_and_bound_threads(void);
+int test_treestore_many_trees(void);
+int test_score_trees_batch(void);
+int test_score_tree_sets(void);
+int test_tree_length_passes(void);
+int test_score_rootings(void);
+
+#endif /* testsearch_h */
@@ -70,6 +70,46 @@ int test_do_fullpass_on_tree(TLtree* t, Morphy m)
 }
 
 
+/* As test_do_fullpass_on_tree, but also collects any steps returned by the
+ * first uppass and tip updates (e.g. for Dollo characters). */
+int test_do_fullpass_all_steps(TLtree* t, Morphy m)
+{
+    int length = 0;
+    
+    int i = 0;
+    int end = 0;
+    
+    int index = 0;
+    int postorder[2 * t->ntaxa];
+    tl_traverse_tree(t->start, &index, postorder);
+    end = index-1;
+    
+    for (i = 0; i <= end; ++i)
+    {
+        TLnode* n = &t->trnodes[postorder[i]];
+        
+        if (!n->tip) {
+            length += mpl_first_down_recon(n->index, I_LDESC(n->index, t), I_RDESC(n->index, t), m);
+        }
+    }
+    
+    // The root is the last node in the postorder
+    mpl_update_lower_root(I_ANCESTOR(postorder[end], t), postorder[end], m);
+    
+    for (i = end; i >= 0; --i) {
+        TLnode* n = &t->trnodes[postorder[i]];
+        
+        if (n->tip != 0) {
+            length += mpl_update_tip(n->index, I_ANCESTOR(n->index, t), m);
+        } else {
+            length += mpl_first_up_recon(n->index, I_LDESC(n->index, t), I_RDESC(n->index, t), I_ANCESTOR(n->index, t), m);
+        }
+    }
+    
+    return length;
+}
+
+
 int test_do_fullpass_for_NAs(TLtree* t, Morphy m)
 {
     int length = 0;
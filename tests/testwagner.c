@@ -133,3 +133,292 @@ int test_wagner_extended(void)
     
     return failn;
 }
+
+int test_wagner_final_sets(void)
+{
+    theader("Testing Wagner final sets with overlapping descendant sets");
+    int failn   = 0;
+    int numtaxa = 3;
+    int nchar   = 1;
+    int length  = 0;
+    
+    char* matrix =
+    "(123)\
+     (234)\
+     4;";
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("((1,2),3);", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(numtaxa, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    mpl_set_parsim_t(0, WAGNER_T, m);
+    mpl_set_num_internal_nodes(numtaxa, m);
+    mpl_apply_tipdata(m);
+    
+    length = test_do_fullpass_all_steps(tree, m);
+    
+    if (length != 1) {
+        printf("Calculated: %i, expected: %i\n", length, 1);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // State 2 is in the preliminary set of the ancestor of taxa 1 and 2, but
+    // no reconstruction of length 1 uses it there.
+    int node = tree->trnodes[0].anc->index;
+    if (strcmp(mpl_get_stateset(node, 0, 1, m), "23") ||
+        strcmp(mpl_get_stateset(node, 0, 2, m), "3")) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+
+/* Scores a single character on a 12-taxon tree, then records the length added
+ * by reinserting a pruned taxon at its original site and the number of
+ * characters that would need a full recalculation. */
+static void test_NA_insertion_results
+(char* matrix, MPLchtype chtype, int* results)
+{
+    int ntax    = 12;
+    char* newick = "((((((1,2),3),4),5),6),(7,(8,(9,(10,(11,12))))));";
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(ntax, tlp);
+    tl_attach_Newick(newick, tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(ntax, 1, m);
+    mpl_attach_rawdata(matrix, m);
+    mpl_set_parsim_t(0, chtype, m);
+    mpl_set_num_internal_nodes(ntax, m);
+    mpl_apply_tipdata(m);
+    
+    results[0] = test_do_fullpass_on_tree(tree, m);
+    
+    TLnode* src  = &tree->trnodes[3];
+    TLnode* orig = tl_remove_branch(src, tree);
+    
+    results[1] = test_do_fullpass_on_tree(tree, m);
+    results[2] = mpl_get_insertcost(src->index, orig->index, orig->anc->index,
+                                    false, 0, m);
+    results[3] = mpl_check_reopt_inapplics(m);
+    
+    tl_insert_branch(src, orig->index, tree);
+    results[4] = test_do_fullpass_for_NAs(tree, m);
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+}
+
+
+int test_wagner_NA_binary_matches_fitch(void)
+{
+    theader("Testing inapplicable Wagner characters against Fitch on binary data");
+    int failn = 0;
+    int i     = 0;
+    int k     = 0;
+    int fitch[5];
+    int wagner[5];
+    
+    // With only two states, ordered and unordered characters are equivalent
+    char *rawmatrices[] =
+    {
+        (char*)"1---1111---1;",
+        (char*)"1100----1100;",
+        (char*)"11-------100;",
+        (char*)"01----010101;",
+        (char*)"01---1010101;",
+        (char*)"1?\?--?\?--100;",
+        (char*)"11--1000001-;",
+        (char*)"110--?---100;",
+        (char*)"???\?----1???;",
+        (char*)"1----1----1-;",
+        (char*)"-1-1-1--1-1-;",
+        (char*)"--------0101;",
+        (char*)"10101-----01;",
+        (char*)"011--?--0011;",
+        (char*)"----1010----;",
+        (char*)"10----11---1;",
+        (char*)"0--11-111111;",
+    };
+    
+    int nummatrices = 17;
+    
+    for (i = 0; i < nummatrices; ++i) {
+        
+        test_NA_insertion_results(rawmatrices[i], FITCH_T, fitch);
+        test_NA_insertion_results(rawmatrices[i], WAGNER_T, wagner);
+        
+        for (k = 0; k < 5; ++k) {
+            if (fitch[k] != wagner[k]) {
+                break;
+            }
+        }
+        
+        if (k < 5) {
+            printf("Matrix %i: Fitch %i, Wagner %i at result %i\n", i,
+                   fitch[k], wagner[k], k);
+            ++failn;
+            pfail;
+        }
+        else {
+            ppass;
+        }
+    }
+    
+    return failn;
+}
+
+
+int test_wagner_NA_ordered(void)
+{
+    theader("Testing inapplicable Wagner characters with ordered states");
+    int failn   = 0;
+    int numtaxa = 6;
+    int nchar   = 3;
+    int length  = 0;
+    
+    // Both characters have a single applicable region, lost in the tips
+    // scored as inapplicable. The third character only ensures that state 1
+    // is in the symbols list, so that 0 and 2 are not adjacent.
+    char* matrix =
+    "001\
+     22?\
+     0-?\
+     --?\
+     -0?\
+     -2?;";
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("(((1,2),3),(4,(5,6)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(numtaxa, nchar, m);
+    mpl_attach_rawdata(matrix, m);
+    mpl_set_parsim_t(0, WAGNER_T, m);
+    mpl_set_parsim_t(1, WAGNER_T, m);
+    mpl_set_num_internal_nodes(numtaxa, m);
+    mpl_apply_tipdata(m);
+    
+    length = test_do_fullpass_on_tree(tree, m);
+    
+    if (length != 6) {
+        printf("Calculated: %i, expected: %i\n", length, 6);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // As unordered characters, each change costs a single step
+    mpl_set_parsim_t(0, FITCH_T, m);
+    mpl_set_parsim_t(1, FITCH_T, m);
+    mpl_apply_tipdata(m);
+    
+    length = test_do_fullpass_on_tree(tree, m);
+    
+    if (length != 3) {
+        printf("Calculated: %i, expected: %i\n", length, 3);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
+
+
+int test_wagner_local_reopt(void)
+{
+    theader("Testing Wagner insertion costs");
+    int failn   = 0;
+    int numtaxa = 5;
+    int length  = 0;
+    int cost    = 0;
+    
+    char* matrix = "30122;";
+    
+    TLP tlp = tl_new_TL();
+    tl_set_numtaxa(numtaxa, tlp);
+    tl_attach_Newick("((1,2),(3,(4,5)));", tlp);
+    tl_set_current_tree(0, tlp);
+    TLtree* tree = tl_get_TLtree(tlp);
+    
+    Morphy m = mpl_new_Morphy();
+    mpl_init_Morphy(numtaxa, 1, m);
+    mpl_attach_rawdata(matrix, m);
+    mpl_set_parsim_t(0, WAGNER_T, m);
+    mpl_set_num_internal_nodes(numtaxa, m);
+    mpl_apply_tipdata(m);
+    
+    length = test_do_fullpass_on_tree(tree, m);
+    
+    TLnode* src  = &tree->trnodes[0];
+    TLnode* orig = tl_remove_branch(src, tree);
+    
+    if (length != 4 || test_do_fullpass_on_tree(tree, m) != 2) {
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Back in its original place, the taxon adds two steps from state 1
+    cost = mpl_get_insertcost(src->index, orig->index, orig->anc->index,
+                              false, 0, m);
+    if (cost != 2) {
+        printf("Calculated: %i, expected: %i\n", cost, 2);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    // Next to the taxa with state 2, it adds only one
+    TLnode* tgt = &tree->trnodes[3];
+    cost = mpl_get_insertcost(src->index, tgt->index, tgt->anc->index,
+                              false, 0, m);
+    if (cost != 1) {
+        printf("Calculated: %i, expected: %i\n", cost, 1);
+        ++failn;
+        pfail;
+    }
+    else {
+        ppass;
+    }
+    
+    mpl_delete_Morphy(m);
+    tl_delete_TL(tlp);
+    
+    return failn;
+}
@@ -11,5 +11,9 @@
 
 int test_small_wagner(void);
 int test_wagner_extended(void);
+int test_wagner_final_sets(void);
+int test_wagner_NA_binary_matches_fitch(void);
+int test_wagner_NA_ordered(void);
+int test_wagner_local_reopt(void);
 
 #endif /* testwagner_h */